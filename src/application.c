@@ -28,6 +28,7 @@
 #include "easytag.h"
 #include "log.h"
 #include "misc.h"
+#include "save_journal.h"
 #include "setting.h"
 
 /* TODO: Use G_DEFINE_TYPE_WITH_PRIVATE. */
@@ -99,6 +100,68 @@ static const GActionEntry actions[] =
     { "quit", on_quit }
 };
 
+/*
+ * check_for_interrupted_save:
+ *
+ * Ask the user what to do with the files of a save which was interrupted,
+ * for example by a crash, before any directory is loaded.
+ */
+static void
+check_for_interrupted_save (void)
+{
+    EtSaveJournalRecovery recovery = ET_SAVE_JOURNAL_DISCARD;
+    guint n_files;
+
+    n_files = et_save_journal_get_n_interrupted ();
+
+    if (n_files > 0)
+    {
+        GtkWidget *msgdialog;
+        gint response;
+
+        msgdialog = gtk_message_dialog_new (GTK_WINDOW (MainWindow),
+                                            GTK_DIALOG_MODAL
+                                            | GTK_DIALOG_DESTROY_WITH_PARENT,
+                                            GTK_MESSAGE_WARNING,
+                                            GTK_BUTTONS_NONE,
+                                            ngettext ("Saving a file was interrupted",
+                                                      "Saving %u files was interrupted",
+                                                      n_files),
+                                            n_files);
+        gtk_message_dialog_format_secondary_text (GTK_MESSAGE_DIALOG (msgdialog),
+                                                  "%s",
+                                                  _("Do you want to finish saving, or to restore the previous tags and filenames?"));
+        gtk_dialog_add_buttons (GTK_DIALOG (msgdialog), _("_Ignore"),
+                                GTK_RESPONSE_CANCEL, _("_Restore"),
+                                GTK_RESPONSE_NO, _("_Save"), GTK_RESPONSE_YES,
+                                NULL);
+        gtk_dialog_set_default_response (GTK_DIALOG (msgdialog),
+                                         GTK_RESPONSE_YES);
+        gtk_window_set_title (GTK_WINDOW (msgdialog), _("Interrupted Save"));
+
+        response = gtk_dialog_run (GTK_DIALOG (msgdialog));
+        gtk_widget_destroy (msgdialog);
+
+        switch (response)
+        {
+            case GTK_RESPONSE_YES:
+                recovery = ET_SAVE_JOURNAL_RESUME;
+                break;
+            case GTK_RESPONSE_NO:
+                recovery = ET_SAVE_JOURNAL_ROLL_BACK;
+                break;
+            case GTK_RESPONSE_CANCEL:
+            case GTK_RESPONSE_DELETE_EVENT:
+                break;
+            default:
+                g_assert_not_reached ();
+                break;
+        }
+    }
+
+    et_save_journal_recover (recovery);
+}
+
 /*
  * Load the default directory when the user interface is completely displayed
  * to avoid bad visualization effect at startup.
@@ -110,6 +173,10 @@ on_idle_init (EtApplication *self)
 
     priv = et_application_get_instance_private (self);
 
+    /* Recover before resetting the core, as loading the files to recover may
+     * add to the history list. */
+    check_for_interrupted_save ();
+
     ET_Core_Free ();
     ET_Core_Create ();
 
@@ -462,6 +462,9 @@ on_delete (GSimpleAction *action,
     self = ET_APPLICATION_WINDOW (user_data);
     priv = et_application_window_get_instance_private (self);
 
+    /* The deleted files are freed, so they must not be saved any more. */
+    et_save_background_wait ();
+
     /* Save the current displayed data */
     ET_Save_File_Data_From_UI(ETCore->ETFileDisplayed);
 
@@ -625,8 +628,8 @@ on_undo_file_changes (GSimpleAction *action,
 
     g_list_free_full (selfilelist, (GDestroyNotify)gtk_tree_path_free);
 
-    /* Refresh the whole list (faster than file by file) to show changes. */
-    et_application_window_browser_refresh_list (self);
+    /* Refresh the rows of the changed files. */
+    et_application_window_browser_refresh_dirty_files (self);
 
     /* Display the current file */
     ET_Display_File_Data_To_UI(ETCore->ETFileDisplayed);
@@ -668,8 +671,8 @@ on_redo_file_changes (GSimpleAction *action,
 
     g_list_free_full (selfilelist, (GDestroyNotify)gtk_tree_path_free);
 
-    /* Refresh the whole list (faster than file by file) to show changes. */
-    et_application_window_browser_refresh_list (ET_APPLICATION_WINDOW (user_data));
+    /* Refresh the rows of the changed files. */
+    et_application_window_browser_refresh_dirty_files (ET_APPLICATION_WINDOW (user_data));
 
     /* Display the current file */
     ET_Display_File_Data_To_UI(ETCore->ETFileDisplayed);
@@ -889,8 +892,8 @@ on_remove_tags (GSimpleAction *action,
 
     g_list_free_full (selfilelist, (GDestroyNotify)gtk_tree_path_free);
 
-    /* Refresh the whole list (faster than file by file) to show changes. */
-    et_application_window_browser_refresh_list (self);
+    /* Refresh the rows of the changed files. */
+    et_application_window_browser_refresh_dirty_files (self);
 
     /* Display the current file */
     ET_Display_File_Data_To_UI (ETCore->ETFileDisplayed);
@@ -1590,6 +1593,9 @@ et_application_window_dispose (GObject *object)
 
     save_state (self);
 
+    /* The files which are scanned are freed with the file list. */
+    et_duration_scan_stop ();
+
     if (ETCore)
     {
         ET_Core_Free ();
@@ -2626,9 +2632,24 @@ et_application_window_browser_refresh_file_in_list (EtApplicationWindow *self,
     et_browser_refresh_file_in_list (ET_BROWSER (priv->browser), file);
 }
 
+void
+et_application_window_browser_refresh_dirty_files (EtApplicationWindow *self)
+{
+    EtApplicationWindowPrivate *priv;
+
+    g_return_if_fail (ET_APPLICATION_WINDOW (self));
+
+    priv = et_application_window_get_instance_private (self);
+
+    et_browser_refresh_dirty_files (ET_BROWSER (priv->browser));
+}
+
 static void
 quit_confirmed (EtApplicationWindow *self)
 {
+    /* Finish writing the files which are saved in the background. */
+    et_save_background_wait ();
+
     /* Save the configuration when exiting. */
     et_application_window_apply_changes (self);
     
@@ -2654,6 +2675,9 @@ et_application_window_quit (EtApplicationWindow *self)
     GtkWidget *msgbox;
     gint response;
 
+    /* Files which are still being saved are not yet marked as saved. */
+    et_save_background_wait ();
+
     /* If you change the displayed data and quit immediately */
     if (ETCore->ETFileList)
     {
@@ -69,20 +69,29 @@ struct _EtBrowserPrivate
     GtkWidget *file_menu;
     guint file_selected_handler;
     EtSortMode file_sort_mode;
+    GHashTable *file_rows; /* ET_File to its (persistent) GtkTreeIter. */
 
     GtkWidget *album_list;
     GtkWidget *album_menu;
     GtkListStore *album_model;
     guint album_selected_handler;
+    GList *album_artist; /* Node of the artist whose albums are listed. */
+    GHashTable *album_rows; /* Node of an album to its GtkTreeIter. */
 
     GtkWidget *artist_list;
     GtkWidget *artist_menu;
     GtkListStore *artist_model;
     guint artist_selected_handler;
+    GHashTable *artist_rows; /* Node of an artist to its GtkTreeIter. */
+    guint refresh_dirty_idle_id;
 
     GtkWidget *tree; /* Tree of directories. */
     GtkWidget *tree_menu;
     GtkTreeStore *directory_model;
+    GHashTable *subdir_cache; /* Path to EtSubdirProbe. */
+    GHashTable *tree_expansions; /* Path to GCancellable, while reading. */
+    GCancellable *tree_cancellable; /* For probes of subdirectories. */
+    gboolean tree_expand_sync; /* Read expanded nodes synchronously. */
 
     GtkListStore *run_program_model;
 
@@ -211,8 +220,18 @@ static void Browser_Album_List_Load_Files (EtBrowser *self, GList *albumlist,
 static void Browser_Album_List_Row_Selected (EtBrowser *self,
                                              GtkTreeSelection *selection);
 static void Browser_Album_List_Set_Row_Appearance (EtBrowser *self, GtkTreeIter *row);
-
-static gboolean check_for_subdir (const gchar *path);
+static void Browser_Artist_Album_Move_File (EtBrowser *self, ET_File *ETFile,
+                                            ET_File **follow_file,
+                                            gboolean *reload_files);
+static void Browser_Artist_List_Select_File (EtBrowser *self, ET_File *ETFile);
+static void Browser_Album_List_Reload_Selected (EtBrowser *self);
+
+static gboolean check_for_subdir (const gchar *path, gboolean show_hidden);
+static void Browser_Tree_Cancel_All (EtBrowser *self);
+static gboolean Browser_Tree_Cancel_Expansion (EtBrowser *self,
+                                               const gchar *path);
+static void Browser_Tree_Complete_Expansion (EtBrowser *self,
+                                             GtkTreeIter *iter);
 
 static GtkTreePath *Find_Child_Node (EtBrowser *self, GtkTreeIter *parent, gchar *searchtext);
 
@@ -1012,8 +1031,8 @@ et_browser_win32_get_drive_root (EtBrowser *self,
  *
  * - "current_path" is in file system encoding (not UTF-8)
  */
-void
-et_browser_select_dir (EtBrowser *self, const gchar *current_path)
+static void
+Browser_Tree_Select_Dir (EtBrowser *self, const gchar *current_path)
 {
     EtBrowserPrivate *priv;
     GtkTreePath *rootPath = NULL;
@@ -1071,6 +1090,10 @@ et_browser_select_dir (EtBrowser *self, const gchar *current_path)
             continue;
         }
 
+        /* The node may have been expanded by the user before, and still be
+         * read in the background. */
+        Browser_Tree_Complete_Expansion (self, &parentNode);
+
         if (!gtk_tree_model_iter_children(GTK_TREE_MODEL(priv->directory_model), &currentNode, &parentNode))
         {
             gchar *path, *parent_path;
@@ -1101,7 +1124,10 @@ et_browser_select_dir (EtBrowser *self, const gchar *current_path)
                                                    &iter, &parentNode, 0,
                                                    TREE_COLUMN_DIR_NAME, parts[index],
                                                    TREE_COLUMN_FULL_PATH, path,
-                                                   TREE_COLUMN_HAS_SUBDIR, check_for_subdir (current_path),
+                                                   TREE_COLUMN_HAS_SUBDIR,
+                                                   check_for_subdir (current_path,
+                                                                     g_settings_get_boolean (MainSettings,
+                                                                                             "browse-show-hidden")),
                                                    TREE_COLUMN_SCANNED, TRUE,
                                                    TREE_COLUMN_ICON, icon, -1);
 
@@ -1123,7 +1149,8 @@ et_browser_select_dir (EtBrowser *self, const gchar *current_path)
         {
             gtk_tree_model_get(GTK_TREE_MODEL(priv->directory_model), &currentNode,
                                TREE_COLUMN_FULL_PATH, &temp, -1);
-            nodeName = g_path_get_basename(temp);
+            /* Skip the dummy node of an unreadable directory. */
+            nodeName = temp ? g_path_get_basename (temp) : g_strdup ("");
             g_free(temp);
 #ifdef G_OS_WIN32
             if (strcasecmp(parts[index],nodeName) == 0)
@@ -1170,6 +1197,25 @@ et_browser_select_dir (EtBrowser *self, const gchar *current_path)
     return;
 }
 
+/*
+ * et_browser_select_dir: Select the directory corresponding to the 'path' in
+ * the tree browser, but it doesn't read it!
+ *
+ * The nodes expanded on the way are read synchronously, as the tree needs to
+ * be walked down to the directory.
+ */
+void
+et_browser_select_dir (EtBrowser *self, const gchar *current_path)
+{
+    EtBrowserPrivate *priv;
+
+    priv = et_browser_get_instance_private (self);
+
+    priv->tree_expand_sync = TRUE;
+    Browser_Tree_Select_Dir (self, current_path);
+    priv->tree_expand_sync = FALSE;
+}
+
 /*
  * Callback to select-row event
  * Displays the file info of the lowest selected file in the right-hand pane
@@ -1245,6 +1291,7 @@ et_browser_clear_file_model (EtBrowser *self)
     g_signal_handler_block (selection, priv->file_selected_handler);
 
     gtk_list_store_clear (priv->file_model);
+    g_hash_table_remove_all (priv->file_rows);
     gtk_tree_view_columns_autosize (GTK_TREE_VIEW (priv->file_view));
 
     g_signal_handler_unblock (selection, priv->file_selected_handler);
@@ -1330,6 +1377,8 @@ et_browser_load_file_list (EtBrowser *self,
                                            LIST_FILE_URL, FileTag->url,
                                            LIST_FILE_ENCODED_BY,
                                            FileTag->encoded_by, -1);
+        g_hash_table_insert (priv->file_rows, l->data,
+                             gtk_tree_iter_copy (&rowIter));
         g_free(basename_utf8);
         g_free(track);
         g_free (disc);
@@ -1346,22 +1395,71 @@ et_browser_load_file_list (EtBrowser *self,
 }
 
 
+/*
+ * Refresh the filename and tag fields of the row at @iter from @ETFile, then
+ * update its appearance.
+ */
+static void
+Browser_List_Refresh_Row (EtBrowser *self,
+                          GtkTreeIter *iter,
+                          const ET_File *ETFile)
+{
+    EtBrowserPrivate *priv;
+    const File_Tag *FileTag;
+    const File_Name *FileName;
+    gchar *current_basename_utf8;
+    gchar *track;
+    gchar *disc;
+
+    priv = et_browser_get_instance_private (self);
+
+    FileName = (File_Name *)ETFile->FileNameCur->data;
+    FileTag  = (File_Tag *)ETFile->FileTag->data;
+
+    current_basename_utf8 = g_path_get_basename(FileName->value_utf8);
+    track = g_strconcat(FileTag->track ? FileTag->track : "",FileTag->track_total ? "/" : NULL,FileTag->track_total,NULL);
+    disc  = g_strconcat (FileTag->disc_number ? FileTag->disc_number : "",
+                         FileTag->disc_total ? "/" : NULL,
+                         FileTag->disc_total, NULL);
+
+    gtk_list_store_set(priv->file_model, iter,
+                       LIST_FILE_NAME,          current_basename_utf8,
+                       LIST_FILE_TITLE,         FileTag->title,
+                       LIST_FILE_ARTIST,        FileTag->artist,
+                       LIST_FILE_ALBUM_ARTIST,  FileTag->album_artist,
+                       LIST_FILE_ALBUM,         FileTag->album,
+                       LIST_FILE_YEAR,          FileTag->year,
+                       LIST_FILE_DISCNO, disc,
+                       LIST_FILE_TRACK,         track,
+                       LIST_FILE_GENRE,         FileTag->genre,
+                       LIST_FILE_COMMENT,       FileTag->comment,
+                       LIST_FILE_COMPOSER,      FileTag->composer,
+                       LIST_FILE_ORIG_ARTIST,   FileTag->orig_artist,
+                       LIST_FILE_COPYRIGHT,     FileTag->copyright,
+                       LIST_FILE_URL,           FileTag->url,
+                       LIST_FILE_ENCODED_BY,    FileTag->encoded_by,
+                       -1);
+    g_free(current_basename_utf8);
+    g_free(track);
+    g_free (disc);
+
+    Browser_List_Set_Row_Appearance (self, iter);
+}
+
 /*
  * Update state of files in the list after changes (without clearing the list model!)
  *  - Refresh 'filename' is file saved,
  *  - Change color is something changed on the file
+ * This walks every row: prefer et_browser_refresh_dirty_files() after
+ * changing a set of files.
  */
 void
 et_browser_refresh_list (EtBrowser *self)
 {
     EtBrowserPrivate *priv;
-    //GtkTreeIter iter;
     GtkTreePath *currentPath = NULL;
     GtkTreeIter iter;
     gint row;
-    gchar *current_basename_utf8;
-    gchar *track;
-    gchar *disc;
     gboolean valid;
     GVariant *variant;
 
@@ -1375,57 +1473,24 @@ et_browser_refresh_list (EtBrowser *self)
         return;
     }
 
-    // Browse the full list for changes
-    //gtk_tree_model_get_iter_first(GTK_TREE_MODEL(priv->file_model), &iter);
-    //    g_print("above worked %d rows\n", gtk_tree_model_iter_n_children(GTK_TREE_MODEL(priv->file_model), NULL));
-
-    currentPath = gtk_tree_path_new_first();
+    /* Every row is refreshed below. */
+    et_dirty_file_list_clear ();
 
-    valid = gtk_tree_model_get_iter(GTK_TREE_MODEL(priv->file_model), &iter, currentPath);
+    // Browse the full list for changes
+    valid = gtk_tree_model_get_iter_first (GTK_TREE_MODEL (priv->file_model),
+                                           &iter);
     while (valid)
     {
         const ET_File *ETFile;
-        const File_Tag *FileTag;
-        const File_Name *FileName;
+
         // Refresh filename and other fields
         gtk_tree_model_get(GTK_TREE_MODEL(priv->file_model), &iter,
                            LIST_FILE_POINTER, &ETFile, -1);
 
-        FileName = (File_Name *)ETFile->FileNameCur->data;
-        FileTag  = (File_Tag *)ETFile->FileTag->data;
-
-        current_basename_utf8 = g_path_get_basename(FileName->value_utf8);
-        track = g_strconcat(FileTag->track ? FileTag->track : "",FileTag->track_total ? "/" : NULL,FileTag->track_total,NULL);
-        disc  = g_strconcat (FileTag->disc_number ? FileTag->disc_number : "",
-                             FileTag->disc_total ? "/" : NULL,
-                             FileTag->disc_total, NULL);
-
-        gtk_list_store_set(priv->file_model, &iter,
-                           LIST_FILE_NAME,          current_basename_utf8,
-                           LIST_FILE_TITLE,         FileTag->title,
-                           LIST_FILE_ARTIST,        FileTag->artist,
-                           LIST_FILE_ALBUM_ARTIST,  FileTag->album_artist,
-						   LIST_FILE_ALBUM,         FileTag->album,
-                           LIST_FILE_YEAR,          FileTag->year,
-                           LIST_FILE_DISCNO, disc,
-                           LIST_FILE_TRACK,         track,
-                           LIST_FILE_GENRE,         FileTag->genre,
-                           LIST_FILE_COMMENT,       FileTag->comment,
-                           LIST_FILE_COMPOSER,      FileTag->composer,
-                           LIST_FILE_ORIG_ARTIST,   FileTag->orig_artist,
-                           LIST_FILE_COPYRIGHT,     FileTag->copyright,
-                           LIST_FILE_URL,           FileTag->url,
-                           LIST_FILE_ENCODED_BY,    FileTag->encoded_by,
-                           -1);
-        g_free(current_basename_utf8);
-        g_free(track);
-        g_free (disc);
-
-        Browser_List_Set_Row_Appearance (self, &iter);
+        Browser_List_Refresh_Row (self, &iter, ETFile);
 
         valid = gtk_tree_model_iter_next(GTK_TREE_MODEL(priv->file_model), &iter);
     }
-    gtk_tree_path_free(currentPath);
 
     variant = g_action_group_get_action_state (G_ACTION_GROUP (MainWindow),
                                                "file-artist-view");
@@ -1445,6 +1510,7 @@ et_browser_refresh_list (EtBrowser *self)
             Browser_Artist_List_Set_Row_Appearance (self, &iter);
         }
         gtk_tree_path_free(currentPath);
+        currentPath = NULL;
 
 
         for (row=0; row < gtk_tree_model_iter_n_children(GTK_TREE_MODEL(priv->album_model), NULL); row++)
@@ -1463,201 +1529,235 @@ et_browser_refresh_list (EtBrowser *self)
     g_variant_unref (variant);
 }
 
-
 /*
- * Update state of one file in the list after changes (without clearing the clist!)
- *  - Refresh filename is file saved,
- *  - Change color is something change on the file
+ * et_browser_refresh_dirty_files:
+ * @self: an #EtBrowser
+ *
+ * Update the rows of the files which changed since the last refresh (see
+ * et_dirty_file_list_add()), without walking the whole list. The cost of the
+ * refresh depends on the number of changed files, not on the number of
+ * files displayed.
  */
 void
-et_browser_refresh_file_in_list (EtBrowser *self,
-                                 const ET_File *ETFile)
+et_browser_refresh_dirty_files (EtBrowser *self)
 {
     EtBrowserPrivate *priv;
-    GList *selectedRow = NULL;
+    GList *dirty_files;
+    GList *l;
     GVariant *variant;
-    GtkTreeSelection *selection;
-    GtkTreeIter selectedIter;
-    const ET_File *etfile;
-    const File_Tag *FileTag;
-    const File_Name *FileName;
-    gboolean row_found = FALSE;
-    gchar *current_basename_utf8;
-    gchar *track;
-    gchar *disc;
-    gboolean valid;
-    gchar *artist, *album;
 
     g_return_if_fail (ET_BROWSER (self));
 
     priv = et_browser_get_instance_private (self);
 
-    if (!ETCore->ETFileDisplayedList || !priv->file_view || !ETFile ||
-        gtk_tree_model_iter_n_children(GTK_TREE_MODEL(priv->file_model), NULL) == 0)
+    dirty_files = et_dirty_file_list_take ();
+
+    if (!dirty_files)
     {
         return;
     }
 
-    // Search the row of the modified file to update it (when found: row_found=TRUE)
-    // 1/3. Get position of ETFile in ETFileList
-    if (row_found == FALSE)
+    if (!ETCore->ETFileDisplayedList || !priv->file_view)
     {
-        valid = gtk_tree_model_iter_nth_child (GTK_TREE_MODEL(priv->file_model), &selectedIter, NULL, ETFile->IndexKey-1);
-        if (valid)
+        g_list_free (dirty_files);
+        return;
+    }
+
+    for (l = dirty_files; l != NULL; l = g_list_next (l))
+    {
+        GtkTreeIter *iter;
+
+        /* Files which are not displayed have no row to refresh, and are
+         * loaded with their current state when they are displayed. */
+        iter = g_hash_table_lookup (priv->file_rows, l->data);
+
+        if (iter)
         {
-            gtk_tree_model_get(GTK_TREE_MODEL(priv->file_model), &selectedIter,
-                           LIST_FILE_POINTER, &etfile, -1);
-            if (ETFile->ETFileKey == etfile->ETFileKey)
-            {
-                row_found = TRUE;
-            }
+            Browser_List_Refresh_Row (self, iter, (ET_File *)l->data);
         }
     }
 
-    // 2/3. Try with the selected file in list (works only if we select the same file)
-    if (row_found == FALSE)
+    variant = g_action_group_get_action_state (G_ACTION_GROUP (MainWindow),
+                                               "file-artist-view");
+
+    /* When displaying Artist + Album lists => move the files whose artist or
+     * album changed, and refresh also the color of the rows of the changed
+     * artists and albums. */
+    if (strcmp (g_variant_get_string (variant, NULL), "artist") == 0)
     {
-        selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(priv->file_view));
-        selectedRow = gtk_tree_selection_get_selected_rows(selection, NULL);
-        if (selectedRow && selectedRow->data != NULL)
+        GHashTable *artists;
+        GHashTable *albums;
+        GHashTableIter hash_iter;
+        gpointer link;
+        ET_File *follow_file = NULL;
+        gboolean reload_files = FALSE;
+        gboolean all_albums = FALSE;
+        GtkTreeIter iter;
+
+        for (l = dirty_files; l != NULL; l = g_list_next (l))
+        {
+            Browser_Artist_Album_Move_File (self, (ET_File *)l->data,
+                                            &follow_file, &reload_files);
+        }
+
+        if (follow_file)
+        {
+            Browser_Artist_List_Select_File (self, follow_file);
+        }
+        else if (reload_files)
+        {
+            Browser_Album_List_Reload_Selected (self);
+        }
+
+        artists = g_hash_table_new (NULL, NULL);
+        albums = g_hash_table_new (NULL, NULL);
+
+        for (l = dirty_files; l != NULL; l = g_list_next (l))
         {
-            valid = gtk_tree_model_get_iter(GTK_TREE_MODEL(priv->file_model), &selectedIter,
-                                    (GtkTreePath*) selectedRow->data);
-            if (valid)
+            GList *artist_link;
+            GList *album_link;
+
+            if (et_artist_album_list_get_position ((ET_File *)l->data,
+                                                   &artist_link, &album_link))
             {
-                gtk_tree_model_get(GTK_TREE_MODEL(priv->file_model), &selectedIter,
-                                   LIST_FILE_POINTER, &etfile, -1);
-                if (ETFile->ETFileKey == etfile->ETFileKey)
-                {
-                    row_found = TRUE;
-                }
+                g_hash_table_add (artists, artist_link);
+                g_hash_table_add (albums, album_link);
+                all_albums |= artist_link == priv->album_artist;
             }
         }
 
-        g_list_free_full (selectedRow, (GDestroyNotify)gtk_tree_path_free);
-    }
+        g_hash_table_iter_init (&hash_iter, artists);
 
-    // 3/3. Fails, now we browse the full list to find it
-    if (row_found == FALSE)
-    {
-        valid = gtk_tree_model_get_iter_first(GTK_TREE_MODEL(priv->file_model), &selectedIter);
-        while (valid)
+        while (g_hash_table_iter_next (&hash_iter, &link, NULL))
         {
-            gtk_tree_model_get(GTK_TREE_MODEL(priv->file_model), &selectedIter,
-                               LIST_FILE_POINTER, &etfile, -1);
-            if (ETFile->ETFileKey == etfile->ETFileKey)
+            GtkTreeIter *row = g_hash_table_lookup (priv->artist_rows, link);
+
+            if (row)
             {
-                row_found = TRUE;
-                break;
-            } else
+                Browser_Artist_List_Set_Row_Appearance (self, row);
+            }
+        }
+
+        g_hash_table_iter_init (&hash_iter, albums);
+
+        while (g_hash_table_iter_next (&hash_iter, &link, NULL))
+        {
+            GtkTreeIter *row = g_hash_table_lookup (priv->album_rows, link);
+
+            if (row)
             {
-                valid = gtk_tree_model_iter_next(GTK_TREE_MODEL(priv->file_model), &selectedIter);
+                Browser_Album_List_Set_Row_Appearance (self, row);
             }
         }
+
+        /* The "All albums" row is the first one. */
+        if (all_albums
+            && gtk_tree_model_get_iter_first (GTK_TREE_MODEL (priv->album_model),
+                                              &iter))
+        {
+            Browser_Album_List_Set_Row_Appearance (self, &iter);
+        }
+
+        g_hash_table_destroy (artists);
+        g_hash_table_destroy (albums);
     }
 
-    // Error somewhere...
-    if (row_found == FALSE)
-        return;
+    g_variant_unref (variant);
+    g_list_free (dirty_files);
+}
 
-    // Displayed the filename and refresh other fields
-    FileName = (File_Name *)etfile->FileNameCur->data;
-    FileTag  = (File_Tag *)etfile->FileTag->data;
 
-    current_basename_utf8 = g_path_get_basename(FileName->value_utf8);
-    track = g_strconcat(FileTag->track ? FileTag->track : "",FileTag->track_total ? "/" : NULL,FileTag->track_total,NULL);
-    disc  = g_strconcat (FileTag->disc_number ? FileTag->disc_number : "",
-                         FileTag->disc_total ? "/" : NULL, FileTag->disc_total,
-                         NULL);
+static gboolean
+on_refresh_dirty_idle (EtBrowser *self)
+{
+    EtBrowserPrivate *priv;
 
-    gtk_list_store_set(priv->file_model, &selectedIter,
-                       LIST_FILE_NAME,          current_basename_utf8,
-                       LIST_FILE_TITLE,         FileTag->title,
-                       LIST_FILE_ARTIST,        FileTag->artist,
-                       LIST_FILE_ALBUM_ARTIST,  FileTag->album_artist,
-					   LIST_FILE_ALBUM,         FileTag->album,
-                       LIST_FILE_YEAR,          FileTag->year,
-                       LIST_FILE_DISCNO, disc,
-                       LIST_FILE_TRACK,         track,
-                       LIST_FILE_GENRE,         FileTag->genre,
-                       LIST_FILE_COMMENT,       FileTag->comment,
-                       LIST_FILE_COMPOSER,      FileTag->composer,
-                       LIST_FILE_ORIG_ARTIST,   FileTag->orig_artist,
-                       LIST_FILE_COPYRIGHT,     FileTag->copyright,
-                       LIST_FILE_URL,           FileTag->url,
-                       LIST_FILE_ENCODED_BY,    FileTag->encoded_by,
-                       -1);
-    g_free(current_basename_utf8);
-    g_free(track);
-    g_free (disc);
+    priv = et_browser_get_instance_private (self);
 
-    /* Change appearance (line to red) if filename changed. */
-    Browser_List_Set_Row_Appearance (self, &selectedIter);
+    priv->refresh_dirty_idle_id = 0;
+    et_browser_refresh_dirty_files (self);
 
-    variant = g_action_group_get_action_state (G_ACTION_GROUP (MainWindow),
-                                               "file-artist-view");
+    return G_SOURCE_REMOVE;
+}
 
-    /* When displaying Artist + Album lists => refresh also rows color. */
-    if (strcmp (g_variant_get_string (variant, NULL), "artist") == 0)
-    {
-        gchar *current_artist = ((File_Tag *)ETFile->FileTag->data)->artist;
-        gchar *current_album  = ((File_Tag *)ETFile->FileTag->data)->album;
+/*
+ * Update state of one file in the list after changes (without clearing the clist!)
+ *  - Refresh filename is file saved,
+ *  - Change color is something change on the file
+ */
+void
+et_browser_refresh_file_in_list (EtBrowser *self,
+                                 const ET_File *ETFile)
+{
+    EtBrowserPrivate *priv;
+    GVariant *variant;
+    GtkTreeIter *fileIter;
+    GtkTreeIter selectedIter;
 
-        valid = gtk_tree_model_get_iter_first (GTK_TREE_MODEL (priv->artist_model),
-                                               &selectedIter);
+    g_return_if_fail (ET_BROWSER (self));
 
-        while (valid)
-        {
-                gtk_tree_model_get (GTK_TREE_MODEL (priv->artist_model),
-                                    &selectedIter, ARTIST_NAME, &artist, -1);
+    priv = et_browser_get_instance_private (self);
 
-                if ((!current_artist && !artist)
-                    || (current_artist && artist
-                        && g_utf8_collate (current_artist, artist) == 0))
-                {
-                    /* Set color of the row. */
-                    Browser_Artist_List_Set_Row_Appearance (self,
-                                                            &selectedIter);
-                    g_free (artist);
-                    break;
-                }
+    if (!ETCore->ETFileDisplayedList || !priv->file_view || !ETFile)
+    {
+        return;
+    }
 
-                g_free (artist);
+    /* Search the row of the modified file to update it. */
+    fileIter = g_hash_table_lookup (priv->file_rows, ETFile);
 
-                valid = gtk_tree_model_iter_next (GTK_TREE_MODEL (priv->artist_model),
-                                                  &selectedIter);
-        }
+    // Error somewhere...
+    if (fileIter == NULL)
+        return;
 
-        //
-        // FIX ME : see also if we must add a new line / or change list of the ETFile
-        //
-        valid = gtk_tree_model_get_iter_first (GTK_TREE_MODEL (priv->album_model),
-                                               &selectedIter);
+    /* Display the filename and refresh other fields, and change appearance
+     * (line to red) if filename changed. */
+    Browser_List_Refresh_Row (self, fileIter, ETFile);
 
-        while (valid)
-        {
-            gtk_tree_model_get (GTK_TREE_MODEL (priv->album_model),
-                                &selectedIter, ALBUM_NAME, &album, -1);
+    variant = g_action_group_get_action_state (G_ACTION_GROUP (MainWindow),
+                                               "file-artist-view");
+
+    /* When displaying Artist + Album lists => refresh also rows color. */
+    if (strcmp (g_variant_get_string (variant, NULL), "artist") == 0)
+    {
+        GList *artist_link;
+        GList *album_link;
+        GtkTreeIter *row;
 
-            if ((!current_album && !album)
-                || (current_album && album
-                    && g_utf8_collate (current_album, album) == 0))
+        if (et_artist_album_list_get_position (ETFile, &artist_link,
+                                               &album_link))
+        {
+            if ((row = g_hash_table_lookup (priv->artist_rows, artist_link)))
             {
-                /* Set color of the row. */
-                Browser_Album_List_Set_Row_Appearance (self, &selectedIter);
-                g_free (album);
-                break;
+                Browser_Artist_List_Set_Row_Appearance (self, row);
             }
 
-            g_free (album);
+            if ((row = g_hash_table_lookup (priv->album_rows, album_link)))
+            {
+                Browser_Album_List_Set_Row_Appearance (self, row);
+            }
 
-            valid = gtk_tree_model_iter_next (GTK_TREE_MODEL (priv->album_model),
-                                              &selectedIter);
+            /* The "All albums" row is the first one. */
+            if (artist_link == priv->album_artist
+                && gtk_tree_model_get_iter_first (GTK_TREE_MODEL (priv->album_model),
+                                                  &selectedIter))
+            {
+                Browser_Album_List_Set_Row_Appearance (self, &selectedIter);
+            }
         }
 
-        //
-        // FIX ME : see also if we must add a new line / or change list of the ETFile
-        //
+        /* The file stays in the dirty set, to be moved to its new artist or
+         * album once the current change of selection (if any) is done. */
+        if (!priv->refresh_dirty_idle_id)
+        {
+            priv->refresh_dirty_idle_id = g_idle_add ((GSourceFunc)on_refresh_dirty_idle,
+                                                      self);
+        }
+    }
+    else
+    {
+        /* The row is now up to date. */
+        et_dirty_file_list_remove (ETFile);
     }
 
     g_variant_unref (variant);
@@ -1676,6 +1776,7 @@ Browser_List_Set_Row_Appearance (EtBrowser *self, GtkTreeIter *iter)
     ET_File *rowETFile = NULL;
     gboolean otherdir = FALSE;
     const GdkRGBA LIGHT_BLUE = { 0.866, 0.933, 1.0, 1.0 };
+    const GdkRGBA GREY = { 0.5, 0.5, 0.5, 1.0 };
     const GdkRGBA *background;
     //gchar *temp = NULL;
 
@@ -1697,8 +1798,17 @@ Browser_List_Set_Row_Appearance (EtBrowser *self, GtkTreeIter *iter)
     else
         background = NULL;
 
+    /* Set text to grey if the file is still being saved in the
+     * background. */
+    if (rowETFile && rowETFile->pending_saves > 0)
+    {
+        gtk_list_store_set (priv->file_model, iter,
+                            LIST_FONT_WEIGHT, PANGO_WEIGHT_NORMAL,
+                            LIST_ROW_BACKGROUND, background,
+                            LIST_ROW_FOREGROUND, &GREY, -1);
+    }
     // Set text to bold/red if 'filename' or 'tag' changed
-    if ( ET_Check_If_File_Is_Saved(rowETFile) == FALSE )
+    else if ( ET_Check_If_File_Is_Saved(rowETFile) == FALSE )
     {
         if (g_settings_get_boolean (MainSettings, "file-changed-bold"))
         {
@@ -1784,6 +1894,7 @@ et_browser_remove_file (EtBrowser *self,
 
             if (currentETFile == searchETFile)
             {
+                g_hash_table_remove (priv->file_rows, searchETFile);
                 gtk_list_store_remove(priv->file_model, &currentIter);
                 break;
             }
@@ -2318,6 +2429,7 @@ et_browser_clear_artist_model (EtBrowser *self)
     g_signal_handler_block (selection, priv->artist_selected_handler);
 
     gtk_list_store_clear (priv->artist_model);
+    g_hash_table_remove_all (priv->artist_rows);
 
     g_signal_handler_unblock (selection, priv->artist_selected_handler);
 }
@@ -2373,6 +2485,7 @@ Browser_Artist_List_Load_Files (EtBrowser *self, ET_File *etfile_to_select)
                                            ARTIST_NUM_FILES, nbr_files,
                                            ARTIST_ALBUM_LIST_POINTER,
                                            AlbumList, -1);
+        g_hash_table_insert (priv->artist_rows, l, gtk_tree_iter_copy (&iter));
 
         g_object_unref (pixbuf);
 
@@ -2527,6 +2640,8 @@ et_browser_clear_album_model (EtBrowser *self)
     g_signal_handler_block (selection, priv->album_selected_handler);
 
     gtk_list_store_clear (priv->album_model);
+    g_hash_table_remove_all (priv->album_rows);
+    priv->album_artist = NULL;
 
     g_signal_handler_unblock (selection, priv->album_selected_handler);
 }
@@ -2557,6 +2672,12 @@ Browser_Album_List_Load_Files (EtBrowser *self,
     et_browser_clear_album_model (self);
     selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(priv->album_list));
 
+    if (albumlist)
+    {
+        et_artist_album_list_get_position (g_list_first ((GList *)albumlist->data)->data,
+                                           &priv->album_artist, NULL);
+    }
+
     // Create a first row to select all albums of the artist
     for (l = albumlist; l != NULL; l = g_list_next (l))
     {
@@ -2602,6 +2723,7 @@ Browser_Album_List_Load_Files (EtBrowser *self,
                                            g_list_length (g_list_first (etfilelist)),
                                            ALBUM_ETFILE_LIST_POINTER,
                                            etfilelist, -1);
+        g_hash_table_insert (priv->album_rows, l, gtk_tree_iter_copy (&iter));
 
         g_object_unref (icon);
 
@@ -2723,29 +2845,419 @@ Browser_Album_List_Set_Row_Appearance (EtBrowser *self, GtkTreeIter *iter)
     }
 }
 
-void
-et_browser_set_display_mode (EtBrowser *self,
-                             EtBrowserMode mode)
+/*
+ * Update the counts of the row of @artist_link after a file was moved into
+ * (positive deltas) or out of (negative deltas) the artist.
+ */
+static void
+Browser_Artist_List_Update_Row (EtBrowser *self,
+                                GtkTreeIter *iter,
+                                GList *artist_link,
+                                gint files_delta,
+                                gint albums_delta)
 {
     EtBrowserPrivate *priv;
-    ET_File *etfile = ETCore->ETFileDisplayed; // ETFile to display again after changing browser view
-
-    g_return_if_fail (ET_BROWSER (self));
+    guint nbr_files;
+    guint nbr_albums;
 
     priv = et_browser_get_instance_private (self);
 
-    /* Save the current displayed data. */
-    ET_Save_File_Data_From_UI (ETCore->ETFileDisplayed);
-
-    switch (mode)
-    {
-        case ET_BROWSER_MODE_FILE:
-            /* Set the whole list as "Displayed list". */
-            et_displayed_file_list_set (ETCore->ETFileList);
+    gtk_tree_model_get (GTK_TREE_MODEL (priv->artist_model), iter,
+                        ARTIST_NUM_FILES, &nbr_files,
+                        ARTIST_NUM_ALBUMS, &nbr_albums, -1);
+    gtk_list_store_set (priv->artist_model, iter,
+                        ARTIST_NUM_FILES, nbr_files + files_delta,
+                        ARTIST_NUM_ALBUMS, nbr_albums + albums_delta,
+                        ARTIST_ALBUM_LIST_POINTER, artist_link->data, -1);
+    Browser_Artist_List_Set_Row_Appearance (self, iter);
+}
 
-            /* Display Tree Browser. */
-            gtk_notebook_set_current_page (GTK_NOTEBOOK (priv->notebook), 0);
-            et_browser_load_file_list (self, ETCore->ETFileDisplayedList,
+/*
+ * Insert the row of @artist_link, created for @ETFile, at its sorted position.
+ */
+static void
+Browser_Artist_List_Insert_Row (EtBrowser *self,
+                                GList *artist_link,
+                                const ET_File *ETFile)
+{
+    EtBrowserPrivate *priv;
+    GtkTreeIter iter;
+    GtkTreeIter *sibling = NULL;
+    GdkPixbuf *pixbuf;
+
+    priv = et_browser_get_instance_private (self);
+
+    if (artist_link->next)
+    {
+        sibling = g_hash_table_lookup (priv->artist_rows, artist_link->next);
+    }
+
+    pixbuf = gdk_pixbuf_new_from_resource ("/org/gnome/EasyTAG/images/artist.png",
+                                           NULL);
+    gtk_list_store_insert_before (priv->artist_model, &iter, sibling);
+    gtk_list_store_set (priv->artist_model, &iter,
+                        ARTIST_PIXBUF, pixbuf,
+                        ARTIST_NAME,
+                        ((File_Tag *)ETFile->FileTag->data)->artist,
+                        ARTIST_NUM_ALBUMS, 1,
+                        ARTIST_NUM_FILES, 1,
+                        ARTIST_ALBUM_LIST_POINTER, artist_link->data, -1);
+    g_object_unref (pixbuf);
+
+    g_hash_table_insert (priv->artist_rows, artist_link,
+                         gtk_tree_iter_copy (&iter));
+    Browser_Artist_List_Set_Row_Appearance (self, &iter);
+}
+
+/*
+ * Select the artist and album of @ETFile in the artist and album lists, and
+ * display the files of the album.
+ */
+static void
+Browser_Artist_List_Select_File (EtBrowser *self, ET_File *ETFile)
+{
+    EtBrowserPrivate *priv;
+    GtkTreeSelection *selection;
+    GtkTreePath *path;
+    GtkTreeIter *iter;
+    GList *artist_link;
+
+    priv = et_browser_get_instance_private (self);
+
+    if (!et_artist_album_list_get_position (ETFile, &artist_link, NULL))
+    {
+        return;
+    }
+
+    iter = g_hash_table_lookup (priv->artist_rows, artist_link);
+
+    if (!iter)
+    {
+        return;
+    }
+
+    selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (priv->artist_list));
+    g_signal_handler_block (selection, priv->artist_selected_handler);
+    gtk_tree_selection_select_iter (selection, iter);
+    g_signal_handler_unblock (selection, priv->artist_selected_handler);
+
+    path = gtk_tree_model_get_path (GTK_TREE_MODEL (priv->artist_model), iter);
+    gtk_tree_view_scroll_to_cell (GTK_TREE_VIEW (priv->artist_list), path,
+                                  NULL, FALSE, 0, 0);
+    gtk_tree_path_free (path);
+
+    Browser_Album_List_Load_Files (self, (GList *)artist_link->data, ETFile);
+}
+
+/*
+ * Update the count of the row of @album_link after a file was moved into
+ * (positive delta) or out of (negative delta) the album.
+ */
+static void
+Browser_Album_List_Update_Row (EtBrowser *self,
+                               GtkTreeIter *iter,
+                               GList *album_link,
+                               gint files_delta)
+{
+    EtBrowserPrivate *priv;
+    guint nbr_files;
+
+    priv = et_browser_get_instance_private (self);
+
+    gtk_tree_model_get (GTK_TREE_MODEL (priv->album_model), iter,
+                        ALBUM_NUM_FILES, &nbr_files, -1);
+    gtk_list_store_set (priv->album_model, iter,
+                        ALBUM_NUM_FILES, nbr_files + files_delta,
+                        ALBUM_ETFILE_LIST_POINTER,
+                        g_list_first ((GList *)album_link->data), -1);
+    Browser_Album_List_Set_Row_Appearance (self, iter);
+}
+
+/*
+ * Insert the row of @album_link, created for @ETFile, at its sorted position.
+ */
+static void
+Browser_Album_List_Insert_Row (EtBrowser *self,
+                               GList *album_link,
+                               const ET_File *ETFile)
+{
+    EtBrowserPrivate *priv;
+    GtkTreeIter iter;
+    GtkTreeIter *sibling = NULL;
+    GIcon *icon;
+
+    priv = et_browser_get_instance_private (self);
+
+    if (album_link->next)
+    {
+        sibling = g_hash_table_lookup (priv->album_rows, album_link->next);
+    }
+
+    /* TODO: Make the icon use the symbolic variant. */
+    icon = g_themed_icon_new_with_default_fallbacks ("media-optical-cd-audio");
+    gtk_list_store_insert_before (priv->album_model, &iter, sibling);
+    gtk_list_store_set (priv->album_model, &iter,
+                        ALBUM_GICON, icon,
+                        ALBUM_NAME,
+                        ((File_Tag *)ETFile->FileTag->data)->album,
+                        ALBUM_NUM_FILES, 1,
+                        ALBUM_ETFILE_LIST_POINTER, album_link->data, -1);
+    g_object_unref (icon);
+
+    g_hash_table_insert (priv->album_rows, album_link,
+                         gtk_tree_iter_copy (&iter));
+    Browser_Album_List_Set_Row_Appearance (self, &iter);
+}
+
+/*
+ * Add @ETFile to (or remove it from) the list of the "All albums" row.
+ *
+ * Returns: %TRUE if the "All albums" row is selected, %FALSE otherwise
+ */
+static gboolean
+Browser_Album_List_Update_All_Albums (EtBrowser *self,
+                                      ET_File *ETFile,
+                                      gboolean add)
+{
+    EtBrowserPrivate *priv;
+    GtkTreeIter iter;
+    GList *etfilelist;
+    gboolean all_albums_row;
+    guint nbr_files;
+
+    priv = et_browser_get_instance_private (self);
+
+    if (!gtk_tree_model_get_iter_first (GTK_TREE_MODEL (priv->album_model),
+                                        &iter))
+    {
+        return FALSE;
+    }
+
+    gtk_tree_model_get (GTK_TREE_MODEL (priv->album_model), &iter,
+                        ALBUM_ETFILE_LIST_POINTER, &etfilelist,
+                        ALBUM_NUM_FILES, &nbr_files,
+                        ALBUM_ALL_ALBUMS_ROW, &all_albums_row, -1);
+
+    if (!all_albums_row)
+    {
+        return FALSE;
+    }
+
+    /* The list is owned by the row, see et_browser_clear_album_model(). */
+    if (add)
+    {
+        etfilelist = g_list_append (g_list_first (etfilelist), ETFile);
+        nbr_files++;
+    }
+    else
+    {
+        etfilelist = g_list_remove (g_list_first (etfilelist), ETFile);
+        nbr_files--;
+    }
+
+    gtk_list_store_set (priv->album_model, &iter,
+                        ALBUM_ETFILE_LIST_POINTER, etfilelist,
+                        ALBUM_NUM_FILES, nbr_files, -1);
+    Browser_Album_List_Set_Row_Appearance (self, &iter);
+
+    return gtk_tree_selection_iter_is_selected (gtk_tree_view_get_selection (GTK_TREE_VIEW (priv->album_list)),
+                                                &iter);
+}
+
+/*
+ * Display again the files of the selected album, after files were moved into
+ * or out of it.
+ */
+static void
+Browser_Album_List_Reload_Selected (EtBrowser *self)
+{
+    EtBrowserPrivate *priv;
+    GtkTreeSelection *selection;
+    GtkTreeIter iter;
+    GList *etfilelist;
+
+    priv = et_browser_get_instance_private (self);
+
+    selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (priv->album_list));
+
+    if (!gtk_tree_selection_get_selected (selection, NULL, &iter))
+    {
+        return;
+    }
+
+    gtk_tree_model_get (GTK_TREE_MODEL (priv->album_model), &iter,
+                        ALBUM_ETFILE_LIST_POINTER, &etfilelist, -1);
+
+    et_displayed_file_list_set (etfilelist);
+    et_browser_load_file_list (self, etfilelist, ETCore->ETFileDisplayed);
+}
+
+/*
+ * File @ETFile again under its artist and album if they changed, and update
+ * only the artist and album rows involved. The list of files must be reloaded
+ * afterwards if @reload_files is set, or the artist and album of
+ * @follow_file selected if it is set (for instance because the file being
+ * edited moved, or the album being displayed no longer exists).
+ */
+static void
+Browser_Artist_Album_Move_File (EtBrowser *self,
+                                ET_File *ETFile,
+                                ET_File **follow_file,
+                                gboolean *reload_files)
+{
+    EtBrowserPrivate *priv;
+    EtArtistAlbumMove move;
+    GtkTreeSelection *selection;
+    GtkTreeIter *iter;
+    gboolean shown_old;
+    gboolean shown_new;
+
+    priv = et_browser_get_instance_private (self);
+
+    if (!et_artist_album_list_move_file (ETFile, &move))
+    {
+        return;
+    }
+
+    if (ETFile == ETCore->ETFileDisplayed)
+    {
+        *follow_file = ETFile;
+    }
+    else if (g_hash_table_contains (priv->file_rows, ETFile))
+    {
+        /* The file leaves the displayed album. */
+        *reload_files = TRUE;
+    }
+
+    shown_old = priv->album_artist && priv->album_artist == move.old_artist;
+    shown_new = priv->album_artist && priv->album_artist == move.new_artist;
+
+    /* Artist rows. */
+    iter = g_hash_table_lookup (priv->artist_rows, move.old_artist);
+
+    if (iter)
+    {
+        if (move.old_artist_removed)
+        {
+            selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (priv->artist_list));
+            g_signal_handler_block (selection, priv->artist_selected_handler);
+            gtk_list_store_remove (priv->artist_model, iter);
+            g_signal_handler_unblock (selection,
+                                      priv->artist_selected_handler);
+            g_hash_table_remove (priv->artist_rows, move.old_artist);
+        }
+        else
+        {
+            Browser_Artist_List_Update_Row (self, iter, move.old_artist, -1,
+                                            move.old_album_removed ? -1 : 0);
+        }
+    }
+
+    if (move.new_artist_created)
+    {
+        Browser_Artist_List_Insert_Row (self, move.new_artist, ETFile);
+    }
+    else if ((iter = g_hash_table_lookup (priv->artist_rows, move.new_artist)))
+    {
+        Browser_Artist_List_Update_Row (self, iter, move.new_artist, 1,
+                                        move.new_album_created ? 1 : 0);
+    }
+
+    /* Album rows, if the albums of one of the artists are listed. */
+    selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (priv->album_list));
+
+    if (shown_old)
+    {
+        iter = g_hash_table_lookup (priv->album_rows, move.old_album);
+
+        if (iter && move.old_album_removed)
+        {
+            /* Nothing is left to display in the selected album. */
+            if (gtk_tree_selection_iter_is_selected (selection, iter)
+                && !*follow_file)
+            {
+                *follow_file = ETFile;
+            }
+
+            g_signal_handler_block (selection, priv->album_selected_handler);
+            gtk_list_store_remove (priv->album_model, iter);
+            g_signal_handler_unblock (selection, priv->album_selected_handler);
+            g_hash_table_remove (priv->album_rows, move.old_album);
+        }
+        else if (iter)
+        {
+            Browser_Album_List_Update_Row (self, iter, move.old_album, -1);
+        }
+
+        if (!shown_new)
+        {
+            Browser_Album_List_Update_All_Albums (self, ETFile, FALSE);
+        }
+
+        if (move.old_artist_removed)
+        {
+            /* The listed albums belong to an artist which no longer
+             * exists. */
+            et_browser_clear_album_model (self);
+
+            if (!*follow_file)
+            {
+                *follow_file = ETFile;
+            }
+        }
+    }
+
+    if (shown_new)
+    {
+        if (move.new_album_created)
+        {
+            Browser_Album_List_Insert_Row (self, move.new_album, ETFile);
+        }
+        else if ((iter = g_hash_table_lookup (priv->album_rows,
+                                              move.new_album)))
+        {
+            Browser_Album_List_Update_Row (self, iter, move.new_album, 1);
+
+            /* The file joins the displayed album. */
+            if (gtk_tree_selection_iter_is_selected (selection, iter))
+            {
+                *reload_files = TRUE;
+            }
+        }
+
+        if (!shown_old
+            && Browser_Album_List_Update_All_Albums (self, ETFile, TRUE))
+        {
+            *reload_files = TRUE;
+        }
+    }
+
+    et_artist_album_move_clear (&move);
+}
+
+void
+et_browser_set_display_mode (EtBrowser *self,
+                             EtBrowserMode mode)
+{
+    EtBrowserPrivate *priv;
+    ET_File *etfile = ETCore->ETFileDisplayed; // ETFile to display again after changing browser view
+
+    g_return_if_fail (ET_BROWSER (self));
+
+    priv = et_browser_get_instance_private (self);
+
+    /* Save the current displayed data. */
+    ET_Save_File_Data_From_UI (ETCore->ETFileDisplayed);
+
+    switch (mode)
+    {
+        case ET_BROWSER_MODE_FILE:
+            /* Set the whole list as "Displayed list". */
+            et_displayed_file_list_set (ETCore->ETFileList);
+
+            /* Display Tree Browser. */
+            gtk_notebook_set_current_page (GTK_NOTEBOOK (priv->notebook), 0);
+            et_browser_load_file_list (self, ETCore->ETFileDisplayedList,
                                        etfile);
 
             /* Displays the first file if nothing specified. */
@@ -3082,6 +3594,7 @@ Browser_Tree_Initialize (EtBrowser *self)
 
     g_return_if_fail (priv->directory_model != NULL);
 
+    Browser_Tree_Cancel_All (self);
     gtk_tree_store_clear (priv->directory_model);
 
 #ifdef G_OS_WIN32
@@ -3321,209 +3834,999 @@ Browser_Tree_Handle_Rename (EtBrowser *self,
         gtk_tree_store_set(priv->directory_model, &iter,
                            TREE_COLUMN_FULL_PATH, path_new, -1);
 
-        g_free(path_new);
-        g_free(path);
+        g_free(path_new);
+        g_free(path);
+
+        /* Recurse if necessary. */
+        if (gtk_tree_model_iter_has_child (GTK_TREE_MODEL (priv->directory_model),
+                                           &iter))
+        {
+            Browser_Tree_Handle_Rename (self, &iter, old_path, new_path);
+        }
+
+    } while (gtk_tree_model_iter_next(GTK_TREE_MODEL(priv->directory_model), &iter));
+
+}
+
+/*
+ * Find the child node of "parentnode" that has text of "childtext
+ * Returns NULL on failure
+ */
+static GtkTreePath *
+Find_Child_Node (EtBrowser *self, GtkTreeIter *parentnode, gchar *childtext)
+{
+    EtBrowserPrivate *priv;
+    gint row;
+    GtkTreeIter iter;
+    gchar *text;
+    gchar *temp;
+
+    priv = et_browser_get_instance_private (self);
+
+    for (row=0; row < gtk_tree_model_iter_n_children(GTK_TREE_MODEL(priv->directory_model), parentnode); row++)
+    {
+        if (row == 0)
+        {
+            if (gtk_tree_model_iter_children(GTK_TREE_MODEL(priv->directory_model), &iter, parentnode) == FALSE) return NULL;
+        } else
+        {
+            if (gtk_tree_model_iter_next(GTK_TREE_MODEL(priv->directory_model), &iter) == FALSE)
+                return NULL;
+        }
+        gtk_tree_model_get(GTK_TREE_MODEL(priv->directory_model), &iter,
+                           TREE_COLUMN_FULL_PATH, &temp, -1);
+        text = g_path_get_basename(temp);
+        g_free(temp);
+        if(strcmp(childtext,text) == 0)
+        {
+            g_free(text);
+            return gtk_tree_model_get_path(GTK_TREE_MODEL(priv->directory_model), &iter);
+        }
+        g_free(text);
+
+    }
+
+    return NULL;
+}
+
+/*
+ * check_for_subdir:
+ * @path: (type filename): the path to test
+ * @show_hidden: whether hidden subdirectories should be taken into account
+ *
+ * Check if @path has any subdirectories. This does blocking I/O, and is run
+ * in a worker thread by Browser_Tree_Probe_Subdirs() when expanding the tree.
+ *
+ * Returns: %TRUE if subdirectories exist, %FALSE otherwise
+ */
+static gboolean
+check_for_subdir (const gchar *path, gboolean show_hidden)
+{
+    GFile *dir;
+    GFileEnumerator *enumerator;
+
+    dir = g_file_new_for_path (path);
+    enumerator = g_file_enumerate_children (dir,
+                                            G_FILE_ATTRIBUTE_STANDARD_TYPE ","
+                                            G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN,
+                                            G_FILE_QUERY_INFO_NONE,
+                                            NULL, NULL);
+    g_object_unref (dir);
+
+    if (enumerator)
+    {
+        GFileInfo *childinfo;
+
+        while ((childinfo = g_file_enumerator_next_file (enumerator,
+                                                         NULL, NULL)))
+        {
+            if ((g_file_info_get_file_type (childinfo) ==
+                 G_FILE_TYPE_DIRECTORY) &&
+                (show_hidden || !g_file_info_get_is_hidden (childinfo)))
+            {
+                g_object_unref (childinfo);
+                g_file_enumerator_close (enumerator, NULL, NULL);
+                g_object_unref (enumerator);
+                return TRUE;
+            }
+
+            g_object_unref (childinfo);
+        }
+
+        g_file_enumerator_close (enumerator, NULL, NULL);
+        g_object_unref (enumerator);
+    }
+
+    return FALSE;
+}
+
+/*
+ * get_gicon_for_info:
+ * @info: information about the directory, with the access attributes
+ * @path_state: whether the icon should be shown open or closed
+ *
+ * Return an icon for the directory, with an emblem if the permissions in @info
+ * show that it is unreadable or readonly.
+ *
+ * Returns: an icon corresponding to @info
+ */
+static GIcon *
+get_gicon_for_info (GFileInfo *info, EtPathState path_state)
+{
+    GIcon *folder_icon;
+    GIcon *emblem_icon;
+    GIcon *emblemed_icon;
+    GEmblem *emblem;
+
+    switch (path_state)
+    {
+        case ET_PATH_STATE_OPEN:
+            folder_icon = g_themed_icon_new ("folder-open");
+            break;
+        case ET_PATH_STATE_CLOSED:
+            folder_icon = g_themed_icon_new ("folder");
+            break;
+        default:
+            g_assert_not_reached ();
+    }
+
+    if (!g_file_info_get_attribute_boolean (info,
+                                            G_FILE_ATTRIBUTE_ACCESS_CAN_READ))
+    {
+        emblem_icon = g_themed_icon_new ("emblem-unreadable");
+        emblem = g_emblem_new_with_origin (emblem_icon,
+                                           G_EMBLEM_ORIGIN_LIVEMETADATA);
+        emblemed_icon = g_emblemed_icon_new (folder_icon, emblem);
+        g_object_unref (folder_icon);
+        g_object_unref (emblem_icon);
+        g_object_unref (emblem);
+
+        folder_icon = emblemed_icon;
+    }
+    else if (!g_file_info_get_attribute_boolean (info, G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE))
+    {
+        emblem_icon = g_themed_icon_new ("emblem-readonly");
+        emblem = g_emblem_new_with_origin (emblem_icon,
+                                           G_EMBLEM_ORIGIN_LIVEMETADATA);
+        emblemed_icon = g_emblemed_icon_new (folder_icon, emblem);
+        g_object_unref (folder_icon);
+        g_object_unref (emblem_icon);
+        g_object_unref (emblem);
+
+        folder_icon = emblemed_icon;
+    }
+
+    return folder_icon;
+}
+
+/*
+ * get_gicon_for_path:
+ * @path: (type filename): path to create icon for
+ * @path_state: whether the icon should be shown open or closed
+ *
+ * Check the permissions for the supplied @path (authorized?, readonly?,
+ * unreadable?) and return an appropriate icon.
+ *
+ * Returns: an icon corresponding to the @path
+ */
+static GIcon *
+get_gicon_for_path (const gchar *path, EtPathState path_state)
+{
+    GIcon *folder_icon;
+    GFile *file;
+    GFileInfo *info;
+    GError *error = NULL;
+
+    file = g_file_new_for_path (path);
+    info = g_file_query_info (file, G_FILE_ATTRIBUTE_ACCESS_CAN_READ ","
+                              G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE,
+                              G_FILE_QUERY_INFO_NONE, NULL, &error);
+
+    if (info == NULL)
+    {
+        g_warning ("Error while querying path information: %s",
+                   error->message);
+        g_clear_error (&error);
+        info = g_file_info_new ();
+        g_file_info_set_attribute_boolean (info,
+                                           G_FILE_ATTRIBUTE_ACCESS_CAN_READ,
+                                           FALSE);
+    }
+
+    folder_icon = get_gicon_for_info (info, path_state);
+
+    g_object_unref (file);
+    g_object_unref (info);
+
+    return folder_icon;
+}
+
+/*
+ * EtSubdirProbe:
+ * @mtime: modification time of the directory when it was probed
+ * @show_hidden: whether hidden subdirectories were taken into account
+ * @has_subdir: whether the directory has subdirectories
+ *
+ * Cached result of check_for_subdir(). Adding or removing a subdirectory
+ * changes the modification time of the directory, so the result is valid as
+ * long as the modification time is unchanged.
+ */
+typedef struct
+{
+    guint64 mtime;
+    gboolean show_hidden;
+    gboolean has_subdir;
+} EtSubdirProbe;
+
+static void
+et_subdir_probe_free (gpointer probe)
+{
+    g_slice_free (EtSubdirProbe, probe);
+}
+
+/*
+ * EtSubdirProbeItem:
+ * @path: (type filename): the directory to probe
+ * @mtime: modification time of the directory, from the parent enumeration
+ * @has_subdir: result of the probe, filled in by the worker thread
+ */
+typedef struct
+{
+    gchar *path;
+    guint64 mtime;
+    gboolean has_subdir;
+} EtSubdirProbeItem;
+
+static void
+et_subdir_probe_item_clear (EtSubdirProbeItem *item)
+{
+    g_free (item->path);
+}
+
+/*
+ * EtSubdirProbeData:
+ * @parent: the node of the tree whose children are being probed
+ * @items: (element-type EtSubdirProbeItem): the children to probe
+ * @show_hidden: whether hidden subdirectories should be taken into account
+ */
+typedef struct
+{
+    GtkTreeRowReference *parent;
+    GArray *items;
+    gboolean show_hidden;
+} EtSubdirProbeData;
+
+static void
+et_subdir_probe_data_free (EtSubdirProbeData *data)
+{
+    gtk_tree_row_reference_free (data->parent);
+    g_array_free (data->items, TRUE);
+    g_slice_free (EtSubdirProbeData, data);
+}
+
+/*
+ * Attributes read when listing the subdirectories of a node, which are enough
+ * to insert the child nodes without any further I/O.
+ */
+static const gchar TREE_ENUMERATE_ATTRIBUTES[] = G_FILE_ATTRIBUTE_STANDARD_TYPE ","
+                                                 G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME ","
+                                                 G_FILE_ATTRIBUTE_STANDARD_NAME ","
+                                                 G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN ","
+                                                 G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+                                                 G_FILE_ATTRIBUTE_ACCESS_CAN_READ ","
+                                                 G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE;
+
+/* Number of children read by each asynchronous enumeration step. */
+static const gint TREE_ENUMERATE_BATCH = 100;
+
+/*
+ * Find the dummy node, used to show an expander on unread nodes, among the
+ * children of @parent, and remove it.
+ */
+static void
+Browser_Tree_Remove_Dummy_Node (EtBrowser *self, GtkTreeIter *parent)
+{
+    EtBrowserPrivate *priv;
+    GtkTreeIter child;
+    gboolean valid;
+
+    priv = et_browser_get_instance_private (self);
+
+    valid = gtk_tree_model_iter_children (GTK_TREE_MODEL (priv->directory_model),
+                                          &child, parent);
+
+    while (valid)
+    {
+        gchar *path;
+
+        gtk_tree_model_get (GTK_TREE_MODEL (priv->directory_model), &child,
+                            TREE_COLUMN_FULL_PATH, &path, -1);
+
+        if (path == NULL)
+        {
+            gtk_tree_store_remove (priv->directory_model, &child);
+            return;
+        }
+
+        g_free (path);
+        valid = gtk_tree_model_iter_next (GTK_TREE_MODEL (priv->directory_model),
+                                          &child);
+    }
+}
+
+static void
+Browser_Tree_Probe_Subdirs_Thread (GSimpleAsyncResult *result,
+                                   GObject *object,
+                                   GCancellable *cancellable)
+{
+    EtSubdirProbeData *data;
+    guint i;
+
+    data = g_simple_async_result_get_op_res_gpointer (result);
+
+    for (i = 0; i < data->items->len; i++)
+    {
+        EtSubdirProbeItem *item;
+
+        if (g_cancellable_is_cancelled (cancellable))
+        {
+            return;
+        }
+
+        item = &g_array_index (data->items, EtSubdirProbeItem, i);
+        item->has_subdir = check_for_subdir (item->path, data->show_hidden);
+    }
+}
+
+/*
+ * Store the results of the probe in the cache, and remove the expander from
+ * the child nodes which do not have any subdirectories.
+ */
+static void
+Browser_Tree_Probe_Subdirs_Done (GObject *object,
+                                 GAsyncResult *result,
+                                 gpointer user_data)
+{
+    EtBrowser *self;
+    EtBrowserPrivate *priv;
+    GCancellable *cancellable;
+    EtSubdirProbeData *data;
+    GHashTable *no_subdir;
+    GtkTreePath *path;
+    GtkTreeIter parent;
+    GtkTreeIter child;
+    gboolean valid;
+    guint i;
+
+    self = ET_BROWSER (object);
+    priv = et_browser_get_instance_private (self);
+    cancellable = user_data;
+    data = g_simple_async_result_get_op_res_gpointer (G_SIMPLE_ASYNC_RESULT (result));
+
+    if (g_cancellable_is_cancelled (cancellable))
+    {
+        g_object_unref (cancellable);
+        return;
+    }
+
+    g_object_unref (cancellable);
+
+    no_subdir = g_hash_table_new (g_str_hash, g_str_equal);
+
+    for (i = 0; i < data->items->len; i++)
+    {
+        EtSubdirProbeItem *item;
+        EtSubdirProbe *probe;
+
+        item = &g_array_index (data->items, EtSubdirProbeItem, i);
+
+        probe = g_slice_new (EtSubdirProbe);
+        probe->mtime = item->mtime;
+        probe->show_hidden = data->show_hidden;
+        probe->has_subdir = item->has_subdir;
+        g_hash_table_replace (priv->subdir_cache, g_strdup (item->path),
+                              probe);
+
+        if (!item->has_subdir)
+        {
+            g_hash_table_add (no_subdir, item->path);
+        }
+    }
+
+    path = gtk_tree_row_reference_get_path (data->parent);
+
+    if (path
+        && g_hash_table_size (no_subdir) > 0
+        && gtk_tree_model_get_iter (GTK_TREE_MODEL (priv->directory_model),
+                                    &parent, path))
+    {
+        valid = gtk_tree_model_iter_children (GTK_TREE_MODEL (priv->directory_model),
+                                              &child, &parent);
+
+        while (valid)
+        {
+            gchar *child_path;
+            gboolean scanned;
+
+            gtk_tree_model_get (GTK_TREE_MODEL (priv->directory_model), &child,
+                                TREE_COLUMN_FULL_PATH, &child_path,
+                                TREE_COLUMN_SCANNED, &scanned, -1);
+
+            /* Nodes which were expanded meanwhile were already read. */
+            if (child_path && !scanned
+                && g_hash_table_contains (no_subdir, child_path))
+            {
+                Browser_Tree_Remove_Dummy_Node (self, &child);
+                gtk_tree_store_set (priv->directory_model, &child,
+                                    TREE_COLUMN_HAS_SUBDIR, FALSE, -1);
+            }
+
+            g_free (child_path);
+            valid = gtk_tree_model_iter_next (GTK_TREE_MODEL (priv->directory_model),
+                                              &child);
+        }
+    }
+
+    gtk_tree_path_free (path);
+    g_hash_table_destroy (no_subdir);
+}
+
+/*
+ * Check in a worker thread which of the @items (children of @parent, with an
+ * unknown or outdated entry in the cache) have subdirectories. Takes ownership
+ * of @items.
+ */
+static void
+Browser_Tree_Probe_Subdirs (EtBrowser *self,
+                            GtkTreeIter *parent,
+                            GArray *items)
+{
+    EtBrowserPrivate *priv;
+    EtSubdirProbeData *data;
+    GSimpleAsyncResult *result;
+    GtkTreePath *path;
+
+    priv = et_browser_get_instance_private (self);
+
+    if (items->len == 0)
+    {
+        g_array_free (items, TRUE);
+        return;
+    }
+
+    path = gtk_tree_model_get_path (GTK_TREE_MODEL (priv->directory_model),
+                                    parent);
+
+    data = g_slice_new (EtSubdirProbeData);
+    data->parent = gtk_tree_row_reference_new (GTK_TREE_MODEL (priv->directory_model),
+                                               path);
+    data->items = items;
+    data->show_hidden = g_settings_get_boolean (MainSettings,
+                                                "browse-show-hidden");
+    gtk_tree_path_free (path);
+
+    result = g_simple_async_result_new (G_OBJECT (self),
+                                        Browser_Tree_Probe_Subdirs_Done,
+                                        g_object_ref (priv->tree_cancellable),
+                                        Browser_Tree_Probe_Subdirs);
+    g_simple_async_result_set_op_res_gpointer (result, data,
+                                               (GDestroyNotify)et_subdir_probe_data_free);
+    g_simple_async_result_run_in_thread (result,
+                                         Browser_Tree_Probe_Subdirs_Thread,
+                                         G_PRIORITY_LOW,
+                                         priv->tree_cancellable);
+    g_object_unref (result);
+}
+
+/*
+ * Insert a node below @parent for each subdirectory in @infos (children of
+ * @dir). The "has subdirectories" state is taken from the cache when it is
+ * still valid, otherwise the node gets an expander and the subdirectory is
+ * added to @probe_items to be checked in the background.
+ *
+ * Returns: the number of inserted nodes
+ */
+static guint
+Browser_Tree_Insert_Subdirs (EtBrowser *self,
+                             GtkTreeIter *parent,
+                             GFile *dir,
+                             GList *infos,
+                             GArray *probe_items)
+{
+    EtBrowserPrivate *priv;
+    gboolean show_hidden;
+    guint n_inserted = 0;
+    GList *l;
+
+    priv = et_browser_get_instance_private (self);
+
+    show_hidden = g_settings_get_boolean (MainSettings, "browse-show-hidden");
+
+    for (l = infos; l != NULL; l = g_list_next (l))
+    {
+        GFileInfo *childinfo = l->data;
+        const gchar *dirname_utf8;
+        const EtSubdirProbe *probe;
+        GFile *child;
+        gchar *fullpath_file;
+        guint64 mtime;
+        gboolean has_subdir;
+        GtkTreeIter currentIter;
+        GtkTreeIter subNodeIter;
+        GIcon *icon;
+
+        if (g_file_info_get_file_type (childinfo) != G_FILE_TYPE_DIRECTORY
+            || (!show_hidden && g_file_info_get_is_hidden (childinfo)))
+        {
+            continue;
+        }
+
+        child = g_file_get_child (dir, g_file_info_get_name (childinfo));
+        fullpath_file = g_file_get_path (child);
+        g_object_unref (child);
+
+        dirname_utf8 = g_file_info_get_display_name (childinfo);
+        mtime = g_file_info_get_attribute_uint64 (childinfo,
+                                                  G_FILE_ATTRIBUTE_TIME_MODIFIED);
+        probe = g_hash_table_lookup (priv->subdir_cache, fullpath_file);
+
+        if (probe && probe->mtime == mtime && probe->show_hidden == show_hidden)
+        {
+            has_subdir = probe->has_subdir;
+        }
+        else
+        {
+            EtSubdirProbeItem item;
+
+            /* Assume that there are subdirectories until the probe says
+             * otherwise. */
+            has_subdir = TRUE;
+            item.path = g_strdup (fullpath_file);
+            item.mtime = mtime;
+            item.has_subdir = TRUE;
+            g_array_append_val (probe_items, item);
+        }
+
+        /* Select pixmap according permissions for the directory. */
+        icon = get_gicon_for_info (childinfo, ET_PATH_STATE_CLOSED);
+
+        gtk_tree_store_insert_with_values (priv->directory_model,
+                                           &currentIter, parent,
+                                           G_MAXINT,
+                                           TREE_COLUMN_DIR_NAME,
+                                           dirname_utf8,
+                                           TREE_COLUMN_FULL_PATH,
+                                           fullpath_file,
+                                           TREE_COLUMN_HAS_SUBDIR,
+                                           has_subdir,
+                                           TREE_COLUMN_SCANNED, FALSE,
+                                           TREE_COLUMN_ICON, icon, -1);
+
+        if (has_subdir)
+        {
+            /* Insert a dummy node. */
+            gtk_tree_store_append(priv->directory_model, &subNodeIter, &currentIter);
+        }
+
+        g_object_unref (icon);
+        g_free (fullpath_file);
+        n_inserted++;
+    }
+
+    return n_inserted;
+}
+
+/*
+ * Mark the node at @iter as read: remove its dummy node (if no subdirectory
+ * was inserted before it), show it as open, and start probing the
+ * @probe_items in the background.
+ */
+static void
+Browser_Tree_Finish_Expansion (EtBrowser *self,
+                               GtkTreeIter *iter,
+                               gboolean dummy_removed,
+                               GArray *probe_items)
+{
+    EtBrowserPrivate *priv;
+    gchar *parentPath;
+    GIcon *icon;
+#ifdef G_OS_WIN32
+    GtkTreePath *gtreePath;
+#endif /* G_OS_WIN32 */
+
+    priv = et_browser_get_instance_private (self);
+
+    if (!dummy_removed)
+    {
+        Browser_Tree_Remove_Dummy_Node (self, iter);
+    }
+
+    gtk_tree_model_get (GTK_TREE_MODEL (priv->directory_model), iter,
+                        TREE_COLUMN_FULL_PATH, &parentPath, -1);
+    icon = get_gicon_for_path (parentPath, ET_PATH_STATE_OPEN);
+
+#ifdef G_OS_WIN32
+    gtreePath = gtk_tree_model_get_path (GTK_TREE_MODEL (priv->directory_model),
+                                         iter);
+
+    // set open folder pixmap except on drive (depth == 0)
+    if (gtk_tree_path_get_depth(gtreePath) > 1)
+    {
+        // update the icon of the node to opened folder :-)
+        gtk_tree_store_set(priv->directory_model, iter,
+                           TREE_COLUMN_SCANNED, TRUE,
+                           TREE_COLUMN_ICON, icon,
+                           -1);
+    }
+
+    gtk_tree_path_free (gtreePath);
+#else /* !G_OS_WIN32 */
+    // update the icon of the node to opened folder :-)
+    gtk_tree_store_set(priv->directory_model, iter,
+                       TREE_COLUMN_SCANNED, TRUE,
+                       TREE_COLUMN_ICON, icon,
+                       -1);
+#endif /* !G_OS_WIN32 */
+
+    gtk_tree_sortable_set_sort_column_id(GTK_TREE_SORTABLE(priv->directory_model),
+                                         TREE_COLUMN_DIR_NAME, GTK_SORT_ASCENDING);
+
+    Browser_Tree_Probe_Subdirs (self, iter, probe_items);
+
+    g_object_unref (icon);
+    g_free (parentPath);
+}
+
+/*
+ * Read the subdirectories of the node at @iter, blocking until they are all
+ * inserted. Used when the tree is walked programmatically, for instance by
+ * et_browser_select_dir(), which needs the child nodes straight away.
+ */
+static void
+Browser_Tree_Expand_Sync (EtBrowser *self, GtkTreeIter *iter)
+{
+    EtBrowserPrivate *priv;
+    GFile *dir;
+    GFileEnumerator *enumerator;
+    gchar *parentPath;
+    GArray *probe_items;
+    guint n_inserted = 0;
+
+    priv = et_browser_get_instance_private (self);
+
+    gtk_tree_model_get (GTK_TREE_MODEL (priv->directory_model), iter,
+                        TREE_COLUMN_FULL_PATH, &parentPath, -1);
+
+    probe_items = g_array_new (FALSE, FALSE, sizeof (EtSubdirProbeItem));
+    g_array_set_clear_func (probe_items,
+                            (GDestroyNotify)et_subdir_probe_item_clear);
+
+    dir = g_file_new_for_path (parentPath);
+    enumerator = g_file_enumerate_children (dir, TREE_ENUMERATE_ATTRIBUTES,
+                                            G_FILE_QUERY_INFO_NONE,
+                                            NULL, NULL);
+
+    if (enumerator)
+    {
+        GFileInfo *childinfo;
+
+        while ((childinfo = g_file_enumerator_next_file (enumerator,
+                                                         NULL, NULL))
+               != NULL)
+        {
+            GList single = { childinfo, NULL, NULL };
+
+            n_inserted += Browser_Tree_Insert_Subdirs (self, iter, dir,
+                                                       &single, probe_items);
+            g_object_unref (childinfo);
+        }
+
+        g_file_enumerator_close (enumerator, NULL, NULL);
+        g_object_unref (enumerator);
+    }
+
+    g_object_unref (dir);
+    g_free (parentPath);
+
+    /* The dummy node is only kept if the directory could not be read. */
+    Browser_Tree_Finish_Expansion (self, iter, enumerator == NULL,
+                                   probe_items);
+}
+
+/*
+ * EtTreeExpansion:
+ * @self: the browser
+ * @row: the node being expanded
+ * @dir: the directory of the node
+ * @path: (type filename): the path of the node, key in tree_expansions
+ * @cancellable: cancelled if the node is collapsed or the tree is reloaded
+ * @probe_items: subdirectories to probe once the enumeration is complete
+ * @dummy_removed: whether the dummy node was already removed
+ *
+ * State of a node being read asynchronously.
+ */
+typedef struct
+{
+    EtBrowser *self;
+    GtkTreeRowReference *row;
+    GFile *dir;
+    gchar *path;
+    GCancellable *cancellable;
+    GArray *probe_items;
+    gboolean dummy_removed;
+} EtTreeExpansion;
+
+static void
+et_tree_expansion_free (EtTreeExpansion *expansion)
+{
+    EtBrowserPrivate *priv;
+
+    priv = et_browser_get_instance_private (expansion->self);
+
+    /* Only forget about the expansion if it was not replaced meanwhile. */
+    if (g_hash_table_lookup (priv->tree_expansions, expansion->path)
+        == expansion->cancellable)
+    {
+        g_hash_table_remove (priv->tree_expansions, expansion->path);
+    }
+
+    if (expansion->probe_items)
+    {
+        g_array_free (expansion->probe_items, TRUE);
+    }
+
+    gtk_tree_row_reference_free (expansion->row);
+    g_object_unref (expansion->dir);
+    g_free (expansion->path);
+    g_object_unref (expansion->cancellable);
+    g_object_unref (expansion->self);
+    g_slice_free (EtTreeExpansion, expansion);
+}
+
+/*
+ * Get the iter of the node being expanded, or return %FALSE if the node was
+ * removed.
+ */
+static gboolean
+et_tree_expansion_get_iter (EtTreeExpansion *expansion, GtkTreeIter *iter)
+{
+    EtBrowserPrivate *priv;
+    GtkTreePath *path;
+    gboolean valid;
+
+    priv = et_browser_get_instance_private (expansion->self);
+
+    path = gtk_tree_row_reference_get_path (expansion->row);
+
+    if (!path)
+    {
+        return FALSE;
+    }
+
+    valid = gtk_tree_model_get_iter (GTK_TREE_MODEL (priv->directory_model),
+                                     iter, path);
+    gtk_tree_path_free (path);
+
+    return valid;
+}
+
+static void
+Browser_Tree_Next_Files_Cb (GObject *object,
+                            GAsyncResult *result,
+                            gpointer user_data)
+{
+    GFileEnumerator *enumerator;
+    EtTreeExpansion *expansion;
+    GList *infos;
+    GtkTreeIter iter;
+    GError *error = NULL;
+
+    enumerator = G_FILE_ENUMERATOR (object);
+    expansion = user_data;
+
+    infos = g_file_enumerator_next_files_finish (enumerator, result, &error);
 
-        /* Recurse if necessary. */
-        if (gtk_tree_model_iter_has_child (GTK_TREE_MODEL (priv->directory_model),
-                                           &iter))
+    if (g_cancellable_is_cancelled (expansion->cancellable)
+        || !et_tree_expansion_get_iter (expansion, &iter))
+    {
+        g_list_free_full (infos, g_object_unref);
+        g_clear_error (&error);
+        g_file_enumerator_close_async (enumerator, G_PRIORITY_DEFAULT, NULL,
+                                       NULL, NULL);
+        et_tree_expansion_free (expansion);
+        return;
+    }
+
+    if (infos == NULL)
+    {
+        /* End of the directory, or an error which cuts the listing short. */
+        if (error)
         {
-            Browser_Tree_Handle_Rename (self, &iter, old_path, new_path);
+            g_debug ("Error while reading directory ‘%s’: %s",
+                     expansion->path, error->message);
+            g_error_free (error);
         }
 
-    } while (gtk_tree_model_iter_next(GTK_TREE_MODEL(priv->directory_model), &iter));
+        g_file_enumerator_close_async (enumerator, G_PRIORITY_DEFAULT, NULL,
+                                       NULL, NULL);
+        Browser_Tree_Finish_Expansion (expansion->self, &iter,
+                                       expansion->dummy_removed,
+                                       expansion->probe_items);
+        expansion->probe_items = NULL;
+        et_tree_expansion_free (expansion);
+        return;
+    }
+
+    if (Browser_Tree_Insert_Subdirs (expansion->self, &iter, expansion->dir,
+                                     infos, expansion->probe_items) > 0
+        && !expansion->dummy_removed)
+    {
+        /* Real nodes are shown now, so the expander is no longer needed. */
+        Browser_Tree_Remove_Dummy_Node (expansion->self, &iter);
+        expansion->dummy_removed = TRUE;
+    }
 
+    g_list_free_full (infos, g_object_unref);
+
+    g_file_enumerator_next_files_async (enumerator, TREE_ENUMERATE_BATCH,
+                                        G_PRIORITY_DEFAULT,
+                                        expansion->cancellable,
+                                        Browser_Tree_Next_Files_Cb, expansion);
 }
 
-/*
- * Find the child node of "parentnode" that has text of "childtext
- * Returns NULL on failure
- */
-static GtkTreePath *
-Find_Child_Node (EtBrowser *self, GtkTreeIter *parentnode, gchar *childtext)
+static void
+Browser_Tree_Enumerate_Cb (GObject *object,
+                           GAsyncResult *result,
+                           gpointer user_data)
 {
-    EtBrowserPrivate *priv;
-    gint row;
+    GFileEnumerator *enumerator;
+    EtTreeExpansion *expansion;
     GtkTreeIter iter;
-    gchar *text;
-    gchar *temp;
+    GError *error = NULL;
 
-    priv = et_browser_get_instance_private (self);
+    expansion = user_data;
 
-    for (row=0; row < gtk_tree_model_iter_n_children(GTK_TREE_MODEL(priv->directory_model), parentnode); row++)
+    enumerator = g_file_enumerate_children_finish (G_FILE (object), result,
+                                                   &error);
+
+    if (g_cancellable_is_cancelled (expansion->cancellable)
+        || !et_tree_expansion_get_iter (expansion, &iter))
     {
-        if (row == 0)
-        {
-            if (gtk_tree_model_iter_children(GTK_TREE_MODEL(priv->directory_model), &iter, parentnode) == FALSE) return NULL;
-        } else
-        {
-            if (gtk_tree_model_iter_next(GTK_TREE_MODEL(priv->directory_model), &iter) == FALSE)
-                return NULL;
-        }
-        gtk_tree_model_get(GTK_TREE_MODEL(priv->directory_model), &iter,
-                           TREE_COLUMN_FULL_PATH, &temp, -1);
-        text = g_path_get_basename(temp);
-        g_free(temp);
-        if(strcmp(childtext,text) == 0)
+        g_clear_error (&error);
+
+        if (enumerator)
         {
-            g_free(text);
-            return gtk_tree_model_get_path(GTK_TREE_MODEL(priv->directory_model), &iter);
+            g_file_enumerator_close_async (enumerator, G_PRIORITY_DEFAULT,
+                                           NULL, NULL, NULL);
+            g_object_unref (enumerator);
         }
-        g_free(text);
 
+        et_tree_expansion_free (expansion);
+        return;
     }
 
-    return NULL;
+    if (!enumerator)
+    {
+        /* Keep the dummy node, as when reading synchronously. */
+        g_debug ("Error while reading directory ‘%s’: %s", expansion->path,
+                 error->message);
+        g_error_free (error);
+        Browser_Tree_Finish_Expansion (expansion->self, &iter, TRUE,
+                                       expansion->probe_items);
+        expansion->probe_items = NULL;
+        et_tree_expansion_free (expansion);
+        return;
+    }
+
+    g_file_enumerator_next_files_async (enumerator, TREE_ENUMERATE_BATCH,
+                                        G_PRIORITY_DEFAULT,
+                                        expansion->cancellable,
+                                        Browser_Tree_Next_Files_Cb, expansion);
+    g_object_unref (enumerator);
 }
 
 /*
- * check_for_subdir:
- * @path: (type filename): the path to test
+ * Cancel the asynchronous reading of the node with the given @path, if any.
  *
- * Check if @path has any subdirectories.
- *
- * Returns: %TRUE if subdirectories exist, %FALSE otherwise
+ * Returns: %TRUE if a reading was cancelled, %FALSE otherwise
  */
 static gboolean
-check_for_subdir (const gchar *path)
+Browser_Tree_Cancel_Expansion (EtBrowser *self, const gchar *path)
 {
-    GFile *dir;
-    GFileEnumerator *enumerator;
+    EtBrowserPrivate *priv;
+    GCancellable *cancellable;
 
-    dir = g_file_new_for_path (path);
-    enumerator = g_file_enumerate_children (dir,
-                                            G_FILE_ATTRIBUTE_STANDARD_TYPE ","
-                                            G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN,
-                                            G_FILE_QUERY_INFO_NONE,
-                                            NULL, NULL);
-    g_object_unref (dir);
+    priv = et_browser_get_instance_private (self);
 
-    if (enumerator)
+    if (path == NULL)
     {
-        GFileInfo *childinfo;
-
-        while ((childinfo = g_file_enumerator_next_file (enumerator,
-                                                         NULL, NULL)))
-        {
-            if ((g_file_info_get_file_type (childinfo) ==
-                 G_FILE_TYPE_DIRECTORY) &&
-                (g_settings_get_boolean (MainSettings, "browse-show-hidden")
-                 || !g_file_info_get_is_hidden (childinfo)))
-            {
-                g_object_unref (childinfo);
-                g_file_enumerator_close (enumerator, NULL, NULL);
-                g_object_unref (enumerator);
-                return TRUE;
-            }
+        return FALSE;
+    }
 
-            g_object_unref (childinfo);
-        }
+    cancellable = g_hash_table_lookup (priv->tree_expansions, path);
 
-        g_file_enumerator_close (enumerator, NULL, NULL);
-        g_object_unref (enumerator);
+    if (cancellable == NULL)
+    {
+        return FALSE;
     }
 
-    return FALSE;
+    g_cancellable_cancel (cancellable);
+    g_hash_table_remove (priv->tree_expansions, path);
+
+    return TRUE;
 }
 
 /*
- * get_gicon_for_path:
- * @path: (type filename): path to create icon for
- * @path_state: whether the icon should be shown open or closed
- *
- * Check the permissions for the supplied @path (authorized?, readonly?,
- * unreadable?) and return an appropriate icon.
- *
- * Returns: an icon corresponding to the @path
+ * Cancel all the asynchronous readings of nodes, and the pending probes of
+ * subdirectories, for instance when the tree is reloaded.
  */
-static GIcon *
-get_gicon_for_path (const gchar *path, EtPathState path_state)
+static void
+Browser_Tree_Cancel_All (EtBrowser *self)
 {
-    GIcon *folder_icon;
-    GIcon *emblem_icon;
-    GIcon *emblemed_icon;
-    GEmblem *emblem;
-    GFile *file;
-    GFileInfo *info;
-    GError *error = NULL;
+    EtBrowserPrivate *priv;
+    GHashTableIter iter;
+    gpointer cancellable;
 
-    switch (path_state)
-    {
-        case ET_PATH_STATE_OPEN:
-            folder_icon = g_themed_icon_new ("folder-open");
-            break;
-        case ET_PATH_STATE_CLOSED:
-            folder_icon = g_themed_icon_new ("folder");
-            break;
-        default:
-            g_assert_not_reached ();
-    }
+    priv = et_browser_get_instance_private (self);
 
-    file = g_file_new_for_path (path);
-    info = g_file_query_info (file, G_FILE_ATTRIBUTE_ACCESS_CAN_READ ","
-                              G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE,
-                              G_FILE_QUERY_INFO_NONE, NULL, &error);
+    g_hash_table_iter_init (&iter, priv->tree_expansions);
 
-    if (info == NULL)
+    while (g_hash_table_iter_next (&iter, NULL, &cancellable))
     {
-        g_warning ("Error while querying path information: %s",
-                   error->message);
-        g_clear_error (&error);
-        info = g_file_info_new ();
-        g_file_info_set_attribute_boolean (info,
-                                           G_FILE_ATTRIBUTE_ACCESS_CAN_READ,
-                                           FALSE);
+        g_cancellable_cancel (G_CANCELLABLE (cancellable));
     }
 
-    if (!g_file_info_get_attribute_boolean (info,
-                                            G_FILE_ATTRIBUTE_ACCESS_CAN_READ))
-    {
-        emblem_icon = g_themed_icon_new ("emblem-unreadable");
-        emblem = g_emblem_new_with_origin (emblem_icon,
-                                           G_EMBLEM_ORIGIN_LIVEMETADATA);
-        emblemed_icon = g_emblemed_icon_new (folder_icon, emblem);
-        g_object_unref (folder_icon);
-        g_object_unref (emblem_icon);
-        g_object_unref (emblem);
+    g_hash_table_remove_all (priv->tree_expansions);
 
-        folder_icon = emblemed_icon;
-    }
-    else if (!g_file_info_get_attribute_boolean (info, G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE))
+    g_cancellable_cancel (priv->tree_cancellable);
+    g_object_unref (priv->tree_cancellable);
+    priv->tree_cancellable = g_cancellable_new ();
+}
+
+/*
+ * Make sure that the node at @iter is fully read, so that its children can be
+ * walked straight away. If the node is being read asynchronously, the reading
+ * is restarted synchronously.
+ */
+static void
+Browser_Tree_Complete_Expansion (EtBrowser *self, GtkTreeIter *iter)
+{
+    EtBrowserPrivate *priv;
+    GtkTreeIter child;
+    gchar *path;
+
+    priv = et_browser_get_instance_private (self);
+
+    gtk_tree_model_get (GTK_TREE_MODEL (priv->directory_model), iter,
+                        TREE_COLUMN_FULL_PATH, &path, -1);
+
+    if (Browser_Tree_Cancel_Expansion (self, path))
     {
-        emblem_icon = g_themed_icon_new ("emblem-readonly");
-        emblem = g_emblem_new_with_origin (emblem_icon,
-                                           G_EMBLEM_ORIGIN_LIVEMETADATA);
-        emblemed_icon = g_emblemed_icon_new (folder_icon, emblem);
-        g_object_unref (folder_icon);
-        g_object_unref (emblem_icon);
-        g_object_unref (emblem);
+        /* Drop the nodes read so far, and read the directory again. */
+        while (gtk_tree_model_iter_children (GTK_TREE_MODEL (priv->directory_model),
+                                             &child, iter))
+        {
+            gtk_tree_store_remove (priv->directory_model, &child);
+        }
 
-        folder_icon = emblemed_icon;
+        Browser_Tree_Expand_Sync (self, iter);
     }
 
-    g_object_unref (file);
-    g_object_unref (info);
-
-    return folder_icon;
+    g_free (path);
 }
 
 /*
  * Open up a node on the browser tree
- * Scanning and showing all subdirectories
+ * Scanning and showing all subdirectories. The directory is read
+ * asynchronously, unless the tree is being walked by et_browser_select_dir().
  */
 static void
 expand_cb (EtBrowser *self, GtkTreeIter *iter, GtkTreePath *gtreePath, GtkTreeView *tree)
 {
     EtBrowserPrivate *priv;
-    GFile *dir;
-    GFileEnumerator *enumerator;
-    gchar *fullpath_file;
+    EtTreeExpansion *expansion;
     gchar *parentPath;
     gboolean treeScanned;
-    gboolean has_subdir = FALSE;
-    GtkTreeIter currentIter;
-    GtkTreeIter subNodeIter;
-    GIcon *icon;
 
     priv = et_browser_get_instance_private (self);
 
@@ -3533,109 +4836,46 @@ expand_cb (EtBrowser *self, GtkTreeIter *iter, GtkTreePath *gtreePath, GtkTreeVi
                        TREE_COLUMN_FULL_PATH, &parentPath,
                        TREE_COLUMN_SCANNED,   &treeScanned, -1);
 
-    if (treeScanned)
+    if (treeScanned || parentPath == NULL)
+    {
+        g_free (parentPath);
         return;
+    }
 
-    dir = g_file_new_for_path (parentPath);
-    enumerator = g_file_enumerate_children (dir,
-                                            G_FILE_ATTRIBUTE_STANDARD_TYPE ","
-                                            G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME ","
-                                            G_FILE_ATTRIBUTE_STANDARD_NAME ","
-                                            G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN,
-                                            G_FILE_QUERY_INFO_NONE,
-                                            NULL, NULL);
-
-    if (enumerator)
+    if (priv->tree_expand_sync)
     {
-        GFileInfo *childinfo;
-
-        while ((childinfo = g_file_enumerator_next_file (enumerator,
-                                                         NULL, NULL))
-               != NULL)
-        {
-            const gchar *name;
-            GFile *child;
-            gboolean isdir;
-
-            name = g_file_info_get_name (childinfo);
-            child = g_file_get_child (dir, name);
-            fullpath_file = g_file_get_path (child);
-            isdir = g_file_info_get_file_type (childinfo) == G_FILE_TYPE_DIRECTORY;
-
-            if (isdir &&
-                (g_settings_get_boolean (MainSettings, "browse-show-hidden")
-                 || !g_file_info_get_is_hidden (childinfo)))
-            {
-                const gchar *dirname_utf8;
-                dirname_utf8 = g_file_info_get_display_name (childinfo);
-
-                has_subdir = check_for_subdir (fullpath_file);
-
-                /* Select pixmap according permissions for the directory. */
-                icon = get_gicon_for_path (fullpath_file,
-                                           ET_PATH_STATE_CLOSED);
-
-                gtk_tree_store_insert_with_values (priv->directory_model,
-                                                   &currentIter, iter,
-                                                   G_MAXINT,
-                                                   TREE_COLUMN_DIR_NAME,
-                                                   dirname_utf8,
-                                                   TREE_COLUMN_FULL_PATH,
-                                                   fullpath_file,
-                                                   TREE_COLUMN_HAS_SUBDIR,
-                                                   !has_subdir,
-                                                   TREE_COLUMN_SCANNED, FALSE,
-                                                   TREE_COLUMN_ICON, icon, -1);
-
-                if (has_subdir)
-                {
-                    /* Insert a dummy node. */
-                    gtk_tree_store_append(priv->directory_model, &subNodeIter, &currentIter);
-                }
-
-                g_object_unref (icon);
-            }
-
-            g_free (fullpath_file);
-            g_object_unref (childinfo);
-            g_object_unref (child);
-        }
-
-        g_file_enumerator_close (enumerator, NULL, NULL);
-        g_object_unref (enumerator);
-
-        /* Remove dummy node. */
-        gtk_tree_model_iter_children (GTK_TREE_MODEL (priv->directory_model),
-                                      &subNodeIter, iter);
-        gtk_tree_store_remove (priv->directory_model, &subNodeIter);
+        Browser_Tree_Expand_Sync (self, iter);
+        g_free (parentPath);
+        return;
     }
 
-    g_object_unref (dir);
-    icon = get_gicon_for_path (parentPath, ET_PATH_STATE_OPEN);
-
-#ifdef G_OS_WIN32
-    // set open folder pixmap except on drive (depth == 0)
-    if (gtk_tree_path_get_depth(gtreePath) > 1)
+    if (g_hash_table_contains (priv->tree_expansions, parentPath))
     {
-        // update the icon of the node to opened folder :-)
-        gtk_tree_store_set(priv->directory_model, iter,
-                           TREE_COLUMN_SCANNED, TRUE,
-                           TREE_COLUMN_ICON, icon,
-                           -1);
+        /* Already being read. */
+        g_free (parentPath);
+        return;
     }
-#else /* !G_OS_WIN32 */
-    // update the icon of the node to opened folder :-)
-    gtk_tree_store_set(priv->directory_model, iter,
-                       TREE_COLUMN_SCANNED, TRUE,
-                       TREE_COLUMN_ICON, icon,
-                       -1);
-#endif /* !G_OS_WIN32 */
 
-    gtk_tree_sortable_set_sort_column_id(GTK_TREE_SORTABLE(priv->directory_model),
-                                         TREE_COLUMN_DIR_NAME, GTK_SORT_ASCENDING);
-
-    g_object_unref (icon);
-    g_free(parentPath);
+    expansion = g_slice_new0 (EtTreeExpansion);
+    expansion->self = g_object_ref (self);
+    expansion->row = gtk_tree_row_reference_new (GTK_TREE_MODEL (priv->directory_model),
+                                                 gtreePath);
+    expansion->dir = g_file_new_for_path (parentPath);
+    expansion->path = parentPath;
+    expansion->cancellable = g_cancellable_new ();
+    expansion->probe_items = g_array_new (FALSE, FALSE,
+                                          sizeof (EtSubdirProbeItem));
+    g_array_set_clear_func (expansion->probe_items,
+                            (GDestroyNotify)et_subdir_probe_item_clear);
+
+    g_hash_table_insert (priv->tree_expansions, g_strdup (parentPath),
+                         g_object_ref (expansion->cancellable));
+
+    g_file_enumerate_children_async (expansion->dir, TREE_ENUMERATE_ATTRIBUTES,
+                                     G_FILE_QUERY_INFO_NONE,
+                                     G_PRIORITY_DEFAULT,
+                                     expansion->cancellable,
+                                     Browser_Tree_Enumerate_Cb, expansion);
 }
 
 static void
@@ -3656,6 +4896,9 @@ collapse_cb (EtBrowser *self, GtkTreeIter *iter, GtkTreePath *treePath, GtkTreeV
     gtk_tree_model_get (GTK_TREE_MODEL (priv->directory_model), iter,
                         TREE_COLUMN_FULL_PATH, &path, -1);
 
+    /* Stop reading the directory, as its children are removed below. */
+    Browser_Tree_Cancel_Expansion (self, path);
+
     /* If the directory is not readable, do not delete its children. */
     file = g_file_new_for_path (path);
     g_free (path);
@@ -4325,6 +5568,9 @@ Rename_Directory (EtBrowser *self)
 
     g_return_if_fail (priv->rename_directory_dialog != NULL);
 
+    /* The files which are being saved must not move under the engine. */
+    et_save_background_wait ();
+
     directory_parent    = g_object_get_data(G_OBJECT(priv->rename_directory_dialog),"Parent_Directory");
     directory_last_name = g_object_get_data(G_OBJECT(priv->rename_directory_dialog),"Current_Directory");
 
@@ -5068,6 +6314,18 @@ et_browser_destroy (GtkWidget *widget)
         /* The model is disposed when the combo box is disposed. */
     }
 
+    if (priv->refresh_dirty_idle_id)
+    {
+        g_source_remove (priv->refresh_dirty_idle_id);
+        priv->refresh_dirty_idle_id = 0;
+    }
+
+    /* Pending reads of the tree hold a reference on the browser. */
+    if (priv->tree_cancellable)
+    {
+        Browser_Tree_Cancel_All (ET_BROWSER (widget));
+    }
+
     GTK_WIDGET_CLASS (et_browser_parent_class)->destroy (widget);
 }
 
@@ -5081,6 +6339,12 @@ et_browser_finalize (GObject *object)
     g_free (priv->current_path);
     priv->current_path = NULL;
     g_clear_object (&priv->run_program_model);
+    g_hash_table_destroy (priv->file_rows);
+    g_hash_table_destroy (priv->artist_rows);
+    g_hash_table_destroy (priv->album_rows);
+    g_hash_table_destroy (priv->subdir_cache);
+    g_hash_table_destroy (priv->tree_expansions);
+    g_clear_object (&priv->tree_cancellable);
 
     G_OBJECT_CLASS (et_browser_parent_class)->finalize (object);
 }
@@ -5098,6 +6362,21 @@ et_browser_init (EtBrowser *self)
     priv->open_files_with_dialog = NULL;
     priv->open_files_with_combobox = NULL;
     priv->current_path = NULL;
+    priv->file_rows = g_hash_table_new_full (NULL, NULL, NULL,
+                                             (GDestroyNotify)gtk_tree_iter_free);
+    priv->artist_rows = g_hash_table_new_full (NULL, NULL, NULL,
+                                               (GDestroyNotify)gtk_tree_iter_free);
+    priv->album_rows = g_hash_table_new_full (NULL, NULL, NULL,
+                                              (GDestroyNotify)gtk_tree_iter_free);
+    priv->album_artist = NULL;
+    priv->refresh_dirty_idle_id = 0;
+    priv->subdir_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                g_free,
+                                                et_subdir_probe_free);
+    priv->tree_expansions = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                   g_free, g_object_unref);
+    priv->tree_cancellable = g_cancellable_new ();
+    priv->tree_expand_sync = FALSE;
 
     create_browser (self);
 }
@@ -79,6 +79,7 @@ void et_browser_set_sensitive (EtBrowser *self, gboolean sensitive);
 void et_browser_load_file_list (EtBrowser *self, GList *etfilelist, const ET_File *etfile_to_select);
 void et_browser_refresh_list (EtBrowser *self);
 void et_browser_refresh_file_in_list (EtBrowser *self, const ET_File *ETFile);
+void et_browser_refresh_dirty_files (EtBrowser *self);
 void et_browser_clear (EtBrowser *self);
 void et_browser_select_file_by_et_file (EtBrowser *self, const ET_File *ETFile, gboolean select_it);
 GtkTreePath * et_browser_select_file_by_et_file2 (EtBrowser *self, const ET_File *searchETFile, gboolean select_it, GtkTreePath *startPath);
@@ -2625,7 +2625,7 @@ Cddb_Set_Track_Infos_To_File_List (EtCDDBDialog *self)
     g_list_free_full (g_list_first (selectedrows),
                       (GDestroyNotify)gtk_tree_path_free);
 
-    et_application_window_browser_refresh_list (ET_APPLICATION_WINDOW (MainWindow));
+    et_application_window_browser_refresh_dirty_files (ET_APPLICATION_WINDOW (MainWindow));
     ET_Display_File_Data_To_UI(ETCore->ETFileDisplayed);
 
     return TRUE;
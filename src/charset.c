@@ -33,6 +33,7 @@
 
 #include "setting.h"
 #include "log.h"
+#include "utf8_validate.h"
 #include "win32/win32dep.h"
 
 typedef struct
@@ -364,6 +365,97 @@ const gchar *get_locale (void)
 
 
 
+/*
+ * The iconv descriptors used for conversions are kept for each thread and
+ * each pair of charsets, as opening one is far more expensive than converting
+ * a short tag value or filename with it.
+ */
+static void
+et_charset_iconv_close (gpointer data)
+{
+    g_iconv_close ((GIConv)data);
+}
+
+static GPrivate et_charset_converters =
+    G_PRIVATE_INIT ((GDestroyNotify)g_hash_table_unref);
+
+/*
+ * et_charset_get_converter:
+ * @to_codeset: the charset to convert to
+ * @from_codeset: the charset to convert from
+ *
+ * Get the iconv descriptor of the current thread for the pair of charsets,
+ * opening it if needed.
+ *
+ * Returns: the descriptor, owned by the cache, or (GIConv)-1 if the
+ *          conversion is not supported
+ */
+static GIConv
+et_charset_get_converter (const gchar *to_codeset, const gchar *from_codeset)
+{
+    GHashTable *converters;
+    gchar *key;
+    GIConv converter;
+
+    converters = g_private_get (&et_charset_converters);
+
+    if (converters == NULL)
+    {
+        converters = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                            et_charset_iconv_close);
+        g_private_set (&et_charset_converters, converters);
+    }
+
+    key = g_strconcat (to_codeset, "\n", from_codeset, NULL);
+    converter = g_hash_table_lookup (converters, key);
+
+    if (converter != NULL)
+    {
+        g_free (key);
+        return converter;
+    }
+
+    converter = g_iconv_open (to_codeset, from_codeset);
+
+    if (converter == (GIConv)-1)
+    {
+        g_free (key);
+        return converter;
+    }
+
+    g_hash_table_insert (converters, key, converter);
+
+    return converter;
+}
+
+/*
+ * et_charset_convert:
+ *
+ * Same as g_convert(), but with a cached iconv descriptor.
+ */
+static gchar *
+et_charset_convert (const gchar *string, gssize length,
+                    const gchar *to_codeset, const gchar *from_codeset,
+                    gsize *bytes_read, gsize *bytes_written, GError **error)
+{
+    GIConv converter;
+
+    converter = et_charset_get_converter (to_codeset, from_codeset);
+
+    if (converter == (GIConv)-1)
+    {
+        /* Let GLib report the unsupported conversion. */
+        return g_convert (string, length, to_codeset, from_codeset,
+                          bytes_read, bytes_written, error);
+    }
+
+    /* Reset the shift state, which a failed conversion may have left. */
+    g_iconv (converter, NULL, NULL, NULL, NULL);
+
+    return g_convert_with_iconv (string, length, converter, bytes_read,
+                                 bytes_written, error);
+}
+
 /*
  * convert_string : (don't use with UTF-16 strings)
  *  - display_error : if TRUE, may return an escaped string and display an error
@@ -387,7 +479,7 @@ convert_string_1 (const gchar *string, gssize length, const gchar *from_codeset,
 
     g_return_val_if_fail (string != NULL, NULL);
 
-    output = g_convert(string, length, to_codeset, from_codeset, NULL, &bytes_written, &error);
+    output = et_charset_convert (string, length, to_codeset, from_codeset, NULL, &bytes_written, &error);
     //output = g_convert_with_fallback(string, length, to_codeset, from_codeset, "?", NULL, &bytes_written, &error);
 
     if (output == NULL)
@@ -435,12 +527,22 @@ convert_string_1 (const gchar *string, gssize length, const gchar *from_codeset,
  */
 gchar *convert_to_utf8 (const gchar *string)
 {
+    const gchar *locale_charset;
     gchar *output;
     GError *error = NULL;
 
     g_return_val_if_fail (string != NULL, NULL);
 
-    output = g_locale_to_utf8(string, -1, NULL, NULL, &error);
+    if (g_get_charset (&locale_charset))
+    {
+        /* No conversion is needed from a UTF-8 locale. */
+        output = g_locale_to_utf8 (string, -1, NULL, NULL, &error);
+    }
+    else
+    {
+        output = et_charset_convert (string, -1, "UTF-8", locale_charset, NULL,
+                                     NULL, &error);
+    }
 
     if (output == NULL)
     {
@@ -477,7 +579,7 @@ filename_to_display (const gchar *string)
 
     g_return_val_if_fail (string != NULL, NULL);
 
-    if (g_utf8_validate(string, -1, NULL))
+    if (et_utf8_validate (string))
     {
         // String already in UTF-8
         ret = g_strdup(string);
@@ -491,14 +593,14 @@ filename_to_display (const gchar *string)
         {
             //g_print("> char_encoding: %s\n",char_encoding);
             error = NULL;
-            ret = g_convert(string, -1, "UTF-8", char_encoding, NULL, NULL, &error);
+            ret = et_charset_convert (string, -1, "UTF-8", char_encoding, NULL, NULL, &error);
         }
 
         if (!ret)
         {
             // Failing that, try ISO-8859-1
             error = NULL;
-            ret = g_convert(string, -1, "UTF-8", "ISO-8859-1", NULL, NULL, &error);
+            ret = et_charset_convert (string, -1, "UTF-8", "ISO-8859-1", NULL, NULL, &error);
         }
 
         if (!ret)
@@ -551,8 +653,8 @@ gchar *filename_from_display (const gchar *string)
         switch (enc_option)
         {
             case ET_RENAME_ENCODING_TRY_ALTERNATIVE:
-                ret = g_convert (string, -1, char_encoding, "UTF-8", NULL,
-                                 NULL, &error);
+                ret = et_charset_convert (string, -1, char_encoding, "UTF-8",
+                                          NULL, NULL, &error);
                 break;
             case ET_RENAME_ENCODING_TRANSLITERATE:
             {
@@ -564,7 +666,7 @@ gchar *filename_from_display (const gchar *string)
                  * looking characters.
                  */
                 gchar *enc = g_strconcat (char_encoding, "//TRANSLIT", NULL);
-                ret = g_convert (string, -1, enc, "UTF-8", NULL, NULL, &error);
+                ret = et_charset_convert (string, -1, enc, "UTF-8", NULL, NULL, &error);
                 g_free (enc);
                 break;
             }
@@ -576,7 +678,7 @@ gchar *filename_from_display (const gchar *string)
                  * be silently discarded.
                  */
                 gchar *enc = g_strconcat (char_encoding, "//IGNORE", NULL);
-                ret = g_convert (string, -1, enc, "UTF-8", NULL, NULL, &error);
+                ret = et_charset_convert (string, -1, enc, "UTF-8", NULL, NULL, &error);
                 g_free (enc);
                 break;
             }
@@ -593,7 +695,7 @@ gchar *filename_from_display (const gchar *string)
         {
             //g_print("> char_encoding: %s\n",char_encoding);
             error = NULL;
-            ret = g_convert(string, -1, char_encoding, "UTF-8", NULL, NULL, &error);
+            ret = et_charset_convert (string, -1, char_encoding, "UTF-8", NULL, NULL, &error);
         }
     }
 
@@ -601,7 +703,7 @@ gchar *filename_from_display (const gchar *string)
     {
         // Failing that, try ISO-8859-1
         error = NULL;
-        ret = g_convert(string, -1, "ISO-8859-1", "UTF-8", NULL, NULL, &error);
+        ret = et_charset_convert (string, -1, "ISO-8859-1", "UTF-8", NULL, NULL, &error);
     }
 
     if (!ret)
@@ -655,7 +757,7 @@ gchar *Try_To_Validate_Utf8_String (const gchar *string)
 
     g_return_val_if_fail (string != NULL, NULL);
 
-    if (g_utf8_validate(string, -1, NULL))
+    if (et_utf8_validate (string))
     {
         // String already in UTF-8
         ret = g_strdup(string);
@@ -669,14 +771,14 @@ gchar *Try_To_Validate_Utf8_String (const gchar *string)
         {
             //g_print("> char_encoding: %s\n",char_encoding);
             error = NULL;
-            ret = g_convert(string, -1, "UTF-8", char_encoding, NULL, NULL, &error);
+            ret = et_charset_convert (string, -1, "UTF-8", char_encoding, NULL, NULL, &error);
         }
 
         if (!ret)
         {
             // Failing that, try ISO-8859-1
             error = NULL;
-            ret = g_convert(string, -1, "UTF-8", "ISO-8859-1", NULL, NULL, &error);
+            ret = et_charset_convert (string, -1, "UTF-8", "ISO-8859-1", NULL, NULL, &error);
         }
 
         if (!ret)
@@ -0,0 +1,512 @@
+/* EasyTAG - tag editor for audio files
+ * Copyright (C) 2026  agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "config.h"
+
+#include "duration_scanner.h"
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <string.h>
+
+#include "mpeg_frame.h"
+
+/* The files are read in chunks of this size, checking for cancellation in
+ * between. */
+#define SCAN_CHUNK_SIZE (256 * 1024)
+
+#define ID3V2_HEADER_SIZE 10
+#define ID3V1_TAG_SIZE 128
+#define APE_FOOTER_SIZE 32
+
+/*
+ * EtDurationScanner:
+ *
+ * Walks all the frames of MPEG files, on a single low-priority worker thread,
+ * to find their exact duration and their number of sync errors and corrupt
+ * frames. The results are cached, with the modification time and size of
+ * each file, so that unchanged files are only scanned once.
+ */
+struct _EtDurationScanner
+{
+    EtDurationScannerFunc func;
+    gpointer user_data;
+    GThreadPool *pool;
+    GCancellable *cancellable;
+
+    /* Only used by the worker thread, and by et_duration_scanner_free() once
+     * the worker thread is done. */
+    GKeyFile *cache;
+    gchar *cache_path;
+    gboolean cache_changed;
+
+    /* The results waiting to be passed to the main thread. */
+    GMutex lock;
+    GArray *results;
+    guint idle_id;
+};
+
+typedef struct
+{
+    guint key;
+    gchar *filename;
+} EtDurationScannerJob;
+
+typedef struct
+{
+    guint key;
+    gint duration;
+    guint errors;
+} EtDurationScannerResult;
+
+static guint32
+read_uint32_le (const guchar *data)
+{
+    return ((guint32)data[3] << 24) | ((guint32)data[2] << 16)
+           | ((guint32)data[1] << 8) | (guint32)data[0];
+}
+
+static gboolean
+read_at (GInputStream *istream,
+         goffset offset,
+         guchar *buffer,
+         gsize count,
+         gsize *bytes_read,
+         GCancellable *cancellable)
+{
+    return g_seekable_seek (G_SEEKABLE (istream), offset, G_SEEK_SET,
+                            cancellable, NULL)
+           && g_input_stream_read_all (istream, buffer, count, bytes_read,
+                                       cancellable, NULL);
+}
+
+/*
+ * Find the region of the file between the ID3v2 tag at its start, and the
+ * APE and ID3v1 tags at its end.
+ */
+static void
+et_duration_scanner_find_audio (GInputStream *istream,
+                                goffset size,
+                                guchar *buffer,
+                                goffset *start,
+                                goffset *end,
+                                GCancellable *cancellable)
+{
+    gsize bytes_read;
+
+    *start = 0;
+    *end = size;
+
+    if (read_at (istream, 0, buffer, ID3V2_HEADER_SIZE, &bytes_read,
+                 cancellable)
+        && bytes_read == ID3V2_HEADER_SIZE
+        && memcmp (buffer, "ID3", 3) == 0
+        && (buffer[6] | buffer[7] | buffer[8] | buffer[9]) < 0x80)
+    {
+        /* A synchsafe size, which excludes the header and the footer. */
+        *start = ID3V2_HEADER_SIZE + ((buffer[6] << 21) | (buffer[7] << 14)
+                                      | (buffer[8] << 7) | buffer[9]);
+
+        if (buffer[5] & 0x10)
+        {
+            *start += ID3V2_HEADER_SIZE;
+        }
+    }
+
+    if (size >= ID3V1_TAG_SIZE
+        && read_at (istream, size - ID3V1_TAG_SIZE, buffer, 3, &bytes_read,
+                    cancellable)
+        && bytes_read == 3
+        && memcmp (buffer, "TAG", 3) == 0)
+    {
+        *end -= ID3V1_TAG_SIZE;
+    }
+
+    if (*end >= APE_FOOTER_SIZE
+        && read_at (istream, *end - APE_FOOTER_SIZE, buffer, APE_FOOTER_SIZE,
+                    &bytes_read, cancellable)
+        && bytes_read == APE_FOOTER_SIZE
+        && memcmp (buffer, "APETAGEX", 8) == 0)
+    {
+        /* The size includes the footer, but not the optional header. */
+        *end -= read_uint32_le (&buffer[12]);
+
+        if (read_uint32_le (&buffer[20]) & 0x80000000)
+        {
+            *end -= APE_FOOTER_SIZE;
+        }
+    }
+
+    *end = MAX (*end, *start);
+}
+
+/*
+ * Walk all the frames of the file. Returns FALSE if the file could not be
+ * read, if no frame was found, or if the scan was cancelled.
+ */
+static gboolean
+et_duration_scanner_scan (EtDurationScanner *self,
+                          GFile *file,
+                          goffset size,
+                          EtDurationScannerResult *result)
+{
+    GFileInputStream *istream;
+    guchar *buffer;
+    goffset start;
+    goffset end;
+    goffset offset;
+    gsize bytes_read;
+    gssize first;
+    EtMpegFrame frame;
+    EtMpegVbrHeader vbr;
+    EtMpegFrameScan scan;
+    guint64 samples;
+    guint64 trimmed;
+    gboolean success = FALSE;
+
+    istream = g_file_read (file, self->cancellable, NULL);
+
+    if (!istream)
+    {
+        return FALSE;
+    }
+
+    buffer = g_malloc (SCAN_CHUNK_SIZE);
+
+    et_duration_scanner_find_audio (G_INPUT_STREAM (istream), size, buffer,
+                                    &start, &end, self->cancellable);
+
+    if (!read_at (G_INPUT_STREAM (istream), start, buffer,
+                  MIN (SCAN_CHUNK_SIZE, end - start), &bytes_read,
+                  self->cancellable))
+    {
+        goto out;
+    }
+
+    /* Junk before the first frame is not an error of the stream. */
+    first = et_mpeg_frame_sync (buffer, bytes_read, &frame);
+
+    if (first < 0)
+    {
+        goto out;
+    }
+
+    et_mpeg_frame_parse_vbr_header (&buffer[first], bytes_read - first,
+                                    &frame, &vbr);
+
+    et_mpeg_frame_scan_init (&scan);
+    et_mpeg_frame_scan_feed (&scan, &buffer[first], bytes_read - first);
+    offset = start + bytes_read;
+
+    while (offset < end)
+    {
+        if (!g_input_stream_read_all (G_INPUT_STREAM (istream), buffer,
+                                      MIN (SCAN_CHUNK_SIZE, end - offset),
+                                      &bytes_read, self->cancellable, NULL)
+            || bytes_read == 0)
+        {
+            goto out;
+        }
+
+        et_mpeg_frame_scan_feed (&scan, buffer, bytes_read);
+        offset += bytes_read;
+    }
+
+    et_mpeg_frame_scan_finish (&scan);
+
+    samples = scan.samples;
+
+    /* The VBR header takes the place of the audio of the first frame. */
+    if (vbr.type != ET_MPEG_VBR_NONE && samples >= frame.samples)
+    {
+        samples -= frame.samples;
+    }
+
+    trimmed = vbr.encoder_delay + vbr.encoder_padding;
+
+    if (samples > trimmed)
+    {
+        samples -= trimmed;
+    }
+
+    result->duration = samples / frame.samplerate;
+    result->errors = scan.errors;
+    success = TRUE;
+
+out:
+    g_free (buffer);
+    g_object_unref (istream);
+
+    return success;
+}
+
+static gboolean
+on_idle (gpointer user_data)
+{
+    EtDurationScanner *self;
+    GArray *results;
+    guint i;
+
+    self = user_data;
+
+    g_mutex_lock (&self->lock);
+    results = self->results;
+    self->results = g_array_new (FALSE, FALSE,
+                                 sizeof (EtDurationScannerResult));
+    self->idle_id = 0;
+    g_mutex_unlock (&self->lock);
+
+    for (i = 0; i < results->len; i++)
+    {
+        const EtDurationScannerResult *result;
+
+        result = &g_array_index (results, EtDurationScannerResult, i);
+        self->func (result->key, result->duration, result->errors,
+                    self->user_data);
+    }
+
+    g_array_free (results, TRUE);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+et_duration_scanner_post (EtDurationScanner *self,
+                          const EtDurationScannerResult *result)
+{
+    g_mutex_lock (&self->lock);
+
+    g_array_append_val (self->results, *result);
+
+    /* Batch the results, and keep the user interface responsive. */
+    if (self->idle_id == 0)
+    {
+        self->idle_id = g_idle_add_full (G_PRIORITY_LOW, on_idle, self, NULL);
+    }
+
+    g_mutex_unlock (&self->lock);
+}
+
+static void
+et_duration_scanner_save_cache (EtDurationScanner *self)
+{
+    gchar *dir;
+    gchar *buffer;
+    gsize length;
+    GError *error = NULL;
+
+    dir = g_path_get_dirname (self->cache_path);
+    g_mkdir_with_parents (dir, 0700);
+    g_free (dir);
+
+    buffer = g_key_file_to_data (self->cache, &length, NULL);
+
+    if (!g_file_set_contents (self->cache_path, buffer, length, &error))
+    {
+        g_warning ("Error saving the duration cache: %s", error->message);
+        g_error_free (error);
+    }
+    else
+    {
+        self->cache_changed = FALSE;
+    }
+
+    g_free (buffer);
+}
+
+static void
+et_duration_scanner_run_job (gpointer data,
+                             gpointer user_data)
+{
+    EtDurationScannerJob *job;
+    EtDurationScanner *self;
+    EtDurationScannerResult result;
+    GFile *file;
+    GFileInfo *info;
+    gchar *group;
+    guint64 mtime;
+    goffset size;
+
+    job = data;
+    self = user_data;
+
+    if (g_cancellable_is_cancelled (self->cancellable))
+    {
+        goto out;
+    }
+
+    file = g_file_new_for_path (job->filename);
+    info = g_file_query_info (file,
+                              G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+                              G_FILE_ATTRIBUTE_TIME_MODIFIED,
+                              G_FILE_QUERY_INFO_NONE, self->cancellable, NULL);
+
+    if (!info)
+    {
+        g_object_unref (file);
+        goto out;
+    }
+
+    size = g_file_info_get_size (info);
+    mtime = g_file_info_get_attribute_uint64 (info,
+                                              G_FILE_ATTRIBUTE_TIME_MODIFIED);
+    g_object_unref (info);
+
+    result.key = job->key;
+
+    /* Filenames may not be valid UTF-8, nor valid group names. */
+    group = g_compute_checksum_for_string (G_CHECKSUM_SHA1, job->filename, -1);
+
+    if (g_key_file_get_uint64 (self->cache, group, "mtime", NULL) == mtime
+        && g_key_file_get_int64 (self->cache, group, "size", NULL) == size
+        && g_key_file_has_key (self->cache, group, "duration", NULL))
+    {
+        result.duration = g_key_file_get_integer (self->cache, group,
+                                                  "duration", NULL);
+        result.errors = g_key_file_get_integer (self->cache, group, "errors",
+                                                NULL);
+    }
+    else if (et_duration_scanner_scan (self, file, size, &result))
+    {
+        g_key_file_set_uint64 (self->cache, group, "mtime", mtime);
+        g_key_file_set_int64 (self->cache, group, "size", size);
+        g_key_file_set_integer (self->cache, group, "duration",
+                                result.duration);
+        g_key_file_set_integer (self->cache, group, "errors", result.errors);
+        self->cache_changed = TRUE;
+    }
+    else
+    {
+        g_free (group);
+        g_object_unref (file);
+        goto out;
+    }
+
+    g_free (group);
+    g_object_unref (file);
+
+    et_duration_scanner_post (self, &result);
+
+    /* Save the cache each time that the queue is drained. */
+    if (self->cache_changed && g_thread_pool_unprocessed (self->pool) == 0)
+    {
+        et_duration_scanner_save_cache (self);
+    }
+
+out:
+    g_free (job->filename);
+    g_slice_free (EtDurationScannerJob, job);
+}
+
+/*
+ * et_duration_scanner_new:
+ * @func: the function to call with the results
+ * @user_data: the user data to pass to @func
+ *
+ * Returns: a new duration scanner, to free with et_duration_scanner_free()
+ */
+EtDurationScanner *
+et_duration_scanner_new (EtDurationScannerFunc func,
+                         gpointer user_data)
+{
+    EtDurationScanner *self;
+
+    g_return_val_if_fail (func != NULL, NULL);
+
+    self = g_slice_new0 (EtDurationScanner);
+    self->func = func;
+    self->user_data = user_data;
+    self->cancellable = g_cancellable_new ();
+    self->cache = g_key_file_new ();
+    self->cache_path = g_build_filename (g_get_user_cache_dir (),
+                                         PACKAGE_TARNAME, "durations", NULL);
+    g_mutex_init (&self->lock);
+    self->results = g_array_new (FALSE, FALSE,
+                                 sizeof (EtDurationScannerResult));
+
+    /* A missing cache is not an error. */
+    g_key_file_load_from_file (self->cache, self->cache_path,
+                               G_KEY_FILE_NONE, NULL);
+
+    /* A single thread, so as not to compete with the user for the disk. */
+    self->pool = g_thread_pool_new (et_duration_scanner_run_job, self, 1,
+                                    FALSE, NULL);
+
+    return self;
+}
+
+/*
+ * et_duration_scanner_push:
+ * @self: a duration scanner
+ * @key: a key to identify the file in the results
+ * @filename: the filename of an MPEG file
+ *
+ * Queue a file to scan.
+ */
+void
+et_duration_scanner_push (EtDurationScanner *self,
+                          guint key,
+                          const gchar *filename)
+{
+    EtDurationScannerJob *job;
+
+    g_return_if_fail (self != NULL);
+    g_return_if_fail (filename != NULL);
+
+    job = g_slice_new (EtDurationScannerJob);
+    job->key = key;
+    job->filename = g_strdup (filename);
+
+    g_thread_pool_push (self->pool, job, NULL);
+}
+
+/*
+ * et_duration_scanner_free:
+ * @self: a duration scanner
+ *
+ * Cancel the scan of the file being read, drop the queued files, and wait for
+ * the worker thread. The results which were not yet passed to the main thread
+ * are dropped too.
+ */
+void
+et_duration_scanner_free (EtDurationScanner *self)
+{
+    g_return_if_fail (self != NULL);
+
+    g_cancellable_cancel (self->cancellable);
+
+    /* The queued jobs only free themselves, once cancelled. */
+    g_thread_pool_free (self->pool, FALSE, TRUE);
+
+    if (self->idle_id != 0)
+    {
+        g_source_remove (self->idle_id);
+    }
+
+    if (self->cache_changed)
+    {
+        et_duration_scanner_save_cache (self);
+    }
+
+    g_array_free (self->results, TRUE);
+    g_mutex_clear (&self->lock);
+    g_free (self->cache_path);
+    g_key_file_free (self->cache);
+    g_object_unref (self->cancellable);
+    g_slice_free (EtDurationScanner, self);
+}
@@ -0,0 +1,48 @@
+/* EasyTAG - tag editor for audio files
+ * Copyright (C) 2026  agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef ET_DURATION_SCANNER_H_
+#define ET_DURATION_SCANNER_H_
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _EtDurationScanner EtDurationScanner;
+
+/*
+ * EtDurationScannerFunc:
+ * @key: the key passed to et_duration_scanner_push() for the file
+ * @duration: the exact duration of the file, in seconds
+ * @errors: the number of sync errors and corrupt frames in the file
+ * @user_data: the user data passed to et_duration_scanner_new()
+ *
+ * Called on the main thread for each file which was scanned.
+ */
+typedef void (*EtDurationScannerFunc) (guint key, gint duration, guint errors,
+                                       gpointer user_data);
+
+EtDurationScanner * et_duration_scanner_new (EtDurationScannerFunc func,
+                                             gpointer user_data);
+void et_duration_scanner_push (EtDurationScanner *self, guint key,
+                               const gchar *filename);
+void et_duration_scanner_free (EtDurationScanner *self);
+
+G_END_DECLS
+
+#endif /* ET_DURATION_SCANNER_H_ */
@@ -38,6 +38,9 @@
 #include "scan_dialog.h"
 #include "et_core.h"
 #include "charset.h"
+#include "save_engine.h"
+#include "duration_scanner.h"
+#include "mpeg_header.h"
 
 #include "win32/win32dep.h"
 
@@ -57,15 +60,44 @@ static gboolean SF_HideMsgbox_Rename_File;
 /* To remember which button was pressed when renaming file */
 static gint SF_ButtonPressed_Rename_File;
 
-static gboolean Write_File_Tag (ET_File *ETFile, gboolean hide_msgbox);
+/*
+ * State of Save_List_Of_Files, updated from the batches of the save engine.
+ */
+typedef struct
+{
+    gint nb_files_saved;
+    gint nb_files_to_save;
+    /* Error dialog of the first error which stopped saving, run once the
+     * save engine finished. */
+    GtkWidget *error_dialog;
+} EtSaveState;
+
+/* Save engine of the files being saved in the background, and its state, or
+ * NULL if no file is being saved in the background. */
+static EtSaveEngine *background_engine = NULL;
+static EtSaveState background_state;
+/* TRUE while files are pushed to background_engine, which must then not be
+ * freed. */
+static gboolean background_pushing = FALSE;
+
+static void Save_Progress_Update (const EtSaveState *state);
+static void on_save_engine_results (EtSaveEngine *engine, GPtrArray *results,
+                                    gpointer user_data);
+static void Save_Background_Finish (void);
+static gboolean on_save_background_idle (gpointer user_data);
+
+/* Scanner of the exact duration of the MPEG files of the file list, or NULL
+ * if the files are not being scanned. */
+static EtDurationScanner *duration_scanner = NULL;
+/* ET_File of each ETFileKey queued in the duration scanner and not yet
+ * scanned. */
+static GHashTable *duration_scan_files = NULL;
 static gint Save_File (ET_File *ETFile, gboolean multiple_files,
-                       gboolean force_saving_files);
+                       gboolean force_saving_files, EtSaveEngineFlags *flags);
 static gint Save_Selected_Files_With_Answer (gboolean force_saving_files);
 static gint Save_List_Of_Files (GList *etfilelist,
                                 gboolean force_saving_files);
 
-static gboolean et_rename_file (const char *old_filepath,
-                                const char *new_filepath, GError **error);
 static GList *read_directory_recursively (GList *file_list,
                                           GFileEnumerator *dir_enumerator,
                                           gboolean recurse);
@@ -144,25 +176,36 @@ static gint
 Save_List_Of_Files (GList *etfilelist, gboolean force_saving_files)
 {
     EtApplicationWindow *window;
-    gint       progress_bar_index;
     gint       saving_answer;
     gint       nb_files_to_save;
     gint       nb_files_changed_by_ext_program;
     gchar     *msg;
-    gchar      progress_bar_text[30];
     GList *l;
     ET_File   *etfile_save_position = NULL;
     File_Tag  *FileTag;
     File_Name *FileNameNew;
-    double     fraction;
     GAction *action;
     GtkWidget *widget_focused;
-    GtkTreePath *currentPath = NULL;
+    EtSaveEngine *engine;
+    EtSaveState foreground_state = { 0, 0, NULL };
+    EtSaveState *state;
+    gboolean background;
+    gboolean stopped = FALSE;
 
     g_return_val_if_fail (ETCore != NULL, FALSE);
 
     window = ET_APPLICATION_WINDOW (MainWindow);
 
+    background = g_settings_get_boolean (MainSettings,
+                                         "file-save-in-background");
+
+    /* Finish the previous saves first, if they cannot be added to. */
+    if (!background || (background_engine
+                        && et_save_engine_is_stopped (background_engine)))
+    {
+        et_save_background_wait ();
+    }
+
     /* Save the current position in the list */
     etfile_save_position = ETCore->ETFileDisplayed;
 
@@ -200,11 +243,14 @@ Save_List_Of_Files (GList *etfilelist, gboolean force_saving_files)
                                       G_FILE_QUERY_INFO_NONE, NULL, NULL);
         g_object_unref (file);
 
+        /* The modification time of a file which is being saved is only
+         * known once it is saved. */
         if (fileinfo)
         {
-            if (ETFile->FileModificationTime
-                != g_file_info_get_attribute_uint64 (fileinfo,
-                                                     G_FILE_ATTRIBUTE_TIME_MODIFIED))
+            if (ETFile->pending_saves == 0
+                && ETFile->FileModificationTime
+                   != g_file_info_get_attribute_uint64 (fileinfo,
+                                                        G_FILE_ATTRIBUTE_TIME_MODIFIED))
             {
                 nb_files_changed_by_ext_program++;
             }
@@ -214,17 +260,40 @@ Save_List_Of_Files (GList *etfilelist, gboolean force_saving_files)
         g_free(basename_cur_utf8);
     }
 
+    if (background)
+    {
+        /* Add to the files which are still being saved, if any. */
+        if (background_engine == NULL)
+        {
+            background_state.nb_files_saved = 0;
+            background_state.nb_files_to_save = 0;
+            background_state.error_dialog = NULL;
+            background_engine = et_save_engine_new (on_save_engine_results,
+                                                    &background_state);
+        }
+
+        state = &background_state;
+        background_pushing = TRUE;
+    }
+    else
+    {
+        state = &foreground_state;
+    }
+
     /* Initialize status bar */
-    et_application_window_progress_set_fraction (window, 0.0);
-    progress_bar_index = 0;
-    g_snprintf(progress_bar_text, 30, "%d/%d", progress_bar_index, nb_files_to_save);
-    et_application_window_progress_set_text (window, progress_bar_text);
+    state->nb_files_to_save += nb_files_to_save;
+    Save_Progress_Update (state);
 
-    /* Set to unsensitive all command buttons (except Quit button) */
-    et_application_window_disable_command_actions (window);
-    et_application_window_browser_set_sensitive (window, FALSE);
-    et_application_window_tag_area_set_sensitive (window, FALSE);
-    et_application_window_file_area_set_sensitive (window, FALSE);
+    /* Set to unsensitive all command buttons (except Quit button), unless
+     * the files are saved in the background, while the user keeps
+     * editing. */
+    if (!background)
+    {
+        et_application_window_disable_command_actions (window);
+        et_application_window_browser_set_sensitive (window, FALSE);
+        et_application_window_tag_area_set_sensitive (window, FALSE);
+        et_application_window_file_area_set_sensitive (window, FALSE);
+    }
 
     /* Show msgbox (if needed) to ask confirmation ('SF' for Save File) */
     SF_HideMsgbox_Write_Tag = FALSE;
@@ -278,9 +347,30 @@ Save_List_Of_Files (GList *etfilelist, gboolean force_saving_files)
         }
     }
 
+    /* The confirmations are asked here, file after file, while the save
+     * engine writes the tags and renames the files of the previous ones on its
+     * worker threads. */
+    if (background)
+    {
+        engine = background_engine;
+    }
+    else
+    {
+        engine = et_save_engine_new (on_save_engine_results, state);
+    }
+
     for (l = etfilelist; l != NULL && !Main_Stop_Button_Pressed;
          l = g_list_next (l))
     {
+        EtSaveEngineFlags flags = 0;
+
+        /* Saving a previous file failed. */
+        if (et_save_engine_is_stopped (engine))
+        {
+            stopped = TRUE;
+            break;
+        }
+
         FileTag = ((ET_File *)l->data)->FileTag->data;
         FileNameNew = ((ET_File *)l->data)->FileNameNew->data;
 
@@ -289,54 +379,111 @@ Save_List_Of_Files (GList *etfilelist, gboolean force_saving_files)
         if ( force_saving_files
         || FileTag->saved == FALSE || FileNameNew->saved == FALSE )
         {
-            /* ET_Display_File_Data_To_UI ((ET_File *)l->data);
-             * Use of 'currentPath' to try to increase speed. Indeed, in many
-             * cases, the next file to select, is the next in the list. */
-            currentPath = et_application_window_browser_select_file_by_et_file2 (window,
-                                                                                (ET_File *)l->data,
-                                                                                FALSE,
-                                                                                currentPath);
-
-            fraction = (++progress_bar_index) / (double) nb_files_to_save;
-            et_application_window_progress_set_fraction (window, fraction);
-            g_snprintf(progress_bar_text, 30, "%d/%d", progress_bar_index, nb_files_to_save);
-            et_application_window_progress_set_text (window,
-                                                     progress_bar_text);
-
-            /* Needed to refresh status bar */
-            while (gtk_events_pending())
-                gtk_main_iteration();
-
-            // Save tag and rename file
+            // Ask what to save of the file
             saving_answer = Save_File ((ET_File *)l->data,
                                        nb_files_to_save > 1 ? TRUE : FALSE,
-                                       force_saving_files);
+                                       force_saving_files, &flags);
 
             if (saving_answer == -1)
             {
-                /* Stop saving files + reinit progress bar */
-                et_application_window_progress_set_text (window, "");
-                et_application_window_progress_set_fraction (window, 0.0);
-                et_application_window_status_bar_message (window,
-                                                          _("Saving files was stopped"),
-                                                          TRUE);
-                /* To update state of command buttons */
-                et_application_window_update_actions (window);
-                et_application_window_browser_set_sensitive (window, TRUE);
-                et_application_window_tag_area_set_sensitive (window, TRUE);
-                et_application_window_file_area_set_sensitive (window, TRUE);
+                /* Files of the previous saves in the background are still
+                 * saved. */
+                if (!background)
+                {
+                    et_save_engine_stop (engine);
+                }
+
+                stopped = TRUE;
+                break;
+            }
 
-                if (currentPath)
+            if (flags & (ET_SAVE_ENGINE_WRITE_TAG | ET_SAVE_ENGINE_RENAME))
+            {
+                /* A file can only be queued once, so wait for the previous
+                 * save of a file which was edited while being saved. */
+                if (((ET_File *)l->data)->pending_saves > 0)
                 {
-                    gtk_tree_path_free (currentPath);
+                    et_save_engine_wait (engine);
                 }
-                return -1; /* We stop all actions */
+
+                et_save_engine_push (engine, (ET_File *)l->data, flags);
             }
+            else
+            {
+                /* Nothing to save, so the file is already done. */
+                state->nb_files_saved++;
+                Save_Progress_Update (state);
+            }
+        }
+    }
+
+    /* Rename the files of this save together, once their tags are written,
+     * so that they can take the names of each other. */
+    et_save_engine_flush_renames (engine);
+
+    if (background)
+    {
+        background_pushing = FALSE;
+
+        /* The files may all have been saved while asking confirmations. */
+        if (et_save_engine_get_n_pending (engine) == 0)
+        {
+            g_idle_add (on_save_background_idle, NULL);
         }
+
+        Main_Stop_Button_Pressed = FALSE;
+        action = g_action_map_lookup_action (G_ACTION_MAP (MainWindow),
+                                             "stop");
+        g_simple_action_set_enabled (G_SIMPLE_ACTION (action), FALSE);
+
+        if (!stopped)
+        {
+            et_application_window_status_bar_message (window,
+                                                      _("Saving files in the background"),
+                                                      TRUE);
+        }
+
+        /* Show the files which are being saved. */
+        et_application_window_browser_refresh_dirty_files (window);
+        et_application_window_update_actions (window);
+
+        return stopped ? -1 : TRUE;
+    }
+
+    /* The status bar and the browser are updated from the batches of
+     * results while waiting. */
+    et_save_engine_wait (engine);
+
+    if (state->error_dialog)
+    {
+        gtk_dialog_run (GTK_DIALOG (state->error_dialog));
+        gtk_widget_destroy (state->error_dialog);
+        stopped = TRUE;
+    }
+
+    if (et_save_engine_is_stopped (engine))
+    {
+        stopped = TRUE;
     }
 
-    if (currentPath)
-        gtk_tree_path_free(currentPath);
+    et_save_engine_free (engine);
+
+    if (stopped)
+    {
+        /* Stop saving files + reinit progress bar */
+        et_application_window_progress_set_text (window, "");
+        et_application_window_progress_set_fraction (window, 0.0);
+        et_application_window_status_bar_message (window,
+                                                  _("Saving files was stopped"),
+                                                  TRUE);
+        /* To update state of command buttons */
+        et_application_window_update_actions (window);
+        et_application_window_browser_set_sensitive (window, TRUE);
+        et_application_window_tag_area_set_sensitive (window, TRUE);
+        et_application_window_file_area_set_sensitive (window, TRUE);
+
+        return -1; /* We stop all actions */
+    }
 
     if (Main_Stop_Button_Pressed)
         msg = g_strdup (_("Saving files was stopped"));
@@ -368,21 +515,23 @@ Save_List_Of_Files (GList *etfilelist, gboolean force_saving_files)
     et_application_window_progress_set_fraction (window, 0.0);
     et_application_window_status_bar_message (window, msg, TRUE);
     g_free(msg);
-    et_application_window_browser_refresh_list (window);
+    et_application_window_browser_refresh_dirty_files (window);
     return TRUE;
 }
 
 
 
 /*
- * Save changes of the ETFile (write tag and rename file)
+ * Ask which changes of the ETFile to save (write tag and rename file), and
+ * return them in flags for the save engine.
  *  - multiple_files = TRUE  : when saving files, a msgbox appears with ability
  *                             to do the same action for all files.
  *  - multiple_files = FALSE : appears only a msgbox to ask confirmation.
+ * Returns -1 to stop saving files.
  */
 static gint
 Save_File (ET_File *ETFile, gboolean multiple_files,
-           gboolean force_saving_files)
+           gboolean force_saving_files, EtSaveEngineFlags *flags)
 {
     const File_Tag *FileTag;
     const File_Name *FileNameNew;
@@ -501,23 +650,15 @@ Save_File (ET_File *ETFile, gboolean multiple_files,
         switch (response)
         {
             case GTK_RESPONSE_YES:
-            {
-                gboolean rc;
+                *flags |= ET_SAVE_ENGINE_WRITE_TAG;
 
                 // if 'SF_HideMsgbox_Write_Tag is TRUE', then errors are displayed only in log
-                rc = Write_File_Tag(ETFile,SF_HideMsgbox_Write_Tag);
-                // if an error occurs when 'SF_HideMsgbox_Write_Tag is TRUE', we don't stop saving...
-                if (rc != TRUE && !SF_HideMsgbox_Write_Tag)
+                // and we don't stop saving...
+                if (!SF_HideMsgbox_Write_Tag)
                 {
-                    stop_loop = -1;
-
-                    g_free (basename_cur_utf8);
-                    g_free (basename_new_utf8);
-
-                    return stop_loop;
+                    *flags |= ET_SAVE_ENGINE_STOP_ON_TAG_ERROR;
                 }
                 break;
-            }
             case GTK_RESPONSE_NO:
                 break;
             case GTK_RESPONSE_CANCEL:
@@ -635,62 +776,15 @@ Save_File (ET_File *ETFile, gboolean multiple_files,
         switch(response)
         {
             case GTK_RESPONSE_YES:
-            {
-                gboolean rc;
-                GError *error = NULL;
-                const gchar *cur_filename = ((File_Name *)ETFile->FileNameCur->data)->value;
-                const gchar *new_filename = ((File_Name *)ETFile->FileNameNew->data)->value;
-                rc = et_rename_file (cur_filename, new_filename, &error);
+                *flags |= ET_SAVE_ENGINE_RENAME;
 
                 // if 'SF_HideMsgbox_Rename_File is TRUE', then errors are displayed only in log
-                if (!rc)
-                {
-                    if (!SF_HideMsgbox_Rename_File)
-                    {
-                        msgdialog = gtk_message_dialog_new (GTK_WINDOW (MainWindow),
-                                                            GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
-                                                            GTK_MESSAGE_ERROR,
-                                                            GTK_BUTTONS_CLOSE,
-                                                            _("Cannot rename file ‘%s’ to ‘%s’"),
-                                                            filename_cur_utf8,
-                                                            filename_new_utf8);
-                        gtk_message_dialog_format_secondary_text (GTK_MESSAGE_DIALOG (msgdialog),
-                                                                  "%s",
-                                                                  error->message);
-                        gtk_window_set_title (GTK_WINDOW (msgdialog),
-                                              _("Rename File Error"));
-
-                        gtk_dialog_run (GTK_DIALOG (msgdialog));
-                        gtk_widget_destroy (msgdialog);
-                    }
-
-                    Log_Print (LOG_ERROR,
-                               _("Cannot rename file ‘%s’ to ‘%s’: %s"),
-                               filename_cur_utf8, filename_new_utf8,
-                               error->message);
-
-                    et_application_window_status_bar_message (ET_APPLICATION_WINDOW (MainWindow),
-                                                              _("File(s) not renamed"),
-                                                              TRUE);
-                    g_error_free (error);
-                }
-
-                // if an error occurs when 'SF_HideMsgbox_Rename_File is TRUE', we don't stop saving...
-                if (!rc && !SF_HideMsgbox_Rename_File)
+                // and we don't stop saving...
+                if (!SF_HideMsgbox_Rename_File)
                 {
-                    stop_loop = -1;
-
-                    g_free (basename_cur_utf8);
-                    g_free (basename_new_utf8);
-
-                    return stop_loop;
+                    *flags |= ET_SAVE_ENGINE_STOP_ON_RENAME_ERROR;
                 }
-
-                /* Mark after renaming files. */
-                ETFile->FileNameCur = ETFile->FileNameNew;
-                ET_Mark_File_Name_As_Saved (ETFile);
                 break;
-            }
             case GTK_RESPONSE_NO:
                 break;
             case GTK_RESPONSE_CANCEL:
@@ -711,188 +805,348 @@ Save_File (ET_File *ETFile, gboolean multiple_files,
     g_free(basename_cur_utf8);
     g_free(basename_new_utf8);
 
-    /* Refresh file into browser list */
-    // Browser_List_Refresh_File_In_List(ETFile);
-
     return 1;
 }
 
 /*
- * et_rename_file:
- * @old_filepath: path of file to be renamed
- * @new_filepath: path of renamed file
- * @error: a #GError to provide information on errors, or %NULL to ignore
- *
- * Rename @old_filepath to @new_filepath.
- *
- * Returns: %TRUE if the rename was successful, %FALSE otherwise
+ * Update the progress bar from the number of files saved.
  */
-static gboolean
-et_rename_file (const char *old_filepath, const char *new_filepath,
-                GError **error)
+static void
+Save_Progress_Update (const EtSaveState *state)
 {
-    GFile *file_old;
-    GFile *file_new;
-    GFile *file_new_parent;
+    EtApplicationWindow *window;
+    gchar progress_bar_text[30];
 
-    g_return_val_if_fail (old_filepath != NULL && new_filepath != NULL, FALSE);
-    g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+    window = ET_APPLICATION_WINDOW (MainWindow);
 
-    file_old = g_file_new_for_path (old_filepath);
-    file_new = g_file_new_for_path (new_filepath);
-    file_new_parent = g_file_get_parent (file_new);
+    et_application_window_progress_set_fraction (window,
+                                                 state->nb_files_to_save > 0
+                                                 ? state->nb_files_saved / (double)state->nb_files_to_save
+                                                 : 0.0);
+    g_snprintf (progress_bar_text, 30, "%d/%d", state->nb_files_saved,
+                state->nb_files_to_save);
+    et_application_window_progress_set_text (window, progress_bar_text);
+}
+
+/*
+ * Report a batch of files saved by the save engine: log the errors, keep the
+ * first error which stopped saving to be displayed at the end, and update the
+ * status bar and the browser once for the whole batch.
+ */
+static void
+on_save_engine_results (EtSaveEngine *engine, GPtrArray *results,
+                        gpointer user_data)
+{
+    EtSaveState *state = user_data;
+    EtApplicationWindow *window;
+    const EtSaveEngineResult *last_written = NULL;
+    gboolean rename_failed = FALSE;
+    guint i;
 
-    if (!g_file_make_directory_with_parents (file_new_parent, NULL, error))
+    window = ET_APPLICATION_WINDOW (MainWindow);
+
+    for (i = 0; i < results->len; i++)
     {
-        /* Ignore an error if the directory already exists. */
-        if (!g_error_matches (*error, G_IO_ERROR, G_IO_ERROR_EXISTS))
+        const EtSaveEngineResult *result = g_ptr_array_index (results, i);
+
+        if (result->skipped)
         {
-            g_object_unref (file_new_parent);
-            goto err;
+            continue;
         }
 
-        g_clear_error (error);
-    }
+        state->nb_files_saved++;
 
-    g_assert (error == NULL || *error == NULL);
-    g_object_unref (file_new_parent);
-
-    /* Move the file. */
-    if (!g_file_move (file_old, file_new, G_FILE_COPY_NONE, NULL, NULL, NULL,
-                      error))
-    {
-        if (g_error_matches (*error, G_IO_ERROR, G_IO_ERROR_EXISTS))
+        if (result->tag_written)
+        {
+            last_written = result;
+        }
+        else if (result->tag_error)
         {
-            /* Possibly a case change on a case-insensitive filesystem. */
-            /* TODO: casefold the paths of both files, and check to see whether
-             * they only differ by case? */
-            gchar *tmp_filename;
-            mode_t old_mode;
-            gint fd;
-            GFile *tmp_file;
-            GError *tmp_error = NULL;
-
-            tmp_filename = g_strconcat (old_filepath, ".XXXXXX", NULL);
-
-            old_mode = umask (077);
-            fd = mkstemp (tmp_filename);
-            umask (old_mode);
-
-            if (fd >= 0)
+            Log_Print (LOG_ERROR, "%s", result->tag_error->message);
+
+            // if 'SF_HideMsgbox_Write_Tag' was TRUE, then errors are displayed only in log
+            if (result->flags & ET_SAVE_ENGINE_STOP_ON_TAG_ERROR
+                && !state->error_dialog)
             {
-                close (fd);
+                gchar *basename_utf8;
+
+                basename_utf8 = g_path_get_basename (result->filename_cur_utf8);
+                state->error_dialog = gtk_message_dialog_new (GTK_WINDOW (MainWindow),
+                                                              GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+                                                              GTK_MESSAGE_ERROR,
+                                                              GTK_BUTTONS_CLOSE,
+                                                              _("Cannot write tag in file ‘%s’"),
+                                                              basename_utf8);
+                gtk_message_dialog_format_secondary_text (GTK_MESSAGE_DIALOG (state->error_dialog),
+                                                          "%s",
+                                                          result->tag_error->message);
+                gtk_window_set_title (GTK_WINDOW (state->error_dialog),
+                                      _("Tag Write Error"));
+                g_free (basename_utf8);
             }
+        }
 
-            tmp_file = g_file_new_for_path (tmp_filename);
-            g_free (tmp_filename);
+        if (result->rename_error)
+        {
+            rename_failed = TRUE;
 
-            if (!g_file_move (file_old, tmp_file, G_FILE_COPY_OVERWRITE, NULL,
-                              NULL, NULL, &tmp_error))
-            {
-                g_file_delete (tmp_file, NULL, NULL);
+            Log_Print (LOG_ERROR,
+                       _("Cannot rename file ‘%s’ to ‘%s’: %s"),
+                       result->filename_cur_utf8, result->filename_new_utf8,
+                       result->rename_error->message);
 
-                g_object_unref (tmp_file);
-                g_clear_error (error);
-                g_propagate_error (error, tmp_error);
-                goto err;
-            }
-            else
+            // if 'SF_HideMsgbox_Rename_File' was TRUE, then errors are displayed only in log
+            if (result->flags & ET_SAVE_ENGINE_STOP_ON_RENAME_ERROR
+                && !state->error_dialog)
             {
-                /* Move to temporary file succeeded, now move to the real new
-                 * location. */
-                if (!g_file_move (tmp_file, file_new, G_FILE_COPY_NONE, NULL,
-                                  NULL, NULL, &tmp_error))
-                {
-                    g_file_move (tmp_file, file_old, G_FILE_COPY_NONE, NULL,
-                                 NULL, NULL, NULL);
-                    g_object_unref (tmp_file);
-                    g_clear_error (error);
-                    g_propagate_error (error, tmp_error);
-                    goto err;
-                }
-                else
-                {
-                    /* Move succeeded, so clear the original error about the
-                     * new file already existing. */
-                    g_object_unref (tmp_file);
-                    g_clear_error (error);
-                    goto out;
-                }
+                state->error_dialog = gtk_message_dialog_new (GTK_WINDOW (MainWindow),
+                                                              GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+                                                              GTK_MESSAGE_ERROR,
+                                                              GTK_BUTTONS_CLOSE,
+                                                              _("Cannot rename file ‘%s’ to ‘%s’"),
+                                                              result->filename_cur_utf8,
+                                                              result->filename_new_utf8);
+                gtk_message_dialog_format_secondary_text (GTK_MESSAGE_DIALOG (state->error_dialog),
+                                                          "%s",
+                                                          result->rename_error->message);
+                gtk_window_set_title (GTK_WINDOW (state->error_dialog),
+                                      _("Rename File Error"));
             }
         }
-        else
-        {
-            /* Error moving file. */
-            goto err;
-        }
     }
 
-out:
-    g_object_unref (file_old);
-    g_object_unref (file_new);
-    g_assert (error == NULL || *error == NULL);
-    return TRUE;
+    if (rename_failed)
+    {
+        et_application_window_status_bar_message (window,
+                                                  _("File(s) not renamed"),
+                                                  TRUE);
+    }
+    else if (last_written)
+    {
+        gchar *basename_utf8;
+        gchar *msg;
 
-err:
-    g_object_unref (file_old);
-    g_object_unref (file_new);
-    g_assert (error == NULL || *error != NULL);
-    return FALSE;
+        basename_utf8 = g_path_get_basename (last_written->filename_cur_utf8);
+        msg = g_strdup_printf (_("Wrote tag of ‘%s’"), basename_utf8);
+        et_application_window_status_bar_message (window, msg, TRUE);
+        g_free (msg);
+        g_free (basename_utf8);
+    }
+
+    Save_Progress_Update (state);
+
+    /* Show the saved state of the files of the batch. */
+    et_application_window_browser_refresh_dirty_files (window);
+
+    if (engine == background_engine
+        && et_save_engine_get_n_pending (engine) == 0)
+    {
+        /* The engine cannot be freed from its own callback. */
+        g_idle_add (on_save_background_idle, NULL);
+    }
 }
 
 /*
- * Write tag of the ETFile
- * Return TRUE => OK
- *        FALSE => error
+ * Free the engine of the files saved in the background, once they are all
+ * saved, and report the end of the save.
  */
+static void
+Save_Background_Finish (void)
+{
+    EtApplicationWindow *window;
+    gboolean stopped;
+
+    g_return_if_fail (background_engine != NULL);
+    g_return_if_fail (et_save_engine_get_n_pending (background_engine) == 0);
+
+    window = ET_APPLICATION_WINDOW (MainWindow);
+
+    stopped = et_save_engine_is_stopped (background_engine);
+    et_save_engine_free (background_engine);
+    background_engine = NULL;
+
+    et_application_window_progress_set_text (window, "");
+    et_application_window_progress_set_fraction (window, 0.0);
+    et_application_window_status_bar_message (window,
+                                              stopped ? _("Saving files was stopped")
+                                                      : _("All files have been saved"),
+                                              TRUE);
+    et_application_window_update_actions (window);
+    et_application_window_browser_refresh_dirty_files (window);
+
+    if (background_state.error_dialog)
+    {
+        /* Do not block the user, who may still be editing. */
+        gtk_window_set_modal (GTK_WINDOW (background_state.error_dialog),
+                              FALSE);
+        g_signal_connect (background_state.error_dialog, "response",
+                          G_CALLBACK (gtk_widget_destroy), NULL);
+        gtk_widget_show (background_state.error_dialog);
+        background_state.error_dialog = NULL;
+    }
+}
+
 static gboolean
-Write_File_Tag (ET_File *ETFile, gboolean hide_msgbox)
+on_save_background_idle (gpointer user_data)
 {
-    GError *error = NULL;
-    const gchar *cur_filename_utf8 = ((File_Name *)ETFile->FileNameCur->data)->value_utf8;
-    gchar *msg = NULL;
-    gchar *basename_utf8;
-    GtkWidget *msgdialog;
-
-    basename_utf8 = g_path_get_basename(cur_filename_utf8);
-    msg = g_strdup_printf (_("Writing tag of ‘%s’"),basename_utf8);
-    et_application_window_status_bar_message (ET_APPLICATION_WINDOW (MainWindow),
-                                              msg, TRUE);
-    g_free(msg);
-    msg = NULL;
+    /* More files may have been pushed since the idle was added. */
+    if (background_engine && !background_pushing
+        && et_save_engine_get_n_pending (background_engine) == 0)
+    {
+        Save_Background_Finish ();
+    }
 
-    if (ET_Save_File_Tag_To_HD (ETFile, &error))
+    return G_SOURCE_REMOVE;
+}
+
+/*
+ * et_save_background_wait:
+ *
+ * Wait for the files which are being saved in the background, before the
+ * files are freed or changed on disk by something else than the save.
+ */
+void
+et_save_background_wait (void)
+{
+    if (background_engine == NULL || background_pushing)
     {
-        msg = g_strdup_printf (_("Wrote tag of ‘%s’"), basename_utf8);
-        et_application_window_status_bar_message (ET_APPLICATION_WINDOW (MainWindow),
-                                                  msg, TRUE);
-        g_free (msg);
-        g_free (basename_utf8);
-        return TRUE;
+        return;
     }
 
-    Log_Print (LOG_ERROR, "%s", error->message);
+    et_save_engine_wait (background_engine);
+    Save_Background_Finish ();
+}
+
+/*
+ * Replace the duration of a file, estimated from its first frames, by its
+ * exact duration once all its frames were scanned.
+ */
+static void
+on_duration_scanned (guint key,
+                     gint duration,
+                     guint errors,
+                     gpointer user_data)
+{
+    ET_File *ETFile;
+    ET_File_Info *info;
 
-    if (!hide_msgbox)
+    if (duration_scan_files == NULL
+        || !(ETFile = g_hash_table_lookup (duration_scan_files,
+                                           GUINT_TO_POINTER (key))))
     {
-        msgdialog = gtk_message_dialog_new(GTK_WINDOW(MainWindow),
-                             GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
-                             GTK_MESSAGE_ERROR,
-                             GTK_BUTTONS_CLOSE,
-                             _("Cannot write tag in file ‘%s’"),
-                             basename_utf8);
-        gtk_message_dialog_format_secondary_text (GTK_MESSAGE_DIALOG (msgdialog),
-                                                  "%s", error->message);
-        gtk_window_set_title(GTK_WINDOW(msgdialog),_("Tag Write Error"));
+        /* The file was removed from the list. */
+        return;
+    }
 
-        gtk_dialog_run(GTK_DIALOG(msgdialog));
-        gtk_widget_destroy(msgdialog);
+    g_hash_table_remove (duration_scan_files, GUINT_TO_POINTER (key));
+
+    info = ETFile->ETFileInfo;
+
+    if (et_displayed_file_list_contains (ETFile))
+    {
+        ETCore->ETFileDisplayedList_TotalDuration += duration - info->duration;
+    }
+
+    info->duration = duration;
+
+    if (errors > 0)
+    {
+        const gchar *filename_utf8;
+
+        filename_utf8 = ((File_Name *)ETFile->FileNameCur->data)->value_utf8;
+        Log_Print (LOG_WARNING,
+                   ngettext ("Found one sync error or corrupt frame in file ‘%s’",
+                             "Found %u sync errors or corrupt frames in file ‘%s’",
+                             errors),
+                   errors, filename_utf8);
+    }
+
+#ifdef ENABLE_MP3
+    if (ETFile == ETCore->ETFileDisplayed)
+    {
+        EtFileHeaderFields *fields;
+
+        fields = et_mpeg_header_display_file_info_to_ui (ETFile);
+        et_application_window_file_area_set_header_fields (ET_APPLICATION_WINDOW (MainWindow),
+                                                           fields);
+        et_mpeg_file_header_fields_free (fields);
+    }
+#endif /* ENABLE_MP3 */
+}
+
+/*
+ * Queue the MPEG files of the file list, to find their exact duration in the
+ * background.
+ */
+static void
+Scan_Durations (void)
+{
+    GList *l;
+
+    g_return_if_fail (duration_scanner == NULL);
+
+    for (l = ETCore->ETFileList; l != NULL; l = g_list_next (l))
+    {
+        ET_File *ETFile = l->data;
+
+        switch (ETFile->ETFileDescription->FileType)
+        {
+            case MP3_FILE:
+            case MP2_FILE:
+                if (duration_scanner == NULL)
+                {
+                    duration_scanner = et_duration_scanner_new (on_duration_scanned,
+                                                                NULL);
+                    duration_scan_files = g_hash_table_new (NULL, NULL);
+                }
+
+                g_hash_table_insert (duration_scan_files,
+                                     GUINT_TO_POINTER (ETFile->ETFileKey),
+                                     ETFile);
+                et_duration_scanner_push (duration_scanner, ETFile->ETFileKey,
+                                          ((File_Name *)ETFile->FileNameCur->data)->value);
+                break;
+            default:
+                break;
+        }
     }
+}
 
-    g_clear_error (&error);
-    g_free(basename_utf8);
+/*
+ * et_duration_scan_stop:
+ *
+ * Stop finding the exact duration of files, before the file list is freed.
+ */
+void
+et_duration_scan_stop (void)
+{
+    if (duration_scanner)
+    {
+        et_duration_scanner_free (duration_scanner);
+        duration_scanner = NULL;
+    }
 
-    return FALSE;
+    if (duration_scan_files)
+    {
+        g_hash_table_destroy (duration_scan_files);
+        duration_scan_files = NULL;
+    }
+}
+
+/*
+ * et_duration_scan_remove_file:
+ * @ETFile: a file which is being removed from the file list
+ *
+ * Forget @ETFile, so that its exact duration is not stored once it is freed.
+ */
+void
+et_duration_scan_remove_file (const ET_File *ETFile)
+{
+    if (duration_scan_files)
+    {
+        g_hash_table_remove (duration_scan_files,
+                             GUINT_TO_POINTER (ETFile->ETFileKey));
+    }
 }
 
 /*
@@ -921,6 +1175,10 @@ Read_Directory (const gchar *path_real)
 
     g_return_val_if_fail (path_real != NULL, FALSE);
 
+    /* The files which are being saved are freed with the file list. */
+    et_save_background_wait ();
+    et_duration_scan_stop ();
+
     ReadingDirectory = TRUE;    /* A flag to avoid to start another reading */
 
     /* Initialize file list */
@@ -1086,6 +1344,12 @@ Read_Directory (const gchar *path_real)
             msg = g_strdup(_("No file found in this directory"));
     }
 
+    if (ETCore->ETFileList
+        && g_settings_get_boolean (MainSettings, "file-scan-exact-duration"))
+    {
+        Scan_Durations ();
+    }
+
     /* Update sensitivity of buttons and menus */
     et_application_window_update_actions (window);
 
@@ -52,6 +52,9 @@ extern gboolean ReadingDirectory;
 void Action_Save_Selected_Files         (void);
 void Action_Force_Saving_Selected_Files (void);
 gint Save_All_Files_With_Answer         (gboolean force_saving_files);
+void et_save_background_wait           (void);
+void et_duration_scan_stop             (void);
+void et_duration_scan_remove_file      (const ET_File *ETFile);
 
 void Action_Main_Stop_Button_Pressed    (void);
 
@@ -45,6 +45,13 @@ ET_Core_Free (void)
 {
     g_return_if_fail (ETCore != NULL);
 
+    /* The dirty set only contains pointers into the file list. */
+    if (ETCore->ETFileDirtySet)
+    {
+        g_hash_table_destroy (ETCore->ETFileDirtySet);
+        ETCore->ETFileDirtySet = NULL;
+    }
+
     /* First frees lists. */
     if (ETCore->ETFileList)
     {
@@ -70,6 +77,19 @@ ET_Core_Free (void)
         ETCore->ETArtistAlbumFileList = NULL;
     }
 
+    /* Left over if the list was empty. */
+    if (ETCore->ETArtistAlbumFileIndex)
+    {
+        g_hash_table_destroy (ETCore->ETArtistAlbumFileIndex);
+        ETCore->ETArtistAlbumFileIndex = NULL;
+    }
+
+    if (ETCore->ETArtistAlbumArtistIndex)
+    {
+        g_hash_table_destroy (ETCore->ETArtistAlbumArtistIndex);
+        ETCore->ETArtistAlbumArtistIndex = NULL;
+    }
+
     if (ETCore)
     {
         g_slice_free (ET_Core, ETCore);
@@ -43,6 +43,8 @@ typedef struct
 
     // The list of files organized by artist then album
     GList *ETArtistAlbumFileList;
+    GHashTable *ETArtistAlbumFileIndex;   // Position of each ET_File in ETArtistAlbumFileList
+    GHashTable *ETArtistAlbumArtistIndex; // Node of each artist in ETArtistAlbumFileList
 
     // Displayed list (part of the main list of files displayed in BrowserList) (used when displaying by Artist & Album) 
     GList *ETFileDisplayedList;                 // List of files displayed (List of ET_File from ETFileList / ATArtistAlbumFileList) | !! May not point to the first item!!
@@ -50,6 +52,7 @@ typedef struct
     guint  ETFileDisplayedList_Length;          // Contains the length of the displayed list
     gfloat ETFileDisplayedList_TotalSize;       // Total of the size of files in displayed list (in bytes)
     gulong ETFileDisplayedList_TotalDuration;   // Total of duration of files in displayed list (in seconds)
+    guint  ETFileDisplayedList_Serial;          // Changed each time the displayed list is set (see ET_File displayed_serial)
 
     // Displayed item
     ET_File *ETFileDisplayed;           // Pointer to the current ETFile displayed in EasyTAG (may be NULL)
@@ -57,6 +60,9 @@ typedef struct
 
     // History list
     GList *ETHistoryFileList;           // History list of files changes for undo/redo actions
+
+    // Dirty set
+    GHashTable *ETFileDirtySet;         // Set of ET_File changed since the last refresh of the BrowserList (see et_browser_refresh_dirty_files)
 } ET_Core;
 
 extern ET_Core *ETCore; /* Main pointer to structure needed by EasyTAG. */
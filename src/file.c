@@ -77,8 +77,6 @@ static EtFileHeaderFields * ET_Display_File_Info_To_UI (const ET_File *ETFile);
 static gboolean ET_Save_File_Name_From_UI (const ET_File *ETFile,
                                            File_Name *FileName);
 
-static void ET_Mark_File_Tag_As_Saved (ET_File *ETFile);
-
 static gboolean ET_Add_File_Name_To_List (ET_File *ETFile,
                                           File_Name *FileName);
 static gboolean ET_Add_File_Tag_To_List (ET_File *ETFile, File_Tag  *FileTag);
@@ -1119,7 +1117,7 @@ ET_Display_File_Data_To_UI (ET_File *ETFile)
     /* Display file data, header data and file type */
     switch (description->FileType)
     {
-#if defined ENABLE_MP3 && defined ENABLE_ID3LIB
+#ifdef ENABLE_MP3
         case MP3_FILE:
         case MP2_FILE:
             fields = et_mpeg_header_display_file_info_to_ui (ETFile);
@@ -1714,10 +1712,22 @@ ET_Save_File_Tag_Internal (ET_File *ETFile, File_Tag *FileTag)
 
 
 /*
- * Save data contained into File_Tag structure to the file on hard disk.
+ * et_file_write_tag:
+ * @ETFile: the file to write the tag of
+ * @modification_time: (out) (allow-none): the modification time of the file
+ *                     after writing, or %NULL to ignore
+ * @error: a #GError to provide information on errors, or %NULL to ignore
+ *
+ * Write the current tag of @ETFile to disk, without marking it as saved. This
+ * does not touch the UI or the file lists, so it may be called from the
+ * worker threads of the save engine, as long as nothing else modifies @ETFile
+ * at the same time.
+ *
+ * Returns: %TRUE if the tag was written, %FALSE otherwise
  */
 gboolean
-ET_Save_File_Tag_To_HD (ET_File *ETFile, GError **error)
+et_file_write_tag (ET_File *ETFile, guint64 *modification_time,
+                   GError **error)
 {
     const ET_File_Description *description;
     const gchar *cur_filename;
@@ -1776,9 +1786,9 @@ ET_Save_File_Tag_To_HD (ET_File *ETFile, GError **error)
 #endif
         case UNKNOWN_TAG:
         default:
-            Log_Print (LOG_ERROR,
-                       "Saving to HD: Undefined function for tag type '%d' (file %s).",
-                       (gint)description->TagType, cur_filename_utf8);
+            g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                         "Saving to HD: Undefined function for tag type '%d' (file %s).",
+                         (gint)description->TagType, cur_filename_utf8);
             state = FALSE;
             break;
     }
@@ -1805,8 +1815,12 @@ ET_Save_File_Tag_To_HD (ET_File *ETFile, GError **error)
 
     if (fileinfo)
     {
-        ETFile->FileModificationTime = g_file_info_get_attribute_uint64 (fileinfo,
-                                                                         G_FILE_ATTRIBUTE_TIME_MODIFIED);
+        if (modification_time)
+        {
+            *modification_time = g_file_info_get_attribute_uint64 (fileinfo,
+                                                                   G_FILE_ATTRIBUTE_TIME_MODIFIED);
+        }
+
         g_object_unref (fileinfo);
     }
 
@@ -1828,7 +1842,6 @@ ET_Save_File_Tag_To_HD (ET_File *ETFile, GError **error)
             g_free (path);
         }
 
-        ET_Mark_File_Tag_As_Saved(ETFile);
         return TRUE;
     }
     else
@@ -1839,6 +1852,24 @@ ET_Save_File_Tag_To_HD (ET_File *ETFile, GError **error)
     }
 }
 
+/*
+ * Save data contained into File_Tag structure to the file on hard disk.
+ */
+gboolean
+ET_Save_File_Tag_To_HD (ET_File *ETFile, GError **error)
+{
+    g_return_val_if_fail (ETFile != NULL, FALSE);
+    g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+    if (!et_file_write_tag (ETFile, &ETFile->FileModificationTime, error))
+    {
+        return FALSE;
+    }
+
+    ET_Mark_File_Tag_As_Saved (ETFile);
+    return TRUE;
+}
+
 /*
  * Check if 'FileName' and 'FileTag' differ with those of 'ETFile'.
  * Manage undo feature for the ETFile and the main undo list.
@@ -1894,6 +1925,7 @@ ET_Manage_Changes_Of_File_Data (ET_File *ETFile,
     {
         ETCore->ETHistoryFileList = et_history_list_add (ETCore->ETHistoryFileList,
                                                          ETFile);
+        et_dirty_file_list_add (ETFile);
     }
 
     //return TRUE;
@@ -2000,6 +2032,11 @@ gboolean ET_Undo_File_Data (ET_File *ETFile)
         has_filetag_undo_data  = TRUE;
     }
 
+    if (has_filename_undo_data || has_filetag_undo_data)
+    {
+        et_dirty_file_list_add (ETFile);
+    }
+
     return has_filename_undo_data | has_filetag_undo_data;
 }
 
@@ -2061,6 +2098,11 @@ gboolean ET_Redo_File_Data (ET_File *ETFile)
         has_filetag_redo_data  = TRUE;
     }
 
+    if (has_filename_redo_data || has_filetag_redo_data)
+    {
+        et_dirty_file_list_add (ETFile);
+    }
+
     return has_filename_redo_data | has_filetag_redo_data;
 }
 
@@ -2126,7 +2168,7 @@ Set_Saved_Value_Of_File_Tag (File_Tag *FileTag, gboolean saved)
     if (FileTag) FileTag->saved = saved;
 }
 
-static void
+void
 ET_Mark_File_Tag_As_Saved (ET_File *ETFile)
 {
     File_Tag *FileTag;
@@ -2136,6 +2178,8 @@ ET_Mark_File_Tag_As_Saved (ET_File *ETFile)
     FileTagList = ETFile->FileTagList;
     g_list_foreach(FileTagList,(GFunc)Set_Saved_Value_Of_File_Tag,FALSE); // All other FileTag set to FALSE
     FileTag->saved = TRUE; // The current FileTag set to TRUE
+
+    et_dirty_file_list_add (ETFile);
 }
 
 
@@ -2148,6 +2192,76 @@ void ET_Mark_File_Name_As_Saved (ET_File *ETFile)
     FileNameList = ETFile->FileNameList;
     g_list_foreach(FileNameList,(GFunc)Set_Saved_Value_Of_File_Tag,FALSE);
     FileNameNew->saved = TRUE;
+
+    et_dirty_file_list_add (ETFile);
+}
+
+/*
+ * et_file_mark_saved_tag:
+ * @ETFile: the file
+ * @FileTag: the tag which was written to the file
+ *
+ * Mark @FileTag as the tag on disk. If the file was edited while it was
+ * being saved, @FileTag is older than the current tag, which then stays
+ * unsaved.
+ *
+ * Returns: %TRUE if @FileTag is in the history of @ETFile, %FALSE otherwise
+ */
+gboolean
+et_file_mark_saved_tag (ET_File *ETFile, const File_Tag *FileTag)
+{
+    GList *l;
+
+    g_return_val_if_fail (ETFile != NULL, FALSE);
+
+    l = g_list_find (ETFile->FileTagList, FileTag);
+
+    if (l == NULL)
+    {
+        return FALSE;
+    }
+
+    g_list_foreach (ETFile->FileTagList, (GFunc)Set_Saved_Value_Of_File_Tag,
+                    FALSE);
+    ((File_Tag *)l->data)->saved = TRUE;
+
+    et_dirty_file_list_add (ETFile);
+
+    return TRUE;
+}
+
+/*
+ * et_file_mark_saved_name:
+ * @ETFile: the file
+ * @FileName: the filename which the file was renamed to
+ *
+ * Mark @FileName as the current filename on disk. If the file was renamed
+ * again while it was being saved, the newer filename stays unsaved.
+ *
+ * Returns: %TRUE if @FileName is in the history of @ETFile, %FALSE otherwise
+ */
+gboolean
+et_file_mark_saved_name (ET_File *ETFile, const File_Name *FileName)
+{
+    GList *l;
+
+    g_return_val_if_fail (ETFile != NULL, FALSE);
+
+    l = g_list_find (ETFile->FileNameList, FileName);
+
+    if (l == NULL)
+    {
+        return FALSE;
+    }
+
+    ETFile->FileNameCur = l;
+    g_list_foreach (ETFile->FileNameList, (GFunc)Set_Saved_Value_Of_File_Tag,
+                    FALSE);
+    ((File_Name *)l->data)->saved = TRUE;
+
+    et_dirty_file_list_add (ETFile);
+
+    return TRUE;
 }
 
 /*
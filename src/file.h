@@ -52,6 +52,9 @@ typedef struct
     GList *FileTag;           /* Points to the current item used of FileTagList */
     GList *FileTagList;       /* Contains the history of changes about file tag data */
     GList *FileTagListBak;    /* Contains items of FileTagList removed by 'undo' procedure but have data currently saved */
+
+    guint pending_saves;      /* Number of saves of the file queued in the save engine, only accessed from the main thread */
+    guint displayed_serial;   /* Value of ETCore->ETFileDisplayedList_Serial when the file was in the displayed list (see et_displayed_file_list_contains) */
 } ET_File;
 
 /*
@@ -71,6 +74,8 @@ void ET_Display_File_Data_To_UI (ET_File *ETFile);
 void ET_Save_File_Data_From_UI (ET_File *ETFile);
 gboolean ET_Save_File_Name_Internal (const ET_File *ETFile, File_Name *FileName);
 gboolean ET_Save_File_Tag_To_HD (ET_File *ETFile, GError **error);
+gboolean et_file_write_tag (ET_File *ETFile, guint64 *modification_time,
+                            GError **error);
 gboolean ET_Save_File_Tag_Internal (ET_File *ETFile, File_Tag *FileTag);
 
 guint ET_Undo_Key_New (void);
@@ -81,7 +86,10 @@ gboolean ET_File_Data_Has_Undo_Data (const ET_File *ETFile);
 gboolean ET_File_Data_Has_Redo_Data (const ET_File *ETFile);
 
 gboolean ET_Manage_Changes_Of_File_Data (ET_File *ETFile, File_Name *FileName, File_Tag *FileTag);
+void ET_Mark_File_Tag_As_Saved (ET_File *ETFile);
 void ET_Mark_File_Name_As_Saved (ET_File *ETFile);
+gboolean et_file_mark_saved_tag (ET_File *ETFile, const File_Tag *FileTag);
+gboolean et_file_mark_saved_name (ET_File *ETFile, const File_Name *FileName);
 gchar *ET_File_Name_Generate (const ET_File *ETFile, const gchar *new_file_name);
 
 gint ET_Comp_Func_Sort_File_By_Ascending_Filename (const ET_File *ETFile1, const ET_File *ETFile2);
@@ -131,6 +131,19 @@ et_artist_album_file_list_free (GList *file_list)
     }
 
     g_list_free (file_list);
+
+    /* The index refers to the nodes of the list. */
+    if (ETCore->ETArtistAlbumFileIndex)
+    {
+        g_hash_table_destroy (ETCore->ETArtistAlbumFileIndex);
+        ETCore->ETArtistAlbumFileIndex = NULL;
+    }
+
+    if (ETCore->ETArtistAlbumArtistIndex)
+    {
+        g_hash_table_destroy (ETCore->ETArtistAlbumArtistIndex);
+        ETCore->ETArtistAlbumArtistIndex = NULL;
+    }
 }
 
 /* Key for each item of ETFileList */
@@ -209,6 +222,12 @@ et_file_list_add (GList *file_list,
     const gchar  *locale_lc_ctype = getenv("LC_CTYPE");
     GError *error = NULL;
     gboolean success;
+    /* Where the audio starts, after any ID3v2 tag. */
+    goffset audio_offset = 0;
+    /* Whether the header was read along with the tag. */
+    gboolean file_info_read = FALSE;
+    /* Error from reading the header along with the tag, if any. */
+    GError *file_info_error = NULL;
 
     g_return_val_if_fail (filename != NULL, file_list);
 
@@ -234,6 +253,9 @@ et_file_list_add (GList *file_list,
     FileTag = et_file_tag_new ();
     FileTag->saved = TRUE;    /* The file hasn't been changed, so it's saved */
 
+    /* Some tag readers fill the ET_File_Info structure too. */
+    ETFileInfo = et_file_info_new ();
+
     /* Patch from Doruk Fisek and Onur Kucuk: avoid upper/lower conversion bugs
      * (like I->i conversion in some locales) in tag parsing. The problem occurs
      * for example with Turkish language where it can't read 'TITLE=' field if
@@ -244,7 +266,7 @@ et_file_list_add (GList *file_list,
     {
 #ifdef ENABLE_MP3
         case ID3_TAG:
-            if (!id3tag_read_file_tag (file, FileTag, &error))
+            if (!id3tag_read_file_tag (file, FileTag, &audio_offset, &error))
             {
                 Log_Print (LOG_ERROR,
                            "Error reading ID3 tag from file ‘%s’: %s",
@@ -266,7 +288,10 @@ et_file_list_add (GList *file_list,
 #endif
 #ifdef ENABLE_FLAC
         case FLAC_TAG:
-            if (!flac_tag_read_file_tag (file, FileTag, &error))
+            /* The header is read separately if the tag could not be read,
+             * or if there was no STREAMINFO block to fill it from. */
+            if (!flac_tag_read_file_tag (file, FileTag, ETFileInfo,
+                                         &file_info_read, &error))
             {
                 Log_Print (LOG_ERROR,
                            _("Error reading tag from FLAC file ‘%s’: %s"),
@@ -286,13 +311,18 @@ et_file_list_add (GList *file_list,
             break;
 #ifdef ENABLE_MP4
         case MP4_TAG:
-            if (!mp4tag_read_file_tag (file, FileTag, &error))
+            if (!mp4tag_read_file_tag (file, FileTag, ETFileInfo,
+                                       &file_info_error, &error))
             {
                 Log_Print (LOG_ERROR,
                            _("Error reading tag from MP4 file ‘%s’: %s"),
                            filename_utf8, error->message);
                 g_clear_error (&error);
             }
+            else
+            {
+                file_info_read = TRUE;
+            }
             break;
 #endif
 #ifdef ENABLE_WAVPACK
@@ -308,13 +338,18 @@ et_file_list_add (GList *file_list,
 #endif
 #ifdef ENABLE_OPUS
         case OPUS_TAG:
-            if (!et_opus_tag_read_file_tag (file, FileTag, &error))
+            if (!et_opus_tag_read_file_tag (file, FileTag, ETFileInfo,
+                                            &error))
             {
                 Log_Print (LOG_ERROR,
                            _("Error reading tag from Opus file ‘%s’: %s"),
                            filename_utf8, error->message);
                 g_clear_error (&error);
             }
+            else
+            {
+                file_info_read = TRUE;
+            }
             break;
 #endif
         case UNKNOWN_TAG:
@@ -334,14 +369,13 @@ et_file_list_add (GList *file_list,
     }
 
     /* Fill the ET_File_Info structure */
-    ETFileInfo = et_file_info_new ();
-
     switch (description->FileType)
     {
-#if defined ENABLE_MP3 && defined ENABLE_ID3LIB
+#ifdef ENABLE_MP3
         case MP3_FILE:
         case MP2_FILE:
-            success = et_mpeg_header_read_file_info (file, ETFileInfo, &error);
+            success = et_mpeg_header_read_file_info (file, audio_offset,
+                                                     ETFileInfo, &error);
             break;
 #endif
 #ifdef ENABLE_OGG
@@ -357,7 +391,15 @@ et_file_list_add (GList *file_list,
 #endif
 #ifdef ENABLE_FLAC
         case FLAC_FILE:
-            success = et_flac_header_read_file_info (file, ETFileInfo, &error);
+            if (file_info_read)
+            {
+                success = TRUE;
+            }
+            else
+            {
+                success = et_flac_header_read_file_info (file, ETFileInfo,
+                                                         &error);
+            }
             break;
 #endif
         case MPC_FILE:
@@ -374,12 +416,35 @@ et_file_list_add (GList *file_list,
 #endif
 #ifdef ENABLE_MP4
         case MP4_FILE:
-            success = et_mp4_header_read_file_info (file, ETFileInfo, &error);
+            if (file_info_read)
+            {
+                /* Report a header error from the tag read, without parsing
+                 * the file again. */
+                success = (file_info_error == NULL);
+
+                if (!success)
+                {
+                    g_propagate_error (&error, file_info_error);
+                    file_info_error = NULL;
+                }
+            }
+            else
+            {
+                success = et_mp4_header_read_file_info (file, ETFileInfo,
+                                                        &error);
+            }
             break;
 #endif
 #ifdef ENABLE_OPUS
         case OPUS_FILE:
-            success = et_opus_read_file_info (file, ETFileInfo, &error);
+            if (file_info_read)
+            {
+                success = TRUE;
+            }
+            else
+            {
+                success = et_opus_read_file_info (file, ETFileInfo, &error);
+            }
             break;
 #endif
         case OFR_FILE:
@@ -402,6 +467,8 @@ et_file_list_add (GList *file_list,
         g_error_free (error);
     }
 
+    g_clear_error (&file_info_error);
+
     /* Restore previous value */
     setlocale(LC_CTYPE, locale_lc_ctype ? locale_lc_ctype : "");
 
@@ -479,63 +546,103 @@ et_file_list_add (GList *file_list,
 }
 
 /*
- * Comparison function for sorting by ascending artist in the ArtistAlbumList.
+ * EtArtistAlbumEntry:
+ * @artist: the artist under which the file is filed
+ * @album: the album under which the file is filed
+ * @artist_link: the node of the artist in ETArtistAlbumFileList
+ * @album_link: the node of the album in the list of albums of @artist_link
+ *
+ * Position of a file in ETArtistAlbumFileList. The artist and album are those
+ * of the tag when the file was filed, so that the file can still be found
+ * after its tag changed.
+ */
+typedef struct
+{
+    gchar *artist;
+    gchar *album;
+    GList *artist_link;
+    GList *album_link;
+} EtArtistAlbumEntry;
+
+static void
+et_artist_album_entry_free (EtArtistAlbumEntry *entry)
+{
+    g_free (entry->artist);
+    g_free (entry->album);
+    g_slice_free (EtArtistAlbumEntry, entry);
+}
+
+/*
+ * Hash and equality functions for artist names, which may be %NULL.
+ */
+static guint
+et_artist_album_name_hash (gconstpointer name)
+{
+    return name ? g_str_hash (name) : 0;
+}
+
+static gboolean
+et_artist_album_name_equal (gconstpointer name1, gconstpointer name2)
+{
+    return g_strcmp0 (name1, name2) == 0;
+}
+
+/*
+ * Compare two artist or album names, sorting a missing name first.
  */
 static gint
-ET_Comp_Func_Sort_Artist_Item_By_Ascending_Artist (const GList *AlbumList1,
-                                                   const GList *AlbumList2)
+et_artist_album_name_compare (const gchar *name1, const gchar *name2)
 {
-    const GList *etfilelist1 = NULL;
-    const GList *etfilelist2 = NULL;
-    const ET_File *etfile1 = NULL;
-    const ET_File *etfile2 = NULL;
-    const gchar *etfile1_artist;
-    const gchar *etfile2_artist;
-
-    if (!AlbumList1
-    || !(etfilelist1    = (GList *)AlbumList1->data)
-    || !(etfile1        = (ET_File *)etfilelist1->data)
-    || !(etfile1_artist = ((File_Tag *)etfile1->FileTag->data)->artist) )
-        return -1;
-
-    if (!AlbumList2
-    || !(etfilelist2    = (GList *)AlbumList2->data)
-    || !(etfile2        = (ET_File *)etfilelist2->data)
-    || !(etfile2_artist = ((File_Tag *)etfile2->FileTag->data)->artist) )
-        return 1;
+    if (!name1) return -1;
+    if (!name2) return  1;
 
     /*if (g_settings_get_boolean (MainSettings, "sort-case-sensitive"))
-     *    return strcmp(etfile1_artist,etfile2_artist); */
+     *    return strcmp(name1,name2); */
     //else
-        return strcasecmp(etfile1_artist,etfile2_artist);
+        return strcasecmp (name1, name2);
 }
 
 /*
- * Comparison function for sorting by ascending album in the ArtistAlbumList.
+ * Return the position of the first file of @etfilelist, which gives the artist
+ * and album of the whole list.
+ */
+static const EtArtistAlbumEntry *
+et_artist_album_list_get_entry (const GList *etfilelist)
+{
+    return g_hash_table_lookup (ETCore->ETArtistAlbumFileIndex,
+                                g_list_first ((GList *)etfilelist)->data);
+}
+
+/*
+ * Comparison function for sorting by ascending artist in the ArtistAlbumList.
  */
 static gint
-ET_Comp_Func_Sort_Album_Item_By_Ascending_Album (const GList *etfilelist1,
-                                                 const GList *etfilelist2)
+et_artist_album_list_compare_artists (gconstpointer AlbumList1,
+                                      gconstpointer AlbumList2)
 {
-    const ET_File *etfile1;
-    const ET_File *etfile2;
-    const gchar *etfile1_album;
-    const gchar *etfile2_album;
+    const EtArtistAlbumEntry *entry1;
+    const EtArtistAlbumEntry *entry2;
 
-    if (!etfilelist1
-    || !(etfile1        = (ET_File *)etfilelist1->data)
-    || !(etfile1_album  = ((File_Tag *)etfile1->FileTag->data)->album) )
-        return -1;
+    entry1 = et_artist_album_list_get_entry (((const GList *)AlbumList1)->data);
+    entry2 = et_artist_album_list_get_entry (((const GList *)AlbumList2)->data);
 
-    if (!etfilelist2
-    || !(etfile2        = (ET_File *)etfilelist2->data)
-    || !(etfile2_album  = ((File_Tag *)etfile2->FileTag->data)->album) )
-        return 1;
+    return et_artist_album_name_compare (entry1->artist, entry2->artist);
+}
 
-    /*if (g_settings_get_boolean (MainSettings, "sort-case-sensitive"))
-     *    return strcmp(etfile1_album,etfile2_album); */
-    //else
-        return strcasecmp(etfile1_album,etfile2_album);
+/*
+ * Comparison function for sorting by ascending album in the ArtistAlbumList.
+ */
+static gint
+et_artist_album_list_compare_albums (gconstpointer etfilelist1,
+                                     gconstpointer etfilelist2)
+{
+    const EtArtistAlbumEntry *entry1;
+    const EtArtistAlbumEntry *entry2;
+
+    entry1 = et_artist_album_list_get_entry (etfilelist1);
+    entry2 = et_artist_album_list_get_entry (etfilelist2);
+
+    return et_artist_album_name_compare (entry1->album, entry2->album);
 }
 
 /*
@@ -553,108 +660,262 @@ ET_Comp_Func_Sort_Etfile_Item_By_Ascending_Filename (const ET_File *ETFile1,
     return ET_Comp_Func_Sort_File_By_Ascending_Filename(ETFile1,ETFile2);
 }
 
+/*
+ * Insert @data into the sorted @list, after the items which compare equal, and
+ * return the new node.
+ */
+static GList *
+et_list_insert_sorted_link (GList **list,
+                            gpointer data,
+                            GCompareFunc func)
+{
+    GList *prev = NULL;
+    GList *next;
+    GList *link;
+
+    for (next = *list; next != NULL; next = g_list_next (next))
+    {
+        if (func (data, next->data) < 0)
+        {
+            break;
+        }
+
+        prev = next;
+    }
+
+    link = g_list_alloc ();
+    link->data = data;
+    link->prev = prev;
+    link->next = next;
+
+    if (prev)
+    {
+        prev->next = link;
+    }
+    else
+    {
+        *list = link;
+    }
+
+    if (next)
+    {
+        next->prev = link;
+    }
+
+    return link;
+}
+
 /*
  * The ETArtistAlbumFileList contains 3 levels of lists to sort the ETFile by artist then by album :
  *  - "ETArtistAlbumFileList" list is a list of "ArtistList" items,
  *  - "ArtistList" list is a list of "AlbumList" items,
  *  - "AlbumList" list is a list of ETFile items.
+ * The position of each ETFile is kept in ETCore->ETArtistAlbumFileIndex, and
+ * the node of each artist in ETCore->ETArtistAlbumArtistIndex, so that a file
+ * can be filed or moved without walking the lists.
+ * If @keep_sorted is %FALSE, the lists must be sorted once all the files are
+ * added, see et_artist_album_list_new_from_file_list().
  * Note : use the function ET_Debug_Print_Artist_Album_List(...) to understand how it works, it needed...
  */
-static GList *
-et_artist_album_list_add_file (GList *file_list,
-                               ET_File *ETFile)
+static void
+et_artist_album_list_link_file (GList **file_list,
+                                ET_File *ETFile,
+                                gboolean keep_sorted,
+                                EtArtistAlbumMove *move)
 {
-    const gchar *ETFile_Artist;
-    const gchar *ETFile_Album;
-    const gchar *etfile_artist;
-    const gchar *etfile_album;
-    GList *ArtistList;
-    GList *AlbumList = NULL;
-    GList *etfilelist = NULL;
-    GList *result;
-    ET_File *etfile = NULL;
+    const File_Tag *FileTag;
+    EtArtistAlbumEntry *entry;
+    GList *AlbumList;
+    GList *etfilelist;
+
+    g_return_if_fail (ETFile != NULL);
+
+    FileTag = (File_Tag *)ETFile->FileTag->data;
 
-    g_return_val_if_fail (ETFile != NULL, NULL);
+    /* Index the file first, as the comparison functions look up its
+     * position. */
+    entry = g_slice_new (EtArtistAlbumEntry);
+    entry->artist = g_strdup (FileTag->artist);
+    entry->album = g_strdup (FileTag->album);
+    g_hash_table_insert (ETCore->ETArtistAlbumFileIndex, ETFile, entry);
 
-    /* Album value of the ETFile passed in parameter. */
-    ETFile_Album = ((File_Tag *)ETFile->FileTag->data)->album;
-    /* Artist value of the ETFile passed in parameter. */
-    ETFile_Artist = ((File_Tag *)ETFile->FileTag->data)->artist;
+    entry->artist_link = g_hash_table_lookup (ETCore->ETArtistAlbumArtistIndex,
+                                              entry->artist);
 
-    for (ArtistList = file_list; ArtistList != NULL;
-         ArtistList = g_list_next (ArtistList))
+    if (!entry->artist_link)
     {
-        AlbumList = (GList *)ArtistList->data;  /* Take the first item */
-        /* Take the first item, and the first etfile item. */
-        if (AlbumList && (etfilelist = (GList *)AlbumList->data)
-            && (etfile = (ET_File *)etfilelist->data)
-            && ((File_Tag *)etfile->FileTag->data) != NULL)
+        /* The "ArtistList" item was NOT found! => Add a new "ArtistList" to
+         * the main list (=ETArtistAlbumFileList). */
+        etfilelist = g_list_append (NULL, ETFile);
+        AlbumList = g_list_append (NULL, etfilelist);
+
+        if (keep_sorted)
         {
-            etfile_artist = ((File_Tag *)etfile->FileTag->data)->artist;
+            entry->artist_link = et_list_insert_sorted_link (file_list,
+                                                             AlbumList,
+                                                             et_artist_album_list_compare_artists);
         }
         else
         {
-            etfile_artist = NULL;
+            *file_list = g_list_prepend (*file_list, AlbumList);
+            entry->artist_link = *file_list;
         }
 
-        if ((etfile_artist &&  ETFile_Artist && strcmp (etfile_artist,
-                                                        ETFile_Artist) == 0)
-            || (!etfile_artist && !ETFile_Artist)) /* The "artist" values correspond? */
+        entry->album_link = AlbumList;
+        g_hash_table_insert (ETCore->ETArtistAlbumArtistIndex,
+                             g_strdup (entry->artist), entry->artist_link);
+
+        if (move)
         {
-            /* The "ArtistList" item was found! */
-            while (AlbumList)
+            move->new_artist_created = TRUE;
+            move->new_album_created = TRUE;
+        }
+    }
+    else
+    {
+        /* The "ArtistList" item was found! */
+        for (AlbumList = (GList *)entry->artist_link->data; AlbumList != NULL;
+             AlbumList = g_list_next (AlbumList))
+        {
+            if (g_strcmp0 (et_artist_album_list_get_entry (AlbumList->data)->album,
+                           entry->album) == 0)
             {
-                if ((etfilelist = (GList *)AlbumList->data)
-                    && (etfile = (ET_File *)etfilelist->data)
-                    && ((File_Tag *)etfile->FileTag->data) != NULL)
-                {
-                    etfile_album = ((File_Tag *)etfile->FileTag->data)->album;
-                }
-                else
-                {
-                    etfile_album = NULL;
-                }
+                break;
+            }
+        }
 
-                if ((etfile_album && ETFile_Album && strcmp (etfile_album,
-                                                             ETFile_Album) == 0)
-                    || (!etfile_album && !ETFile_Album))
-                    /* The "album" values correspond? */
-                {
-                    /* The "AlbumList" item was found!
-                     * Add the ETFile to this AlbumList item */
-                    AlbumList->data = g_list_append ((GList *)AlbumList->data,
-                                                     ETFile);
-                    AlbumList->data = g_list_sort ((GList *)AlbumList->data,
-                                                   (GCompareFunc)ET_Comp_Func_Sort_Etfile_Item_By_Ascending_Filename);
-                    return file_list;
-                }
+        if (AlbumList)
+        {
+            /* The "AlbumList" item was found!
+             * Add the ETFile to this AlbumList item */
+            etfilelist = g_list_first ((GList *)AlbumList->data);
 
-                AlbumList = g_list_next (AlbumList);
+            if (keep_sorted)
+            {
+                etfilelist = g_list_insert_sorted (etfilelist, ETFile,
+                                                   (GCompareFunc)ET_Comp_Func_Sort_Etfile_Item_By_Ascending_Filename);
+            }
+            else
+            {
+                etfilelist = g_list_prepend (etfilelist, ETFile);
             }
 
+            AlbumList->data = etfilelist;
+            entry->album_link = AlbumList;
+        }
+        else
+        {
             /* The "AlbumList" item was NOT found! => Add a new "AlbumList"
              * item (+...) item to the "ArtistList" list. */
+            GList *albums = (GList *)entry->artist_link->data;
+
             etfilelist = g_list_append (NULL, ETFile);
-            ArtistList->data = g_list_append ((GList *)ArtistList->data,
-                                              etfilelist);
-            ArtistList->data = g_list_sort ((GList *)ArtistList->data,
-                                            (GCompareFunc)ET_Comp_Func_Sort_Album_Item_By_Ascending_Album);
-            return file_list;
+
+            if (keep_sorted)
+            {
+                entry->album_link = et_list_insert_sorted_link (&albums,
+                                                                etfilelist,
+                                                                et_artist_album_list_compare_albums);
+            }
+            else
+            {
+                albums = g_list_prepend (albums, etfilelist);
+                entry->album_link = albums;
+            }
+
+            entry->artist_link->data = albums;
+
+            if (move)
+            {
+                move->new_album_created = TRUE;
+            }
         }
     }
 
-    /* The "ArtistList" item was NOT found! => Add a new "ArtistList" to the
-     * main list (=ETArtistAlbumFileList). */
-    etfilelist = g_list_append (NULL, ETFile);
-    AlbumList  = g_list_append (NULL, etfilelist);
-    file_list = g_list_append (file_list, AlbumList);
+    if (move)
+    {
+        move->new_artist = entry->artist_link;
+        move->new_album = entry->album_link;
+    }
+}
+
+/*
+ * Remove @ETFile from the lists, and the artist and album if they are left
+ * empty. The nodes of a removed artist or album are unlinked and returned in
+ * @move, so that they can still be compared with the rows of the browser, or
+ * freed at once if @move is %NULL.
+ *
+ * Returns: %TRUE if the file was removed, %FALSE if it was not in the lists
+ */
+static gboolean
+et_artist_album_list_unlink_file (GList **file_list,
+                                  ET_File *ETFile,
+                                  EtArtistAlbumMove *move)
+{
+    EtArtistAlbumEntry *entry;
+    GList *artist_link;
+    GList *album_link;
+    GList *etfilelist;
+    gboolean album_removed = FALSE;
+    gboolean artist_removed = FALSE;
+
+    if (!ETCore->ETArtistAlbumFileIndex)
+    {
+        return FALSE;
+    }
+
+    entry = g_hash_table_lookup (ETCore->ETArtistAlbumFileIndex, ETFile);
+
+    if (!entry)
+    {
+        return FALSE;
+    }
+
+    artist_link = entry->artist_link;
+    album_link = entry->album_link;
 
-    /* Sort the list by ascending Artist. */
-    /* TODO: Use g_list_insert_sorted() instead. */
-    result = g_list_sort (file_list,
-                          (GCompareFunc)ET_Comp_Func_Sort_Artist_Item_By_Ascending_Artist);
+    etfilelist = g_list_remove (g_list_first ((GList *)album_link->data),
+                                ETFile);
+    album_link->data = etfilelist;
 
-    return result;
+    if (!etfilelist) /* Delete from AlbumList. */
+    {
+        artist_link->data = g_list_remove_link ((GList *)artist_link->data,
+                                                album_link);
+        album_removed = TRUE;
+
+        if (!artist_link->data) /* Delete from the main list. */
+        {
+            g_hash_table_remove (ETCore->ETArtistAlbumArtistIndex,
+                                 entry->artist);
+            *file_list = g_list_remove_link (*file_list, artist_link);
+            artist_removed = TRUE;
+        }
+    }
+
+    g_hash_table_remove (ETCore->ETArtistAlbumFileIndex, ETFile);
+
+    if (move)
+    {
+        move->old_artist = artist_link;
+        move->old_album = album_link;
+        move->old_artist_removed = artist_removed;
+        move->old_album_removed = album_removed;
+    }
+    else
+    {
+        if (album_removed)
+        {
+            g_list_free_1 (album_link);
+        }
+
+        if (artist_removed)
+        {
+            g_list_free_1 (artist_link);
+        }
+    }
+
+    return TRUE;
 }
 
 GList *
@@ -663,73 +924,174 @@ et_artist_album_list_new_from_file_list (GList *file_list)
     GList *result = NULL;
     GList *l;
 
+    /* The index only refers to the list being built. */
+    if (ETCore->ETArtistAlbumFileIndex)
+    {
+        g_hash_table_destroy (ETCore->ETArtistAlbumFileIndex);
+    }
+
+    if (ETCore->ETArtistAlbumArtistIndex)
+    {
+        g_hash_table_destroy (ETCore->ETArtistAlbumArtistIndex);
+    }
+
+    ETCore->ETArtistAlbumFileIndex = g_hash_table_new_full (NULL, NULL, NULL,
+                                                            (GDestroyNotify)et_artist_album_entry_free);
+    ETCore->ETArtistAlbumArtistIndex = g_hash_table_new_full (et_artist_album_name_hash,
+                                                              et_artist_album_name_equal,
+                                                              g_free, NULL);
+
     for (l = g_list_first (file_list); l != NULL; l = g_list_next (l))
     {
-        ET_File *ETFile = (ET_File *)l->data;
-        result = et_artist_album_list_add_file (result, ETFile);
+        et_artist_album_list_link_file (&result, (ET_File *)l->data, FALSE,
+                                        NULL);
     }
 
-    return result;
+    /* Sort each level once, which keeps the nodes (and so the index) valid. */
+    for (l = result; l != NULL; l = g_list_next (l))
+    {
+        GList *m;
+
+        for (m = (GList *)l->data; m != NULL; m = g_list_next (m))
+        {
+            m->data = g_list_sort ((GList *)m->data,
+                                   (GCompareFunc)ET_Comp_Func_Sort_Etfile_Item_By_Ascending_Filename);
+        }
+
+        l->data = g_list_sort ((GList *)l->data,
+                               et_artist_album_list_compare_albums);
+    }
+
+    return g_list_sort (result, et_artist_album_list_compare_artists);
 }
 
 /*
- * Delete the corresponding file (allocated data was previously freed!). Return TRUE if deleted.
+ * et_artist_album_list_move_file:
+ * @ETFile: a file whose tag may have changed
+ * @move: (out caller-allocates): return location for the changes, to be
+ *        cleared with et_artist_album_move_clear()
+ *
+ * File @ETFile again in ETCore->ETArtistAlbumFileList if its artist or album
+ * changed since it was filed, creating or removing artists and albums as
+ * needed.
+ *
+ * Returns: %TRUE if the file was moved, %FALSE if its artist and album are
+ * unchanged, or if it is not in the list
  */
-static gboolean
-ET_Remove_File_From_Artist_Album_List (ET_File *ETFile)
+gboolean
+et_artist_album_list_move_file (ET_File *ETFile,
+                                EtArtistAlbumMove *move)
 {
-    GList *ArtistList;
-    GList *AlbumList;
-    GList *etfilelist;
+    const EtArtistAlbumEntry *entry;
+    const File_Tag *FileTag;
 
     g_return_val_if_fail (ETFile != NULL, FALSE);
+    g_return_val_if_fail (move != NULL, FALSE);
+
+    memset (move, 0, sizeof (EtArtistAlbumMove));
 
-    /* Search for the ETFile in the list. */
-    for (ArtistList = ETCore->ETArtistAlbumFileList; ArtistList != NULL;
-         ArtistList = g_list_next (ArtistList))
+    if (!ETCore->ETArtistAlbumFileIndex)
     {
-        for (AlbumList = g_list_first ((GList *)ArtistList->data);
-             AlbumList != NULL; AlbumList = g_list_next (AlbumList))
-        {
-            for (etfilelist = g_list_first ((GList *)AlbumList->data);
-                 etfilelist != NULL; etfilelist = g_list_next (etfilelist))
-            {
-                ET_File *etfile = (ET_File *)etfilelist->data;
+        return FALSE;
+    }
 
-                if (ETFile == etfile) /* The ETFile to delete was found! */
-                {
-                    etfilelist = g_list_remove (etfilelist, ETFile);
+    entry = g_hash_table_lookup (ETCore->ETArtistAlbumFileIndex, ETFile);
+    FileTag = (File_Tag *)ETFile->FileTag->data;
 
-                    if (etfilelist) /* Delete from AlbumList. */
-                    {
-                        AlbumList->data = (gpointer) g_list_first (etfilelist);
-                    }
-                    else
-                    {
-                        AlbumList = g_list_remove (AlbumList, AlbumList->data);
+    if (!entry
+        || (g_strcmp0 (entry->artist, FileTag->artist) == 0
+            && g_strcmp0 (entry->album, FileTag->album) == 0))
+    {
+        return FALSE;
+    }
 
-                        if (AlbumList) /* Delete from ArtistList. */
-                        {
-                            ArtistList->data = AlbumList;
-                        }
-                        else
-                        {
-                            /* Delete from the main list. */
-                            ETCore->ETArtistAlbumFileList = g_list_remove (ArtistList,ArtistList->data);
+    et_artist_album_list_unlink_file (&ETCore->ETArtistAlbumFileList, ETFile,
+                                      move);
+    et_artist_album_list_link_file (&ETCore->ETArtistAlbumFileList, ETFile,
+                                    TRUE, move);
 
-                            return TRUE;
-                        }
+    return TRUE;
+}
 
-                        return TRUE;
-                    }
+/*
+ * et_artist_album_move_clear:
+ * @move: the changes returned by et_artist_album_list_move_file()
+ *
+ * Free the nodes of the artist and album removed by the move.
+ */
+void
+et_artist_album_move_clear (EtArtistAlbumMove *move)
+{
+    g_return_if_fail (move != NULL);
 
-                    return TRUE;
-                }
-            }
-        }
+    if (move->old_album_removed)
+    {
+        g_list_free_1 (move->old_album);
+    }
+
+    if (move->old_artist_removed)
+    {
+        g_list_free_1 (move->old_artist);
+    }
+
+    memset (move, 0, sizeof (EtArtistAlbumMove));
+}
+
+/*
+ * et_artist_album_list_get_position:
+ * @ETFile: a file
+ * @artist: (out) (allow-none): return location for the node of the artist of
+ *          the file in ETCore->ETArtistAlbumFileList
+ * @album: (out) (allow-none): return location for the node of the album of the
+ *         file in the list of albums of @artist
+ *
+ * Find where @ETFile is filed in ETCore->ETArtistAlbumFileList.
+ *
+ * Returns: %TRUE if the file is in the list, %FALSE otherwise
+ */
+gboolean
+et_artist_album_list_get_position (const ET_File *ETFile,
+                                   GList **artist,
+                                   GList **album)
+{
+    const EtArtistAlbumEntry *entry;
+
+    if (!ETCore->ETArtistAlbumFileIndex)
+    {
+        return FALSE;
+    }
+
+    entry = g_hash_table_lookup (ETCore->ETArtistAlbumFileIndex, ETFile);
+
+    if (!entry)
+    {
+        return FALSE;
+    }
+
+    if (artist)
+    {
+        *artist = entry->artist_link;
     }
 
-    return FALSE; /* ETFile is NUL, or not found in the list. */
+    if (album)
+    {
+        *album = entry->album_link;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Delete the corresponding file (allocated data was previously freed!). Return TRUE if deleted.
+ */
+static gboolean
+ET_Remove_File_From_Artist_Album_List (ET_File *ETFile)
+{
+    g_return_val_if_fail (ETFile != NULL, FALSE);
+
+    /* ETFile is NULL, or not found in the list. */
+    return et_artist_album_list_unlink_file (&ETCore->ETArtistAlbumFileList,
+                                             ETFile, NULL);
 }
 
 /*
@@ -802,6 +1164,12 @@ ET_Remove_File_From_File_List (ET_File *ETFile)
     // Remove the file from the ETArtistAlbumList list
     ET_Remove_File_From_Artist_Album_List(ETFile);
 
+    /* The file must not be refreshed after being freed. */
+    et_dirty_file_list_remove (ETFile);
+
+    /* Nor given its exact duration. */
+    et_duration_scan_remove_file (ETFile);
+
     /* Remove the file from the ETFileDisplayedList list (if not already). */
     ETCore->ETFileDisplayedList = g_list_remove (g_list_first (ETCore->ETFileDisplayedList),
                                                  ETFileDisplayedList);
@@ -1152,10 +1520,13 @@ et_displayed_file_list_set (GList *ETFileList)
     ETCore->ETFileDisplayedList_Length = et_displayed_file_list_length (ETCore->ETFileDisplayedList);
     ETCore->ETFileDisplayedList_TotalSize     = 0;
     ETCore->ETFileDisplayedList_TotalDuration = 0;
+    /* Files of the previous displayed list no longer match. */
+    ETCore->ETFileDisplayedList_Serial++;
 
     // Get size and duration of files in the list
     for (l = ETCore->ETFileDisplayedList; l != NULL; l = g_list_next (l))
     {
+        ((ET_File *)l->data)->displayed_serial = ETCore->ETFileDisplayedList_Serial;
         ETCore->ETFileDisplayedList_TotalSize += ((ET_File_Info *)((ET_File *)l->data)->ETFileInfo)->size;
         ETCore->ETFileDisplayedList_TotalDuration += ((ET_File_Info *)((ET_File *)l->data)->ETFileInfo)->duration;
     }
@@ -1169,6 +1540,108 @@ et_displayed_file_list_set (GList *ETFileList)
     et_displayed_file_list_renumber (ETCore->ETFileDisplayedList);
 }
 
+/*
+ * et_displayed_file_list_contains:
+ * @ETFile: a file of the file list
+ *
+ * Check whether @ETFile is in the displayed list, and so is counted in its
+ * total size and duration, without walking the list.
+ *
+ * Returns: %TRUE if @ETFile is displayed, %FALSE otherwise
+ */
+gboolean
+et_displayed_file_list_contains (const ET_File *ETFile)
+{
+    g_return_val_if_fail (ETFile != NULL, FALSE);
+
+    return ETCore->ETFileDisplayedList_Serial != 0
+           && ETFile->displayed_serial == ETCore->ETFileDisplayedList_Serial;
+}
+
+/*
+ * et_dirty_file_list_add:
+ * @ETFile: a file whose name, tag or saved state has changed
+ *
+ * Record that the row of @ETFile in the browser is out of date, so that it is
+ * updated by the next call to et_browser_refresh_dirty_files().
+ */
+void
+et_dirty_file_list_add (ET_File *ETFile)
+{
+    g_return_if_fail (ETFile != NULL);
+
+    if (!ETCore)
+    {
+        return;
+    }
+
+    if (!ETCore->ETFileDirtySet)
+    {
+        ETCore->ETFileDirtySet = g_hash_table_new (NULL, NULL);
+    }
+
+    g_hash_table_add (ETCore->ETFileDirtySet, ETFile);
+}
+
+/*
+ * et_dirty_file_list_remove:
+ * @ETFile: a file which no longer needs refreshing
+ *
+ * Remove @ETFile from the dirty set, for example because its row has just been
+ * refreshed or because the file is being removed from the list.
+ */
+void
+et_dirty_file_list_remove (const ET_File *ETFile)
+{
+    if (!ETCore || !ETCore->ETFileDirtySet)
+    {
+        return;
+    }
+
+    g_hash_table_remove (ETCore->ETFileDirtySet, ETFile);
+}
+
+/*
+ * et_dirty_file_list_take:
+ *
+ * Take all the files changed since the last refresh, leaving the dirty set
+ * empty.
+ *
+ * Returns: (element-type ET_File) (transfer container): the list of changed
+ * files, to be freed with g_list_free(), or %NULL if nothing changed
+ */
+GList *
+et_dirty_file_list_take (void)
+{
+    GList *result;
+
+    if (!ETCore || !ETCore->ETFileDirtySet)
+    {
+        return NULL;
+    }
+
+    result = g_hash_table_get_keys (ETCore->ETFileDirtySet);
+    g_hash_table_remove_all (ETCore->ETFileDirtySet);
+
+    return result;
+}
+
+/*
+ * et_dirty_file_list_clear:
+ *
+ * Forget about all changed files, after the whole browser list was refreshed.
+ */
+void
+et_dirty_file_list_clear (void)
+{
+    if (!ETCore || !ETCore->ETFileDirtySet)
+    {
+        return;
+    }
+
+    g_hash_table_remove_all (ETCore->ETFileDirtySet);
+}
+
 /*
  * Function used to update path of filenames into list after renaming a parent directory
  * (for ex: "/mp3/old_path/file.mp3" to "/mp3/new_path/file.mp3"
@@ -34,7 +34,36 @@ void et_file_list_update_directory_name (GList *file_list, const gchar *old_path
 guint et_file_list_get_n_files_in_path (GList *file_list, const gchar *path_utf8);
 void et_file_list_free (GList *file_list);
 
+/*
+ * EtArtistAlbumMove:
+ * @old_artist: the node of the previous artist of the file
+ * @old_album: the node of the previous album of the file
+ * @old_artist_removed: whether @old_artist was left empty, and removed
+ * @old_album_removed: whether @old_album was left empty, and removed
+ * @new_artist: the node of the new artist of the file
+ * @new_album: the node of the new album of the file
+ * @new_artist_created: whether @new_artist was created for the file
+ * @new_album_created: whether @new_album was created for the file
+ *
+ * Changes to ETCore->ETArtistAlbumFileList after the artist or album of a file
+ * changed, see et_artist_album_list_move_file().
+ */
+typedef struct
+{
+    GList *old_artist;
+    GList *old_album;
+    gboolean old_artist_removed;
+    gboolean old_album_removed;
+    GList *new_artist;
+    GList *new_album;
+    gboolean new_artist_created;
+    gboolean new_album_created;
+} EtArtistAlbumMove;
+
 GList * et_artist_album_list_new_from_file_list (GList *file_list);
+gboolean et_artist_album_list_move_file (ET_File *ETFile, EtArtistAlbumMove *move);
+void et_artist_album_move_clear (EtArtistAlbumMove *move);
+gboolean et_artist_album_list_get_position (const ET_File *ETFile, GList **artist, GList **album);
 void et_artist_album_file_list_free (GList *file_list);
 
 GList * ET_Displayed_File_List_First (void);
@@ -45,6 +74,12 @@ GList * ET_Displayed_File_List_By_Etfile (const ET_File *ETFile);
 
 void et_displayed_file_list_set (GList *ETFileList);
 void et_displayed_file_list_free (GList *file_list);
+gboolean et_displayed_file_list_contains (const ET_File *ETFile);
+
+void et_dirty_file_list_add (ET_File *ETFile);
+void et_dirty_file_list_remove (const ET_File *ETFile);
+GList * et_dirty_file_list_take (void);
+void et_dirty_file_list_clear (void);
 
 GList * et_history_list_add (GList *history_list, ET_File *ETFile);
 gboolean ET_Add_File_To_History_List (ET_File *ETFile);
@@ -56,6 +56,18 @@ enum
 /* File for log. */
 static const gchar LOG_FILE[] = "easytag.log";
 
+/* The thread which owns the log area, as Log_Print() is also called from
+ * the threads which save files. */
+static GThread *log_thread = NULL;
+
+/* A message printed from another thread, which is added to the log from the
+ * main loop. */
+typedef struct
+{
+    EtLogAreaKind error_type;
+    gchar *string;
+} EtLogAreaMessage;
+
 /**************
  * Prototypes *
  **************/
@@ -126,6 +138,8 @@ static void
 et_log_area_class_init (EtLogAreaClass *klass)
 {
     g_type_class_add_private (klass, sizeof (EtLogAreaPrivate));
+
+    log_thread = g_thread_self ();
 }
 
 static void
@@ -277,15 +291,18 @@ get_icon_name_from_error_kind (EtLogAreaKind error_kind)
 }
 
 /*
- * Function to use anywhere in the application to send a message to the LogList
+ * Log_Print_String:
+ * @error_type: the kind of message
+ * @string: (transfer full): the message
+ *
+ * Add the message to the log area and to the log file. Only call this from
+ * the thread of the log area.
  */
-void
-Log_Print (EtLogAreaKind error_type, const gchar * const format, ...)
+static void
+Log_Print_String (EtLogAreaKind error_type, gchar *string)
 {
     EtLogArea *self;
     EtLogAreaPrivate *priv;
-    va_list args;
-    gchar *string;
     gchar *time;
     guint n_items;
     GtkTreeIter iter;
@@ -301,10 +318,6 @@ Log_Print (EtLogAreaKind error_type, const gchar * const format, ...)
 
     priv = et_log_area_get_instance_private (self);
 
-    va_start (args, format);
-    string = g_strdup_vprintf (format, args);
-    va_end (args);
-
     time = Log_Format_Date ();
 
     /* Remove lines that exceed the limit. */
@@ -414,3 +427,45 @@ Log_Print (EtLogAreaKind error_type, const gchar * const format, ...)
     g_object_unref (file_ostream);
     g_object_unref (file);
 }
+
+static gboolean
+Log_Print_Idle (gpointer user_data)
+{
+    EtLogAreaMessage *message = user_data;
+
+    Log_Print_String (message->error_type, message->string);
+    g_slice_free (EtLogAreaMessage, message);
+
+    return G_SOURCE_REMOVE;
+}
+
+/*
+ * Function to use anywhere in the application to send a message to the LogList
+ *
+ * Messages printed from other threads than the one of the log area, such as
+ * those which save files, are added to it from the main loop.
+ */
+void
+Log_Print (EtLogAreaKind error_type, const gchar * const format, ...)
+{
+    va_list args;
+    gchar *string;
+
+    va_start (args, format);
+    string = g_strdup_vprintf (format, args);
+    va_end (args);
+
+    if (g_thread_self () == log_thread)
+    {
+        Log_Print_String (error_type, string);
+    }
+    else
+    {
+        EtLogAreaMessage *message;
+
+        message = g_slice_new (EtLogAreaMessage);
+        message->error_type = error_type;
+        message->string = string;
+        g_idle_add (Log_Print_Idle, message);
+    }
+}
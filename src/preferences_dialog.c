@@ -214,6 +214,7 @@ create_preferences_dialog (EtPreferencesDialog *self)
     GtkWidget *OpenSelectedBrowserNode;
     GtkWidget *BrowseHiddendir;
     GtkWidget *ShowHeaderInfos;
+    GtkWidget *ScanExactDuration;
     GtkWidget *ChangedFilesDisplayedToBold;
     GtkWidget *SortingFileCaseSensitive;
     GtkWidget *ShowLogView;
@@ -221,6 +222,7 @@ create_preferences_dialog (EtPreferencesDialog *self)
     GtkWidget *ReplaceIllegalCharactersInFilename;
     GtkWidget *PreserveModificationTime;
     GtkWidget *UpdateParentDirectoryModificationTime;
+    GtkWidget *SaveInBackground;
     GtkWidget *FilenameCharacterSetOther;
     GtkWidget *FilenameCharacterSetApproximate;
     GtkWidget *FilenameCharacterSetDiscard;
@@ -385,6 +387,12 @@ create_preferences_dialog (EtPreferencesDialog *self)
     g_settings_bind (MainSettings, "file-show-header", ShowHeaderInfos,
                      "active", G_SETTINGS_BIND_DEFAULT);
 
+    /* Find the exact duration of MP3 files. */
+    ScanExactDuration = GTK_WIDGET (gtk_builder_get_object (builder,
+                                                            "header_exact_duration_check"));
+    g_settings_bind (MainSettings, "file-scan-exact-duration",
+                     ScanExactDuration, "active", G_SETTINGS_BIND_DEFAULT);
+
     /* Display color mode for changed files in list. */
     /* Set "new" Gtk+-2.0ish black/bold style for changed items. */
     ChangedFilesDisplayedToBold = GTK_WIDGET (gtk_builder_get_object (builder,
@@ -447,6 +455,12 @@ create_preferences_dialog (EtPreferencesDialog *self)
                      UpdateParentDirectoryModificationTime, "active",
                      G_SETTINGS_BIND_DEFAULT);
 
+    /* Save files in the background */
+    SaveInBackground = GTK_WIDGET (gtk_builder_get_object (builder,
+                                                           "file_background_check"));
+    g_settings_bind (MainSettings, "file-save-in-background",
+                     SaveInBackground, "active", G_SETTINGS_BIND_DEFAULT);
+
     /* Character Set for Filename */
     FilenameCharacterSetOther = GTK_WIDGET (gtk_builder_get_object (builder,
                                                                     "file_encoding_try_alternative_radio"));
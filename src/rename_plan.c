@@ -0,0 +1,868 @@
+/* EasyTAG - tag editor for audio files
+ * Copyright (C) 2026  agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/* For renameat2(). */
+#define _GNU_SOURCE
+
+#include "config.h"
+
+#include "rename_plan.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <gio/gio.h>
+#include <glib/gi18n.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef G_OS_WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+/*
+ * A rename plan renames a set of files together. The whole mapping from the
+ * old paths to the new ones is known before any file is renamed, so:
+ *
+ * - files which would be renamed to the same path, or over a file which is
+ *   not renamed, are reported before anything is touched
+ * - a file whose new path is the old path of another file of the plan is
+ *   renamed after that file moved away
+ * - files which are renamed to the paths of each other, such as swaps and
+ *   rotations, are resolved by exchanging them, or by moving one of them to a
+ *   temporary path first
+ *
+ * The renames never replace a file, so that a file which appeared since the
+ * plan was made is not lost.
+ */
+
+typedef enum
+{
+    ET_RENAME_PENDING,
+    ET_RENAME_DONE,
+    ET_RENAME_FAILED
+} EtRenameState;
+
+typedef struct
+{
+    gchar *old_path;
+    gchar *new_path;
+    gpointer data;
+
+    EtRenameState state;
+    GError *error;
+
+    /* The path of the file while it is moved out of the way, or NULL. */
+    gchar *tmp_path;
+    /* TRUE if the new path already names the file, such as for a change of
+     * case on a case-insensitive filesystem. */
+    gboolean same_file;
+    /* TRUE if another file, which is not renamed, has the new path. */
+    gboolean target_exists;
+    /* TRUE once the steps to rename the file were planned. */
+    gboolean scheduled;
+} EtRenameEntry;
+
+typedef enum
+{
+    /* Move the file to its new path. */
+    ET_RENAME_STEP_MOVE,
+    /* Move the file to a temporary path, to free its old path. */
+    ET_RENAME_STEP_MOVE_ASIDE,
+    /* Exchange the file with the other one, which is renamed to the old
+     * path of the file. */
+    ET_RENAME_STEP_EXCHANGE
+} EtRenameStepKind;
+
+typedef struct
+{
+    EtRenameStepKind kind;
+    EtRenameEntry *entry;
+    EtRenameEntry *other;
+} EtRenameStep;
+
+struct _EtRenamePlan
+{
+    /* The entries, in the order in which they were added. */
+    GPtrArray *entries;
+    /* The entries by their old and new paths, which are owned by the
+     * entries. */
+    GHashTable *by_old_path;
+    GHashTable *by_new_path;
+    GArray *steps;
+
+    EtRenamePlanAsideFunc aside_func;
+    gpointer aside_data;
+};
+
+static void
+et_rename_entry_free (EtRenameEntry *entry)
+{
+    g_free (entry->old_path);
+    g_free (entry->new_path);
+    g_free (entry->tmp_path);
+    g_clear_error (&entry->error);
+    g_slice_free (EtRenameEntry, entry);
+}
+
+static void
+et_rename_entry_fail (EtRenameEntry *entry, GError *error)
+{
+    entry->state = ET_RENAME_FAILED;
+    g_clear_error (&entry->error);
+    entry->error = error;
+}
+
+/*
+ * et_rename_plan_new:
+ *
+ * Create a new, empty, rename plan.
+ *
+ * Returns: a new #EtRenamePlan, free with et_rename_plan_free()
+ */
+EtRenamePlan *
+et_rename_plan_new (void)
+{
+    EtRenamePlan *self;
+
+    self = g_slice_new0 (EtRenamePlan);
+    self->entries = g_ptr_array_new_with_free_func ((GDestroyNotify)et_rename_entry_free);
+    self->by_old_path = g_hash_table_new (g_str_hash, g_str_equal);
+    self->by_new_path = g_hash_table_new (g_str_hash, g_str_equal);
+    self->steps = g_array_new (FALSE, FALSE, sizeof (EtRenameStep));
+
+    return self;
+}
+
+/*
+ * et_rename_plan_add:
+ * @self: the rename plan
+ * @old_path: the current path of the file
+ * @new_path: the path to rename the file to
+ * @data: data to pass back to the #EtRenamePlanFunc for the file
+ *
+ * Add a file to rename to the plan. Each file must only be added once.
+ */
+void
+et_rename_plan_add (EtRenamePlan *self,
+                    const gchar *old_path,
+                    const gchar *new_path,
+                    gpointer data)
+{
+    EtRenameEntry *entry;
+
+    g_return_if_fail (self != NULL);
+    g_return_if_fail (old_path != NULL && new_path != NULL);
+
+    entry = g_slice_new0 (EtRenameEntry);
+    entry->old_path = g_strdup (old_path);
+    entry->new_path = g_strdup (new_path);
+    entry->data = data;
+    entry->state = ET_RENAME_PENDING;
+
+    g_ptr_array_add (self->entries, entry);
+}
+
+/*
+ * et_rename_plan_set_aside_func:
+ * @self: the rename plan
+ * @func: the function to call before a file is moved to a temporary path
+ * @user_data: user data to pass to @func
+ *
+ * Set a function to record the temporary paths of the files, so that they
+ * can be found if the renames are interrupted.
+ */
+void
+et_rename_plan_set_aside_func (EtRenamePlan *self,
+                               EtRenamePlanAsideFunc func,
+                               gpointer user_data)
+{
+    g_return_if_fail (self != NULL);
+
+    self->aside_func = func;
+    self->aside_data = user_data;
+}
+
+/*
+ * et_rename_plan_is_same_file:
+ *
+ * Returns: %TRUE if both paths name the same file on the disk
+ */
+static gboolean
+et_rename_plan_is_same_file (const GStatBuf *old_stat,
+                             const GStatBuf *new_stat)
+{
+#ifdef G_OS_WIN32
+    /* There are no inode numbers to compare. */
+    return FALSE;
+#else
+    return old_stat->st_dev == new_stat->st_dev
+           && old_stat->st_ino == new_stat->st_ino;
+#endif
+}
+
+/*
+ * et_rename_plan_resolve:
+ * @self: the rename plan
+ *
+ * Find the files which cannot be renamed, as their new path would still be
+ * taken, and mark them as failed.
+ */
+static void
+et_rename_plan_resolve (EtRenamePlan *self)
+{
+    gboolean changed;
+    guint i;
+
+    for (i = 0; i < self->entries->len; i++)
+    {
+        EtRenameEntry *entry = g_ptr_array_index (self->entries, i);
+
+        if (!g_hash_table_contains (self->by_old_path, entry->old_path))
+        {
+            g_hash_table_insert (self->by_old_path, entry->old_path, entry);
+        }
+
+        if (strcmp (entry->old_path, entry->new_path) == 0)
+        {
+            /* Nothing to do, but the file keeps its path. */
+            entry->state = ET_RENAME_DONE;
+        }
+        else if (g_hash_table_contains (self->by_new_path, entry->new_path))
+        {
+            gchar *display_name = g_filename_display_name (entry->new_path);
+
+            et_rename_entry_fail (entry,
+                                  g_error_new (G_IO_ERROR, G_IO_ERROR_EXISTS,
+                                               _("Another file is renamed to ‘%s’"),
+                                               display_name));
+            g_free (display_name);
+        }
+        else
+        {
+            g_hash_table_insert (self->by_new_path, entry->new_path, entry);
+        }
+    }
+
+    /* Only the new paths which are not freed by the plan itself are looked
+     * up on the disk. */
+    for (i = 0; i < self->entries->len; i++)
+    {
+        EtRenameEntry *entry = g_ptr_array_index (self->entries, i);
+        GStatBuf new_stat;
+
+        if (entry->state != ET_RENAME_PENDING
+            || g_hash_table_contains (self->by_old_path, entry->new_path))
+        {
+            continue;
+        }
+
+        if (g_lstat (entry->new_path, &new_stat) == 0)
+        {
+            GStatBuf old_stat;
+
+            if (g_lstat (entry->old_path, &old_stat) == 0
+                && et_rename_plan_is_same_file (&old_stat, &new_stat))
+            {
+                entry->same_file = TRUE;
+            }
+            else
+            {
+                entry->target_exists = TRUE;
+            }
+        }
+    }
+
+    /* A file which cannot be renamed keeps its path, which in turn may be the
+     * new path of another file. */
+    do
+    {
+        changed = FALSE;
+
+        for (i = 0; i < self->entries->len; i++)
+        {
+            EtRenameEntry *entry = g_ptr_array_index (self->entries, i);
+            EtRenameEntry *occupant;
+
+            if (entry->state != ET_RENAME_PENDING)
+            {
+                continue;
+            }
+
+            occupant = g_hash_table_lookup (self->by_old_path,
+                                            entry->new_path);
+
+            if (entry->target_exists
+                || (occupant && occupant->state != ET_RENAME_PENDING))
+            {
+                gchar *display_name = g_filename_display_name (entry->new_path);
+
+                et_rename_entry_fail (entry,
+                                      g_error_new (G_IO_ERROR,
+                                                   G_IO_ERROR_EXISTS,
+                                                   _("The file ‘%s’ already exists"),
+                                                   display_name));
+                g_free (display_name);
+                changed = TRUE;
+            }
+        }
+    } while (changed);
+}
+
+static void
+et_rename_plan_add_step (EtRenamePlan *self,
+                         EtRenameStepKind kind,
+                         EtRenameEntry *entry,
+                         EtRenameEntry *other)
+{
+    EtRenameStep step = { kind, entry, other };
+
+    g_array_append_val (self->steps, step);
+}
+
+/*
+ * et_rename_plan_schedule_chain:
+ * @self: the rename plan
+ * @entry: a file whose new path is free, or will be by then
+ *
+ * Plan to move @entry, then the file which is renamed to the old path of
+ * @entry, and so on down the chain.
+ */
+static void
+et_rename_plan_schedule_chain (EtRenamePlan *self,
+                               EtRenameEntry *entry)
+{
+    while (entry && entry->state == ET_RENAME_PENDING && !entry->scheduled)
+    {
+        et_rename_plan_add_step (self, ET_RENAME_STEP_MOVE, entry, NULL);
+        entry->scheduled = TRUE;
+        entry = g_hash_table_lookup (self->by_new_path, entry->old_path);
+    }
+}
+
+/*
+ * et_rename_plan_schedule:
+ * @self: the rename plan
+ *
+ * Order the renames, so that each file is only moved once its new path is
+ * free.
+ */
+static void
+et_rename_plan_schedule (EtRenamePlan *self)
+{
+    guint i;
+
+    /* The chains start with a file whose new path is not taken. */
+    for (i = 0; i < self->entries->len; i++)
+    {
+        EtRenameEntry *entry = g_ptr_array_index (self->entries, i);
+        EtRenameEntry *occupant;
+
+        if (entry->state != ET_RENAME_PENDING || entry->scheduled)
+        {
+            continue;
+        }
+
+        occupant = g_hash_table_lookup (self->by_old_path, entry->new_path);
+
+        if (occupant == NULL)
+        {
+            et_rename_plan_schedule_chain (self, entry);
+        }
+    }
+
+    /* The remaining files are in cycles, where every new path is the old
+     * path of another file of the cycle. */
+    for (i = 0; i < self->entries->len; i++)
+    {
+        EtRenameEntry *entry = g_ptr_array_index (self->entries, i);
+        EtRenameEntry *next;
+
+        if (entry->state != ET_RENAME_PENDING || entry->scheduled)
+        {
+            continue;
+        }
+
+        next = g_hash_table_lookup (self->by_old_path, entry->new_path);
+        g_assert (next != NULL && next->state == ET_RENAME_PENDING);
+
+        if (g_hash_table_lookup (self->by_old_path, next->new_path) == entry)
+        {
+            /* Two files swap their paths. */
+            et_rename_plan_add_step (self, ET_RENAME_STEP_EXCHANGE, entry,
+                                     next);
+            entry->scheduled = TRUE;
+            next->scheduled = TRUE;
+            continue;
+        }
+
+        /* Break the cycle by moving the file out of the way, then move it to
+         * its new path once the rest of the cycle was renamed. */
+        et_rename_plan_add_step (self, ET_RENAME_STEP_MOVE_ASIDE, entry, NULL);
+        entry->scheduled = TRUE;
+        et_rename_plan_schedule_chain (self,
+                                       g_hash_table_lookup (self->by_new_path,
+                                                            entry->old_path));
+        et_rename_plan_add_step (self, ET_RENAME_STEP_MOVE, entry, NULL);
+    }
+}
+
+static void
+et_rename_plan_set_errno_error (GError **error, gint errsv)
+{
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv), "%s",
+                 g_strerror (errsv));
+}
+
+/*
+ * et_rename_plan_move:
+ * @old_path: the path of the file
+ * @new_path: the path to move the file to
+ * @replace: whether to replace a file at @new_path
+ * @error: a #GError to provide information on errors, or %NULL to ignore
+ *
+ * Move a file, with a single system call if possible.
+ *
+ * Returns: %TRUE if the file was moved, %FALSE otherwise
+ */
+static gboolean
+et_rename_plan_move (const gchar *old_path,
+                     const gchar *new_path,
+                     gboolean replace,
+                     GError **error)
+{
+    GFile *old_file;
+    GFile *new_file;
+    gboolean success;
+
+#ifdef HAVE_RENAMEAT2
+    if (renameat2 (AT_FDCWD, old_path, AT_FDCWD, new_path,
+                   replace ? 0 : RENAME_NOREPLACE) == 0)
+    {
+        return TRUE;
+    }
+
+    /* Otherwise the flag is not supported by the filesystem, or the file is
+     * moved to another filesystem, which GIO copes with. */
+    if (errno != EINVAL && errno != ENOSYS && errno != EXDEV)
+    {
+        et_rename_plan_set_errno_error (error, errno);
+        return FALSE;
+    }
+#endif /* HAVE_RENAMEAT2 */
+
+    old_file = g_file_new_for_path (old_path);
+    new_file = g_file_new_for_path (new_path);
+
+    success = g_file_move (old_file, new_file,
+                           replace ? G_FILE_COPY_OVERWRITE : G_FILE_COPY_NONE,
+                           NULL, NULL, NULL, error);
+
+    g_object_unref (old_file);
+    g_object_unref (new_file);
+
+    return success;
+}
+
+/*
+ * et_rename_plan_move_aside:
+ * @self: the rename plan
+ * @entry: the file to move
+ * @error: a #GError to provide information on errors, or %NULL to ignore
+ *
+ * Move the file of @entry to a new temporary path, next to its old path.
+ *
+ * Returns: %TRUE if the file was moved, %FALSE otherwise
+ */
+static gboolean
+et_rename_plan_move_aside (EtRenamePlan *self,
+                           EtRenameEntry *entry,
+                           GError **error)
+{
+    gchar *tmp_path;
+    gint fd;
+
+    tmp_path = g_strconcat (entry->old_path, ".XXXXXX", NULL);
+
+    /* Reserve the temporary path, which is then replaced by the file. */
+    fd = g_mkstemp (tmp_path);
+
+    if (fd == -1)
+    {
+        et_rename_plan_set_errno_error (error, errno);
+        g_free (tmp_path);
+        return FALSE;
+    }
+
+    close (fd);
+
+    if (self->aside_func)
+    {
+        self->aside_func (entry->data, tmp_path, self->aside_data);
+    }
+
+    if (!et_rename_plan_move (entry->old_path, tmp_path, TRUE, error))
+    {
+        g_unlink (tmp_path);
+        g_free (tmp_path);
+        return FALSE;
+    }
+
+    entry->tmp_path = tmp_path;
+
+    return TRUE;
+}
+
+/*
+ * et_rename_plan_put_back:
+ * @entry: a file which failed to be renamed
+ *
+ * Move the file of @entry back from its temporary path, if it was moved
+ * aside. If its old path is taken, the file stays at its temporary path,
+ * which is reported once the plan was run.
+ *
+ * Returns: %TRUE if the file is at its old path, %FALSE otherwise
+ */
+static gboolean
+et_rename_plan_put_back (EtRenameEntry *entry)
+{
+    if (entry->tmp_path == NULL)
+    {
+        return TRUE;
+    }
+
+    if (!et_rename_plan_move (entry->tmp_path, entry->old_path, FALSE, NULL))
+    {
+        return FALSE;
+    }
+
+    g_clear_pointer (&entry->tmp_path, g_free);
+
+    return TRUE;
+}
+
+/*
+ * et_rename_plan_move_entry:
+ * @self: the rename plan
+ * @entry: the file to rename
+ * @directories: the directories which are known to exist
+ *
+ * Move the file of @entry to its new path, and update its state.
+ */
+static void
+et_rename_plan_move_entry (EtRenamePlan *self,
+                           EtRenameEntry *entry,
+                           GHashTable *directories)
+{
+    gchar *dirname;
+    const gchar *path;
+    GError *error = NULL;
+
+    if (entry->state != ET_RENAME_PENDING)
+    {
+        return;
+    }
+
+    /* Each new directory is only created once. */
+    dirname = g_path_get_dirname (entry->new_path);
+
+    if (g_hash_table_contains (directories, dirname))
+    {
+        g_free (dirname);
+    }
+    else if (g_mkdir_with_parents (dirname, 0777) == -1)
+    {
+        et_rename_plan_set_errno_error (&error, errno);
+        g_free (dirname);
+        et_rename_entry_fail (entry, error);
+        et_rename_plan_put_back (entry);
+        return;
+    }
+    else
+    {
+        g_hash_table_add (directories, dirname);
+    }
+
+    /* The file cannot be moved over itself, for example to change the case
+     * of its name on a case-insensitive filesystem. */
+    if (entry->same_file && entry->tmp_path == NULL
+        && !et_rename_plan_move_aside (self, entry, &error))
+    {
+        et_rename_entry_fail (entry, error);
+        return;
+    }
+
+    path = entry->tmp_path ? entry->tmp_path : entry->old_path;
+
+    if (et_rename_plan_move (path, entry->new_path, FALSE, &error))
+    {
+        entry->state = ET_RENAME_DONE;
+        g_clear_pointer (&entry->tmp_path, g_free);
+        return;
+    }
+
+    et_rename_entry_fail (entry, error);
+    et_rename_plan_put_back (entry);
+}
+
+/*
+ * et_rename_plan_undo_move:
+ * @entry: a file which was renamed
+ * @cause: the file of the same cycle which could not be renamed
+ *
+ * Move the file of @entry back to its old path, so that the old path of
+ * @cause, which was taken by @entry, is free again.
+ *
+ * Returns: %TRUE if the file was moved back, %FALSE otherwise
+ */
+static gboolean
+et_rename_plan_undo_move (EtRenameEntry *entry,
+                          const EtRenameEntry *cause)
+{
+    gchar *display_name;
+
+    if (!et_rename_plan_move (entry->new_path, entry->old_path, FALSE, NULL))
+    {
+        return FALSE;
+    }
+
+    display_name = g_filename_display_name (cause->old_path);
+    et_rename_entry_fail (entry,
+                          g_error_new (G_IO_ERROR, G_IO_ERROR_FAILED,
+                                       _("The file was not renamed, as ‘%s’ could not be renamed"),
+                                       display_name));
+    g_free (display_name);
+
+    return TRUE;
+}
+
+/*
+ * et_rename_plan_exchange:
+ * @self: the rename plan
+ * @entry: a file to rename
+ * @other: the file whose old path is the new path of @entry, and whose new
+ *         path is the old path of @entry
+ * @directories: the directories which are known to exist
+ *
+ * Swap the paths of the two files, atomically if possible.
+ */
+static void
+et_rename_plan_exchange (EtRenamePlan *self,
+                         EtRenameEntry *entry,
+                         EtRenameEntry *other,
+                         GHashTable *directories)
+{
+    GError *error = NULL;
+
+#ifdef HAVE_RENAMEAT2
+    if (renameat2 (AT_FDCWD, entry->old_path, AT_FDCWD, entry->new_path,
+                   RENAME_EXCHANGE) == 0)
+    {
+        entry->state = ET_RENAME_DONE;
+        other->state = ET_RENAME_DONE;
+        return;
+    }
+#endif /* HAVE_RENAMEAT2 */
+
+    if (!et_rename_plan_move_aside (self, entry, &error))
+    {
+        et_rename_entry_fail (entry, error);
+    }
+
+    /* If @entry could not be moved aside, @other fails as its new path is
+     * taken. */
+    et_rename_plan_move_entry (self, other, directories);
+    et_rename_plan_move_entry (self, entry, directories);
+
+    /* If @entry could not be moved to the old path of @other, its own old
+     * path is taken by @other, so move @other back first. */
+    if (entry->tmp_path != NULL && other->state == ET_RENAME_DONE
+        && et_rename_plan_undo_move (other, entry))
+    {
+        et_rename_plan_put_back (entry);
+    }
+}
+
+/*
+ * et_rename_plan_undo_cycle:
+ * @self: the rename plan
+ * @first: the index of the step which moved a file aside to break a cycle
+ * @last: the index of the step which failed to move that file to its new
+ *        path
+ *
+ * The file which was moved aside cannot be moved back to its old path once
+ * the next file of the cycle was renamed to it, so undo the renames of the
+ * cycle in reverse order, then put the file back.
+ */
+static void
+et_rename_plan_undo_cycle (EtRenamePlan *self,
+                           guint first,
+                           guint last)
+{
+    EtRenameEntry *aside;
+    guint i;
+
+    aside = g_array_index (self->steps, EtRenameStep, first).entry;
+
+    for (i = last - 1; i > first; i--)
+    {
+        EtRenameEntry *entry = g_array_index (self->steps, EtRenameStep,
+                                              i).entry;
+
+        /* Each earlier rename needs the old path which this one freed. */
+        if (entry->state == ET_RENAME_DONE
+            && !et_rename_plan_undo_move (entry, aside))
+        {
+            return;
+        }
+    }
+
+    et_rename_plan_put_back (aside);
+}
+
+/*
+ * et_rename_plan_execute:
+ * @self: the rename plan
+ *
+ * Rename the files, following the planned steps.
+ */
+static void
+et_rename_plan_execute (EtRenamePlan *self)
+{
+    GHashTable *directories;
+    EtRenameEntry *aside = NULL;
+    guint cycle_start = 0;
+    guint i;
+
+    directories = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                         NULL);
+
+    for (i = 0; i < self->steps->len; i++)
+    {
+        EtRenameStep *step = &g_array_index (self->steps, EtRenameStep, i);
+        GError *error = NULL;
+
+        switch (step->kind)
+        {
+            case ET_RENAME_STEP_MOVE:
+                et_rename_plan_move_entry (self, step->entry, directories);
+
+                /* The last step of a cycle moves the file which was moved
+                 * aside. */
+                if (step->entry == aside && step->entry->tmp_path != NULL)
+                {
+                    et_rename_plan_undo_cycle (self, cycle_start, i);
+                }
+                break;
+            case ET_RENAME_STEP_MOVE_ASIDE:
+                /* The rest of the cycle then fails, as the old path of the
+                 * file is still taken. */
+                if (!et_rename_plan_move_aside (self, step->entry, &error))
+                {
+                    et_rename_entry_fail (step->entry, error);
+                }
+
+                aside = step->entry;
+                cycle_start = i;
+                break;
+            case ET_RENAME_STEP_EXCHANGE:
+                et_rename_plan_exchange (self, step->entry, step->other,
+                                         directories);
+                break;
+            default:
+                g_assert_not_reached ();
+                break;
+        }
+    }
+
+    g_hash_table_destroy (directories);
+
+    /* Do not leave a file under a temporary name without saying where. */
+    for (i = 0; i < self->entries->len; i++)
+    {
+        EtRenameEntry *entry = g_ptr_array_index (self->entries, i);
+        gchar *display_name;
+
+        if (entry->tmp_path == NULL)
+        {
+            continue;
+        }
+
+        display_name = g_filename_display_name (entry->tmp_path);
+        et_rename_entry_fail (entry,
+                              g_error_new (entry->error->domain,
+                                           entry->error->code,
+                                           _("The file was left at ‘%s’: %s"),
+                                           display_name,
+                                           entry->error->message));
+        g_free (display_name);
+    }
+}
+
+/*
+ * et_rename_plan_run:
+ * @self: the rename plan
+ * @func: the function to call with the result of each file
+ * @user_data: user data to pass to @func
+ *
+ * Check that the files of the plan can be renamed, rename them, then call
+ * @func for each of them. This is safe to call from a worker thread.
+ */
+void
+et_rename_plan_run (EtRenamePlan *self,
+                    EtRenamePlanFunc func,
+                    gpointer user_data)
+{
+    guint i;
+
+    g_return_if_fail (self != NULL);
+    g_return_if_fail (func != NULL);
+
+    et_rename_plan_resolve (self);
+    et_rename_plan_schedule (self);
+    et_rename_plan_execute (self);
+
+    for (i = 0; i < self->entries->len; i++)
+    {
+        EtRenameEntry *entry = g_ptr_array_index (self->entries, i);
+        GError *error = entry->error;
+
+        entry->error = NULL;
+        func (entry->data, entry->state == ET_RENAME_DONE, error, user_data);
+    }
+}
+
+/*
+ * et_rename_plan_free:
+ * @self: the rename plan
+ *
+ * Free the plan.
+ */
+void
+et_rename_plan_free (EtRenamePlan *self)
+{
+    g_return_if_fail (self != NULL);
+
+    g_array_unref (self->steps);
+    g_hash_table_destroy (self->by_new_path);
+    g_hash_table_destroy (self->by_old_path);
+    g_ptr_array_unref (self->entries);
+    g_slice_free (EtRenamePlan, self);
+}
@@ -0,0 +1,66 @@
+/* EasyTAG - tag editor for audio files
+ * Copyright (C) 2026  agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef ET_RENAME_PLAN_H_
+#define ET_RENAME_PLAN_H_
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _EtRenamePlan EtRenamePlan;
+
+/*
+ * EtRenamePlanFunc:
+ * @data: the data passed to et_rename_plan_add() for the file
+ * @renamed: %TRUE if the file was renamed
+ * @error: (transfer full): the error if the file was not renamed, or %NULL
+ * @user_data: the user data passed to et_rename_plan_run()
+ *
+ * Called once for each file of the plan, in the order in which they were
+ * added, after all the files were renamed.
+ */
+typedef void (*EtRenamePlanFunc) (gpointer data, gboolean renamed,
+                                  GError *error, gpointer user_data);
+
+/*
+ * EtRenamePlanAsideFunc:
+ * @data: the data passed to et_rename_plan_add() for the file
+ * @tmp_path: the temporary path which the file is about to be moved to
+ * @user_data: the user data passed to et_rename_plan_set_aside_func()
+ *
+ * Called before a file is moved to a temporary path, to free its old path
+ * for another file of the plan, or to change the case of its name. The file
+ * is left there if the renames are interrupted.
+ */
+typedef void (*EtRenamePlanAsideFunc) (gpointer data, const gchar *tmp_path,
+                                       gpointer user_data);
+
+EtRenamePlan * et_rename_plan_new (void);
+void et_rename_plan_add (EtRenamePlan *self, const gchar *old_path,
+                         const gchar *new_path, gpointer data);
+void et_rename_plan_set_aside_func (EtRenamePlan *self,
+                                    EtRenamePlanAsideFunc func,
+                                    gpointer user_data);
+void et_rename_plan_run (EtRenamePlan *self, EtRenamePlanFunc func,
+                         gpointer user_data);
+void et_rename_plan_free (EtRenamePlan *self);
+
+G_END_DECLS
+
+#endif /* ET_RENAME_PLAN_H_ */
@@ -0,0 +1,731 @@
+/* EasyTAG - tag editor for audio files
+ * Copyright (C) 2026  agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "config.h"
+
+#include "save_engine.h"
+
+#include <gio/gio.h>
+
+#include "file_list.h"
+#ifdef ENABLE_MP3
+#include "id3_tag.h"
+#endif
+#include "rename_plan.h"
+#include "save_journal.h"
+
+/*
+ * The save engine writes tags and renames files on a pool of worker threads.
+ * Files are grouped by the directory that they are in, and the files of a
+ * directory are saved one after the other, in the order in which they were
+ * pushed, by a single worker at a time, while separate directories are saved
+ * in parallel.
+ *
+ * The files to rename are collected in a batch, until
+ * et_save_engine_flush_renames() is called. Once the tags of all the files of
+ * the batch are written, the files are renamed together with an
+ * #EtRenamePlan, so that renames which depend on each other, such as swaps,
+ * are ordered and resolved as a whole.
+ *
+ * The workers write a snapshot of the tag and filename of each file, taken
+ * when the file was pushed, so that the file can still be edited while it is
+ * queued. The results are sent back to the main thread, where they are
+ * applied to the file list in batches from an idle callback.
+ *
+ * Each file is recorded in the save journal when it is pushed, so that a save
+ * which is interrupted can be recovered at the next startup. The identity of
+ * each file of a batch is recorded before the batch is renamed, so that the
+ * file is still found if the renames are interrupted.
+ */
+
+/* Saving is mostly limited by I/O, so a few threads are enough to keep the
+ * disks busy. */
+#define ET_SAVE_ENGINE_MAX_THREADS 4
+
+struct _EtSaveEngine
+{
+    EtSaveEngineFunc func;
+    gpointer user_data;
+
+    GThreadPool *pool;
+    GAsyncQueue *results;
+    EtSaveJournal *journal;
+
+    /* Protects directories and the queues of the EtSaveDirectory. */
+    GMutex mutex;
+    GHashTable *directories;
+
+    /* Accessed atomically. */
+    gint stopped;
+    gint flush_pending;
+
+    /* Only accessed from the main thread. */
+    guint n_pending;
+    struct _EtSaveRenameBatch *batch;
+};
+
+typedef struct _EtSaveRenameBatch
+{
+    /* The jobs which rename their file, in the order in which they were
+     * pushed. */
+    GPtrArray *jobs;
+    /* The number of jobs whose tags are not written yet, plus one until the
+     * batch is flushed. Protected by the mutex of the engine. */
+    guint n_unfinished;
+} EtSaveRenameBatch;
+
+typedef struct
+{
+    GQueue jobs;
+    /* TRUE while the directory is queued in, or run by, the thread pool. */
+    gboolean running;
+} EtSaveDirectory;
+
+typedef struct
+{
+    /* Must be first, as the results are passed to the EtSaveEngineFunc. */
+    EtSaveEngineResult result;
+
+    gchar *filename_cur;
+    gchar *filename_new;
+    guint64 modification_time;
+    guint journal_id;
+
+    /* The tag and new filename of the file when it was pushed, in its
+     * history, to be marked as saved. Never dereferenced. */
+    const File_Tag *tag;
+    const File_Name *name;
+    /* Copy of the file, with a copy of the tag and the current filename,
+     * written by the worker. */
+    ET_File snapshot;
+
+    /* The batch of renames which the job belongs to, or NULL. */
+    EtSaveRenameBatch *batch;
+    /* FALSE if the file must not be renamed any more, as writing its tag
+     * failed. */
+    gboolean rename;
+} EtSaveJob;
+
+static void
+et_save_job_free (EtSaveJob *job)
+{
+    EtSaveEngineResult *result = &job->result;
+
+    g_clear_error (&result->tag_error);
+    g_clear_error (&result->rename_error);
+    g_free (result->filename_cur_utf8);
+    g_free (result->filename_new_utf8);
+    g_free (job->filename_cur);
+    g_free (job->filename_new);
+    g_list_free_full (job->snapshot.FileTagList,
+                      (GDestroyNotify)et_file_tag_free);
+    g_list_free_full (job->snapshot.FileNameList,
+                      (GDestroyNotify)et_file_name_free);
+    g_slice_free (EtSaveJob, job);
+}
+
+static void
+et_save_directory_free (EtSaveDirectory *directory)
+{
+    g_queue_foreach (&directory->jobs, (GFunc)et_save_job_free, NULL);
+    g_queue_clear (&directory->jobs);
+    g_slice_free (EtSaveDirectory, directory);
+}
+
+/*
+ * et_save_engine_flush:
+ * @user_data: the #EtSaveEngine
+ *
+ * Mark the files which were saved since the last flush, and pass them to the
+ * callback of the engine as a single batch.
+ *
+ * Returns: %G_SOURCE_REMOVE
+ */
+static gboolean
+et_save_engine_flush (gpointer user_data)
+{
+    EtSaveEngine *self = user_data;
+    GPtrArray *results;
+    EtSaveJob *job;
+
+    /* Reset before draining, so that a result which is pushed while draining
+     * schedules a new flush at worst. */
+    g_atomic_int_set (&self->flush_pending, FALSE);
+
+    results = g_ptr_array_new_with_free_func ((GDestroyNotify)et_save_job_free);
+
+    while ((job = g_async_queue_try_pop (self->results)))
+    {
+        EtSaveEngineResult *result = &job->result;
+        ET_File *ETFile = result->ETFile;
+
+        g_assert (ETFile->pending_saves > 0);
+        ETFile->pending_saves--;
+
+        if (result->flags & ET_SAVE_ENGINE_WRITE_TAG && !result->skipped)
+        {
+            ETFile->FileModificationTime = job->modification_time;
+        }
+
+        /* Only what was pushed was saved, even if the file was edited since,
+         * and the edits may have dropped it from the history. */
+        if (result->tag_written && !et_file_mark_saved_tag (ETFile, job->tag))
+        {
+            g_debug ("%s", "Saved tag no longer in the history of the file");
+        }
+
+        if (result->renamed && !et_file_mark_saved_name (ETFile, job->name))
+        {
+            g_debug ("%s",
+                     "Saved filename no longer in the history of the file");
+        }
+
+        /* Show that the file is no longer pending. */
+        et_dirty_file_list_add (ETFile);
+
+        g_ptr_array_add (results, job);
+    }
+
+    if (results->len > 0)
+    {
+        g_assert (self->n_pending >= results->len);
+        self->n_pending -= results->len;
+        self->func (self, results, self->user_data);
+    }
+
+    g_ptr_array_unref (results);
+
+    return G_SOURCE_REMOVE;
+}
+
+/*
+ * et_save_engine_run_job:
+ * @job: the job to run
+ *
+ * Write the tag of the file, if requested by the flags of the job. The file
+ * is renamed later, with the rest of its batch. Called from a worker thread.
+ *
+ * Returns: %FALSE if the job failed in a way which should stop the engine,
+ *          %TRUE otherwise
+ */
+static gboolean
+et_save_engine_run_job (EtSaveJob *job)
+{
+    EtSaveEngineResult *result = &job->result;
+
+    if (result->flags & ET_SAVE_ENGINE_WRITE_TAG)
+    {
+        result->tag_written = et_file_write_tag (&job->snapshot,
+                                                 &job->modification_time,
+                                                 &result->tag_error);
+
+        /* Do not rename a file whose tag could not be written. */
+        if (!result->tag_written
+            && result->flags & ET_SAVE_ENGINE_STOP_ON_TAG_ERROR)
+        {
+            job->rename = FALSE;
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/*
+ * et_save_engine_post:
+ * @self: the save engine
+ * @job: the finished job
+ *
+ * Send the result of @job to the main thread.
+ */
+static void
+et_save_engine_post (EtSaveEngine *self,
+                     EtSaveJob *job)
+{
+    g_async_queue_push (self->results, job);
+
+    if (g_atomic_int_compare_and_exchange (&self->flush_pending, FALSE, TRUE))
+    {
+        g_idle_add (et_save_engine_flush, self);
+    }
+}
+
+static void
+et_save_engine_on_renamed (gpointer data,
+                           gboolean renamed,
+                           GError *error,
+                           gpointer user_data)
+{
+    EtSaveJob *job = data;
+    EtSaveEngine *self = user_data;
+    EtSaveEngineResult *result = &job->result;
+
+    result->renamed = renamed;
+    result->rename_error = error;
+
+    if (!renamed && result->flags & ET_SAVE_ENGINE_STOP_ON_RENAME_ERROR)
+    {
+        g_atomic_int_set (&self->stopped, TRUE);
+    }
+}
+
+static void
+et_save_engine_on_aside (gpointer data,
+                         const gchar *tmp_path,
+                         gpointer user_data)
+{
+    EtSaveJob *job = data;
+    EtSaveEngine *self = user_data;
+
+    et_save_journal_move_aside (self->journal, job->journal_id, tmp_path);
+}
+
+/*
+ * et_save_engine_run_batch:
+ * @self: the save engine
+ * @batch: the batch of renames, whose tags were all written
+ *
+ * Rename the files of @batch together, then send their results to the main
+ * thread, and free @batch. Called from the worker which finished the last
+ * job of the batch, or from the main thread when the batch is flushed after
+ * that.
+ */
+static void
+et_save_engine_run_batch (EtSaveEngine *self,
+                          EtSaveRenameBatch *batch)
+{
+    EtRenamePlan *plan;
+    guint i;
+
+    plan = et_rename_plan_new ();
+
+    /* The files are not renamed once the engine was stopped, like the files
+     * which were not started then. */
+    if (!g_atomic_int_get (&self->stopped))
+    {
+        for (i = 0; i < batch->jobs->len; i++)
+        {
+            EtSaveJob *job = g_ptr_array_index (batch->jobs, i);
+
+            if (job->rename && !job->result.skipped)
+            {
+                et_rename_plan_add (plan, job->filename_cur,
+                                    job->filename_new, job);
+                et_save_journal_add_rename (self->journal, job->journal_id,
+                                            job->filename_cur);
+            }
+        }
+    }
+
+    /* Record the identities of the files before any of them is renamed, so
+     * that they can be found at whichever path they were left on recovery. */
+    et_save_journal_begin_renames (self->journal);
+    et_rename_plan_set_aside_func (plan, et_save_engine_on_aside, self);
+    et_rename_plan_run (plan, et_save_engine_on_renamed, self);
+    et_rename_plan_free (plan);
+
+    for (i = 0; i < batch->jobs->len; i++)
+    {
+        EtSaveJob *job = g_ptr_array_index (batch->jobs, i);
+
+        if (job->result.skipped)
+        {
+            et_save_journal_end (self->journal, job->journal_id, NULL);
+        }
+        else
+        {
+            et_save_journal_end (self->journal, job->journal_id,
+                                 job->result.renamed ? job->filename_new
+                                                     : job->filename_cur);
+        }
+
+        et_save_engine_post (self, job);
+    }
+
+    g_ptr_array_unref (batch->jobs);
+    g_slice_free (EtSaveRenameBatch, batch);
+}
+
+/*
+ * et_save_engine_unref_batch:
+ * @self: the save engine
+ * @batch: the batch of renames
+ *
+ * Drop a job, or the flushing, which the batch waits for, and rename the
+ * files of the batch if nothing is left to wait for.
+ */
+static void
+et_save_engine_unref_batch (EtSaveEngine *self,
+                            EtSaveRenameBatch *batch)
+{
+    gboolean finished;
+
+    g_mutex_lock (&self->mutex);
+    finished = (--batch->n_unfinished == 0);
+    g_mutex_unlock (&self->mutex);
+
+    if (finished)
+    {
+        et_save_engine_run_batch (self, batch);
+    }
+}
+
+/*
+ * et_save_engine_worker:
+ * @data: the #EtSaveDirectory to save the files of
+ * @user_data: the #EtSaveEngine
+ *
+ * Save the queued files of a directory in order, until its queue is empty.
+ */
+static void
+et_save_engine_worker (gpointer data, gpointer user_data)
+{
+    EtSaveDirectory *directory = data;
+    EtSaveEngine *self = user_data;
+
+    for (;;)
+    {
+        EtSaveJob *job;
+
+        g_mutex_lock (&self->mutex);
+        job = g_queue_pop_head (&directory->jobs);
+
+        if (job == NULL)
+        {
+            directory->running = FALSE;
+            g_mutex_unlock (&self->mutex);
+            return;
+        }
+
+        g_mutex_unlock (&self->mutex);
+
+        if (g_atomic_int_get (&self->stopped))
+        {
+            job->result.skipped = TRUE;
+        }
+        else
+        {
+            et_save_journal_begin (self->journal, job->journal_id);
+
+            if (!et_save_engine_run_job (job))
+            {
+                g_atomic_int_set (&self->stopped, TRUE);
+            }
+
+            et_save_journal_written (self->journal, job->journal_id);
+        }
+
+        /* The file is renamed, and its save completed, with its batch. */
+        if (job->batch)
+        {
+            et_save_engine_unref_batch (self, job->batch);
+            continue;
+        }
+
+        et_save_journal_end (self->journal, job->journal_id,
+                             job->result.skipped ? NULL : job->filename_cur);
+        et_save_engine_post (self, job);
+    }
+}
+
+/*
+ * et_save_engine_new:
+ * @func: the function to call with each batch of results
+ * @user_data: user data to pass to @func
+ *
+ * Create a new save engine. The engine must be created and used from the main
+ * thread.
+ *
+ * Returns: a new #EtSaveEngine, free with et_save_engine_free()
+ */
+EtSaveEngine *
+et_save_engine_new (EtSaveEngineFunc func, gpointer user_data)
+{
+    EtSaveEngine *self;
+
+    g_return_val_if_fail (func != NULL, NULL);
+
+    self = g_slice_new0 (EtSaveEngine);
+    self->func = func;
+    self->user_data = user_data;
+    self->results = g_async_queue_new ();
+    self->journal = et_save_journal_new ();
+    g_mutex_init (&self->mutex);
+    self->directories = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                               (GDestroyNotify)et_save_directory_free);
+
+    /* Non-exclusive pools cannot fail to be created. */
+    self->pool = g_thread_pool_new (et_save_engine_worker, self,
+                                    ET_SAVE_ENGINE_MAX_THREADS, FALSE, NULL);
+
+#ifdef ENABLE_MP3
+    /* The check changes the settings temporarily, so do it before the
+     * workers can write any tag. */
+    et_id3tag_check_id3lib ();
+#endif
+
+    return self;
+}
+
+/*
+ * et_save_engine_push:
+ * @self: the save engine
+ * @ETFile: the file to save
+ * @flags: what to save
+ *
+ * Queue @ETFile to be saved after the files previously pushed from the same
+ * directory. The current tag and filename of @ETFile are saved, so it may be
+ * edited while it is queued, but it must not be freed, or pushed again, until
+ * its result was passed to the callback of the engine.
+ */
+void
+et_save_engine_push (EtSaveEngine *self, ET_File *ETFile,
+                     EtSaveEngineFlags flags)
+{
+    const File_Name *FileNameCur;
+    const File_Name *FileNameNew;
+    File_Tag *FileTag;
+    File_Name *FileName;
+    EtSaveDirectory *directory;
+    EtSaveJob *job;
+    gchar *dirname;
+
+    g_return_if_fail (self != NULL);
+    g_return_if_fail (ETFile != NULL);
+
+    FileNameCur = (File_Name *)ETFile->FileNameCur->data;
+    FileNameNew = (File_Name *)ETFile->FileNameNew->data;
+
+    job = g_slice_new0 (EtSaveJob);
+    job->result.ETFile = ETFile;
+    job->result.flags = flags;
+    job->result.filename_cur_utf8 = g_strdup (FileNameCur->value_utf8);
+    job->result.filename_new_utf8 = g_strdup (FileNameNew->value_utf8);
+    job->filename_cur = g_strdup (FileNameCur->value);
+    job->filename_new = g_strdup (FileNameNew->value);
+    job->modification_time = ETFile->FileModificationTime;
+    job->journal_id = et_save_journal_add (self->journal, ETFile,
+                                           flags & ET_SAVE_ENGINE_WRITE_TAG,
+                                           flags & ET_SAVE_ENGINE_RENAME);
+
+    job->tag = ETFile->FileTag->data;
+    job->name = FileNameNew;
+
+    FileTag = et_file_tag_new ();
+    et_file_tag_copy_into (FileTag, job->tag);
+
+    FileName = et_file_name_new ();
+    FileName->value = g_strdup (FileNameCur->value);
+    FileName->value_utf8 = g_strdup (FileNameCur->value_utf8);
+    FileName->value_ck = g_strdup (FileNameCur->value_ck);
+
+    /* The header information is never modified, so it can be shared. */
+    job->snapshot = *ETFile;
+    job->snapshot.FileTagList = g_list_append (NULL, FileTag);
+    job->snapshot.FileTag = job->snapshot.FileTagList;
+    job->snapshot.FileTagListBak = NULL;
+    job->snapshot.FileNameList = g_list_append (NULL, FileName);
+    job->snapshot.FileNameCur = job->snapshot.FileNameList;
+    job->snapshot.FileNameNew = job->snapshot.FileNameList;
+    job->snapshot.FileNameListBak = NULL;
+
+    ETFile->pending_saves++;
+    et_dirty_file_list_add (ETFile);
+
+    self->n_pending++;
+
+    dirname = g_path_get_dirname (job->filename_cur);
+
+    g_mutex_lock (&self->mutex);
+
+    directory = g_hash_table_lookup (self->directories, dirname);
+
+    if (directory == NULL)
+    {
+        directory = g_slice_new0 (EtSaveDirectory);
+        g_queue_init (&directory->jobs);
+        g_hash_table_insert (self->directories, dirname, directory);
+    }
+    else
+    {
+        g_free (dirname);
+    }
+
+    /* The batch must be referenced before a worker can finish the job. */
+    if (flags & ET_SAVE_ENGINE_RENAME)
+    {
+        if (self->batch == NULL)
+        {
+            self->batch = g_slice_new (EtSaveRenameBatch);
+            self->batch->jobs = g_ptr_array_new ();
+            self->batch->n_unfinished = 1;
+        }
+
+        job->batch = self->batch;
+        job->rename = TRUE;
+        g_ptr_array_add (self->batch->jobs, job);
+        self->batch->n_unfinished++;
+    }
+
+    g_queue_push_tail (&directory->jobs, job);
+
+    if (!directory->running)
+    {
+        directory->running = TRUE;
+        g_thread_pool_push (self->pool, directory, NULL);
+    }
+
+    g_mutex_unlock (&self->mutex);
+}
+
+/*
+ * et_save_engine_flush_renames:
+ * @self: the save engine
+ *
+ * Close the batch of files to rename which were pushed so far. They are
+ * renamed together once all their tags are written, and the files which are
+ * pushed next start a new batch.
+ */
+void
+et_save_engine_flush_renames (EtSaveEngine *self)
+{
+    EtSaveRenameBatch *batch;
+
+    g_return_if_fail (self != NULL);
+
+    batch = self->batch;
+
+    if (batch == NULL)
+    {
+        return;
+    }
+
+    self->batch = NULL;
+
+    /* If all the tags were already written, the files are renamed right
+     * away, on the main thread. */
+    et_save_engine_unref_batch (self, batch);
+}
+
+/*
+ * et_save_engine_stop:
+ * @self: the save engine
+ *
+ * Skip the files which were not started yet. They are still passed to the
+ * callback, with their skipped field set.
+ */
+void
+et_save_engine_stop (EtSaveEngine *self)
+{
+    g_return_if_fail (self != NULL);
+
+    g_atomic_int_set (&self->stopped, TRUE);
+}
+
+/*
+ * et_save_engine_is_stopped:
+ * @self: the save engine
+ *
+ * Check whether the engine was stopped, either with et_save_engine_stop() or
+ * because saving a file failed with a stop flag.
+ *
+ * Returns: %TRUE if the engine was stopped, %FALSE otherwise
+ */
+gboolean
+et_save_engine_is_stopped (EtSaveEngine *self)
+{
+    g_return_val_if_fail (self != NULL, TRUE);
+
+    return g_atomic_int_get (&self->stopped);
+}
+
+/*
+ * et_save_engine_get_n_pending:
+ * @self: the save engine
+ *
+ * Returns: the number of pushed files whose results were not passed to the
+ *          callback yet
+ */
+guint
+et_save_engine_get_n_pending (EtSaveEngine *self)
+{
+    g_return_val_if_fail (self != NULL, 0);
+
+    return self->n_pending;
+}
+
+/*
+ * et_save_engine_wait:
+ * @self: the save engine
+ *
+ * Run the main loop until the results of all pushed files were passed to the
+ * callback, then make sure that the files are on the disk.
+ */
+void
+et_save_engine_wait (EtSaveEngine *self)
+{
+    g_return_if_fail (self != NULL);
+
+    et_save_engine_flush_renames (self);
+
+    while (self->n_pending > 0)
+    {
+        g_main_context_iteration (NULL, TRUE);
+    }
+
+    et_save_journal_sync (self->journal);
+}
+
+/*
+ * et_save_engine_free:
+ * @self: the save engine
+ *
+ * Wait for the files being saved, then free the engine. Results which were
+ * not passed to the callback yet are discarded, without marking the files as
+ * saved, so call et_save_engine_wait() first.
+ */
+void
+et_save_engine_free (EtSaveEngine *self)
+{
+    EtSaveJob *job;
+
+    g_return_if_fail (self != NULL);
+
+    et_save_engine_stop (self);
+    et_save_engine_flush_renames (self);
+    g_thread_pool_free (self->pool, FALSE, TRUE);
+
+    /* No worker can schedule a flush any more. */
+    while (g_source_remove_by_user_data (self))
+    {
+        ;
+    }
+
+    while ((job = g_async_queue_try_pop (self->results)))
+    {
+        job->result.ETFile->pending_saves--;
+        et_save_job_free (job);
+    }
+
+    /* Every pushed file was either saved or skipped, so the save is over. */
+    et_save_journal_free (self->journal);
+    g_async_queue_unref (self->results);
+    g_hash_table_destroy (self->directories);
+    g_mutex_clear (&self->mutex);
+    g_slice_free (EtSaveEngine, self);
+}
@@ -0,0 +1,101 @@
+/* EasyTAG - tag editor for audio files
+ * Copyright (C) 2026  agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef ET_SAVE_ENGINE_H_
+#define ET_SAVE_ENGINE_H_
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+#include "file.h"
+
+typedef struct _EtSaveEngine EtSaveEngine;
+
+/*
+ * EtSaveEngineFlags:
+ * @ET_SAVE_ENGINE_WRITE_TAG: write the current tag of the file
+ * @ET_SAVE_ENGINE_RENAME: rename the file to its new filename
+ * @ET_SAVE_ENGINE_STOP_ON_TAG_ERROR: stop the engine if writing the tag fails
+ * @ET_SAVE_ENGINE_STOP_ON_RENAME_ERROR: stop the engine if renaming fails
+ *
+ * What to do with a file pushed to the save engine.
+ */
+typedef enum
+{
+    ET_SAVE_ENGINE_WRITE_TAG = 1 << 0,
+    ET_SAVE_ENGINE_RENAME = 1 << 1,
+    ET_SAVE_ENGINE_STOP_ON_TAG_ERROR = 1 << 2,
+    ET_SAVE_ENGINE_STOP_ON_RENAME_ERROR = 1 << 3
+} EtSaveEngineFlags;
+
+/*
+ * EtSaveEngineResult:
+ * @ETFile: the file which was saved
+ * @flags: the flags which the file was pushed with
+ * @skipped: %TRUE if the file was not processed, as the engine was stopped
+ * @tag_written: %TRUE if the tag was written
+ * @renamed: %TRUE if the file was renamed
+ * @tag_error: the error when writing the tag, or %NULL
+ * @rename_error: the error when renaming, or %NULL
+ * @filename_cur_utf8: the UTF-8 filename before renaming
+ * @filename_new_utf8: the UTF-8 filename to rename to
+ *
+ * The outcome of saving a single file. By the time it is passed to the
+ * #EtSaveEngineFunc, the tag and filename which were saved were already
+ * marked as saved.
+ */
+typedef struct
+{
+    ET_File *ETFile;
+    EtSaveEngineFlags flags;
+    gboolean skipped;
+    gboolean tag_written;
+    gboolean renamed;
+    GError *tag_error;
+    GError *rename_error;
+    gchar *filename_cur_utf8;
+    gchar *filename_new_utf8;
+} EtSaveEngineResult;
+
+/*
+ * EtSaveEngineFunc:
+ * @engine: the save engine
+ * @results: (element-type EtSaveEngineResult): the results of a batch of
+ *           files, in the order in which they completed
+ * @user_data: the user data passed to et_save_engine_new()
+ *
+ * Called on the main thread with the files that finished since the previous
+ * batch.
+ */
+typedef void (*EtSaveEngineFunc) (EtSaveEngine *engine, GPtrArray *results,
+                                  gpointer user_data);
+
+EtSaveEngine * et_save_engine_new (EtSaveEngineFunc func, gpointer user_data);
+void et_save_engine_push (EtSaveEngine *self, ET_File *ETFile,
+                          EtSaveEngineFlags flags);
+void et_save_engine_flush_renames (EtSaveEngine *self);
+void et_save_engine_stop (EtSaveEngine *self);
+gboolean et_save_engine_is_stopped (EtSaveEngine *self);
+guint et_save_engine_get_n_pending (EtSaveEngine *self);
+void et_save_engine_wait (EtSaveEngine *self);
+void et_save_engine_free (EtSaveEngine *self);
+
+G_END_DECLS
+
+#endif /* ET_SAVE_ENGINE_H_ */
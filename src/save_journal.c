@@ -0,0 +1,3033 @@
+/* EasyTAG - tag editor for audio files
+ * Copyright (C) 2026  agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/* For syncfs(), fallocate() and copy_file_range(). */
+#define _GNU_SOURCE
+
+#include "config.h"
+
+#include "save_journal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glib/gi18n.h>
+#include <glib/gstdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef G_OS_WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#ifdef HAVE_LINUX_FALLOC_H
+#include <linux/falloc.h>
+#endif
+#endif
+
+#include "charset.h"
+#include "file_list.h"
+#include "log.h"
+#include "rename_plan.h"
+#include "save_engine.h"
+
+/*
+ * The save journal records what a save is about to do to each file, so that
+ * a save which is interrupted by a crash or a power loss can be finished or
+ * undone at the next startup.
+ *
+ * The journal is a text file in the cache directory, with one record per
+ * line, and each field of a record escaped with g_strescape():
+ *
+ *   I <id> <write tag> <rename> <current filename> <new filename>
+ *     [<fields of the new tag> <pictures of the new tag, or - if unchanged>]
+ *   N <id> <device> <inode>
+ *   A <id> <temporary path>
+ *   D <id>
+ *
+ * An intent record (I) is made durable before the file is touched. Syncing
+ * each file as it is saved would limit a save to one file per disk flush, so
+ * the files are synced in groups instead, after which their done records (D)
+ * are appended to the journal. The journal is removed once the whole save
+ * is durable.
+ *
+ * The files which are renamed together may take the paths of each other, or
+ * be moved to a temporary path to break a cycle, so a file cannot be found by
+ * its path once the renames were interrupted. The identity of each file (N)
+ * is made durable before any file of the batch is renamed, and each
+ * temporary path (A) before a file is moved there. On recovery, the files
+ * are found by their identity, and moved back to their old paths, before
+ * anything else is done.
+ *
+ * While the tag of a file is written, the tag writers record each change
+ * which they are about to make to the file in an undo file next to the
+ * journal, named after the identifier of the file. Each undo record is
+ * synced before the change is made:
+ *
+ *   B: the original bytes of a range which is about to be overwritten,
+ *      moved or truncated, and the size of the file. Only short ranges are
+ *      moved in place: when the audio data would have to be moved, the file
+ *      is written to a temporary file instead, so that the audio data is
+ *      never copied to the undo file
+ *   S: a range which is about to be inserted or collapsed by the filesystem
+ *   T: a temporary file which is about to be created next to the file
+ *   R: a synced temporary file which is about to be renamed over the file
+ *
+ * On recovery, the undo records of the files which were not done are undone
+ * in the reverse order, which puts the original bytes back and removes the
+ * temporary files. Once a file was replaced by a temporary file, its
+ * previous contents are gone, and it cannot be rolled back any more. When
+ * resuming, the new tag is written again over the consistent file.
+ */
+
+#define ET_SAVE_JOURNAL_HEADER "EasyTAG save journal 2"
+
+/* Number of saved files to sync at once. */
+#define ET_SAVE_JOURNAL_GROUP_SIZE 32
+
+/* Size of the buffer used to copy data to and from an undo file, when it
+ * cannot be copied within the kernel. */
+#define ET_SAVE_JOURNAL_BUFFER_SIZE (1024 * 1024)
+
+struct _EtSaveJournal
+{
+    gchar *path;
+    /* -1 if the journal could not be written, in which case the files are
+     * still synced, but the save cannot be recovered. Only written with
+     * write_mutex held, and read atomically otherwise. */
+    gint fd;
+
+    /* Serializes the writes to the journal. The disk is only waited for
+     * with this held, so that et_save_journal_add() is never blocked by a
+     * sync. */
+    GMutex write_mutex;
+
+    /* Protects all of the following. */
+    GMutex mutex;
+
+    /* Intent records which were not written to the journal yet. */
+    GString *pending;
+    guint last_id;
+    guint synced_id;
+
+    /* Files which were saved since the last group was synced. */
+    GArray *saved_ids;
+    GPtrArray *saved_files;
+};
+
+typedef struct
+{
+    guint id;
+    gboolean done;
+    gboolean write_tag;
+    gboolean rename;
+    gchar *filename_cur;
+    gchar *filename_new;
+    gchar **new_fields;
+    /* Whether the pictures of the file were changed to new_pictures. */
+    gboolean set_pictures;
+    EtPicture *new_pictures;
+
+    /* Whether the identity of the file was recorded before it was renamed,
+     * and the paths which it was moved to meanwhile, or NULL. */
+    gboolean identified;
+    guint64 device;
+    guint64 inode;
+    GPtrArray *tmp_paths;
+    /* The path of the file once it was found on recovery, or NULL. */
+    gchar *filename;
+} EtSaveJournalEntry;
+
+typedef enum
+{
+    ET_SAVE_JOURNAL_UNDO_BYTES = 'B',
+    ET_SAVE_JOURNAL_UNDO_SHIFT = 'S',
+    ET_SAVE_JOURNAL_UNDO_TEMPORARY = 'T',
+    ET_SAVE_JOURNAL_UNDO_REPLACE = 'R'
+} EtSaveJournalUndoType;
+
+/* A record of an undo file is this header, in little-endian, followed by
+ * the data of the record, then by the type again. The trailer is only
+ * written once the header and the data are on the disk, so that a record
+ * which was only partly written, even in an order chosen by the disk, is
+ * detected. */
+typedef struct
+{
+    guint64 type;
+    /* The identity and the size of the file when the record was made, or of
+     * the temporary file for ET_SAVE_JOURNAL_UNDO_REPLACE. */
+    guint64 device;
+    guint64 inode;
+    guint64 size;
+    guint64 offset;
+    /* The length of the data, or the signed distance of a shift. */
+    guint64 length;
+} EtSaveJournalUndoHeader;
+
+typedef struct
+{
+    EtSaveJournalUndoType type;
+    guint64 device;
+    guint64 inode;
+    goffset size;
+    goffset offset;
+    goffset length;
+    /* Offset of the data in the undo file. */
+    goffset data;
+} EtSaveJournalUndo;
+
+typedef struct
+{
+    goffset start;
+    goffset end;
+} EtSaveJournalRange;
+
+/* The file whose tag is written by the current thread. */
+typedef struct
+{
+    EtSaveJournal *journal;
+    guint id;
+    gchar *path;
+    /* The undo file, or -1 until the first change. */
+    gint fd;
+
+    /* The ranges of the file which were backed up since it was last
+     * shifted, whose original bytes are already in the undo file. */
+    guint64 device;
+    guint64 inode;
+    GArray *ranges;
+} EtSaveJournalCurrent;
+
+static GPrivate et_save_journal_current = G_PRIVATE_INIT (NULL);
+
+/* The text fields of the tag which are recorded in the journal. Unsupported
+ * fields are kept from the file on recovery. */
+static const glong tag_fields[] =
+{
+    G_STRUCT_OFFSET (File_Tag, title),
+    G_STRUCT_OFFSET (File_Tag, artist),
+    G_STRUCT_OFFSET (File_Tag, album_artist),
+    G_STRUCT_OFFSET (File_Tag, album),
+    G_STRUCT_OFFSET (File_Tag, disc_number),
+    G_STRUCT_OFFSET (File_Tag, disc_total),
+    G_STRUCT_OFFSET (File_Tag, year),
+    G_STRUCT_OFFSET (File_Tag, track),
+    G_STRUCT_OFFSET (File_Tag, track_total),
+    G_STRUCT_OFFSET (File_Tag, genre),
+    G_STRUCT_OFFSET (File_Tag, comment),
+    G_STRUCT_OFFSET (File_Tag, composer),
+    G_STRUCT_OFFSET (File_Tag, orig_artist),
+    G_STRUCT_OFFSET (File_Tag, copyright),
+    G_STRUCT_OFFSET (File_Tag, url),
+    G_STRUCT_OFFSET (File_Tag, encoded_by)
+};
+
+static gchar *
+et_save_journal_get_path (void)
+{
+    return g_build_filename (g_get_user_cache_dir (), PACKAGE_TARNAME,
+                             "save-journal", NULL);
+}
+
+static gchar *
+et_save_journal_get_undo_path (const gchar *path, guint id)
+{
+    return g_strdup_printf ("%s-%u", path, id);
+}
+
+/*
+ * et_save_journal_sync_fd:
+ * @fd: the file descriptor to sync
+ *
+ * Flush the data of @fd to the disk.
+ *
+ * Returns: %TRUE on success, %FALSE otherwise, with errno set
+ */
+static gboolean
+et_save_journal_sync_fd (gint fd)
+{
+#ifdef G_OS_WIN32
+    return _commit (fd) == 0;
+#elif defined HAVE_FDATASYNC
+    return fdatasync (fd) == 0;
+#else
+    return fsync (fd) == 0;
+#endif
+}
+
+#ifndef G_OS_WIN32
+/*
+ * et_save_journal_sync_directory:
+ * @filename: a file in the directory to sync
+ *
+ * Flush the entries of the directory of @filename to the disk.
+ */
+static void
+et_save_journal_sync_directory (const gchar *filename)
+{
+    gchar *dirname;
+    gint fd;
+
+    dirname = g_path_get_dirname (filename);
+    fd = g_open (dirname, O_RDONLY, 0);
+
+    if (fd != -1)
+    {
+        fsync (fd);
+        close (fd);
+    }
+
+    g_free (dirname);
+}
+#endif /* !G_OS_WIN32 */
+
+/*
+ * et_save_journal_sync_files:
+ * @files: (element-type filename): the files to sync
+ *
+ * Flush the data of @files, and their directory entries, to the disk.
+ */
+static void
+et_save_journal_sync_files (GPtrArray *files)
+{
+    GHashTable *synced;
+    guint i;
+
+#ifdef HAVE_SYNCFS
+    /* Syncing the whole filesystem once is much faster than syncing a group
+     * of files one after the other, and includes the renames. */
+    synced = g_hash_table_new_full (g_int64_hash, g_int64_equal, g_free,
+                                    NULL);
+
+    for (i = 0; i < files->len; i++)
+    {
+        struct stat st;
+        gint fd;
+
+        fd = g_open (g_ptr_array_index (files, i), O_RDONLY, 0);
+
+        if (fd == -1)
+        {
+            continue;
+        }
+
+        if (fstat (fd, &st) == 0)
+        {
+            gint64 device = st.st_dev;
+
+            if (!g_hash_table_contains (synced, &device))
+            {
+                if (syncfs (fd) != 0)
+                {
+                    et_save_journal_sync_fd (fd);
+                }
+
+                g_hash_table_add (synced, g_memdup (&device, sizeof (device)));
+            }
+        }
+
+        close (fd);
+    }
+#else
+    synced = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+    for (i = 0; i < files->len; i++)
+    {
+        const gchar *filename = g_ptr_array_index (files, i);
+        gint fd;
+
+        fd = g_open (filename, O_RDONLY, 0);
+
+        if (fd != -1)
+        {
+            et_save_journal_sync_fd (fd);
+            close (fd);
+        }
+
+#ifndef G_OS_WIN32
+        {
+            gchar *dirname = g_path_get_dirname (filename);
+
+            if (g_hash_table_contains (synced, dirname))
+            {
+                g_free (dirname);
+                continue;
+            }
+
+            et_save_journal_sync_directory (filename);
+            g_hash_table_add (synced, dirname);
+        }
+#endif /* !G_OS_WIN32 */
+    }
+#endif /* !HAVE_SYNCFS */
+
+    g_hash_table_destroy (synced);
+}
+
+/*
+ * et_save_journal_write_all:
+ * @fd: the journal
+ * @data: the records to append
+ * @length: the length of @data
+ *
+ * Returns: %TRUE on success, %FALSE otherwise, with errno set
+ */
+static gboolean
+et_save_journal_write_all (gint fd, const gchar *data, gsize length)
+{
+    while (length > 0)
+    {
+        gssize written = write (fd, data, length);
+
+        if (written == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            return FALSE;
+        }
+
+        data += written;
+        length -= written;
+    }
+
+    return TRUE;
+}
+
+/*
+ * et_save_journal_write:
+ * @self: the save journal
+ * @id: the identifier of a file whose intent record must be on the disk
+ * @records: (allow-none): records to write after the pending intents
+ *
+ * Append the pending intent records, then @records, to the journal, and
+ * flush it to the disk. Nothing is written if @records is %NULL and the
+ * record of @id was already flushed, possibly by another thread.
+ */
+static void
+et_save_journal_write (EtSaveJournal *self, guint id, const GString *records)
+{
+    GString *pending;
+    guint last_id;
+
+    g_mutex_lock (&self->write_mutex);
+    g_mutex_lock (&self->mutex);
+
+    if (records == NULL && self->synced_id >= id)
+    {
+        g_mutex_unlock (&self->mutex);
+        g_mutex_unlock (&self->write_mutex);
+        return;
+    }
+
+    /* Take the pending intents, so that more can be added while they are
+     * written. */
+    pending = self->pending;
+    self->pending = g_string_new (NULL);
+    last_id = self->last_id;
+
+    g_mutex_unlock (&self->mutex);
+
+    if (records)
+    {
+        g_string_append_len (pending, records->str, records->len);
+    }
+
+    if (self->fd != -1
+        && !et_save_journal_write_all (self->fd, pending->str, pending->len))
+    {
+        g_warning ("Error writing the save journal ‘%s’: %s", self->path,
+                   g_strerror (errno));
+        close (self->fd);
+        g_atomic_int_set (&self->fd, -1);
+    }
+
+    if (self->fd != -1 && pending->len > 0)
+    {
+        et_save_journal_sync_fd (self->fd);
+    }
+
+    g_string_free (pending, TRUE);
+
+    g_mutex_lock (&self->mutex);
+    self->synced_id = last_id;
+    g_mutex_unlock (&self->mutex);
+
+    g_mutex_unlock (&self->write_mutex);
+}
+
+/*
+ * et_save_journal_take_group_locked:
+ * @self: the save journal
+ * @ids: (out) (transfer full): return location for the identifiers of the
+ *       files which were saved since the previous group
+ * @files: (out) (transfer full): return location for their filenames
+ *
+ * Start a new group. Must be called with the mutex held.
+ */
+static void
+et_save_journal_take_group_locked (EtSaveJournal *self,
+                                   GArray **ids,
+                                   GPtrArray **files)
+{
+    *ids = self->saved_ids;
+    *files = self->saved_files;
+    self->saved_ids = g_array_new (FALSE, FALSE, sizeof (guint));
+    self->saved_files = g_ptr_array_new_with_free_func (g_free);
+}
+
+/*
+ * et_save_journal_commit:
+ * @self: the save journal
+ * @ids: (transfer full): the identifiers of the files of a group
+ * @files: (transfer full): the filenames of the files of the group
+ *
+ * Sync the files of a group, record them as done, and remove their undo
+ * files. Call this without the mutex held, as the sync takes a while.
+ */
+static void
+et_save_journal_commit (EtSaveJournal *self,
+                        GArray *ids,
+                        GPtrArray *files)
+{
+    GString *records;
+    guint i;
+
+    if (ids->len == 0)
+    {
+        g_ptr_array_unref (files);
+        g_array_unref (ids);
+        return;
+    }
+
+    et_save_journal_sync_files (files);
+    g_ptr_array_unref (files);
+
+    records = g_string_new (NULL);
+
+    for (i = 0; i < ids->len; i++)
+    {
+        g_string_append_printf (records, "D\t%u\n",
+                                g_array_index (ids, guint, i));
+    }
+
+    et_save_journal_write (self, 0, records);
+    g_string_free (records, TRUE);
+
+    /* The undo files are only needed until the files are recorded as
+     * done. */
+    for (i = 0; i < ids->len; i++)
+    {
+        gchar *undo_path;
+
+        undo_path = et_save_journal_get_undo_path (self->path,
+                                                   g_array_index (ids, guint,
+                                                                  i));
+        g_unlink (undo_path);
+        g_free (undo_path);
+    }
+
+    g_array_unref (ids);
+}
+
+static void
+et_save_journal_append_field (GString *record, const gchar *value)
+{
+    gchar *escaped;
+
+    escaped = g_strescape (value ? value : "", NULL);
+    g_string_append_c (record, '\t');
+    g_string_append (record, escaped);
+    g_free (escaped);
+}
+
+static void
+et_save_journal_append_tag (GString *record, const File_Tag *FileTag)
+{
+    gsize i;
+
+    for (i = 0; i < G_N_ELEMENTS (tag_fields); i++)
+    {
+        et_save_journal_append_field (record,
+                                      G_STRUCT_MEMBER (gchar *, FileTag,
+                                                       tag_fields[i]));
+    }
+}
+
+static gboolean
+et_save_journal_pictures_equal (const EtPicture *pic1, const EtPicture *pic2)
+{
+    for (; pic1 != NULL && pic2 != NULL; pic1 = pic1->next, pic2 = pic2->next)
+    {
+        if (pic1->type != pic2->type
+            || g_strcmp0 (pic1->description, pic2->description) != 0
+            || !g_bytes_equal (pic1->bytes, pic2->bytes))
+        {
+            return FALSE;
+        }
+    }
+
+    return pic1 == NULL && pic2 == NULL;
+}
+
+static void
+et_save_journal_append_pictures (GString *record, const EtPicture *pictures)
+{
+    const EtPicture *pic;
+    guint n_pictures = 0;
+
+    for (pic = pictures; pic != NULL; pic = pic->next)
+    {
+        n_pictures++;
+    }
+
+    g_string_append_printf (record, "\t%u", n_pictures);
+
+    for (pic = pictures; pic != NULL; pic = pic->next)
+    {
+        gconstpointer data;
+        gsize size;
+        gchar *encoded;
+
+        g_string_append_printf (record, "\t%d\t%d\t%d", pic->type,
+                                pic->width, pic->height);
+        et_save_journal_append_field (record, pic->description);
+
+        data = g_bytes_get_data (pic->bytes, &size);
+        encoded = g_base64_encode (data, size);
+        g_string_append_c (record, '\t');
+        g_string_append (record, encoded);
+        g_free (encoded);
+    }
+}
+
+/*
+ * et_save_journal_append_identity:
+ * @record: the string to append the record to
+ * @id: the identifier of the file
+ * @filename: the current filename of the file
+ *
+ * Append the identity of a file which is about to be renamed. Nothing is
+ * appended if the file does not exist, as it cannot be renamed then, nor on
+ * Windows, where the inode numbers of files are not meaningful.
+ */
+static void
+et_save_journal_append_identity (GString *record,
+                                 guint id,
+                                 const gchar *filename)
+{
+#ifndef G_OS_WIN32
+    GStatBuf st;
+
+    if (g_lstat (filename, &st) != 0)
+    {
+        return;
+    }
+
+    g_string_append_printf (record,
+                            "N\t%u\t%" G_GUINT64_FORMAT "\t%" G_GUINT64_FORMAT
+                            "\n", id, (guint64)st.st_dev, (guint64)st.st_ino);
+#endif /* !G_OS_WIN32 */
+}
+
+/*
+ * et_save_journal_append_aside:
+ * @record: the string to append the record to
+ * @id: the identifier of the file
+ * @tmp_path: the temporary path which the file is about to be moved to
+ */
+static void
+et_save_journal_append_aside (GString *record,
+                              guint id,
+                              const gchar *tmp_path)
+{
+    g_string_append_printf (record, "A\t%u", id);
+    et_save_journal_append_field (record, tmp_path);
+    g_string_append_c (record, '\n');
+}
+
+/*
+ * et_save_journal_new:
+ *
+ * Start a new save, replacing the journal of any previous one.
+ *
+ * Returns: a new #EtSaveJournal, free with et_save_journal_free()
+ */
+EtSaveJournal *
+et_save_journal_new (void)
+{
+    EtSaveJournal *self;
+    gchar *dirname;
+
+    self = g_slice_new0 (EtSaveJournal);
+    self->path = et_save_journal_get_path ();
+    g_mutex_init (&self->write_mutex);
+    g_mutex_init (&self->mutex);
+    self->pending = g_string_new (ET_SAVE_JOURNAL_HEADER "\n");
+    self->saved_ids = g_array_new (FALSE, FALSE, sizeof (guint));
+    self->saved_files = g_ptr_array_new_with_free_func (g_free);
+
+    dirname = g_path_get_dirname (self->path);
+    g_mkdir_with_parents (dirname, 0700);
+    g_free (dirname);
+
+    self->fd = g_open (self->path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+
+    if (self->fd == -1)
+    {
+        g_warning ("Error creating the save journal ‘%s’: %s", self->path,
+                   g_strerror (errno));
+    }
+
+    return self;
+}
+
+/*
+ * et_save_journal_add:
+ * @self: the save journal
+ * @ETFile: the file which is going to be saved
+ * @write_tag: whether the tag of @ETFile is going to be written
+ * @rename: whether @ETFile is going to be renamed
+ *
+ * Record what is going to be done to @ETFile. The record is only written to
+ * the journal by et_save_journal_begin(), together with the records added
+ * since the previous call, so call this as soon as possible.
+ *
+ * Returns: the identifier of the file in the journal
+ */
+guint
+et_save_journal_add (EtSaveJournal *self, const ET_File *ETFile,
+                     gboolean write_tag, gboolean rename)
+{
+    const File_Tag *saved_tag = NULL;
+    const File_Tag *FileTag;
+    GList *l;
+    guint id;
+
+    g_return_val_if_fail (self != NULL, 0);
+    g_return_val_if_fail (ETFile != NULL, 0);
+
+    /* The tag which is in the file, whose pictures are kept on recovery if
+     * they are not changed. */
+    for (l = ETFile->FileTagList; l != NULL; l = g_list_next (l))
+    {
+        if (((File_Tag *)l->data)->saved)
+        {
+            saved_tag = l->data;
+            break;
+        }
+    }
+
+    if (saved_tag == NULL)
+    {
+        saved_tag = ETFile->FileTagList->data;
+    }
+
+    g_mutex_lock (&self->mutex);
+
+    id = ++self->last_id;
+
+    g_string_append_printf (self->pending, "I\t%u\t%d\t%d", id,
+                            write_tag ? 1 : 0, rename ? 1 : 0);
+    et_save_journal_append_field (self->pending,
+                                  ((File_Name *)ETFile->FileNameCur->data)->value);
+    et_save_journal_append_field (self->pending,
+                                  ((File_Name *)ETFile->FileNameNew->data)->value);
+
+    if (write_tag)
+    {
+        FileTag = ETFile->FileTag->data;
+        et_save_journal_append_tag (self->pending, FileTag);
+
+        /* Pictures are too large to record for every file. */
+        if (et_save_journal_pictures_equal (saved_tag->picture,
+                                            FileTag->picture))
+        {
+            g_string_append (self->pending, "\t-");
+        }
+        else
+        {
+            et_save_journal_append_pictures (self->pending,
+                                             FileTag->picture);
+        }
+    }
+
+    g_string_append_c (self->pending, '\n');
+
+    g_mutex_unlock (&self->mutex);
+
+    return id;
+}
+
+/*
+ * et_save_journal_begin:
+ * @self: the save journal
+ * @id: the identifier of the file, from et_save_journal_add()
+ *
+ * Make sure that the record of the file is on the disk, before the file is
+ * saved. Until et_save_journal_written() is called, the changes which the
+ * tag writers make on the calling thread are backed up in the undo file of
+ * the file. This is safe to call from a worker thread.
+ */
+void
+et_save_journal_begin (EtSaveJournal *self, guint id)
+{
+#ifndef G_OS_WIN32
+    EtSaveJournalCurrent *current;
+#endif
+
+    g_return_if_fail (self != NULL);
+    g_return_if_fail (g_private_get (&et_save_journal_current) == NULL);
+
+    et_save_journal_write (self, id, NULL);
+
+#ifndef G_OS_WIN32
+    current = g_slice_new0 (EtSaveJournalCurrent);
+    current->journal = self;
+    current->id = id;
+    current->path = et_save_journal_get_undo_path (self->path, id);
+    current->fd = -1;
+    current->ranges = g_array_new (FALSE, FALSE, sizeof (EtSaveJournalRange));
+    g_private_set (&et_save_journal_current, current);
+#endif /* !G_OS_WIN32 */
+}
+
+/*
+ * et_save_journal_written:
+ * @self: the save journal
+ * @id: the identifier of the file, from et_save_journal_begin()
+ *
+ * Stop backing up the changes made on the calling thread, once the tag of
+ * the file was written. The undo file is kept until the file is done.
+ */
+void
+et_save_journal_written (EtSaveJournal *self, guint id)
+{
+    EtSaveJournalCurrent *current;
+
+    g_return_if_fail (self != NULL);
+
+    current = g_private_get (&et_save_journal_current);
+
+    if (current == NULL)
+    {
+        return;
+    }
+
+    g_return_if_fail (current->journal == self && current->id == id);
+
+#ifndef G_OS_WIN32
+    if (current->fd != -1)
+    {
+        close (current->fd);
+    }
+#endif /* !G_OS_WIN32 */
+
+    g_array_unref (current->ranges);
+    g_free (current->path);
+    g_slice_free (EtSaveJournalCurrent, current);
+    g_private_set (&et_save_journal_current, NULL);
+}
+
+/*
+ * et_save_journal_add_rename:
+ * @self: the save journal
+ * @id: the identifier of the file, from et_save_journal_add()
+ * @filename: the current filename of the file
+ *
+ * Record the identity of a file which is about to be renamed with the other
+ * files of its batch, once its tag was written, so that it can be found on
+ * recovery wherever the renames left it. The record is only written to the
+ * journal by et_save_journal_begin_renames(). This is safe to call from a
+ * worker thread.
+ */
+void
+et_save_journal_add_rename (EtSaveJournal *self,
+                            guint id,
+                            const gchar *filename)
+{
+    g_return_if_fail (self != NULL);
+    g_return_if_fail (filename != NULL);
+
+    g_mutex_lock (&self->mutex);
+    et_save_journal_append_identity (self->pending, id, filename);
+    g_mutex_unlock (&self->mutex);
+}
+
+/*
+ * et_save_journal_begin_renames:
+ * @self: the save journal
+ *
+ * Make sure that the identities of the files which are about to be renamed
+ * are on the disk, before any of them is renamed. This is safe to call from
+ * a worker thread.
+ */
+void
+et_save_journal_begin_renames (EtSaveJournal *self)
+{
+    g_return_if_fail (self != NULL);
+
+    /* Flush whatever is pending. */
+    et_save_journal_write (self, G_MAXUINT, NULL);
+}
+
+/*
+ * et_save_journal_move_aside:
+ * @self: the save journal
+ * @id: the identifier of the file, from et_save_journal_add()
+ * @tmp_path: the temporary path which the file is about to be moved to
+ *
+ * Record that a file which is renamed is about to be moved to a temporary
+ * path, and make the record durable. This is safe to call from a worker
+ * thread.
+ */
+void
+et_save_journal_move_aside (EtSaveJournal *self,
+                            guint id,
+                            const gchar *tmp_path)
+{
+    GString *record;
+
+    g_return_if_fail (self != NULL);
+    g_return_if_fail (tmp_path != NULL);
+
+    record = g_string_new (NULL);
+    et_save_journal_append_aside (record, id, tmp_path);
+    et_save_journal_write (self, 0, record);
+    g_string_free (record, TRUE);
+}
+
+/*
+ * et_save_journal_end:
+ * @self: the save journal
+ * @id: the identifier of the file, from et_save_journal_add()
+ * @filename: (allow-none): the filename of the file after saving, or %NULL
+ *            if the file was not touched
+ *
+ * Record that the file was saved. The file is synced, and recorded as done,
+ * together with the next files in its group. This is safe to call from a
+ * worker thread.
+ */
+void
+et_save_journal_end (EtSaveJournal *self, guint id, const gchar *filename)
+{
+    GArray *ids = NULL;
+    GPtrArray *files = NULL;
+
+    g_return_if_fail (self != NULL);
+
+    g_mutex_lock (&self->mutex);
+
+    g_array_append_val (self->saved_ids, id);
+
+    if (filename)
+    {
+        g_ptr_array_add (self->saved_files, g_strdup (filename));
+    }
+
+    if (self->saved_ids->len >= ET_SAVE_JOURNAL_GROUP_SIZE)
+    {
+        et_save_journal_take_group_locked (self, &ids, &files);
+    }
+
+    g_mutex_unlock (&self->mutex);
+
+    if (ids)
+    {
+        et_save_journal_commit (self, ids, files);
+    }
+}
+
+/*
+ * et_save_journal_sync:
+ * @self: the save journal
+ *
+ * Sync the files of the current group, even if it is not full.
+ */
+void
+et_save_journal_sync (EtSaveJournal *self)
+{
+    GArray *ids;
+    GPtrArray *files;
+
+    g_return_if_fail (self != NULL);
+
+    g_mutex_lock (&self->mutex);
+    et_save_journal_take_group_locked (self, &ids, &files);
+    g_mutex_unlock (&self->mutex);
+
+    et_save_journal_commit (self, ids, files);
+}
+
+/*
+ * et_save_journal_free:
+ * @self: the save journal
+ *
+ * Sync the last group of files, and remove the journal. All the files which
+ * were begun must have ended.
+ */
+void
+et_save_journal_free (EtSaveJournal *self)
+{
+    g_return_if_fail (self != NULL);
+
+    et_save_journal_sync (self);
+
+    if (self->fd != -1)
+    {
+        close (self->fd);
+    }
+
+    g_unlink (self->path);
+
+    g_ptr_array_unref (self->saved_files);
+    g_array_unref (self->saved_ids);
+    g_string_free (self->pending, TRUE);
+    g_mutex_clear (&self->mutex);
+    g_mutex_clear (&self->write_mutex);
+    g_free (self->path);
+    g_slice_free (EtSaveJournal, self);
+}
+
+#ifndef G_OS_WIN32
+static void
+et_save_journal_set_error (GError **error, gint errsv)
+{
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv), "%s",
+                 g_strerror (errsv));
+}
+
+static gboolean
+et_save_journal_pread_all (gint fd, gpointer buffer, gsize count,
+                           goffset offset, GError **error)
+{
+    while (count > 0)
+    {
+        gssize bytes_read = pread (fd, buffer, count, offset);
+
+        if (bytes_read == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            et_save_journal_set_error (error, errno);
+            return FALSE;
+        }
+
+        if (bytes_read == 0)
+        {
+            g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED, "%s",
+                         _("Unexpected end of file"));
+            return FALSE;
+        }
+
+        buffer = (gchar *)buffer + bytes_read;
+        count -= bytes_read;
+        offset += bytes_read;
+    }
+
+    return TRUE;
+}
+
+static gboolean
+et_save_journal_pwrite_all (gint fd, gconstpointer buffer, gsize count,
+                            goffset offset, GError **error)
+{
+    while (count > 0)
+    {
+        gssize written = pwrite (fd, buffer, count, offset);
+
+        if (written == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            et_save_journal_set_error (error, errno);
+            return FALSE;
+        }
+
+        buffer = (const gchar *)buffer + written;
+        count -= written;
+        offset += written;
+    }
+
+    return TRUE;
+}
+
+/*
+ * et_save_journal_copy:
+ * @fd_in: the file descriptor to copy from
+ * @offset_in: the offset to copy from
+ * @fd_out: the file descriptor to copy to
+ * @offset_out: the offset to copy to
+ * @length: the number of bytes to copy
+ * @error: a #GError to provide information on errors, or %NULL to ignore
+ *
+ * Copy a range between two files, within the kernel where possible, so that
+ * the data is reflinked where the filesystem can.
+ *
+ * Returns: %TRUE on success, %FALSE otherwise
+ */
+static gboolean
+et_save_journal_copy (gint fd_in, goffset offset_in, gint fd_out,
+                      goffset offset_out, goffset length, GError **error)
+{
+    gchar *buffer;
+
+#ifdef HAVE_COPY_FILE_RANGE
+    while (length > 0)
+    {
+        loff_t in = offset_in;
+        loff_t out = offset_out;
+        gssize copied;
+
+        copied = copy_file_range (fd_in, &in, fd_out, &out,
+                                  MIN (length, G_MAXINT32), 0);
+
+        if (copied > 0)
+        {
+            offset_in += copied;
+            offset_out += copied;
+            length -= copied;
+        }
+        else if (copied == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        else
+        {
+            /* Not supported between these files, or the end of the file
+             * was reached, which the fallback reports. */
+            break;
+        }
+    }
+#endif /* HAVE_COPY_FILE_RANGE */
+
+    if (length == 0)
+    {
+        return TRUE;
+    }
+
+    buffer = g_malloc (ET_SAVE_JOURNAL_BUFFER_SIZE);
+
+    while (length > 0)
+    {
+        const gsize count = MIN (length, ET_SAVE_JOURNAL_BUFFER_SIZE);
+
+        if (!et_save_journal_pread_all (fd_in, buffer, count, offset_in, error)
+            || !et_save_journal_pwrite_all (fd_out, buffer, count, offset_out,
+                                            error))
+        {
+            g_free (buffer);
+            return FALSE;
+        }
+
+        offset_in += count;
+        offset_out += count;
+        length -= count;
+    }
+
+    g_free (buffer);
+    return TRUE;
+}
+
+/*
+ * et_save_journal_move:
+ * @fd: the file descriptor
+ * @from: the offset to move the data from
+ * @to: the offset to move the data to
+ * @length: the number of bytes to move
+ * @error: a #GError to provide information on errors, or %NULL to ignore
+ *
+ * Move a range within a file, which may overlap its destination.
+ *
+ * Returns: %TRUE on success, %FALSE otherwise
+ */
+static gboolean
+et_save_journal_move (gint fd, goffset from, goffset to, goffset length,
+                      GError **error)
+{
+    gchar *buffer;
+
+    buffer = g_malloc (ET_SAVE_JOURNAL_BUFFER_SIZE);
+
+    while (length > 0)
+    {
+        const gsize count = MIN (length, ET_SAVE_JOURNAL_BUFFER_SIZE);
+        goffset src;
+        goffset dst;
+
+        /* Move from the end when moving towards the end, so that no data is
+         * overwritten before it is moved. */
+        if (to > from)
+        {
+            src = from + length - count;
+            dst = to + length - count;
+        }
+        else
+        {
+            src = from;
+            dst = to;
+            from += count;
+            to += count;
+        }
+
+        if (!et_save_journal_pread_all (fd, buffer, count, src, error)
+            || !et_save_journal_pwrite_all (fd, buffer, count, dst, error))
+        {
+            g_free (buffer);
+            return FALSE;
+        }
+
+        length -= count;
+    }
+
+    g_free (buffer);
+    return TRUE;
+}
+
+/*
+ * et_save_journal_get_current:
+ *
+ * Returns: the file whose tag is written by the calling thread, or %NULL if
+ *          its changes are not backed up
+ */
+static EtSaveJournalCurrent *
+et_save_journal_get_current (void)
+{
+    EtSaveJournalCurrent *current;
+    gboolean active;
+
+    current = g_private_get (&et_save_journal_current);
+
+    if (current == NULL)
+    {
+        return NULL;
+    }
+
+    /* The undo files are useless once the journal cannot be written. */
+    active = g_atomic_int_get (&current->journal->fd) != -1;
+
+    return active ? current : NULL;
+}
+
+/*
+ * et_save_journal_open:
+ * @file: the file to back up
+ * @fd: return location for a file descriptor, or -1 if @file is not a local
+ *      file, or does not exist
+ * @st: return location for the identity and the size of @file
+ * @error: a #GError to provide information on errors, or %NULL to ignore
+ *
+ * Returns: %TRUE on success, %FALSE otherwise
+ */
+static gboolean
+et_save_journal_open (GFile *file, gint *fd, struct stat *st, GError **error)
+{
+    gchar *path;
+
+    *fd = -1;
+    path = g_file_get_path (file);
+
+    if (path == NULL)
+    {
+        return TRUE;
+    }
+
+    *fd = g_open (path, O_RDONLY, 0);
+    g_free (path);
+
+    if (*fd == -1)
+    {
+        if (errno == ENOENT)
+        {
+            return TRUE;
+        }
+
+        et_save_journal_set_error (error, errno);
+        return FALSE;
+    }
+
+    if (fstat (*fd, st) != 0)
+    {
+        et_save_journal_set_error (error, errno);
+        close (*fd);
+        *fd = -1;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+ * et_save_journal_append_undo:
+ * @current: the file whose tag is written
+ * @type: the type of the record
+ * @st: (allow-none): the identity and the size of the file to record
+ * @offset: the offset of the record
+ * @length: the length of the data of the record, or the distance of a shift
+ * @source_fd: the file to copy the data of the record from, or -1
+ * @data: (allow-none): the data of the record, if @source_fd is -1
+ * @error: a #GError to provide information on errors, or %NULL to ignore
+ *
+ * Append a record to the undo file, and flush it to the disk. The data is
+ * flushed before the trailer is written, as the data is not checksummed.
+ *
+ * Returns: %TRUE on success, %FALSE otherwise
+ */
+static gboolean
+et_save_journal_append_undo (EtSaveJournalCurrent *current,
+                             EtSaveJournalUndoType type,
+                             const struct stat *st,
+                             goffset offset,
+                             goffset length,
+                             gint source_fd,
+                             const gchar *data,
+                             GError **error)
+{
+    EtSaveJournalUndoHeader header;
+    guint64 trailer;
+    goffset position;
+    goffset data_length;
+    gboolean success;
+
+    if (current->fd == -1)
+    {
+        current->fd = g_open (current->path, O_RDWR | O_CREAT | O_TRUNC,
+                              0600);
+
+        if (current->fd == -1)
+        {
+            et_save_journal_set_error (error, errno);
+            return FALSE;
+        }
+
+        et_save_journal_sync_directory (current->path);
+    }
+
+    position = lseek (current->fd, 0, SEEK_END);
+
+    if (position == -1)
+    {
+        et_save_journal_set_error (error, errno);
+        return FALSE;
+    }
+
+    header.type = GUINT64_TO_LE (type);
+    header.device = GUINT64_TO_LE (st ? (guint64)st->st_dev : 0);
+    header.inode = GUINT64_TO_LE (st ? (guint64)st->st_ino : 0);
+    header.size = GUINT64_TO_LE (st ? (guint64)st->st_size : 0);
+    header.offset = GUINT64_TO_LE ((guint64)offset);
+    header.length = GUINT64_TO_LE ((guint64)length);
+    trailer = header.type;
+
+    data_length = type == ET_SAVE_JOURNAL_UNDO_SHIFT ? 0 : length;
+
+    success = et_save_journal_pwrite_all (current->fd, &header,
+                                          sizeof (header), position, error);
+
+    if (success && data_length > 0)
+    {
+        if (source_fd != -1)
+        {
+            success = et_save_journal_copy (source_fd, offset, current->fd,
+                                            position + sizeof (header),
+                                            data_length, error);
+        }
+        else
+        {
+            success = et_save_journal_pwrite_all (current->fd, data,
+                                                  data_length,
+                                                  position + sizeof (header),
+                                                  error);
+        }
+    }
+
+    if (success && !et_save_journal_sync_fd (current->fd))
+    {
+        et_save_journal_set_error (error, errno);
+        success = FALSE;
+    }
+
+    if (success)
+    {
+        success = et_save_journal_pwrite_all (current->fd, &trailer,
+                                              sizeof (trailer),
+                                              position + sizeof (header)
+                                              + data_length, error);
+    }
+
+    if (success && !et_save_journal_sync_fd (current->fd))
+    {
+        et_save_journal_set_error (error, errno);
+        success = FALSE;
+    }
+
+    if (!success)
+    {
+        /* Drop the partial record, so that the next ones can be read. */
+        if (ftruncate (current->fd, position) != 0)
+        {
+            g_debug ("Error truncating the undo file ‘%s’: %s", current->path,
+                     g_strerror (errno));
+        }
+    }
+
+    return success;
+}
+
+/*
+ * et_save_journal_append_file:
+ * @type: %ET_SAVE_JOURNAL_UNDO_TEMPORARY or %ET_SAVE_JOURNAL_UNDO_REPLACE
+ * @temporary: the temporary file
+ * @st: (allow-none): the identity of @temporary
+ * @error: a #GError to provide information on errors, or %NULL to ignore
+ *
+ * Record a temporary file of the current file, if it is a local file.
+ *
+ * Returns: %TRUE on success, %FALSE otherwise
+ */
+static gboolean
+et_save_journal_append_file (EtSaveJournalUndoType type,
+                             GFile *temporary,
+                             const struct stat *st,
+                             GError **error)
+{
+    EtSaveJournalCurrent *current;
+    gchar *path;
+    gboolean success;
+
+    current = et_save_journal_get_current ();
+
+    if (current == NULL)
+    {
+        return TRUE;
+    }
+
+    path = g_file_get_path (temporary);
+
+    if (path == NULL)
+    {
+        return TRUE;
+    }
+
+    success = et_save_journal_append_undo (current, type, st, 0,
+                                           strlen (path), -1, path, error);
+    g_free (path);
+
+    return success;
+}
+#endif /* !G_OS_WIN32 */
+
+/*
+ * et_save_journal_backup:
+ * @file: the file which is about to be changed
+ * @offset: the offset of the range which is about to be changed
+ * @length: the length of the range, or -1 for the rest of the file
+ * @error: a #GError to provide information on errors, or %NULL to ignore
+ *
+ * Copy the original bytes of a range of @file, which is about to be
+ * overwritten, moved or truncated, to the undo file of the current save, and
+ * flush them to the disk. Ranges which were already backed up are skipped.
+ * Nothing is done if no file is saved by the calling thread.
+ *
+ * Returns: %TRUE on success, %FALSE otherwise, in which case @file must not
+ *          be changed
+ */
+gboolean
+et_save_journal_backup (GFile *file,
+                        goffset offset,
+                        goffset length,
+                        GError **error)
+{
+#ifndef G_OS_WIN32
+    EtSaveJournalCurrent *current;
+    EtSaveJournalRange range;
+    struct stat st;
+    gboolean success;
+    gint fd;
+    guint i;
+
+    g_return_val_if_fail (G_IS_FILE (file), FALSE);
+    g_return_val_if_fail (offset >= 0, FALSE);
+
+    current = et_save_journal_get_current ();
+
+    if (current == NULL)
+    {
+        return TRUE;
+    }
+
+    if (!et_save_journal_open (file, &fd, &st, error))
+    {
+        return FALSE;
+    }
+
+    if (fd == -1)
+    {
+        return TRUE;
+    }
+
+    /* Bytes beyond the end of the file are removed anyway when the size of
+     * the file is restored. */
+    range.start = MIN (offset, st.st_size);
+    range.end = length < 0 ? st.st_size : MIN (offset + length, st.st_size);
+
+    if (current->device != (guint64)st.st_dev
+        || current->inode != (guint64)st.st_ino)
+    {
+        current->device = st.st_dev;
+        current->inode = st.st_ino;
+        g_array_set_size (current->ranges, 0);
+    }
+
+    for (i = 0; i < current->ranges->len; i++)
+    {
+        const EtSaveJournalRange *backed_up;
+
+        backed_up = &g_array_index (current->ranges, EtSaveJournalRange, i);
+
+        if (backed_up->start <= range.start && range.end <= backed_up->end)
+        {
+            close (fd);
+            return TRUE;
+        }
+    }
+
+    success = et_save_journal_append_undo (current,
+                                           ET_SAVE_JOURNAL_UNDO_BYTES, &st,
+                                           range.start,
+                                           range.end - range.start, fd, NULL,
+                                           error);
+    close (fd);
+
+    if (success)
+    {
+        if (range.end == st.st_size)
+        {
+            range.end = G_MAXINT64;
+        }
+
+        g_array_append_val (current->ranges, range);
+    }
+
+    return success;
+#else /* G_OS_WIN32 */
+    return TRUE;
+#endif /* G_OS_WIN32 */
+}
+
+/*
+ * et_save_journal_backup_shift:
+ * @file: the file which is about to be changed
+ * @offset: the offset of the range which is about to be inserted or
+ *          collapsed, aligned to the blocks of the filesystem
+ * @distance: the length of the range which is about to be inserted, or
+ *            minus the length of the range which is about to be collapsed
+ * @error: a #GError to provide information on errors, or %NULL to ignore
+ *
+ * Record that the data of @file from @offset is about to be shifted by the
+ * filesystem, so that the shift can be reversed. The bytes of a collapsed
+ * range must be backed up separately. Nothing is done if no file is saved by
+ * the calling thread.
+ *
+ * Returns: %TRUE on success, %FALSE otherwise, in which case @file must not
+ *          be changed
+ */
+gboolean
+et_save_journal_backup_shift (GFile *file,
+                              goffset offset,
+                              goffset distance,
+                              GError **error)
+{
+#ifndef G_OS_WIN32
+    EtSaveJournalCurrent *current;
+    struct stat st;
+    gboolean success;
+    gint fd;
+
+    g_return_val_if_fail (G_IS_FILE (file), FALSE);
+    g_return_val_if_fail (offset >= 0, FALSE);
+
+    current = et_save_journal_get_current ();
+
+    if (current == NULL)
+    {
+        return TRUE;
+    }
+
+    if (!et_save_journal_open (file, &fd, &st, error))
+    {
+        return FALSE;
+    }
+
+    if (fd == -1)
+    {
+        return TRUE;
+    }
+
+    success = et_save_journal_append_undo (current,
+                                           ET_SAVE_JOURNAL_UNDO_SHIFT, &st,
+                                           offset, distance, -1, NULL, error);
+    close (fd);
+
+    /* The ranges which were backed up are moved. */
+    g_array_set_size (current->ranges, 0);
+
+    return success;
+#else /* G_OS_WIN32 */
+    return TRUE;
+#endif /* G_OS_WIN32 */
+}
+
+/*
+ * et_save_journal_new_temporary:
+ * @file: the file to create a temporary file for
+ * @iostream: return location for a stream on the temporary file
+ * @error: a #GError to provide information on errors, or %NULL to ignore
+ *
+ * Create a hidden temporary file next to @file, to be written instead of
+ * @file, then renamed over it with et_save_journal_replace(). The temporary
+ * file is recorded in the undo file of the current save before it is
+ * created, so that it is removed if the save is interrupted.
+ *
+ * Returns: the temporary file, or %NULL on error
+ */
+GFile *
+et_save_journal_new_temporary (GFile *file,
+                               GFileIOStream **iostream,
+                               GError **error)
+{
+    GFile *parent;
+    gchar *basename;
+    gint tries;
+
+    g_return_val_if_fail (G_IS_FILE (file), NULL);
+    g_return_val_if_fail (iostream != NULL, NULL);
+    g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+    parent = g_file_get_parent (file);
+    basename = g_file_get_basename (file);
+
+    for (tries = 0; tries < 100; tries++)
+    {
+        GFile *tmp_file;
+        gchar *tmp_name;
+        GError *tmp_error = NULL;
+
+        tmp_name = g_strdup_printf (".%s.%08x", basename, g_random_int ());
+        tmp_file = g_file_get_child (parent, tmp_name);
+        g_free (tmp_name);
+
+#ifndef G_OS_WIN32
+        if (!et_save_journal_append_file (ET_SAVE_JOURNAL_UNDO_TEMPORARY,
+                                          tmp_file, NULL, error))
+        {
+            g_object_unref (tmp_file);
+            break;
+        }
+#endif /* !G_OS_WIN32 */
+
+        *iostream = g_file_create_readwrite (tmp_file, G_FILE_CREATE_PRIVATE,
+                                             NULL, &tmp_error);
+
+        if (*iostream)
+        {
+            g_free (basename);
+            g_object_unref (parent);
+            return tmp_file;
+        }
+
+        g_object_unref (tmp_file);
+
+        if (!g_error_matches (tmp_error, G_IO_ERROR, G_IO_ERROR_EXISTS))
+        {
+            g_propagate_error (error, tmp_error);
+            break;
+        }
+
+        g_error_free (tmp_error);
+    }
+
+    if (tries == 100)
+    {
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_EXISTS, "%s",
+                     "Unable to create a temporary file");
+    }
+
+    g_free (basename);
+    g_object_unref (parent);
+
+    return NULL;
+}
+
+/*
+ * et_save_journal_replace:
+ * @temporary: a temporary file from et_save_journal_new_temporary(), which
+ *             was completely written and closed
+ * @file: the file to replace
+ * @error: a #GError to provide information on errors, or %NULL to ignore
+ *
+ * Give @temporary the attributes of @file, and rename it over @file. If a
+ * file is saved by the calling thread, @temporary is flushed to the disk and
+ * recorded as ready first, so that the rename can be finished if the save
+ * is interrupted. @temporary is deleted on error.
+ *
+ * Returns: %TRUE on success, %FALSE otherwise
+ */
+gboolean
+et_save_journal_replace (GFile *temporary,
+                         GFile *file,
+                         GError **error)
+{
+    g_return_val_if_fail (G_IS_FILE (temporary), FALSE);
+    g_return_val_if_fail (G_IS_FILE (file), FALSE);
+    g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+    g_file_copy_attributes (file, temporary, G_FILE_COPY_NONE, NULL, NULL);
+
+#ifndef G_OS_WIN32
+    if (et_save_journal_get_current () != NULL)
+    {
+        struct stat st;
+        gint fd;
+
+        if (!et_save_journal_open (temporary, &fd, &st, error))
+        {
+            g_file_delete (temporary, NULL, NULL);
+            return FALSE;
+        }
+
+        if (fd != -1)
+        {
+            gboolean success = TRUE;
+
+            if (!et_save_journal_sync_fd (fd))
+            {
+                et_save_journal_set_error (error, errno);
+                success = FALSE;
+            }
+
+            close (fd);
+
+            if (!success
+                || !et_save_journal_append_file (ET_SAVE_JOURNAL_UNDO_REPLACE,
+                                                 temporary, &st, error))
+            {
+                g_file_delete (temporary, NULL, NULL);
+                return FALSE;
+            }
+        }
+    }
+#endif /* !G_OS_WIN32 */
+
+    if (!g_file_move (temporary, file, G_FILE_COPY_OVERWRITE, NULL, NULL,
+                      NULL, error))
+    {
+        g_file_delete (temporary, NULL, NULL);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+ * et_save_journal_copy_range:
+ * @file: the file to copy from
+ * @offset: the offset of the range to copy
+ * @length: the length of the range, or -1 for the rest of the file
+ * @temporary: a temporary file from et_save_journal_new_temporary()
+ * @iostream: the stream on @temporary
+ * @error: a #GError to provide information on errors, or %NULL to ignore
+ *
+ * Copy a range of @file to the current position of @iostream, and advance
+ * the position past it. Local files are copied within the kernel where
+ * possible, so that the data is reflinked where the filesystem can, which
+ * avoids rewriting the audio data when only a tag changes size.
+ *
+ * Returns: %TRUE on success, %FALSE otherwise
+ */
+gboolean
+et_save_journal_copy_range (GFile *file,
+                            goffset offset,
+                            goffset length,
+                            GFile *temporary,
+                            GFileIOStream *iostream,
+                            GError **error)
+{
+    GFileInputStream *istream;
+    GOutputStream *ostream;
+    goffset position;
+    gchar *buffer;
+
+    g_return_val_if_fail (G_IS_FILE (file), FALSE);
+    g_return_val_if_fail (offset >= 0, FALSE);
+    g_return_val_if_fail (G_IS_FILE (temporary), FALSE);
+    g_return_val_if_fail (G_IS_FILE_IO_STREAM (iostream), FALSE);
+    g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+    position = g_seekable_tell (G_SEEKABLE (iostream));
+
+#ifndef G_OS_WIN32
+    {
+        gchar *path;
+        gchar *tmp_path;
+
+        path = g_file_get_path (file);
+        tmp_path = g_file_get_path (temporary);
+
+        if (path != NULL && tmp_path != NULL)
+        {
+            struct stat st;
+            gint fd_in;
+            gint fd_out;
+            gboolean success = FALSE;
+
+            fd_in = g_open (path, O_RDONLY, 0);
+            fd_out = fd_in == -1 ? -1 : g_open (tmp_path, O_WRONLY, 0);
+            g_free (tmp_path);
+            g_free (path);
+
+            if (fd_out == -1 || fstat (fd_in, &st) != 0)
+            {
+                et_save_journal_set_error (error, errno);
+            }
+            else
+            {
+                if (length < 0)
+                {
+                    length = MAX (st.st_size - offset, 0);
+                }
+
+                success = et_save_journal_copy (fd_in, offset, fd_out,
+                                                position, length, error);
+            }
+
+            if (fd_out != -1)
+            {
+                close (fd_out);
+            }
+
+            if (fd_in != -1)
+            {
+                close (fd_in);
+            }
+
+            return success
+                   && g_seekable_seek (G_SEEKABLE (iostream),
+                                       position + length, G_SEEK_SET, NULL,
+                                       error);
+        }
+
+        g_free (tmp_path);
+        g_free (path);
+    }
+#endif /* !G_OS_WIN32 */
+
+    istream = g_file_read (file, NULL, error);
+
+    if (!istream)
+    {
+        return FALSE;
+    }
+
+    if (!g_seekable_seek (G_SEEKABLE (istream), offset, G_SEEK_SET, NULL,
+                          error))
+    {
+        g_object_unref (istream);
+        return FALSE;
+    }
+
+    ostream = g_io_stream_get_output_stream (G_IO_STREAM (iostream));
+    buffer = g_malloc (ET_SAVE_JOURNAL_BUFFER_SIZE);
+
+    while (length != 0)
+    {
+        gsize count = ET_SAVE_JOURNAL_BUFFER_SIZE;
+        gssize bytes_read;
+
+        if (length > 0)
+        {
+            count = MIN (length, ET_SAVE_JOURNAL_BUFFER_SIZE);
+        }
+
+        bytes_read = g_input_stream_read (G_INPUT_STREAM (istream), buffer,
+                                          count, NULL, error);
+
+        if (bytes_read == -1)
+        {
+            break;
+        }
+
+        if (bytes_read == 0)
+        {
+            if (length > 0)
+            {
+                g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED, "%s",
+                             _("Unexpected end of file"));
+            }
+            else
+            {
+                length = 0;
+            }
+
+            break;
+        }
+
+        if (!g_output_stream_write_all (ostream, buffer, bytes_read, NULL,
+                                        NULL, error))
+        {
+            break;
+        }
+
+        if (length > 0)
+        {
+            length -= bytes_read;
+        }
+    }
+
+    g_free (buffer);
+    g_object_unref (istream);
+
+    return length == 0;
+}
+
+static void
+et_save_journal_entry_free (EtSaveJournalEntry *entry)
+{
+    g_free (entry->filename_cur);
+    g_free (entry->filename_new);
+    g_strfreev (entry->new_fields);
+
+    if (entry->new_pictures)
+    {
+        et_picture_free (entry->new_pictures);
+    }
+
+    if (entry->tmp_paths)
+    {
+        g_ptr_array_unref (entry->tmp_paths);
+    }
+
+    g_free (entry->filename);
+    g_slice_free (EtSaveJournalEntry, entry);
+}
+
+/*
+ * et_save_journal_parse_fields:
+ * @fields: the escaped fields of a record, starting at the fields of a tag
+ *
+ * Returns: the unescaped fields of a tag, free with g_strfreev()
+ */
+static gchar **
+et_save_journal_parse_fields (gchar **fields)
+{
+    gchar **result;
+    gsize i;
+
+    result = g_new0 (gchar *, G_N_ELEMENTS (tag_fields) + 1);
+
+    for (i = 0; i < G_N_ELEMENTS (tag_fields); i++)
+    {
+        result[i] = g_strcompress (fields[i]);
+    }
+
+    return result;
+}
+
+/*
+ * et_save_journal_parse_pictures:
+ * @entry: the entry to set the pictures of
+ * @fields: the escaped fields of a record, starting at the pictures
+ * @n_fields: the number of fields in @fields
+ *
+ * Returns: %TRUE if the pictures were parsed, %FALSE if the record is
+ *          invalid
+ */
+static gboolean
+et_save_journal_parse_pictures (EtSaveJournalEntry *entry,
+                                gchar **fields,
+                                guint n_fields)
+{
+    EtPicture **next = &entry->new_pictures;
+    guint n_pictures;
+    guint i;
+
+    if (n_fields == 1 && strcmp (fields[0], "-") == 0)
+    {
+        return TRUE;
+    }
+
+    n_pictures = atoi (fields[0]);
+
+    if (n_fields != 1 + 5 * n_pictures)
+    {
+        return FALSE;
+    }
+
+    entry->set_pictures = TRUE;
+
+    for (i = 0; i < n_pictures; i++)
+    {
+        gchar **picture_fields = fields + 1 + 5 * i;
+        gchar *description;
+        guchar *data;
+        gsize size;
+        GBytes *bytes;
+
+        description = g_strcompress (picture_fields[3]);
+        data = g_base64_decode (picture_fields[4], &size);
+        bytes = g_bytes_new_take (data, size);
+
+        *next = et_picture_new (atoi (picture_fields[0]), description,
+                                atoi (picture_fields[1]),
+                                atoi (picture_fields[2]), bytes);
+        next = &(*next)->next;
+
+        g_bytes_unref (bytes);
+        g_free (description);
+    }
+
+    return TRUE;
+}
+
+/*
+ * et_save_journal_read:
+ * @length: (allow-none): return location for the length of the complete
+ *          records of the journal
+ *
+ * Read the journal of an interrupted save. A record which was only partly
+ * written is ignored.
+ *
+ * Returns: (element-type EtSaveJournalEntry): the files which were not done
+ */
+static GList *
+et_save_journal_read (goffset *length)
+{
+    gchar *path;
+    gchar *contents;
+    const gchar *end;
+    gchar **lines;
+    GHashTable *entries;
+    GList *result = NULL;
+    guint n_lines;
+    guint i;
+
+    path = et_save_journal_get_path ();
+
+    if (length)
+    {
+        *length = 0;
+    }
+
+    if (!g_file_get_contents (path, &contents, NULL, NULL))
+    {
+        g_free (path);
+        return NULL;
+    }
+
+    g_free (path);
+
+    if (length)
+    {
+        end = strrchr (contents, '\n');
+        *length = end ? end - contents + 1 : 0;
+    }
+
+    lines = g_strsplit (contents, "\n", -1);
+    g_free (contents);
+
+    n_lines = g_strv_length (lines);
+
+    if (n_lines == 0 || strcmp (lines[0], ET_SAVE_JOURNAL_HEADER) != 0)
+    {
+        g_strfreev (lines);
+        return NULL;
+    }
+
+    entries = g_hash_table_new (NULL, NULL);
+
+    /* The last line is not terminated, so it is either empty or torn. */
+    for (i = 1; i + 1 < n_lines; i++)
+    {
+        gchar **fields = g_strsplit (lines[i], "\t", -1);
+        guint n_fields = g_strv_length (fields);
+
+        if (n_fields == 2 && strcmp (fields[0], "D") == 0)
+        {
+            EtSaveJournalEntry *entry;
+
+            entry = g_hash_table_lookup (entries,
+                                         GUINT_TO_POINTER (atoi (fields[1])));
+
+            if (entry)
+            {
+                entry->done = TRUE;
+            }
+        }
+        else if (n_fields == 4 && strcmp (fields[0], "N") == 0)
+        {
+            EtSaveJournalEntry *entry;
+
+            entry = g_hash_table_lookup (entries,
+                                         GUINT_TO_POINTER (atoi (fields[1])));
+
+            /* The identity is recorded again when the file is renamed on
+             * recovery. */
+            if (entry)
+            {
+                entry->identified = TRUE;
+                entry->device = g_ascii_strtoull (fields[2], NULL, 10);
+                entry->inode = g_ascii_strtoull (fields[3], NULL, 10);
+            }
+        }
+        else if (n_fields == 3 && strcmp (fields[0], "A") == 0)
+        {
+            EtSaveJournalEntry *entry;
+
+            entry = g_hash_table_lookup (entries,
+                                         GUINT_TO_POINTER (atoi (fields[1])));
+
+            if (entry)
+            {
+                if (entry->tmp_paths == NULL)
+                {
+                    entry->tmp_paths = g_ptr_array_new_with_free_func (g_free);
+                }
+
+                g_ptr_array_add (entry->tmp_paths, g_strcompress (fields[2]));
+            }
+        }
+        else if (n_fields >= 6 && strcmp (fields[0], "I") == 0)
+        {
+            EtSaveJournalEntry *entry;
+
+            entry = g_slice_new0 (EtSaveJournalEntry);
+            entry->id = atoi (fields[1]);
+            entry->write_tag = atoi (fields[2]);
+            entry->rename = atoi (fields[3]);
+            entry->filename_cur = g_strcompress (fields[4]);
+            entry->filename_new = g_strcompress (fields[5]);
+
+            if (entry->write_tag)
+            {
+                const guint n_tag_fields = 6 + G_N_ELEMENTS (tag_fields);
+
+                if (n_fields > n_tag_fields
+                    && et_save_journal_parse_pictures (entry,
+                                                       fields + n_tag_fields,
+                                                       n_fields - n_tag_fields))
+                {
+                    entry->new_fields = et_save_journal_parse_fields (fields + 6);
+                }
+                else
+                {
+                    /* Only the filename can be recovered. */
+                    entry->write_tag = FALSE;
+                }
+            }
+
+            g_hash_table_insert (entries, GUINT_TO_POINTER (entry->id),
+                                 entry);
+            result = g_list_prepend (result, entry);
+        }
+
+        g_strfreev (fields);
+    }
+
+    g_hash_table_destroy (entries);
+    g_strfreev (lines);
+
+    /* Keep the files which were not done, in the order of the save. */
+    {
+        GList *l = result;
+
+        while (l != NULL)
+        {
+            GList *next = g_list_next (l);
+
+            if (((EtSaveJournalEntry *)l->data)->done)
+            {
+                et_save_journal_entry_free (l->data);
+                result = g_list_delete_link (result, l);
+            }
+
+            l = next;
+        }
+    }
+
+    return g_list_reverse (result);
+}
+
+#ifndef G_OS_WIN32
+/*
+ * et_save_journal_read_undo:
+ * @fd: the undo file
+ *
+ * Read the records of an undo file. A record which was only partly written,
+ * and whose change was not made, ends the file.
+ *
+ * Returns: (element-type EtSaveJournalUndo): the records, in the order in
+ *          which they were made
+ */
+static GArray *
+et_save_journal_read_undo (gint fd)
+{
+    GArray *records;
+    goffset position = 0;
+
+    records = g_array_new (FALSE, FALSE, sizeof (EtSaveJournalUndo));
+
+    for (;;)
+    {
+        EtSaveJournalUndoHeader header;
+        EtSaveJournalUndo undo;
+        guint64 trailer;
+        goffset data_length;
+
+        if (!et_save_journal_pread_all (fd, &header, sizeof (header),
+                                        position, NULL))
+        {
+            break;
+        }
+
+        undo.type = GUINT64_FROM_LE (header.type);
+        undo.device = GUINT64_FROM_LE (header.device);
+        undo.inode = GUINT64_FROM_LE (header.inode);
+        undo.size = GUINT64_FROM_LE (header.size);
+        undo.offset = GUINT64_FROM_LE (header.offset);
+        undo.length = GUINT64_FROM_LE (header.length);
+        undo.data = position + sizeof (header);
+
+        switch (undo.type)
+        {
+            case ET_SAVE_JOURNAL_UNDO_SHIFT:
+                data_length = 0;
+                break;
+            case ET_SAVE_JOURNAL_UNDO_BYTES:
+            case ET_SAVE_JOURNAL_UNDO_TEMPORARY:
+            case ET_SAVE_JOURNAL_UNDO_REPLACE:
+                data_length = undo.length;
+                break;
+            default:
+                data_length = -1;
+                break;
+        }
+
+        if (data_length < 0
+            || !et_save_journal_pread_all (fd, &trailer, sizeof (trailer),
+                                           undo.data + data_length, NULL)
+            || GUINT64_FROM_LE (trailer) != undo.type)
+        {
+            break;
+        }
+
+        g_array_append_val (records, undo);
+        position = undo.data + data_length + sizeof (trailer);
+    }
+
+    return records;
+}
+
+/*
+ * et_save_journal_unshift:
+ * @fd: the file descriptor
+ * @size: the current size of the file
+ * @offset: the offset of the shift
+ * @distance: the distance of the shift
+ * @error: a #GError to provide information on errors, or %NULL to ignore
+ *
+ * Reverse a shift of the data from @offset by @distance bytes, leaving
+ * garbage in a range which was collapsed, to be restored by its backup.
+ *
+ * Returns: %TRUE on success, %FALSE otherwise
+ */
+static gboolean
+et_save_journal_unshift (gint fd,
+                         goffset size,
+                         goffset offset,
+                         goffset distance,
+                         GError **error)
+{
+    if (distance > 0)
+    {
+#if defined (HAVE_FALLOCATE) && defined (FALLOC_FL_COLLAPSE_RANGE)
+        if (fallocate (fd, FALLOC_FL_COLLAPSE_RANGE, offset, distance) == 0)
+        {
+            return TRUE;
+        }
+#endif /* HAVE_FALLOCATE && FALLOC_FL_COLLAPSE_RANGE */
+
+        if (!et_save_journal_move (fd, offset + distance, offset,
+                                   size - offset - distance, error))
+        {
+            return FALSE;
+        }
+
+        if (ftruncate (fd, size - distance) != 0)
+        {
+            et_save_journal_set_error (error, errno);
+            return FALSE;
+        }
+    }
+    else if (distance < 0)
+    {
+#if defined (HAVE_FALLOCATE) && defined (FALLOC_FL_INSERT_RANGE)
+        if (fallocate (fd, FALLOC_FL_INSERT_RANGE, offset, -distance) == 0)
+        {
+            return TRUE;
+        }
+#endif /* HAVE_FALLOCATE && FALLOC_FL_INSERT_RANGE */
+
+        if (ftruncate (fd, size - distance) != 0)
+        {
+            et_save_journal_set_error (error, errno);
+            return FALSE;
+        }
+
+        if (!et_save_journal_move (fd, offset, offset - distance,
+                                   size - offset, error))
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/*
+ * et_save_journal_undo_file:
+ * @undo_fd: the undo file of the file
+ * @filename: the file
+ * @resume: %TRUE to finish saving the file, %FALSE to roll it back
+ * @replaced: return location for whether the file was replaced by its new
+ *            version, so that its previous contents are lost
+ * @error: a #GError to provide information on errors, or %NULL to ignore
+ *
+ * Undo the changes recorded in the undo file, in the reverse order, and
+ * remove the temporary files which were left. The undoing stops at the
+ * replacement of the file, after which the file is its new version. When
+ * resuming, a temporary file which was ready to replace the file is renamed
+ * over it.
+ *
+ * Returns: %TRUE if the file was brought back to a consistent state, %FALSE
+ *          otherwise
+ */
+static gboolean
+et_save_journal_undo_file (gint undo_fd,
+                           const gchar *filename,
+                           gboolean resume,
+                           gboolean *replaced,
+                           GError **error)
+{
+    GArray *records;
+    struct stat st;
+    guint64 device;
+    guint64 inode;
+    gboolean success = TRUE;
+    gint fd;
+    guint i;
+
+    *replaced = FALSE;
+
+    fd = g_open (filename, O_RDWR, 0);
+
+    if (fd == -1 || fstat (fd, &st) != 0)
+    {
+        et_save_journal_set_error (error, errno);
+
+        if (fd != -1)
+        {
+            close (fd);
+        }
+
+        return FALSE;
+    }
+
+    device = st.st_dev;
+    inode = st.st_ino;
+    records = et_save_journal_read_undo (undo_fd);
+
+    for (i = records->len; success && !*replaced && i > 0; i--)
+    {
+        const EtSaveJournalUndo *undo;
+        gboolean same_file;
+
+        undo = &g_array_index (records, EtSaveJournalUndo, i - 1);
+        same_file = undo->device == device && undo->inode == inode;
+
+        switch (undo->type)
+        {
+            case ET_SAVE_JOURNAL_UNDO_TEMPORARY:
+            case ET_SAVE_JOURNAL_UNDO_REPLACE:
+            {
+                gchar *tmp_path;
+                struct stat tmp_st;
+
+                tmp_path = g_malloc (undo->length + 1);
+
+                if (!et_save_journal_pread_all (undo_fd, tmp_path,
+                                                undo->length, undo->data,
+                                                error))
+                {
+                    g_free (tmp_path);
+                    success = FALSE;
+                    break;
+                }
+
+                tmp_path[undo->length] = '\0';
+
+                if (undo->type == ET_SAVE_JOURNAL_UNDO_REPLACE && same_file)
+                {
+                    /* The temporary file was already renamed. */
+                    *replaced = TRUE;
+                }
+                else if (undo->type == ET_SAVE_JOURNAL_UNDO_REPLACE && resume
+                         && g_lstat (tmp_path, &tmp_st) == 0
+                         && (guint64)tmp_st.st_dev == undo->device
+                         && (guint64)tmp_st.st_ino == undo->inode)
+                {
+                    /* The temporary file is complete, so finish the
+                     * rename. */
+                    if (g_rename (tmp_path, filename) == 0)
+                    {
+                        *replaced = TRUE;
+                    }
+                    else
+                    {
+                        et_save_journal_set_error (error, errno);
+                        success = FALSE;
+                    }
+                }
+                else
+                {
+                    g_unlink (tmp_path);
+                }
+
+                g_free (tmp_path);
+                break;
+            }
+            case ET_SAVE_JOURNAL_UNDO_BYTES:
+                if (!same_file)
+                {
+                    /* The file was replaced by a tag writer which does not
+                     * record its temporary files. */
+                    *replaced = TRUE;
+                    break;
+                }
+
+                if (!et_save_journal_copy (undo_fd, undo->data, fd,
+                                           undo->offset, undo->length, error))
+                {
+                    success = FALSE;
+                }
+                else if (ftruncate (fd, undo->size) != 0)
+                {
+                    et_save_journal_set_error (error, errno);
+                    success = FALSE;
+                }
+                break;
+            case ET_SAVE_JOURNAL_UNDO_SHIFT:
+                if (!same_file)
+                {
+                    *replaced = TRUE;
+                }
+                else if (fstat (fd, &st) != 0)
+                {
+                    et_save_journal_set_error (error, errno);
+                    success = FALSE;
+                }
+                else if (st.st_size == undo->size + undo->length)
+                {
+                    success = et_save_journal_unshift (fd, st.st_size,
+                                                       undo->offset,
+                                                       undo->length, error);
+                }
+                else if (st.st_size != undo->size)
+                {
+                    /* Neither before nor after the shift. */
+                    g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED, "%s",
+                                 _("The size of the file is unexpected"));
+                    success = FALSE;
+                }
+                break;
+            default:
+                g_assert_not_reached ();
+                break;
+        }
+    }
+
+    if (success && !et_save_journal_sync_fd (fd))
+    {
+        et_save_journal_set_error (error, errno);
+        success = FALSE;
+    }
+
+    close (fd);
+    g_array_unref (records);
+
+    return success;
+}
+#endif /* !G_OS_WIN32 */
+
+/*
+ * et_save_journal_recover_tag:
+ * @filename: the file to write the tag of
+ * @entry: the file in the journal
+ * @error: a #GError to provide information on errors, or %NULL to ignore
+ *
+ * Write the new tag of @filename, keeping the fields which are not in the
+ * journal as they are in the file.
+ *
+ * Returns: %TRUE if the tag was written, %FALSE otherwise
+ */
+static gboolean
+et_save_journal_recover_tag (const gchar *filename,
+                             const EtSaveJournalEntry *entry,
+                             GError **error)
+{
+    GList *file_list;
+    ET_File *ETFile;
+    File_Tag *FileTag;
+    gboolean success;
+    gsize i;
+
+    file_list = et_file_list_add (NULL, g_strdup (filename));
+    ETFile = file_list->data;
+
+    FileTag = et_file_tag_new ();
+    et_file_tag_copy_into (FileTag, ETFile->FileTag->data);
+
+    for (i = 0; i < G_N_ELEMENTS (tag_fields); i++)
+    {
+        gchar **field = &G_STRUCT_MEMBER (gchar *, FileTag, tag_fields[i]);
+
+        g_free (*field);
+        *field = *entry->new_fields[i] ? g_strdup (entry->new_fields[i])
+                                       : NULL;
+    }
+
+    if (entry->set_pictures)
+    {
+        et_file_tag_set_picture (FileTag, entry->new_pictures);
+    }
+
+    ETFile->FileTagList = g_list_append (ETFile->FileTagList, FileTag);
+    ETFile->FileTag = g_list_last (ETFile->FileTagList);
+
+    success = et_file_write_tag (ETFile, NULL, error);
+
+    et_file_list_free (file_list);
+
+    return success;
+}
+
+/*
+ * et_save_journal_is_file:
+ * @path: a path which the file of @entry may be at
+ * @entry: a file whose identity was recorded
+ *
+ * Returns: %TRUE if @path is the file of @entry, %FALSE otherwise
+ */
+static gboolean
+et_save_journal_is_file (const gchar *path,
+                         const EtSaveJournalEntry *entry)
+{
+    GStatBuf st;
+
+    return g_lstat (path, &st) == 0
+           && (guint64)st.st_dev == entry->device
+           && (guint64)st.st_ino == entry->inode;
+}
+
+/*
+ * et_save_journal_locate:
+ * @entry: the file to find
+ *
+ * Find the file of @entry, wherever interrupted renames left it. A file
+ * whose identity was recorded may be at its old or new filename, or at a
+ * temporary path, and another file may have taken its old filename. Any
+ * other file was not renamed yet, except on Windows.
+ *
+ * Returns: the path of the file, or %NULL if it was not found
+ */
+static const gchar *
+et_save_journal_locate (const EtSaveJournalEntry *entry)
+{
+    guint i;
+
+    if (!entry->identified)
+    {
+        if (g_file_test (entry->filename_cur, G_FILE_TEST_EXISTS))
+        {
+            return entry->filename_cur;
+        }
+
+#ifdef G_OS_WIN32
+        /* The identities of the files are not recorded, so guess that the
+         * file was renamed. */
+        if (entry->rename
+            && g_file_test (entry->filename_new, G_FILE_TEST_EXISTS))
+        {
+            return entry->filename_new;
+        }
+#endif /* G_OS_WIN32 */
+
+        return NULL;
+    }
+
+    if (et_save_journal_is_file (entry->filename_cur, entry))
+    {
+        return entry->filename_cur;
+    }
+
+    if (et_save_journal_is_file (entry->filename_new, entry))
+    {
+        return entry->filename_new;
+    }
+
+    for (i = entry->tmp_paths ? entry->tmp_paths->len : 0; i > 0; i--)
+    {
+        const gchar *tmp_path = g_ptr_array_index (entry->tmp_paths, i - 1);
+
+        if (et_save_journal_is_file (tmp_path, entry))
+        {
+            return tmp_path;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * et_save_journal_open_recovered:
+ * @length: the length of the complete records of the journal
+ *
+ * Open the journal which is recovered, to record the files which are renamed
+ * on recovery, so that they are still found if the recovery is interrupted.
+ * A record which was only partly written is removed first, so that it is not
+ * completed by the next record.
+ *
+ * Returns: a file descriptor, or -1 if the journal cannot be written
+ */
+static gint
+et_save_journal_open_recovered (goffset length)
+{
+#ifndef G_OS_WIN32
+    gchar *path;
+    gint fd;
+
+    path = et_save_journal_get_path ();
+    fd = g_open (path, O_WRONLY | O_APPEND, 0);
+    g_free (path);
+
+    if (fd != -1 && ftruncate (fd, length) != 0)
+    {
+        close (fd);
+        fd = -1;
+    }
+
+    return fd;
+#else /* G_OS_WIN32 */
+    /* The files cannot be identified anyway. */
+    return -1;
+#endif /* G_OS_WIN32 */
+}
+
+/*
+ * et_save_journal_append_recovered:
+ * @fd: the journal which is recovered, or -1
+ * @records: the records to append
+ *
+ * Append @records to the journal which is recovered, and flush them to the
+ * disk.
+ */
+static void
+et_save_journal_append_recovered (gint fd,
+                                  const GString *records)
+{
+    if (fd == -1 || records->len == 0)
+    {
+        return;
+    }
+
+    if (!et_save_journal_write_all (fd, records->str, records->len)
+        || !et_save_journal_sync_fd (fd))
+    {
+        g_warning ("Error writing the save journal: %s", g_strerror (errno));
+    }
+}
+
+static void
+et_save_journal_recover_aside (gpointer data,
+                               const gchar *tmp_path,
+                               gpointer user_data)
+{
+    const EtSaveJournalEntry *entry = data;
+    GString *record;
+
+    record = g_string_new (NULL);
+    et_save_journal_append_aside (record, entry->id, tmp_path);
+    et_save_journal_append_recovered (GPOINTER_TO_INT (user_data), record);
+    g_string_free (record, TRUE);
+}
+
+static void
+et_save_journal_on_moved_back (gpointer data,
+                               gboolean renamed,
+                               GError *error,
+                               gpointer user_data)
+{
+    EtSaveJournalEntry *entry = data;
+    gchar *filename_utf8;
+
+    if (renamed)
+    {
+        entry->filename = g_strdup (entry->filename_cur);
+        return;
+    }
+
+    filename_utf8 = filename_to_display (entry->filename_cur);
+    Log_Print (LOG_ERROR, _("File ‘%s’ is unrecoverable: %s"), filename_utf8,
+               error->message);
+    g_free (filename_utf8);
+    g_error_free (error);
+}
+
+/*
+ * et_save_journal_undo_renames:
+ * @entries: (element-type EtSaveJournalEntry): the files to recover
+ * @fd: the journal which is recovered, or -1
+ *
+ * Find the file of each entry, and move the files which interrupted renames
+ * left elsewhere back to their old filenames, together, as they may have
+ * taken the old filenames of each other. This is done before the contents of
+ * any file are undone, or its tag written, so that each is done to the right
+ * file.
+ */
+static void
+et_save_journal_undo_renames (GList *entries,
+                              gint fd)
+{
+    EtRenamePlan *plan;
+    GList *l;
+
+    plan = et_rename_plan_new ();
+
+    for (l = entries; l != NULL; l = g_list_next (l))
+    {
+        EtSaveJournalEntry *entry = l->data;
+        const gchar *path;
+
+        path = et_save_journal_locate (entry);
+
+        if (path == NULL)
+        {
+            gchar *filename_utf8 = filename_to_display (entry->filename_cur);
+
+            Log_Print (LOG_ERROR,
+                       _("Cannot recover file ‘%s’, as it no longer exists"),
+                       filename_utf8);
+            g_free (filename_utf8);
+        }
+        else if (strcmp (path, entry->filename_cur) == 0)
+        {
+            entry->filename = g_strdup (path);
+        }
+        else
+        {
+            et_rename_plan_add (plan, path, entry->filename_cur, entry);
+        }
+    }
+
+    et_rename_plan_set_aside_func (plan, et_save_journal_recover_aside,
+                                   GINT_TO_POINTER (fd));
+    et_rename_plan_run (plan, et_save_journal_on_moved_back, NULL);
+    et_rename_plan_free (plan);
+}
+
+/*
+ * et_save_journal_recover_entry:
+ * @entry: the file to recover, once it is at its old filename
+ * @resume: %TRUE to finish saving the file, %FALSE to roll it back
+ *
+ * Put the original bytes of the file back, from its undo file, then write
+ * the new tag of the file when resuming.
+ *
+ * Returns: %TRUE if the file was recovered, %FALSE otherwise
+ */
+static gboolean
+et_save_journal_recover_entry (const EtSaveJournalEntry *entry,
+                               gboolean resume)
+{
+    const gchar *filename = entry->filename;
+    gchar *filename_utf8;
+    gboolean replaced = FALSE;
+    GError *error = NULL;
+
+    /* The file was not found, which was reported. */
+    if (filename == NULL)
+    {
+        return FALSE;
+    }
+
+    filename_utf8 = filename_to_display (filename);
+
+#ifndef G_OS_WIN32
+    if (entry->write_tag)
+    {
+        gchar *path;
+        gchar *undo_path;
+        gint undo_fd;
+
+        path = et_save_journal_get_path ();
+        undo_path = et_save_journal_get_undo_path (path, entry->id);
+        undo_fd = g_open (undo_path, O_RDONLY, 0);
+        g_free (undo_path);
+        g_free (path);
+
+        /* Without an undo file, the file was not changed yet. */
+        if (undo_fd != -1)
+        {
+            gboolean success;
+
+            success = et_save_journal_undo_file (undo_fd, filename, resume,
+                                                 &replaced, &error);
+            close (undo_fd);
+
+            if (!success)
+            {
+                Log_Print (LOG_ERROR,
+                           _("File ‘%s’ is unrecoverable: %s"),
+                           filename_utf8, error->message);
+                g_error_free (error);
+                g_free (filename_utf8);
+                return FALSE;
+            }
+        }
+    }
+#endif /* !G_OS_WIN32 */
+
+    if (!resume && replaced)
+    {
+        Log_Print (LOG_ERROR,
+                   _("File ‘%s’ is unrecoverable, as it was already replaced by its new version"),
+                   filename_utf8);
+        g_free (filename_utf8);
+        return FALSE;
+    }
+
+    if (resume && entry->write_tag)
+    {
+        if (!et_save_journal_recover_tag (filename, entry, &error))
+        {
+            Log_Print (LOG_ERROR, _("Cannot write tag in file ‘%s’: %s"),
+                       filename_utf8, error->message);
+            g_error_free (error);
+            g_free (filename_utf8);
+            return FALSE;
+        }
+    }
+
+    g_free (filename_utf8);
+
+    return TRUE;
+}
+
+static void
+et_save_journal_on_renamed (gpointer data,
+                            gboolean renamed,
+                            GError *error,
+                            gpointer user_data)
+{
+    const EtSaveJournalEntry *entry = data;
+    gchar *filename_utf8;
+
+    filename_utf8 = filename_to_display (entry->filename_cur);
+
+    if (renamed)
+    {
+        Log_Print (LOG_OK, _("Finished saving file ‘%s’"), filename_utf8);
+    }
+    else
+    {
+        Log_Print (LOG_ERROR, _("Cannot rename file ‘%s’: %s"), filename_utf8,
+                   error->message);
+        g_error_free (error);
+    }
+
+    g_free (filename_utf8);
+}
+
+/*
+ * et_save_journal_remove:
+ *
+ * Remove the journal, and the undo files of its files.
+ */
+static void
+et_save_journal_remove (void)
+{
+    gchar *path;
+    gchar *dirname;
+    gchar *prefix;
+    GDir *dir;
+
+    path = et_save_journal_get_path ();
+    dirname = g_path_get_dirname (path);
+    prefix = g_path_get_basename (path);
+
+    dir = g_dir_open (dirname, 0, NULL);
+
+    if (dir)
+    {
+        const gchar *name;
+
+        while ((name = g_dir_read_name (dir)) != NULL)
+        {
+            if (g_str_has_prefix (name, prefix)
+                && name[strlen (prefix)] == '-')
+            {
+                gchar *undo_path = g_build_filename (dirname, name, NULL);
+
+                g_unlink (undo_path);
+                g_free (undo_path);
+            }
+        }
+
+        g_dir_close (dir);
+    }
+
+    g_unlink (path);
+
+    g_free (prefix);
+    g_free (dirname);
+    g_free (path);
+}
+
+/*
+ * et_save_journal_get_n_interrupted:
+ *
+ * Check for a save which was interrupted.
+ *
+ * Returns: the number of files which were not completely saved
+ */
+guint
+et_save_journal_get_n_interrupted (void)
+{
+    GList *entries;
+    guint n_files;
+
+    entries = et_save_journal_read (NULL);
+    n_files = g_list_length (entries);
+    g_list_free_full (entries, (GDestroyNotify)et_save_journal_entry_free);
+
+    return n_files;
+}
+
+/*
+ * et_save_journal_recover:
+ * @recovery: what to do with the files which were not completely saved
+ *
+ * Recover the files of an interrupted save, then remove its journal. The
+ * files are loaded separately from the file list, so this must be called
+ * before any directory is loaded.
+ */
+void
+et_save_journal_recover (EtSaveJournalRecovery recovery)
+{
+    if (recovery != ET_SAVE_JOURNAL_DISCARD)
+    {
+        const gboolean resume = (recovery == ET_SAVE_JOURNAL_RESUME);
+        EtRenamePlan *plan;
+        GString *records;
+        GList *entries;
+        GList *l;
+        goffset length;
+        gint fd;
+
+        entries = et_save_journal_read (&length);
+        fd = entries ? et_save_journal_open_recovered (length) : -1;
+
+        et_save_journal_undo_renames (entries, fd);
+
+        /* The files are renamed again together when resuming, as they may
+         * take the old filenames of each other. */
+        plan = et_rename_plan_new ();
+        records = g_string_new (NULL);
+
+        for (l = entries; l != NULL; l = g_list_next (l))
+        {
+            const EtSaveJournalEntry *entry = l->data;
+            gchar *filename_utf8;
+
+            if (!et_save_journal_recover_entry (entry, resume))
+            {
+                continue;
+            }
+
+            if (resume && entry->rename
+                && strcmp (entry->filename_cur, entry->filename_new) != 0)
+            {
+                /* Writing the tag may have replaced the file. */
+                et_save_journal_append_identity (records, entry->id,
+                                                 entry->filename_cur);
+                et_rename_plan_add (plan, entry->filename_cur,
+                                    entry->filename_new, (gpointer)entry);
+                continue;
+            }
+
+            filename_utf8 = filename_to_display (entry->filename_cur);
+
+            if (resume)
+            {
+                Log_Print (LOG_OK, _("Finished saving file ‘%s’"),
+                           filename_utf8);
+            }
+            else
+            {
+                Log_Print (LOG_OK, _("Restored file ‘%s’"), filename_utf8);
+            }
+
+            g_free (filename_utf8);
+        }
+
+        et_save_journal_append_recovered (fd, records);
+        g_string_free (records, TRUE);
+
+        et_rename_plan_set_aside_func (plan, et_save_journal_recover_aside,
+                                       GINT_TO_POINTER (fd));
+        et_rename_plan_run (plan, et_save_journal_on_renamed, NULL);
+        et_rename_plan_free (plan);
+
+        if (fd != -1)
+        {
+            close (fd);
+        }
+
+        g_list_free_full (entries,
+                          (GDestroyNotify)et_save_journal_entry_free);
+    }
+
+    et_save_journal_remove ();
+}
@@ -0,0 +1,79 @@
+/* EasyTAG - tag editor for audio files
+ * Copyright (C) 2026  agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef ET_SAVE_JOURNAL_H_
+#define ET_SAVE_JOURNAL_H_
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+#include "file.h"
+
+typedef struct _EtSaveJournal EtSaveJournal;
+
+/*
+ * EtSaveJournalRecovery:
+ * @ET_SAVE_JOURNAL_RESUME: finish saving the interrupted files
+ * @ET_SAVE_JOURNAL_ROLL_BACK: restore the contents and filenames of the
+ *                             interrupted files from before the save
+ * @ET_SAVE_JOURNAL_DISCARD: leave the interrupted files as they are
+ *
+ * What to do with the files of a save which was interrupted, for example by
+ * a crash or a power loss.
+ */
+typedef enum
+{
+    ET_SAVE_JOURNAL_RESUME,
+    ET_SAVE_JOURNAL_ROLL_BACK,
+    ET_SAVE_JOURNAL_DISCARD
+} EtSaveJournalRecovery;
+
+EtSaveJournal * et_save_journal_new (void);
+guint et_save_journal_add (EtSaveJournal *self, const ET_File *ETFile,
+                           gboolean write_tag, gboolean rename);
+void et_save_journal_begin (EtSaveJournal *self, guint id);
+void et_save_journal_written (EtSaveJournal *self, guint id);
+void et_save_journal_add_rename (EtSaveJournal *self, guint id,
+                                 const gchar *filename);
+void et_save_journal_begin_renames (EtSaveJournal *self);
+void et_save_journal_move_aside (EtSaveJournal *self, guint id,
+                                 const gchar *tmp_path);
+void et_save_journal_end (EtSaveJournal *self, guint id,
+                          const gchar *filename);
+void et_save_journal_sync (EtSaveJournal *self);
+void et_save_journal_free (EtSaveJournal *self);
+
+gboolean et_save_journal_backup (GFile *file, goffset offset, goffset length,
+                                 GError **error);
+gboolean et_save_journal_backup_shift (GFile *file, goffset offset,
+                                       goffset distance, GError **error);
+GFile * et_save_journal_new_temporary (GFile *file, GFileIOStream **iostream,
+                                       GError **error);
+gboolean et_save_journal_copy_range (GFile *file, goffset offset,
+                                     goffset length, GFile *temporary,
+                                     GFileIOStream *iostream, GError **error);
+gboolean et_save_journal_replace (GFile *temporary, GFile *file,
+                                  GError **error);
+
+guint et_save_journal_get_n_interrupted (void);
+void et_save_journal_recover (EtSaveJournalRecovery recovery);
+
+G_END_DECLS
+
+#endif /* ET_SAVE_JOURNAL_H_ */
@@ -2942,8 +2942,8 @@ et_scan_dialog_scan_selected_files (EtScanDialog *self)
 
     g_list_free_full (selfilelist, (GDestroyNotify)gtk_tree_path_free);
 
-    /* Refresh the whole list (faster than file by file) to show changes. */
-    et_application_window_browser_refresh_list (window);
+    /* Refresh the rows of the changed files. */
+    et_application_window_browser_refresh_dirty_files (window);
 
     /* Display the current file */
     ET_Display_File_Data_To_UI(ETCore->ETFileDisplayed);
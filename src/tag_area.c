@@ -659,8 +659,8 @@ on_apply_to_selection (GObject *object,
 
     g_list_free(etfilelist);
 
-    /* Refresh the whole list (faster than file by file) to show changes. */
-    et_application_window_browser_refresh_list (window);
+    /* Refresh the rows of the changed files. */
+    et_application_window_browser_refresh_dirty_files (window);
 
     /* Display the current file (Needed when sequencing tracks) */
     ET_Display_File_Data_To_UI(ETCore->ETFileDisplayed);
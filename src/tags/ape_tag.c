@@ -31,7 +31,9 @@
 #include "misc.h"
 #include "setting.h"
 #include "charset.h"
+#include "save_journal.h"
 #include "libapetag/apetaglib.h"
+#include "libapetag/is_tag.h"
 
 /*************
  * Functions *
@@ -213,6 +215,55 @@ ape_tag_read_file_tag (GFile *file,
     return TRUE;
 }
 
+/*
+ * et_ape_tag_backup:
+ * @filename: the file about to be written
+ * @error: a #GError to provide information on errors, or %NULL to ignore
+ *
+ * apetag_save() rewrites the APE and ID3v1 tags at the end of the file in
+ * place, and truncates it, so save everything from the start of those tags
+ * to the journal first.
+ *
+ * Returns: %TRUE on success, %FALSE and with @error set otherwise
+ */
+static gboolean
+et_ape_tag_backup (const gchar *filename,
+                   GError **error)
+{
+    FILE *fp;
+    struct is_tag_tail tail;
+    GFile *file;
+    long offset;
+    gboolean success;
+
+    if ((fp = fopen (filename, "rb")) == NULL)
+    {
+        g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                     _("Error while opening file: %s"),
+                     g_strerror (errno));
+        return FALSE;
+    }
+
+    if (is_tag_tail_open (&tail, fp) != 0)
+    {
+        g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_IO,
+                     _("Error while opening file: %s"),
+                     g_strerror (EIO));
+        fclose (fp);
+        return FALSE;
+    }
+
+    offset = tail.fileSize - is_id3v1_tail (&tail) - is_ape_tail (&tail);
+    is_tag_tail_close (&tail);
+    fclose (fp);
+
+    file = g_file_new_for_path (filename);
+    success = et_save_journal_backup (file, MAX (offset, 0), -1, error);
+    g_object_unref (file);
+
+    return success;
+}
+
 gboolean
 ape_tag_write_file_tag (const ET_File *ETFile,
                         GError **error)
@@ -377,6 +428,12 @@ ape_tag_write_file_tag (const ET_File *ETFile,
     else
         apefrm_remove(ape_mem,"Encoded By");
 
+    if (!et_ape_tag_backup (filename_in, error))
+    {
+        apetag_free (ape_mem);
+        return FALSE;
+    }
+
     /* reread all tag-type again  excl. changed frames by apefrm_remove() */
     if (apetag_save (filename_in, ape_mem, APE_TAG_V2 + SAVE_NEW_OLD_APE_TAG)
         != 0)
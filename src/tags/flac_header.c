@@ -22,131 +22,261 @@
 #ifdef ENABLE_FLAC
 
 #include <glib/gi18n.h>
-#include <errno.h>
+#include <string.h>
 
 #include "et_core.h"
 #include "flac_header.h"
 #include "flac_private.h"
 #include "misc.h"
 
-/* Header info of FLAC file */
-gboolean
-et_flac_header_read_file_info (GFile *file,
-                               ET_File_Info *ETFileInfo,
-                               GError **error)
+/* Size of the ID3v2 tag header, which some files start with. */
+#define ID3V2_HEADER_SIZE 10
+/* Size of the "fLaC" stream marker. */
+#define FLAC_STREAM_MARKER_SIZE 4
+/* Size of a metadata block header, and of the STREAMINFO block data. */
+#define FLAC_BLOCK_HEADER_SIZE 4
+#define FLAC_STREAMINFO_SIZE 34
+
+/*
+ * et_flac_read_file_info_from_stream_info:
+ * @file: the file which the stream information was read from
+ * @stream_info: the STREAMINFO metadata block of @file
+ * @metadata_len: the total length of the metadata blocks of @file
+ * @ETFileInfo: ET_File_Info to put information into
+ *
+ * Fill @ETFileInfo from the STREAMINFO metadata block of a FLAC file.
+ */
+void
+et_flac_read_file_info_from_stream_info (GFile *file,
+                                         const FLAC__StreamMetadata_StreamInfo *stream_info,
+                                         gsize metadata_len,
+                                         ET_File_Info *ETFileInfo)
 {
     GFileInfo *info;
-    FLAC__Metadata_Chain *chain;
-    EtFlacReadState state;
-    GFileInputStream *istream;
-    FLAC__IOCallbacks callbacks = { et_flac_read_func,
-                                    NULL, /* Do not set a write callback. */
-                                    et_flac_seek_func, et_flac_tell_func,
-                                    et_flac_eof_func,
-                                    et_flac_read_close_func };
-    FLAC__Metadata_Iterator *iter;
-    gsize metadata_len;
 
-    g_return_val_if_fail (file != NULL && ETFileInfo != NULL, FALSE);
-    g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+    g_return_if_fail (file != NULL && stream_info != NULL
+                      && ETFileInfo != NULL);
 
-    /* Decoding FLAC file */
-    chain = FLAC__metadata_chain_new ();
-
-    if (chain == NULL)
+    if (stream_info->sample_rate > 0)
     {
-        g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_NOMEM, "%s",
-                     g_strerror (ENOMEM));
-        return FALSE;
+        ETFileInfo->duration = stream_info->total_samples
+                               / stream_info->sample_rate;
     }
 
-    istream = g_file_read (file, NULL, &state.error);
+    ETFileInfo->mode = stream_info->channels;
+    ETFileInfo->samplerate = stream_info->sample_rate;
+    ETFileInfo->version = 0; /* Not defined in FLAC file. */
+
+    info = g_file_query_info (file, G_FILE_ATTRIBUTE_STANDARD_SIZE,
+                              G_FILE_QUERY_INFO_NONE, NULL, NULL);
 
-    if (istream == NULL)
+    if (info)
     {
-        FLAC__metadata_chain_delete (chain);
-        return FALSE;
+        ETFileInfo->size = g_file_info_get_size (info);
+        g_object_unref (info);
+    }
+    else
+    {
+        ETFileInfo->size = 0;
     }
 
-    state.eof = FALSE;
-    state.error = NULL;
-    state.istream = istream;
-    state.seekable = G_SEEKABLE (istream);
+    if (ETFileInfo->duration > 0 && ETFileInfo->size > 0)
+    {
+        /* Ignore metadata blocks, and use the remainder to calculate the
+         * average bitrate (including format overhead). */
+        ETFileInfo->bitrate = (ETFileInfo->size - metadata_len) * 8 /
+                              ETFileInfo->duration / 1000;
+    }
+}
 
-    if (!FLAC__metadata_chain_read_with_callbacks (chain, &state, callbacks))
+static gboolean
+read_bytes (GInputStream *istream,
+            guchar *buffer,
+            gsize count,
+            GError **error)
+{
+    gsize bytes_read;
+
+    if (!g_input_stream_read_all (istream, buffer, count, &bytes_read, NULL,
+                                  error))
     {
-        const FLAC__Metadata_ChainStatus status = FLAC__metadata_chain_status (chain);
+        return FALSE;
+    }
 
-        g_debug ("Error reading FLAC metadata chain: %s:",
-                 FLAC__Metadata_ChainStatusString[status]);
-        FLAC__metadata_chain_delete (chain);
-        /* TODO: Provide a dedicated error enum corresponding to status. */
+    if (bytes_read != count)
+    {
         g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED, "%s",
                      _("Error opening FLAC file"));
-        et_flac_read_close_func (&state);
         return FALSE;
     }
 
-    iter = FLAC__metadata_iterator_new ();
+    return TRUE;
+}
 
-    if (iter == NULL)
+static gboolean
+skip_bytes (GInputStream *istream,
+            gsize count,
+            GError **error)
+{
+    while (count > 0)
     {
-        et_flac_read_close_func (&state);
-        g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_NOMEM, "%s",
-                     g_strerror (ENOMEM));
-        return FALSE;
+        gssize skipped;
+
+        skipped = g_input_stream_skip (istream, count, NULL, error);
+
+        if (skipped < 0)
+        {
+            return FALSE;
+        }
+        else if (skipped == 0)
+        {
+            g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED, "%s",
+                         _("Error opening FLAC file"));
+            return FALSE;
+        }
+
+        count -= skipped;
     }
 
-    FLAC__metadata_iterator_init (iter, chain);
-    metadata_len = 0;
+    return TRUE;
+}
 
-    do
+/*
+ * Header info of FLAC file
+ *
+ * Only the metadata block headers and the STREAMINFO block are read; the data
+ * of the other blocks, such as large pictures, is skipped over. The tag
+ * reader fills the same information while reading the tag, so this is only
+ * needed when the tag was not read.
+ */
+gboolean
+et_flac_header_read_file_info (GFile *file,
+                               ET_File_Info *ETFileInfo,
+                               GError **error)
+{
+    GFileInputStream *file_istream;
+    GInputStream *istream;
+    guchar header[ID3V2_HEADER_SIZE];
+    guchar data[FLAC_STREAMINFO_SIZE];
+    FLAC__StreamMetadata_StreamInfo stream_info;
+    gboolean has_stream_info = FALSE;
+    gboolean last;
+    gsize metadata_len = 0;
+
+    g_return_val_if_fail (file != NULL && ETFileInfo != NULL, FALSE);
+    g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+    file_istream = g_file_read (file, NULL, error);
+
+    if (file_istream == NULL)
     {
-        const FLAC__StreamMetadata *block;
+        return FALSE;
+    }
 
-        block = FLAC__metadata_iterator_get_block (iter);
+    istream = G_INPUT_STREAM (file_istream);
 
-        metadata_len += block->length;
+    if (!read_bytes (istream, header, FLAC_STREAM_MARKER_SIZE, error))
+    {
+        goto err;
+    }
+
+    /* Skip an ID3v2 tag before the stream marker, as libFLAC does. */
+    if (memcmp (header, "ID3", 3) == 0)
+    {
+        gsize tag_size;
 
-        if (block->type == FLAC__METADATA_TYPE_STREAMINFO)
+        if (!read_bytes (istream, header + FLAC_STREAM_MARKER_SIZE,
+                         ID3V2_HEADER_SIZE - FLAC_STREAM_MARKER_SIZE, error))
         {
-            const FLAC__StreamMetadata_StreamInfo *stream_info = &block->data.stream_info;
-            ETFileInfo->duration = stream_info->total_samples
-                                   / stream_info->sample_rate;
-            ETFileInfo->mode = stream_info->channels;
-            ETFileInfo->samplerate = stream_info->sample_rate;
-            ETFileInfo->version = 0; /* Not defined in FLAC file. */
+            goto err;
         }
-    }
-    while (FLAC__metadata_iterator_next (iter));
 
-    FLAC__metadata_iterator_delete (iter);
-    FLAC__metadata_chain_delete (chain);
-    et_flac_read_close_func (&state);
-    /* End of decoding FLAC file */
+        /* Synchsafe size, excluding the header, plus an optional footer. */
+        tag_size = ((header[6] & 0x7f) << 21) | ((header[7] & 0x7f) << 14)
+                   | ((header[8] & 0x7f) << 7) | (header[9] & 0x7f);
 
-    info = g_file_query_info (file, G_FILE_ATTRIBUTE_STANDARD_SIZE,
-                              G_FILE_QUERY_INFO_NONE, NULL, NULL);
+        if (header[5] & 0x10)
+        {
+            tag_size += ID3V2_HEADER_SIZE;
+        }
 
-    if (info)
+        if (!skip_bytes (istream, tag_size, error)
+            || !read_bytes (istream, header, FLAC_STREAM_MARKER_SIZE, error))
+        {
+            goto err;
+        }
+    }
+
+    if (memcmp (header, "fLaC", FLAC_STREAM_MARKER_SIZE) != 0)
     {
-        ETFileInfo->size = g_file_info_get_size (info);
-        g_object_unref (info);
+        g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED, "%s",
+                     _("Error opening FLAC file"));
+        goto err;
     }
-    else
+
+    do
     {
-        ETFileInfo->size = 0;
+        guint type;
+        gsize length;
+
+        if (!read_bytes (istream, header, FLAC_BLOCK_HEADER_SIZE, error))
+        {
+            goto err;
+        }
+
+        last = (header[0] & 0x80) != 0;
+        type = header[0] & 0x7f;
+        length = (header[1] << 16) | (header[2] << 8) | header[3];
+        metadata_len += length;
+
+        if (type == FLAC__METADATA_TYPE_STREAMINFO && !has_stream_info
+            && length >= FLAC_STREAMINFO_SIZE)
+        {
+            if (!read_bytes (istream, data, FLAC_STREAMINFO_SIZE, error))
+            {
+                goto err;
+            }
+
+            /* 20 bits of sample rate, 3 bits of channels minus one, 5 bits
+             * of bits per sample minus one and 36 bits of total samples,
+             * after the block and frame sizes. */
+            stream_info.sample_rate = (data[10] << 12) | (data[11] << 4)
+                                      | (data[12] >> 4);
+            stream_info.channels = ((data[12] >> 1) & 0x07) + 1;
+            stream_info.bits_per_sample = (((data[12] & 0x01) << 4)
+                                           | (data[13] >> 4)) + 1;
+            stream_info.total_samples = ((FLAC__uint64)(data[13] & 0x0f) << 32)
+                                        | ((FLAC__uint64)data[14] << 24)
+                                        | (data[15] << 16) | (data[16] << 8)
+                                        | data[17];
+            has_stream_info = TRUE;
+            length -= FLAC_STREAMINFO_SIZE;
+        }
+
+        if (!skip_bytes (istream, length, error))
+        {
+            goto err;
+        }
     }
+    while (!last);
 
-    if (ETFileInfo->duration > 0 && ETFileInfo->size > 0)
+    g_object_unref (file_istream);
+
+    if (!has_stream_info)
     {
-        /* Ignore metadata blocks, and use the remainder to calculate the
-         * average bitrate (including format overhead). */
-        ETFileInfo->bitrate = (ETFileInfo->size - metadata_len) * 8 /
-                              ETFileInfo->duration / 1000;
+        g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED, "%s",
+                     _("Error opening FLAC file"));
+        return FALSE;
     }
 
+    et_flac_read_file_info_from_stream_info (file, &stream_info, metadata_len,
+                                             ETFileInfo);
+
     return TRUE;
+
+err:
+    g_object_unref (file_istream);
+    return FALSE;
 }
 
 EtFileHeaderFields *
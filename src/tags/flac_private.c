@@ -21,6 +21,8 @@
 #include <errno.h>
 #include <unistd.h>
 
+#include "save_journal.h"
+
 size_t
 et_flac_read_func (void *ptr,
                    size_t size,
@@ -61,6 +63,15 @@ et_flac_write_func (const void *ptr,
 
     state = (EtFlacWriteState *)handle;
 
+    if (state->backup
+        && !et_save_journal_backup (state->file,
+                                    g_seekable_tell (state->seekable),
+                                    size * nmemb, &state->error))
+    {
+        errno = EIO;
+        return 0;
+    }
+
     if (!g_output_stream_write_all (G_OUTPUT_STREAM (state->ostream), ptr,
                                     size * nmemb, &bytes_written, NULL,
                                     &state->error))
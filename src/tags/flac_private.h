@@ -26,6 +26,8 @@
 #include <gio/gio.h>
 #include <FLAC/metadata.h>
 
+#include "et_core.h"
+
 G_BEGIN_DECLS
 
 /*
@@ -58,6 +60,9 @@ typedef struct
     GFile *file;
     GFileOutputStream *ostream;
     GFileIOStream *iostream;
+    /* Whether to back up the data which is overwritten in the save
+     * journal. */
+    gboolean backup;
 } EtFlacWriteState;
 
 /* Used with both EtFlacReadState and EtFlacWriteState. */
@@ -73,6 +78,9 @@ int et_flac_read_close_func (FLAC__IOHandle handle);
 size_t et_flac_write_func (const void *ptr, size_t size, size_t nmemb, FLAC__IOHandle handle);
 int et_flac_write_close_func (FLAC__IOHandle handle);
 
+/* Shared between the tag and header readers. */
+void et_flac_read_file_info_from_stream_info (GFile *file, const FLAC__StreamMetadata_StreamInfo *stream_info, gsize metadata_len, ET_File_Info *ETFileInfo);
+
 G_END_DECLS
 
 #endif /* ENABLE_FLAC */
@@ -24,6 +24,7 @@
 
 #include <glib/gi18n.h>
 #include <errno.h>
+#include <string.h>
 
 #include "easytag.h"
 #include "flac_private.h"
@@ -35,6 +36,7 @@
 #include "setting.h"
 #include "picture.h"
 #include "charset.h"
+#include "save_journal.h"
 
 #define MULTIFIELD_SEPARATOR " - "
 
@@ -73,10 +75,15 @@ static gboolean Flac_Set_Tag (FLAC__StreamMetadata *vc_block, const gchar *tag_n
  * Read tag data from a FLAC file using the level 2 flac interface,
  * Note:
  *  - if field is found but contains no info (strlen(str)==0), we don't read it
+ *  - if ETFileInfo is not NULL, it is filled from the STREAMINFO block of the
+ *    same metadata chain, so that the metadata is only read once, and
+ *    file_info_read is set to whether there was such a block to fill it from
  */
 gboolean
 flac_tag_read_file_tag (GFile *file,
                         File_Tag *FileTag,
+                        ET_File_Info *ETFileInfo,
+                        gboolean *file_info_read,
                         GError **error)
 {
     FLAC__Metadata_Chain *chain;
@@ -87,6 +94,9 @@ flac_tag_read_file_tag (GFile *file,
                                     et_flac_eof_func,
                                     et_flac_read_close_func };
     FLAC__Metadata_Iterator *iter;
+    FLAC__StreamMetadata_StreamInfo stream_info;
+    gboolean has_stream_info = FALSE;
+    gsize metadata_len = 0;
 
     gchar *string = NULL;
     guint i;
@@ -94,8 +104,14 @@ flac_tag_read_file_tag (GFile *file,
     //gint j = 1;
 
     g_return_val_if_fail (file != NULL && FileTag != NULL, FALSE);
+    g_return_val_if_fail (ETFileInfo == NULL || file_info_read != NULL, FALSE);
     g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 
+    if (file_info_read)
+    {
+        *file_info_read = FALSE;
+    }
+
     chain = FLAC__metadata_chain_new ();
 
     if (chain == NULL)
@@ -131,13 +147,20 @@ flac_tag_read_file_tag (GFile *file,
 
     FLAC__metadata_iterator_init (iter, chain);
 
-    while (FLAC__metadata_iterator_next (iter))
+    do
     {
         FLAC__StreamMetadata *block;
 
         block = FLAC__metadata_iterator_get_block (iter);
 
-        if (block->type == FLAC__METADATA_TYPE_VORBIS_COMMENT)
+        metadata_len += block->length;
+
+        if (block->type == FLAC__METADATA_TYPE_STREAMINFO)
+        {
+            stream_info = block->data.stream_info;
+            has_stream_info = TRUE;
+        }
+        else if (block->type == FLAC__METADATA_TYPE_VORBIS_COMMENT)
         {
                 FLAC__StreamMetadata_VorbisComment       *vc;
                 FLAC__StreamMetadata_VorbisComment_Entry *field;
@@ -669,11 +692,19 @@ flac_tag_read_file_tag (GFile *file,
             prev_pic = pic;
         }
     }
+    while (FLAC__metadata_iterator_next (iter));
 
     FLAC__metadata_iterator_delete (iter);
     FLAC__metadata_chain_delete (chain);
     et_flac_read_close_func (&state);
 
+    if (ETFileInfo && has_stream_info)
+    {
+        et_flac_read_file_info_from_stream_info (file, &stream_info,
+                                                 metadata_len, ETFileInfo);
+        *file_info_read = TRUE;
+    }
+
 #ifdef ENABLE_MP3
     /* If no FLAC vorbis tag found : we try to get the ID3 tag if it exists
      * (but it will be deleted when rewriting the tag) */
@@ -697,7 +728,7 @@ flac_tag_read_file_tag (GFile *file,
     {
         gboolean rc;
 
-        rc = id3tag_read_file_tag (file, FileTag, NULL);
+        rc = id3tag_read_file_tag (file, FileTag, NULL, NULL);
 
         // If an ID3 tag has been found (and no FLAC tag), we mark the file as
         // unsaved to rewrite a flac tag.
@@ -776,6 +807,171 @@ static gboolean Flac_Set_Tag (FLAC__StreamMetadata *vc_block, const gchar *tag_n
     return FALSE;
 }
 
+/*
+ * Flac_Reserve_Padding:
+ * @chain: the metadata chain, with the padding sorted to the end
+ *
+ * Replace the padding at the end of @chain with a reserve for later edits,
+ * of at least the minimum set by the user and growing with the size of the
+ * rest of the metadata. Only worth doing when the whole file has to be
+ * rewritten anyway.
+ */
+static void
+Flac_Reserve_Padding (FLAC__Metadata_Chain *chain)
+{
+    FLAC__Metadata_Iterator *iter;
+    FLAC__StreamMetadata *padding_block;
+    guint64 metadata_length = 0;
+    guint64 reserve;
+
+    iter = FLAC__metadata_iterator_new ();
+
+    if (iter == NULL)
+    {
+        return;
+    }
+
+    FLAC__metadata_iterator_init (iter, chain);
+
+    do
+    {
+        if (FLAC__metadata_iterator_get_block_type (iter)
+            == FLAC__METADATA_TYPE_PADDING)
+        {
+            FLAC__metadata_iterator_delete_block (iter, false);
+        }
+        else
+        {
+            const FLAC__StreamMetadata *block = FLAC__metadata_iterator_get_block (iter);
+
+            metadata_length += FLAC__STREAM_METADATA_HEADER_LENGTH
+                               + block->length;
+        }
+    } while (FLAC__metadata_iterator_next (iter));
+
+    reserve = metadata_length * g_settings_get_uint (MainSettings,
+                                                     "flac-padding-growth")
+              / 100;
+    reserve = MAX (reserve, g_settings_get_uint (MainSettings,
+                                                 "flac-padding-minimum"));
+    /* The length of a metadata block is a 24-bit field. */
+    reserve = MIN (reserve,
+                   (1 << FLAC__STREAM_METADATA_LENGTH_LEN) - 1);
+
+    if (reserve > 0)
+    {
+        padding_block = FLAC__metadata_object_new (FLAC__METADATA_TYPE_PADDING);
+
+        if (padding_block != NULL)
+        {
+            padding_block->length = reserve;
+
+            /* The iterator is on the last block. */
+            if (!FLAC__metadata_iterator_insert_block_after (iter,
+                                                             padding_block))
+            {
+                FLAC__metadata_object_delete (padding_block);
+            }
+        }
+    }
+
+    FLAC__metadata_iterator_delete (iter);
+}
+
+/*
+ * Flac_Block_Equal:
+ * @a: a VORBIS_COMMENT or PICTURE block
+ * @b: another block
+ *
+ * Compare the blocks field by field, as they would be written to the file.
+ *
+ * Returns: %TRUE if the blocks would be written as the same bytes
+ */
+static gboolean
+Flac_Block_Equal (const FLAC__StreamMetadata *a,
+                  const FLAC__StreamMetadata *b)
+{
+    if (a->type != b->type || a->length != b->length)
+    {
+        return FALSE;
+    }
+
+    if (a->type == FLAC__METADATA_TYPE_VORBIS_COMMENT)
+    {
+        const FLAC__StreamMetadata_VorbisComment *vca = &a->data.vorbis_comment;
+        const FLAC__StreamMetadata_VorbisComment *vcb = &b->data.vorbis_comment;
+        FLAC__uint32 i;
+
+        if (vca->vendor_string.length != vcb->vendor_string.length
+            || memcmp (vca->vendor_string.entry, vcb->vendor_string.entry,
+                       vca->vendor_string.length) != 0
+            || vca->num_comments != vcb->num_comments)
+        {
+            return FALSE;
+        }
+
+        for (i = 0; i < vca->num_comments; i++)
+        {
+            if (vca->comments[i].length != vcb->comments[i].length
+                || memcmp (vca->comments[i].entry, vcb->comments[i].entry,
+                           vca->comments[i].length) != 0)
+            {
+                return FALSE;
+            }
+        }
+
+        return TRUE;
+    }
+    else if (a->type == FLAC__METADATA_TYPE_PICTURE)
+    {
+        const FLAC__StreamMetadata_Picture *pa = &a->data.picture;
+        const FLAC__StreamMetadata_Picture *pb = &b->data.picture;
+
+        return pa->type == pb->type
+               && strcmp (pa->mime_type, pb->mime_type) == 0
+               && strcmp ((const gchar *)pa->description,
+                          (const gchar *)pb->description) == 0
+               && pa->width == pb->width
+               && pa->height == pb->height
+               && pa->depth == pb->depth
+               && pa->colors == pb->colors
+               && pa->data_length == pb->data_length
+               && memcmp (pa->data, pb->data, pa->data_length) == 0;
+    }
+
+    return FALSE;
+}
+
+/*
+ * Flac_Blocks_Equal:
+ * @old_blocks: the tag blocks which were in the file, in order
+ * @new_blocks: the tag blocks to write, in order
+ *
+ * Returns: %TRUE if writing @new_blocks would not change the file
+ */
+static gboolean
+Flac_Blocks_Equal (GPtrArray *old_blocks,
+                   GPtrArray *new_blocks)
+{
+    guint i;
+
+    if (old_blocks->len != new_blocks->len)
+    {
+        return FALSE;
+    }
+
+    for (i = 0; i < old_blocks->len; i++)
+    {
+        if (!Flac_Block_Equal (g_ptr_array_index (old_blocks, i),
+                               g_ptr_array_index (new_blocks, i)))
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
 /*
  * Write Flac tag, using the level 2 flac interface
  */
@@ -798,6 +994,11 @@ flac_tag_write_file_tag (const ET_File *ETFile,
     FLAC__Metadata_Iterator *iter;
     FLAC__StreamMetadata_VorbisComment_Entry vce_field_vendor_string; // To save vendor string
     gboolean vce_field_vendor_string_found = FALSE;
+    /* Copies of the tag blocks of the file, and the new ones, which belong
+     * to the chain. */
+    GPtrArray *old_blocks;
+    GPtrArray *new_blocks;
+    gboolean unchanged;
 
     g_return_val_if_fail (ETFile != NULL && ETFile->FileTag != NULL, FALSE);
     g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
@@ -825,6 +1026,7 @@ flac_tag_write_file_tag (const ET_File *ETFile,
 
     state.file = file;
     state.error = NULL;
+    state.backup = TRUE;
     /* TODO: Fallback to an in-memory copy of the file for non-local files,
      * where creation of the GFileIOStream may fail. */
     iostream = g_file_open_readwrite (file, NULL, &state.error);
@@ -871,11 +1073,27 @@ flac_tag_write_file_tag (const ET_File *ETFile,
     }
     
     FLAC__metadata_iterator_init (iter, chain);
+
+    old_blocks = g_ptr_array_new_with_free_func ((GDestroyNotify)FLAC__metadata_object_delete);
+    new_blocks = g_ptr_array_new ();
     
     while (FLAC__metadata_iterator_next (iter))
     {
         const FLAC__MetadataType block_type = FLAC__metadata_iterator_get_block_type (iter);
 
+        if (block_type == FLAC__METADATA_TYPE_VORBIS_COMMENT
+            || block_type == FLAC__METADATA_TYPE_PICTURE)
+        {
+            FLAC__StreamMetadata *old_block;
+
+            old_block = FLAC__metadata_object_clone (FLAC__metadata_iterator_get_block (iter));
+
+            if (old_block != NULL)
+            {
+                g_ptr_array_add (old_blocks, old_block);
+            }
+        }
+
         /* TODO: Modify the blocks directly, rather than deleting and
          * recreating. */
         if (block_type == FLAC__METADATA_TYPE_VORBIS_COMMENT)
@@ -1023,6 +1241,7 @@ flac_tag_write_file_tag (const ET_File *ETFile,
 
         // Add the block to the the chain (so we don't need to free the block)
         FLAC__metadata_iterator_insert_block_after(iter, vc_block);
+        g_ptr_array_add (new_blocks, vc_block);
     }
     
     
@@ -1089,6 +1308,7 @@ flac_tag_write_file_tag (const ET_File *ETFile,
                 {
                     // Add the block to the the chain (so we don't need to free the block)
                     FLAC__metadata_iterator_insert_block_after(iter, picture_block);
+                    g_ptr_array_add (new_blocks, picture_block);
                 }
             }
             
@@ -1097,23 +1317,42 @@ flac_tag_write_file_tag (const ET_File *ETFile,
     }
     
     FLAC__metadata_iterator_delete (iter);
+
+    /* Writing the same tag again would only change the modification time
+     * of the file, for example when forcing the save of unchanged files. */
+    unchanged = Flac_Blocks_Equal (old_blocks, new_blocks);
+    g_ptr_array_unref (new_blocks);
+    g_ptr_array_unref (old_blocks);
     
     //
     // Prepare for writing tag
     //
     
     FLAC__metadata_chain_sort_padding (chain);
+
+    /* If the metadata no longer fits before the audio data, even by using
+     * the padding, the whole file is rewritten. Leave enough padding then,
+     * so that the next edits can be written in place. */
+    if (!unchanged && FLAC__metadata_chain_check_if_tempfile_needed (chain, true))
+    {
+        Flac_Reserve_Padding (chain);
+    }
  
     /* Write tag. */
-    if (FLAC__metadata_chain_check_if_tempfile_needed (chain, true))
+    if (unchanged)
+    {
+        /* Nothing to write. */
+    }
+    else if (FLAC__metadata_chain_check_if_tempfile_needed (chain, true))
     {
         EtFlacWriteState temp_state;
         GFile *temp_file;
         GFileIOStream *temp_iostream;
         GError *temp_error = NULL;
 
-        temp_file = g_file_new_tmp ("easytag-XXXXXX", &temp_iostream,
-                                    &temp_error);
+        /* Created next to the file, so that it can be renamed over it. */
+        temp_file = et_save_journal_new_temporary (file, &temp_iostream,
+                                                   &temp_error);
 
         if (temp_file == NULL)
         {
@@ -1125,6 +1364,7 @@ flac_tag_write_file_tag (const ET_File *ETFile,
 
         temp_state.file = temp_file;
         temp_state.error = NULL;
+        temp_state.backup = FALSE;
         temp_state.istream = G_FILE_INPUT_STREAM (g_io_stream_get_input_stream (G_IO_STREAM (temp_iostream)));
         temp_state.ostream = G_FILE_OUTPUT_STREAM (g_io_stream_get_output_stream (G_IO_STREAM (temp_iostream)));
         temp_state.seekable = G_SEEKABLE (temp_iostream);
@@ -1141,6 +1381,7 @@ flac_tag_write_file_tag (const ET_File *ETFile,
             flac_error_msg = FLAC__Metadata_ChainStatusString[status];
 
             FLAC__metadata_chain_delete (chain);
+            g_file_delete (temp_file, NULL, NULL);
             et_flac_write_close_func (&temp_state);
             et_flac_write_close_func (&state);
 
@@ -1150,11 +1391,14 @@ flac_tag_write_file_tag (const ET_File *ETFile,
             return FALSE;
         }
 
-        if (!g_file_move (temp_file, file, G_FILE_COPY_OVERWRITE, NULL, NULL,
-                          NULL, &state.error))
+        /* Close the temporary file before it replaces the file. */
+        g_object_ref (temp_file);
+        et_flac_write_close_func (&temp_state);
+
+        if (!et_save_journal_replace (temp_file, file, &state.error))
         {
+            g_object_unref (temp_file);
             FLAC__metadata_chain_delete (chain);
-            et_flac_write_close_func (&temp_state);
 
             g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
                          _("Failed to write comments to file ‘%s’: %s"),
@@ -1163,7 +1407,7 @@ flac_tag_write_file_tag (const ET_File *ETFile,
             return FALSE;
         }
 
-        et_flac_write_close_func (&temp_state);
+        g_object_unref (temp_file);
     }
     else
     {
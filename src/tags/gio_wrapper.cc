@@ -23,10 +23,677 @@
 
 #include "gio_wrapper.h"
 
+#include <errno.h>
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "save_journal.h"
+
+#ifdef G_OS_UNIX
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef HAVE_LINUX_FALLOC_H
+#include <linux/falloc.h>
+#endif
+#endif /* G_OS_UNIX */
+
+/* Size of the buffer used to move data within a file. Large enough to keep
+ * the number of system calls low on files of several GB. */
+#define ET_MOVE_BUFFER_SIZE (1024 * 1024)
+
+/* Largest range which is moved in chunks within a file, as it must be backed
+ * up in the save journal first. */
+#define ET_MOVE_MAX_BACKUP_SIZE (1024 * 1024)
+
+/* Size of a window of the read cache. Reads at least this large bypass the
+ * cache. */
+#define ET_READ_CACHE_WINDOW_SIZE (64 * 1024)
+
+#ifdef G_OS_UNIX
+
+/*
+ * Data movement within a file, used when a tag changes size. The data is
+ * moved in place through a separate file descriptor, instead of copying the
+ * whole file to a temporary one:
+ *  - when the size change is a multiple of the filesystem block size, the
+ *    filesystem is asked to insert or collapse the range with fallocate(),
+ *    which only updates the extent tree
+ *  - otherwise, if the data after the tag is short, it is moved in large
+ *    chunks, with copy_file_range() when the source and destination of a
+ *    chunk do not overlap, so that the data stays in the kernel, or through
+ *    a buffer with pread() and pwrite()
+ *  - otherwise the file is rewritten to a temporary file, which replaces it
+ *    once the tag is saved, see GIO_IOStream::rewrite()
+ *
+ * Each step is backed up in the save journal before it is made, so that an
+ * interrupted move can be undone: a shift by the filesystem is recorded as
+ * such, while the range which is moved in chunks is copied first. Nothing is
+ * backed up while a temporary file is written, as the temporary file is
+ * removed if the save is interrupted, and the data is moved in place within
+ * it whatever its length.
+ */
+
+static void
+et_move_set_error (GError **error, int errsv)
+{
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv), "%s",
+                 g_strerror (errsv));
+}
+
+/*
+ * et_move_open:
+ * @file: the file to open
+ *
+ * Open a separate descriptor on @file, to move data within it.
+ *
+ * Returns: a file descriptor, or -1 if @file is not a local file or cannot be
+ *          opened
+ */
+static int
+et_move_open (GFile *file)
+{
+    gchar *path = g_file_get_path (file);
+    int fd;
+
+    if (!path)
+    {
+        return -1;
+    }
+
+    fd = g_open (path, O_RDWR, 0);
+    g_free (path);
+
+    return fd;
+}
+
+static gboolean
+et_move_pread_all (int fd, void *buffer, gsize count, goffset offset,
+                   GError **error)
+{
+    gchar *p = (gchar *)buffer;
+
+    while (count > 0)
+    {
+        ssize_t r = pread (fd, p, count, offset);
+
+        if (r < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            et_move_set_error (error, errno);
+            return FALSE;
+        }
+        else if (r == 0)
+        {
+            g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED, "%s",
+                         "Unexpected end of file");
+            return FALSE;
+        }
+
+        p += r;
+        count -= r;
+        offset += r;
+    }
+
+    return TRUE;
+}
+
+static gboolean
+et_move_pwrite_all (int fd, const void *buffer, gsize count, goffset offset,
+                    GError **error)
+{
+    const gchar *p = (const gchar *)buffer;
+
+    while (count > 0)
+    {
+        ssize_t r = pwrite (fd, p, count, offset);
+
+        if (r < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            et_move_set_error (error, errno);
+            return FALSE;
+        }
+
+        p += r;
+        count -= r;
+        offset += r;
+    }
+
+    return TRUE;
+}
+
+#ifdef HAVE_COPY_FILE_RANGE
+/*
+ * et_move_copy_range:
+ *
+ * Copy @count bytes from @from to @to within the file, which must not
+ * overlap, without going through user space.
+ *
+ * Returns: %TRUE if the data was copied, %FALSE with @supported cleared if
+ *          the kernel or filesystem cannot do it, or with @error set otherwise
+ */
+static gboolean
+et_move_copy_range (int fd, goffset from, goffset to, gsize count,
+                    gboolean *supported, GError **error)
+{
+    loff_t in = from;
+    loff_t out = to;
+
+    while (count > 0)
+    {
+        ssize_t r = copy_file_range (fd, &in, fd, &out, count, 0);
+
+        if (r < 0)
+        {
+            switch (errno)
+            {
+                case EINTR:
+                    continue;
+                case EXDEV:
+                case EINVAL:
+                case ENOSYS:
+                case EOPNOTSUPP:
+                    *supported = FALSE;
+                    return FALSE;
+                default:
+                    et_move_set_error (error, errno);
+                    return FALSE;
+            }
+        }
+        else if (r == 0)
+        {
+            g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED, "%s",
+                         "Unexpected end of file");
+            return FALSE;
+        }
+
+        count -= r;
+    }
+
+    return TRUE;
+}
+#endif /* HAVE_COPY_FILE_RANGE */
+
+/*
+ * et_move_range:
+ * @fd: the file descriptor
+ * @from: the offset of the data to move
+ * @to: the offset to move the data to
+ * @length: the number of bytes to move
+ * @error: a #GError to provide information on errors, or %NULL to ignore
+ *
+ * Move @length bytes of data from @from to @to within the file. The source
+ * and destination may overlap: data moved towards the end of the file is
+ * moved starting from its end, so that nothing is overwritten before being
+ * moved.
+ *
+ * Returns: %TRUE on success, %FALSE otherwise
+ */
+static gboolean
+et_move_range (int fd, goffset from, goffset to, goffset length,
+               GError **error)
+{
+    const goffset distance = ABS (to - from);
+    gchar *buffer = NULL;
+#ifdef HAVE_COPY_FILE_RANGE
+    gboolean use_copy_range = TRUE;
+#endif
+
+    while (length > 0)
+    {
+        const gsize count = MIN (length, ET_MOVE_BUFFER_SIZE);
+        goffset src;
+        goffset dst;
+
+        if (to > from)
+        {
+            src = from + length - count;
+            dst = to + length - count;
+        }
+        else
+        {
+            src = from;
+            dst = to;
+        }
+
+#ifdef HAVE_COPY_FILE_RANGE
+        if (use_copy_range && distance >= (goffset)count)
+        {
+            if (et_move_copy_range (fd, src, dst, count, &use_copy_range,
+                                    error))
+            {
+                goto next;
+            }
+
+            /* Only fall back to the buffer if the kernel cannot copy. */
+            if (use_copy_range)
+            {
+                g_free (buffer);
+                return FALSE;
+            }
+        }
+#endif /* HAVE_COPY_FILE_RANGE */
+
+        if (!buffer)
+        {
+            buffer = (gchar *)g_malloc (MIN (length, ET_MOVE_BUFFER_SIZE));
+        }
+
+        if (!et_move_pread_all (fd, buffer, count, src, error)
+            || !et_move_pwrite_all (fd, buffer, count, dst, error))
+        {
+            g_free (buffer);
+            return FALSE;
+        }
+
+#ifdef HAVE_COPY_FILE_RANGE
+next:
+#endif
+        if (to < from)
+        {
+            from += count;
+            to += count;
+        }
+
+        length -= count;
+    }
+
+    g_free (buffer);
+    return TRUE;
+}
+
+/*
+ * et_move_insert:
+ * @file: (allow-none): the file, to back up the changes to, or %NULL for a
+ *        temporary file
+ * @fd: the file descriptor
+ * @data: the data to write
+ * @start: the offset to write @data at
+ * @replace: the number of bytes to replace at @start
+ * @error: a #GError to provide information on errors, or %NULL to ignore
+ *
+ * Replace @replace bytes at @start by @data, which is larger, moving the rest
+ * of the file towards its end.
+ *
+ * Returns: %TRUE on success, %FALSE otherwise, with @error unset if the file
+ *          was left unchanged as the rest of it is too long to be backed up
+ */
+static gboolean
+et_move_insert (GFile *file, int fd, TagLib::ByteVector const &data,
+                goffset start, goffset replace, GError **error)
+{
+    struct stat st;
+    const goffset grow = data.size () - replace;
+    const goffset tail = start + replace;
+    gboolean inserted = FALSE;
+
+    g_return_val_if_fail (grow > 0, FALSE);
+
+    if (fstat (fd, &st) != 0)
+    {
+        et_move_set_error (error, errno);
+        return FALSE;
+    }
+
+    if (tail > st.st_size)
+    {
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "%s",
+                     "Insertion beyond the end of file");
+        return FALSE;
+    }
+
+#if defined (HAVE_FALLOCATE) && defined (FALLOC_FL_INSERT_RANGE)
+    /* Insert a range of blocks at the block boundary before the tail, then
+     * restore the part of the block before start, which was moved with it. */
+    if (st.st_blksize > 0 && grow % st.st_blksize == 0)
+    {
+        const goffset offset = tail - tail % st.st_blksize;
+        gsize head = offset < start ? start - offset : 0;
+        gchar *buffer = NULL;
+
+        if (head > 0)
+        {
+            buffer = (gchar *)g_malloc (head);
+
+            if (!et_move_pread_all (fd, buffer, head, offset, error))
+            {
+                g_free (buffer);
+                return FALSE;
+            }
+        }
+
+        if (file && offset < st.st_size
+            && !et_save_journal_backup_shift (file, offset, grow, error))
+        {
+            g_free (buffer);
+            return FALSE;
+        }
+
+        /* The head is restored within the inserted range, which is removed
+         * again if the insertion is undone. */
+        if (offset < st.st_size
+            && fallocate (fd, FALLOC_FL_INSERT_RANGE, offset, grow) == 0)
+        {
+            inserted = TRUE;
+
+            if (head > 0
+                && !et_move_pwrite_all (fd, buffer, head, offset, error))
+            {
+                g_free (buffer);
+                return FALSE;
+            }
+        }
+
+        g_free (buffer);
+    }
+#endif /* HAVE_FALLOCATE && FALLOC_FL_INSERT_RANGE */
+
+    if (!inserted)
+    {
+        if (file && st.st_size - start > ET_MOVE_MAX_BACKUP_SIZE)
+        {
+            return FALSE;
+        }
+
+        if (file && !et_save_journal_backup (file, start, -1, error))
+        {
+            return FALSE;
+        }
+
+        /* Extend the file first, so that a full disk is detected before
+         * anything was moved. */
+#ifdef HAVE_FALLOCATE
+        if (fallocate (fd, 0, st.st_size, grow) != 0
+            && errno != EOPNOTSUPP && errno != ENOSYS)
+        {
+            et_move_set_error (error, errno);
+            return FALSE;
+        }
+#endif /* HAVE_FALLOCATE */
+
+        if (ftruncate (fd, st.st_size + grow) != 0)
+        {
+            et_move_set_error (error, errno);
+            return FALSE;
+        }
+
+        if (!et_move_range (fd, tail, tail + grow, st.st_size - tail, error))
+        {
+            return FALSE;
+        }
+    }
+
+    if (file && !et_save_journal_backup (file, start, data.size (), error))
+    {
+        return FALSE;
+    }
+
+    return et_move_pwrite_all (fd, data.data (), data.size (), start, error);
+}
+
+/*
+ * et_move_remove:
+ * @file: (allow-none): the file, to back up the changes to, or %NULL for a
+ *        temporary file
+ * @fd: the file descriptor
+ * @start: the offset of the data to remove
+ * @length: the number of bytes to remove, not reaching the end of the file
+ * @error: a #GError to provide information on errors, or %NULL to ignore
+ *
+ * Remove @length bytes at @start, moving the rest of the file towards its
+ * beginning.
+ *
+ * Returns: %TRUE on success, %FALSE otherwise, with @error unset if the file
+ *          was left unchanged as the rest of it is too long to be backed up
+ */
+static gboolean
+et_move_remove (GFile *file, int fd, goffset start, goffset length,
+                GError **error)
+{
+    struct stat st;
+
+    if (fstat (fd, &st) != 0)
+    {
+        et_move_set_error (error, errno);
+        return FALSE;
+    }
+
+    if (start + length >= st.st_size)
+    {
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "%s",
+                     "Removal up to the end of file");
+        return FALSE;
+    }
+
+#if defined (HAVE_FALLOCATE) && defined (FALLOC_FL_COLLAPSE_RANGE)
+    /* Collapse a range of blocks from the block boundary before start, then
+     * restore the part of the block before start, which was removed with
+     * it. */
+    if (st.st_blksize > 0 && length % st.st_blksize == 0)
+    {
+        const goffset offset = start - start % st.st_blksize;
+        const gsize head = start - offset;
+        gchar *buffer = NULL;
+
+        if (head > 0)
+        {
+            buffer = (gchar *)g_malloc (head);
+
+            if (!et_move_pread_all (fd, buffer, head, offset, error))
+            {
+                g_free (buffer);
+                return FALSE;
+            }
+        }
+
+        /* The collapsed range is inserted back before it is restored, if
+         * the removal is undone. */
+        if (file
+            && (!et_save_journal_backup (file, offset, length, error)
+                || !et_save_journal_backup_shift (file, offset, -length,
+                                                  error)))
+        {
+            g_free (buffer);
+            return FALSE;
+        }
+
+        if (fallocate (fd, FALLOC_FL_COLLAPSE_RANGE, offset, length) == 0)
+        {
+            gboolean success = head == 0
+                               || ((!file
+                                    || et_save_journal_backup (file, offset,
+                                                               head, error))
+                                   && et_move_pwrite_all (fd, buffer, head,
+                                                          offset, error));
+
+            g_free (buffer);
+            return success;
+        }
+
+        g_free (buffer);
+    }
+#endif /* HAVE_FALLOCATE && FALLOC_FL_COLLAPSE_RANGE */
+
+    if (file && st.st_size - start > ET_MOVE_MAX_BACKUP_SIZE)
+    {
+        return FALSE;
+    }
+
+    if (file && !et_save_journal_backup (file, start, -1, error))
+    {
+        return FALSE;
+    }
+
+    if (!et_move_range (fd, start + length, start,
+                        st.st_size - start - length, error))
+    {
+        return FALSE;
+    }
+
+    if (ftruncate (fd, st.st_size - length) != 0)
+    {
+        et_move_set_error (error, errno);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+#endif /* G_OS_UNIX */
+
+GIO_ReadCache::GIO_ReadCache () :
+    clock (0)
+{
+    for (guint i = 0; i < n_windows; i++)
+    {
+        windows[i].offset = -1;
+        windows[i].length = 0;
+        windows[i].used = 0;
+        windows[i].data = NULL;
+    }
+}
+
+GIO_ReadCache::~GIO_ReadCache ()
+{
+    for (guint i = 0; i < n_windows; i++)
+    {
+        g_free (windows[i].data);
+    }
+}
+
+/*
+ * Return the window starting at the aligned @offset, reading it from @stream
+ * into the least recently used window if it is not cached.
+ */
+GIO_ReadCache::Window *
+GIO_ReadCache::lookup (GInputStream *stream, goffset offset, GError **error)
+{
+    Window *window = NULL;
+    Window *lru = NULL;
+
+    for (guint i = 0; i < n_windows; i++)
+    {
+        if (windows[i].offset == offset)
+        {
+            window = &windows[i];
+            break;
+        }
+
+        if (!lru || windows[i].used < lru->used)
+        {
+            lru = &windows[i];
+        }
+    }
+
+    if (!window)
+    {
+        window = lru;
+        window->offset = -1;
+
+        if (!window->data)
+        {
+            window->data = (char *)g_malloc (ET_READ_CACHE_WINDOW_SIZE);
+        }
+
+        if (!g_seekable_seek (G_SEEKABLE (stream), offset, G_SEEK_SET, NULL,
+                              error)
+            || !g_input_stream_read_all (stream, window->data,
+                                         ET_READ_CACHE_WINDOW_SIZE,
+                                         &window->length, NULL, error))
+        {
+            window->length = 0;
+            return NULL;
+        }
+
+        window->offset = offset;
+    }
+
+    window->used = ++clock;
+
+    return window;
+}
+
+/*
+ * Read @count bytes at @offset of @stream into @buffer, from the cached
+ * windows where possible. The position of @stream is left undefined.
+ *
+ * Returns: the number of bytes read, which is less than @count at the end of
+ *          the stream or on error
+ */
+gsize
+GIO_ReadCache::read (GInputStream *stream, goffset offset, char *buffer,
+                     gsize count, GError **error)
+{
+    gsize bytes = 0;
+
+    if (count >= ET_READ_CACHE_WINDOW_SIZE)
+    {
+        /* Large blocks, such as pictures, are read directly. */
+        if (g_seekable_seek (G_SEEKABLE (stream), offset, G_SEEK_SET, NULL,
+                             error))
+        {
+            g_input_stream_read_all (stream, buffer, count, &bytes, NULL,
+                                     error);
+        }
+
+        return bytes;
+    }
+
+    while (bytes < count)
+    {
+        const goffset start = offset + bytes;
+        const goffset aligned = start - start % ET_READ_CACHE_WINDOW_SIZE;
+        const gsize skip = start - aligned;
+        Window *window = lookup (stream, aligned, error);
+        gsize n;
+
+        if (!window || window->length <= skip)
+        {
+            break;
+        }
+
+        n = MIN (count - bytes, window->length - skip);
+        memcpy (buffer + bytes, window->data + skip, n);
+        bytes += n;
+
+        /* A short window ends at the end of the stream. */
+        if (window->length < ET_READ_CACHE_WINDOW_SIZE)
+        {
+            break;
+        }
+    }
+
+    return bytes;
+}
+
+/*
+ * Drop the cached data, which must be done whenever the stream is modified.
+ */
+void
+GIO_ReadCache::invalidate ()
+{
+    for (guint i = 0; i < n_windows; i++)
+    {
+        windows[i].offset = -1;
+        windows[i].length = 0;
+    }
+}
+
 GIO_InputStream::GIO_InputStream (GFile * file_) :
     file ((GFile *)g_object_ref (gpointer (file_))),
     filename (g_file_get_uri (file)),
-    error (NULL)
+    error (NULL),
+    position (0),
+    size (-1)
 {
     stream = g_file_read (file, NULL, &error);
 }
@@ -55,9 +722,9 @@ GIO_InputStream::readBlock (TagLib::ulong len)
     }
 
     TagLib::ByteVector rv (len, 0);
-    gsize bytes;
-    g_input_stream_read_all (G_INPUT_STREAM (stream), (void *)rv.data (),
-                             len, &bytes, NULL, &error);
+    gsize bytes = cache.read (G_INPUT_STREAM (stream), position, rv.data (),
+                              len, &error);
+    position += bytes;
 
     return rv.resize (bytes);
 }
@@ -102,25 +769,37 @@ GIO_InputStream::seek (long int offset, TagLib::IOStream::Position p)
         return;
     }
 
-    GSeekType type;
+    goffset new_position;
 
     switch (p)
     {
         case TagLib::IOStream::Beginning:
-            type = G_SEEK_SET;
+            new_position = offset;
             break;
         case TagLib::IOStream::Current:
-            type = G_SEEK_CUR;
+            new_position = position + offset;
             break;
         case TagLib::IOStream::End:
-            type = G_SEEK_END;
+            if (length () < 0)
+            {
+                return;
+            }
+
+            new_position = size + offset;
             break;
         default:
             g_warning ("Unknown seek");
             return;
     }
 
-    g_seekable_seek (G_SEEKABLE (stream), offset, type, NULL, &error);
+    if (new_position < 0)
+    {
+        g_set_error (&error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "%s",
+                     g_strerror (EINVAL));
+        return;
+    }
+
+    position = new_position;
 }
 
 void
@@ -136,7 +815,7 @@ GIO_InputStream::clear ()
 long int
 GIO_InputStream::tell () const
 {
-    return g_seekable_tell (G_SEEKABLE (stream));
+    return position;
 }
 
 long int
@@ -147,17 +826,22 @@ GIO_InputStream::length ()
         return -1;
     }
 
-    long int rv = -1;
+    /* The file is only read, so its size is queried once. */
+    if (size >= 0)
+    {
+        return size;
+    }
+
     GFileInfo *info = g_file_input_stream_query_info (stream,
                                                       G_FILE_ATTRIBUTE_STANDARD_SIZE,
                                                       NULL, &error);
     if (info)
     {
-        rv = g_file_info_get_size (info);
+        size = g_file_info_get_size (info);
         g_object_unref (info);
     }
 
-    return rv;
+    return size;
 }
 
 void
@@ -168,6 +852,7 @@ GIO_InputStream::truncate (long int len)
 
 GIO_IOStream::GIO_IOStream (GFile *file_) :
     file ((GFile *)g_object_ref (gpointer (file_))),
+    temporary (NULL),
     filename (g_file_get_uri (file_)),
     error (NULL)
 {
@@ -189,6 +874,13 @@ GIO_IOStream::~GIO_IOStream ()
         g_object_unref (stream);
     }
 
+    /* The file was not saved. */
+    if (temporary)
+    {
+        g_file_delete (temporary, NULL, NULL);
+        g_object_unref (temporary);
+    }
+
     g_free (filename);
     g_object_unref (G_OBJECT (file));
 }
@@ -207,20 +899,27 @@ GIO_IOStream::readBlock (TagLib::ulong len)
         return TagLib::ByteVector::null;
     }
 
-    gsize bytes = 0;
     TagLib::ByteVector rv (len, 0);
     GInputStream *istream = g_io_stream_get_input_stream (G_IO_STREAM (stream));
-    g_input_stream_read_all (istream,
-                             (void *)rv.data (), len,
-                             &bytes,
-                             NULL, &error);
+    const goffset offset = g_seekable_tell (G_SEEKABLE (stream));
+    gsize bytes = cache.read (istream, offset, rv.data (), len, &error);
+
+    /* Leave the stream after the data, as a direct read would, as writes and
+     * data movement use the stream position. */
+    if (!error)
+    {
+        g_seekable_seek (G_SEEKABLE (stream), offset + bytes, G_SEEK_SET,
+                         NULL, &error);
+    }
 
-    return rv.resize(bytes);
+    return rv.resize (bytes);
 }
 
 void
 GIO_IOStream::writeBlock (TagLib::ByteVector const &data)
 {
+    cache.invalidate ();
+
     if (error)
     {
         return;
@@ -229,6 +928,12 @@ GIO_IOStream::writeBlock (TagLib::ByteVector const &data)
     gsize bytes_written;
     GOutputStream *ostream = g_io_stream_get_output_stream (G_IO_STREAM (stream));
 
+    if (!temporary
+        && !et_save_journal_backup (file, tell (), data.size (), &error))
+    {
+        return;
+    }
+
     if (!g_output_stream_write_all (ostream, data.data (), data.size (),
                                     &bytes_written, NULL, &error))
     {
@@ -242,6 +947,8 @@ GIO_IOStream::insert (TagLib::ByteVector const &data,
                       TagLib::ulong start,
                       TagLib::ulong replace)
 {
+    cache.invalidate ();
+
     if (error)
     {
         return;
@@ -261,125 +968,161 @@ GIO_IOStream::insert (TagLib::ByteVector const &data,
         return;
     }
 
-    GFileIOStream *tstr;
-    /* FIXME: Check for NULL. */
-    GFile *tmp = g_file_new_tmp ("easytag-XXXXXX", &tstr, NULL);
-    char buffer[4096];
-    gsize r;
+#ifdef G_OS_UNIX
+    /* Move the data in place for local files. */
+    int fd = et_move_open (temporary ? temporary : file);
 
-    GOutputStream *ostream = g_io_stream_get_output_stream (G_IO_STREAM (tstr));
-    GInputStream *istream = g_io_stream_get_input_stream (G_IO_STREAM (stream));
+    if (fd >= 0)
+    {
+        gboolean moved = et_move_insert (temporary ? NULL : file, fd, data,
+                                         start, replace, &error);
+
+        if (close (fd) != 0 && !error)
+        {
+            et_move_set_error (&error, errno);
+        }
+
+        if (moved || error)
+        {
+            seek (start + data.size ());
+            return;
+        }
+    }
+#endif /* G_OS_UNIX */
 
-    seek (0);
+    rewrite (data, start, replace);
+}
+
+void
+GIO_IOStream::removeBlock (TagLib::ulong start, TagLib::ulong len)
+{
+    cache.invalidate ();
+
+    if (start + len >= (TagLib::ulong)length ())
+    {
+        truncate (start);
+        return;
+    }
+
+#ifdef G_OS_UNIX
+    /* Move the data in place for local files. */
+    int fd = et_move_open (temporary ? temporary : file);
 
-    while (g_input_stream_read_all (istream, buffer,
-                                    MIN (G_N_ELEMENTS (buffer), start),
-                                    &r, NULL, &error) && r > 0)
+    if (fd >= 0)
     {
-        gsize w;
-        g_output_stream_write_all (ostream, buffer, r, &w, NULL, &error);
+        gboolean moved = et_move_remove (temporary ? NULL : file, fd, start,
+                                         len, &error);
 
-        if (w != r)
+        if (close (fd) != 0 && !error)
         {
-            g_warning ("%s", "Unable to write all bytes");
+            et_move_set_error (&error, errno);
         }
 
-	if (error)
-	{
-            g_object_unref (tstr);
-            g_object_unref (tmp);
+        if (moved || error)
+        {
+            seek (start);
             return;
-	}
-
-        start -= r;
+        }
     }
+#endif /* G_OS_UNIX */
 
+    rewrite (TagLib::ByteVector::null, start, len);
+}
+
+/*
+ * Replace @replace bytes at @start by @data, by writing the file with the
+ * change to a temporary file, which replaces the file in commit(). The rest
+ * of the file is copied within the kernel where possible, and the file is
+ * left untouched until it is replaced, so that nothing is backed up in the
+ * save journal. The stream is left after @data, on the temporary file.
+ */
+void
+GIO_IOStream::rewrite (TagLib::ByteVector const &data,
+                       goffset start,
+                       goffset replace)
+{
     if (error)
     {
-        g_object_unref (tstr);
-        g_object_unref (tmp);
         return;
     }
 
-    g_output_stream_write_all (ostream, data.data (), data.size (), NULL,
-                               NULL, &error);
-    seek (replace, TagLib::IOStream::Current);
+    GFile *source = temporary ? temporary : file;
+    GFileIOStream *tstr;
+    GFile *tmp = et_save_journal_new_temporary (file, &tstr, &error);
 
-    if (error)
+    if (!tmp)
     {
-        g_object_unref (tstr);
-        g_object_unref (tmp);
         return;
     }
 
-    while (g_input_stream_read_all (istream, buffer, sizeof (buffer), &r,
-                                    NULL, &error) && r > 0)
-    {
-        gsize bytes_written;
+    GOutputStream *ostream = g_io_stream_get_output_stream (G_IO_STREAM (tstr));
 
-        if (!g_output_stream_write_all (ostream, buffer, r, &bytes_written,
-                                        NULL, &error))
-        {
-            g_debug ("Only %" G_GSIZE_FORMAT " bytes out of %" G_GSIZE_FORMAT
-                     " bytes of data were written", bytes_written, r);
-            g_object_unref (tstr);
-            g_object_unref (tmp);
-            return;
-        }
+    if (!et_save_journal_copy_range (source, 0, start, tmp, tstr, &error)
+        || !g_output_stream_write_all (ostream, data.data (), data.size (),
+                                       NULL, NULL, &error)
+        || !et_save_journal_copy_range (source, start + replace, -1, tmp,
+                                        tstr, &error)
+        || !g_seekable_seek (G_SEEKABLE (tstr), start + data.size (),
+                             G_SEEK_SET, NULL, &error))
+    {
+        g_object_unref (tstr);
+        g_file_delete (tmp, NULL, NULL);
+        g_object_unref (tmp);
+        return;
     }
 
-    g_object_unref (tstr);
     g_object_unref (stream);
-    stream = NULL;
-
-    g_file_move (tmp, file, G_FILE_COPY_OVERWRITE, NULL, NULL, NULL, &error);
+    stream = tstr;
 
-    if (error)
+    if (temporary)
     {
-            g_object_unref (tmp);
-	    return;
+        g_file_delete (temporary, NULL, NULL);
+        g_object_unref (temporary);
     }
 
-    stream = g_file_open_readwrite (file, NULL, &error);
-
-    g_object_unref (tmp);
+    temporary = tmp;
 }
 
-void
-GIO_IOStream::removeBlock (TagLib::ulong start, TagLib::ulong len)
+/*
+ * Replace the file by the temporary file, if the file was rewritten, which
+ * must be done once TagLib saved the file.
+ *
+ * Returns: %TRUE on success, %FALSE otherwise
+ */
+bool
+GIO_IOStream::commit ()
 {
-    if (start + len >= (TagLib::ulong)length ())
+    if (error)
     {
-        truncate (start);
-        return;
+        return false;
     }
 
-    char *buffer[4096];
-    gsize r;
-    GInputStream *istream = g_io_stream_get_input_stream (G_IO_STREAM (stream));
-    GOutputStream *ostream = g_io_stream_get_output_stream (G_IO_STREAM (stream));
-    seek (start + len);
+    if (!temporary)
+    {
+        return true;
+    }
 
-    while (g_input_stream_read_all (istream, buffer, sizeof (buffer), &r, NULL,
-                                    NULL) && r > 0)
+    if (!g_io_stream_close (G_IO_STREAM (stream), NULL, &error))
     {
-        gsize bytes_written;
+        return false;
+    }
 
-        seek (start);
+    g_clear_object (&stream);
 
-        if (!g_output_stream_write_all (ostream, buffer, r, &bytes_written,
-                                        NULL, &error))
-        {
-            g_debug ("Only %" G_GSIZE_FORMAT " bytes out of %" G_GSIZE_FORMAT
-                     " bytes of data were written", bytes_written, r);
-            return;
-        }
+    gboolean replaced = et_save_journal_replace (temporary, file, &error);
+
+    /* The temporary file is deleted on error. */
+    g_object_unref (temporary);
+    temporary = NULL;
 
-        start += r;
-        seek (start + len);
+    if (!replaced)
+    {
+        return false;
     }
 
-    truncate (start);
+    stream = g_file_open_readwrite (file, NULL, &error);
+
+    return !error;
 }
 
 bool
@@ -461,11 +1204,20 @@ GIO_IOStream::length ()
 void
 GIO_IOStream::truncate (long int len)
 {
+    cache.invalidate ();
+
     if (error)
     {
         return;
     }
 
+    /* Only the removed bytes are backed up, which TagLib only truncates
+     * when removing atoms from the end of the file. */
+    if (!temporary && !et_save_journal_backup (file, len, -1, &error))
+    {
+        return;
+    }
+
     g_seekable_truncate (G_SEEKABLE (stream), len, NULL, &error);
 }
 
@@ -27,6 +27,40 @@
 #include <tiostream.h>
 #include <gio/gio.h>
 
+/*
+ * GIO_ReadCache:
+ *
+ * Read-ahead cache of aligned windows of a seekable input stream, so that the
+ * many small reads and seeks which TagLib makes while walking the atoms of a
+ * file are served from memory. The least recently used window is replaced.
+ */
+class GIO_ReadCache
+{
+public:
+    GIO_ReadCache ();
+    ~GIO_ReadCache ();
+    gsize read (GInputStream *stream, goffset offset, char *buffer, gsize count, GError **error);
+    void invalidate ();
+
+private:
+    GIO_ReadCache (const GIO_ReadCache &other);
+
+    struct Window
+    {
+        goffset offset;
+        gsize length;
+        guint64 used;
+        char *data;
+    };
+
+    static const guint n_windows = 4;
+
+    Window *lookup (GInputStream *stream, goffset offset, GError **error);
+
+    Window windows[n_windows];
+    guint64 clock;
+};
+
 class GIO_InputStream : public TagLib::IOStream
 {
 public:
@@ -53,8 +87,20 @@ private:
     GFileInputStream *stream;
     char *filename;
     GError *error;
+    /* The stream is only read through the cache, so the position is kept
+     * here rather than in the stream. */
+    GIO_ReadCache cache;
+    goffset position;
+    goffset size;
 };
 
+/*
+ * GIO_IOStream:
+ *
+ * Read-write stream on a file. When the data after a tag which changes size
+ * is too long to be moved in place, the file is rewritten to a temporary
+ * file, so commit() must be called once TagLib saved the file.
+ */
 class GIO_IOStream : public TagLib::IOStream
 {
 public:
@@ -75,12 +121,19 @@ public:
 
     virtual const GError *getError() const;
 
+    bool commit ();
+
 private:
     GIO_IOStream (const GIO_IOStream &other);
+    void rewrite (TagLib::ByteVector const &data, goffset start, goffset replace);
     GFile *file;
+    /* The copy of the file which is written instead of it, once it was
+     * rewritten, or NULL. */
+    GFile *temporary;
     GFileIOStream *stream;
     char *filename;
     GError *error;
+    GIO_ReadCache cache;
 };
 
 #endif /* ENABLE_MP4 */
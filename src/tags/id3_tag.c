@@ -32,6 +32,7 @@
 #include "misc.h"
 #include "et_core.h"
 #include "charset.h"
+#include "save_journal.h"
 
 #ifdef ENABLE_MP3
 
@@ -44,6 +45,8 @@
  * Declarations *
  ****************/
 #define ID3V2_MAX_STRING_LEN 4096
+#define ID3V1_TAG_SIZE 128
+#define ID3V2_HEADER_SIZE 10
 #define MULTIFIELD_SEPARATOR " - "
 
 
@@ -69,8 +72,17 @@ ID3_C_EXPORT size_t ID3Field_GetUNICODE_1 (const ID3Field *field, unicode_t *buf
 
 static gboolean et_id3tag_check_if_file_is_corrupted (GFile *file,
                                                       GError **error);
+static gboolean et_id3tag_backup (GFile *file, gboolean strip_id3v2,
+                                  GError **error);
+static gboolean et_id3tag_strip_id3v2 (GFile *file, GError **error);
 
 static gboolean id3tag_check_if_id3lib_is_buggy (GError **error);
+static gboolean id3tag_show_buggy_id3lib_dialog (gpointer user_data);
+
+/* Set once id3tag_check_if_id3lib_is_buggy() has run. */
+static gsize id3lib_bug_checked = 0;
+/* TRUE while id3lib is assumed buggy and the user was not warned yet. */
+static gint id3lib_bugged = TRUE;
 
 
 
@@ -145,11 +157,12 @@ id3tag_write_file_v23tag (const ET_File *ETFile,
     GFile *file;
     ID3Tag   *id3_tag = NULL;
     ID3_Err   error_strip_id3v1  = ID3E_NoError;
-    ID3_Err   error_strip_id3v2  = ID3E_NoError;
     ID3_Err   error_update_id3v1 = ID3E_NoError;
     ID3_Err   error_update_id3v2 = ID3E_NoError;
+    GError *tmp_error = NULL;
     gboolean success = TRUE;
     gint number_of_frames;
+    gboolean strip_id3v2;
     gboolean has_title       = FALSE;
     gboolean has_artist      = FALSE;
     gboolean has_album_artist= FALSE;
@@ -166,8 +179,6 @@ id3tag_write_file_v23tag (const ET_File *ETFile,
     gboolean has_encoded_by  = FALSE;
     gboolean has_picture     = FALSE;
     //gboolean has_song_len    = FALSE;
-    static gboolean flag_first_check = TRUE;
-    static gboolean flag_id3lib_bugged = TRUE;
 
     ID3Frame *id3_frame;
     ID3Field *id3_field;
@@ -180,12 +191,7 @@ id3tag_write_file_v23tag (const ET_File *ETFile,
 
     // When writing the first MP3 file, we check if the version of id3lib of the
     // system doesn't contain a bug when writting Unicode tags
-    if (flag_first_check
-        && g_settings_get_boolean (MainSettings, "id3v2-enable-unicode"))
-    {
-        flag_first_check = FALSE;
-        flag_id3lib_bugged = id3tag_check_if_id3lib_is_buggy (NULL);
-    }
+    et_id3tag_check_id3lib ();
 
     FileTag  = (File_Tag *)ETFile->FileTag->data;
     filename      = ((File_Name *)ETFile->FileNameCur->data)->value;
@@ -193,28 +199,24 @@ id3tag_write_file_v23tag (const ET_File *ETFile,
 
     file = g_file_new_for_path (filename);
 
-    /* FIXME: Handle this in the caller instead. */
     /* This is a protection against a bug in id3lib that enters an infinite
-     * loop with corrupted MP3 files (files containing only zeroes) */
+     * loop with corrupted MP3 files (files containing only zeroes). The
+     * caller reports the error, as this may run in a worker thread. */
     if (et_id3tag_check_if_file_is_corrupted (file, error))
     {
-        GtkWidget *msgdialog;
         gchar *basename;
         gchar *utf8_basename;
 
         basename = g_file_get_basename (file);
         utf8_basename = filename_to_display (basename);
 
-        msgdialog = gtk_message_dialog_new (GTK_WINDOW (MainWindow),
-                                            GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
-                                            GTK_MESSAGE_ERROR,
-                                            GTK_BUTTONS_CLOSE,
-                                            _("As the following corrupted file ‘%s’ will cause an error in id3lib, it will not be processed"),
-                                            utf8_basename);
-        gtk_window_set_title (GTK_WINDOW (msgdialog), _("Corrupted file"));
+        if (error == NULL || *error == NULL)
+        {
+            g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                         _("As the following corrupted file ‘%s’ will cause an error in id3lib, it will not be processed"),
+                         utf8_basename);
+        }
 
-        gtk_dialog_run (GTK_DIALOG (msgdialog));
-        gtk_widget_destroy (msgdialog);
         g_free (basename);
         g_free (utf8_basename);
         g_object_unref (file);
@@ -595,10 +597,21 @@ id3tag_write_file_v23tag (const ET_File *ETFile,
     && !has_genre      && !has_composer && !has_orig_artist && !has_copyright && !has_url
     && !has_encoded_by && !has_picture  && !has_comment     && !has_disc_number)//&& !has_song_len )
     {
+        if (!et_id3tag_backup (file, TRUE, error))
+        {
+            ID3Tag_Delete (id3_tag);
+            g_object_unref (file);
+            g_free (basename_utf8);
+            return FALSE;
+        }
+
+        /* The ID3v2 tag is stripped last, as id3lib does not know about
+         * it. */
         error_strip_id3v1 = ID3Tag_Strip(id3_tag,ID3TT_ID3V1);
-        error_strip_id3v2 = ID3Tag_Strip(id3_tag,ID3TT_ID3V2);
+        et_id3tag_strip_id3v2 (file, &tmp_error);
+
         /* Check error messages */
-        if (error_strip_id3v1 == ID3E_NoError && error_strip_id3v2 == ID3E_NoError)
+        if (error_strip_id3v1 == ID3E_NoError && tmp_error == NULL)
         {
             g_debug (_("Removed tag of ‘%s’"), basename_utf8);
         }
@@ -612,13 +625,13 @@ id3tag_write_file_v23tag (const ET_File *ETFile,
                              Id3tag_Get_Error_Message (error_strip_id3v1));
             }
 
-            if (error_strip_id3v2 != ID3E_NoError)
+            if (tmp_error != NULL)
             {
                 g_clear_error (error);
                 g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
                              _("Error while removing ID3v2 tag of ‘%s’: %s"),
-                             basename_utf8,
-                             Id3tag_Get_Error_Message (error_strip_id3v2));
+                             basename_utf8, tmp_error->message);
+                g_error_free (tmp_error);
             }
 
             success = FALSE;
@@ -627,6 +640,17 @@ id3tag_write_file_v23tag (const ET_File *ETFile,
     }
     else
     {
+        strip_id3v2 = !g_settings_get_boolean (MainSettings, "id3v2-enabled")
+                      || number_of_frames == 0;
+
+        if (!et_id3tag_backup (file, strip_id3v2, error))
+        {
+            ID3Tag_Delete (id3_tag);
+            g_object_unref (file);
+            g_free (basename_utf8);
+            return FALSE;
+        }
+
         /* It's better to remove the id3v1 tag before, to synchronize it with the
          * id3v2 tag (else id3lib doesn't do it correctly)
          */
@@ -635,8 +659,7 @@ id3tag_write_file_v23tag (const ET_File *ETFile,
         /*
          * ID3v2 tag
          */
-        if (g_settings_get_boolean (MainSettings, "id3v2-enabled")
-            && number_of_frames != 0)
+        if (!strip_id3v2)
         {
             error_update_id3v2 = ID3Tag_UpdateByTagType(id3_tag,ID3TT_ID3V2);
             if (error_update_id3v2 != ID3E_NoError)
@@ -657,36 +680,22 @@ id3tag_write_file_v23tag (const ET_File *ETFile,
                  * If the patch to id3lib was applied to fix the problem (tested
                  * by id3tag_check_if_id3lib_is_buggy) we didn't make the following
                  * test => OK */
-                if (flag_id3lib_bugged
+                if (g_atomic_int_get (&id3lib_bugged)
                     && g_settings_get_boolean (MainSettings,
                                                "id3v2-enable-unicode"))
                 {
                     File_Tag  *FileTag_tmp = et_file_tag_new ();
 
-                    if (id3tag_read_file_tag (file, FileTag_tmp, NULL) == TRUE
+                    if (id3tag_read_file_tag (file, FileTag_tmp, NULL, NULL) == TRUE
                         && et_file_tag_detect_difference (FileTag,
-                                                          FileTag_tmp) == TRUE)
+                                                          FileTag_tmp) == TRUE
+                        // To display the message only one time
+                        && g_atomic_int_compare_and_exchange (&id3lib_bugged,
+                                                              TRUE, FALSE))
                     {
-                        GtkWidget *msgdialog;
-
-                        msgdialog = gtk_message_dialog_new(GTK_WINDOW(MainWindow),
-                                                           GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
-                                                           GTK_MESSAGE_ERROR,
-                                                           GTK_BUTTONS_CLOSE,
-                                                           "%s",
-                                                           _("You have tried to save this tag to Unicode but it was detected that your version of id3lib is buggy"));
-                        gtk_message_dialog_format_secondary_text(GTK_MESSAGE_DIALOG(msgdialog),
-                                                                 _("If you reload this file, some characters in the tag may not be displayed "
-                                                                 "correctly. Please, apply the patch "
-                                                                 "src/id3lib/patch_id3lib_3.8.3_UTF16_writing_bug.diff to id3lib, which is "
-                                                                 "available in the EasyTAG package sources.\nNote that this message will "
-                                                                 "appear only once.\n\nFile: %s"),
-                                                                  filename_utf8);
-
-                        gtk_window_set_title(GTK_WINDOW(msgdialog),_("Buggy id3lib"));
-                        gtk_dialog_run(GTK_DIALOG(msgdialog));
-                        gtk_widget_destroy(msgdialog);
-                        flag_id3lib_bugged = FALSE; // To display the message only one time
+                        /* The dialog must be shown from the main thread. */
+                        g_idle_add (id3tag_show_buggy_id3lib_dialog,
+                                    g_strdup (filename_utf8));
                     }
 
                     et_file_tag_free (FileTag_tmp);
@@ -694,18 +703,6 @@ id3tag_write_file_v23tag (const ET_File *ETFile,
 
             }
         }
-        else
-        {
-            error_strip_id3v2 = ID3Tag_Strip(id3_tag,ID3TT_ID3V2);
-            if (error_strip_id3v2 != ID3E_NoError)
-            {
-                g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
-                             _("Error while removing ID3v2 tag of ‘%s’: %s"),
-                             basename_utf8,
-                             Id3tag_Get_Error_Message (error_strip_id3v2));
-                success = FALSE;
-            }
-        }
 
         /*
          * ID3v1 tag
@@ -743,6 +740,18 @@ id3tag_write_file_v23tag (const ET_File *ETFile,
                 success = FALSE;
             }
         }
+
+        /* The ID3v2 tag is stripped last, as id3lib does not know about
+         * it. */
+        if (strip_id3v2 && !et_id3tag_strip_id3v2 (file, &tmp_error))
+        {
+            g_clear_error (error);
+            g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                         _("Error while removing ID3v2 tag of ‘%s’: %s"),
+                         basename_utf8, tmp_error->message);
+            g_error_free (tmp_error);
+            success = FALSE;
+        }
     }
 
     /* Free allocated data */
@@ -1432,6 +1441,164 @@ et_id3tag_check_if_file_is_corrupted (GFile *file, GError **error)
     return result;
 }
 
+/*
+ * et_id3tag_get_id3v2_size:
+ * @file: the file to query
+ * @id3v2_size: return location for the size of the ID3v2 tag at the
+ *              beginning of @file, or 0 if there is none
+ * @size: return location for the size of @file
+ * @error: a #GError to provide information on errors, or %NULL to ignore
+ *
+ * Returns: %TRUE on success, %FALSE otherwise
+ */
+static gboolean
+et_id3tag_get_id3v2_size (GFile *file,
+                          goffset *id3v2_size,
+                          goffset *size,
+                          GError **error)
+{
+    GFileInputStream *file_istream;
+    GFileInfo *info;
+    guchar header[ID3V2_HEADER_SIZE];
+    gsize bytes_read;
+
+    file_istream = g_file_read (file, NULL, error);
+
+    if (!file_istream)
+    {
+        return FALSE;
+    }
+
+    if (!g_input_stream_read_all (G_INPUT_STREAM (file_istream), header,
+                                  sizeof (header), &bytes_read, NULL, error))
+    {
+        g_object_unref (file_istream);
+        return FALSE;
+    }
+
+    info = g_file_input_stream_query_info (file_istream,
+                                           G_FILE_ATTRIBUTE_STANDARD_SIZE,
+                                           NULL, error);
+    g_object_unref (file_istream);
+
+    if (!info)
+    {
+        return FALSE;
+    }
+
+    *size = g_file_info_get_size (info);
+    *id3v2_size = 0;
+    g_object_unref (info);
+
+    /* The size of the tag is a synchsafe integer, which excludes the header
+     * and the footer. */
+    if (bytes_read == sizeof (header) && memcmp (header, "ID3", 3) == 0)
+    {
+        *id3v2_size = ID3V2_HEADER_SIZE + ((header[6] & 0x7f) << 21
+                                           | (header[7] & 0x7f) << 14
+                                           | (header[8] & 0x7f) << 7
+                                           | (header[9] & 0x7f));
+
+        if (header[5] & 0x10)
+        {
+            *id3v2_size += ID3V2_HEADER_SIZE;
+        }
+
+        *id3v2_size = MIN (*id3v2_size, *size);
+    }
+
+    return TRUE;
+}
+
+/*
+ * et_id3tag_backup:
+ * @file: the file whose tags are about to be written by id3lib
+ * @strip_id3v2: whether the ID3v2 tag is about to be stripped
+ * @error: a #GError to provide information on errors, or %NULL to ignore
+ *
+ * Back up the ranges of @file which id3lib changes in place: the ID3v2 tag
+ * at the beginning of the file, unless it is about to be stripped with
+ * et_id3tag_strip_id3v2(), and the ID3v1 tag at its end. An ID3v2 tag which
+ * does not fit anymore is written to a new file by id3lib, which replaces
+ * @file.
+ *
+ * Returns: %TRUE on success, %FALSE otherwise
+ */
+static gboolean
+et_id3tag_backup (GFile *file, gboolean strip_id3v2, GError **error)
+{
+    goffset id3v2_size;
+    goffset size;
+
+    if (!et_id3tag_get_id3v2_size (file, &id3v2_size, &size, error))
+    {
+        return FALSE;
+    }
+
+    return (strip_id3v2 || et_save_journal_backup (file, 0, id3v2_size, error))
+           && et_save_journal_backup (file, MAX (size - ID3V1_TAG_SIZE, 0),
+                                      -1, error);
+}
+
+/*
+ * et_id3tag_strip_id3v2:
+ * @file: the file whose ID3v2 tag should be removed
+ * @error: a #GError to provide information on errors, or %NULL to ignore
+ *
+ * Remove the ID3v2 tag at the beginning of @file. id3lib moves the whole
+ * file in place to do so, which could only be undone if the whole file was
+ * backed up first. The rest of the file is copied to a temporary file
+ * instead, within the kernel where possible, which replaces @file. id3lib
+ * must not change @file afterwards, as it does not know about the change.
+ *
+ * Returns: %TRUE on success, %FALSE otherwise
+ */
+static gboolean
+et_id3tag_strip_id3v2 (GFile *file, GError **error)
+{
+    GFile *tmp_file;
+    GFileIOStream *tmp_iostream;
+    goffset id3v2_size;
+    goffset size;
+
+    if (!et_id3tag_get_id3v2_size (file, &id3v2_size, &size, error))
+    {
+        return FALSE;
+    }
+
+    if (id3v2_size == 0)
+    {
+        return TRUE;
+    }
+
+    tmp_file = et_save_journal_new_temporary (file, &tmp_iostream, error);
+
+    if (tmp_file == NULL)
+    {
+        return FALSE;
+    }
+
+    if (!et_save_journal_copy_range (file, id3v2_size, -1, tmp_file,
+                                     tmp_iostream, error)
+        || !g_io_stream_close (G_IO_STREAM (tmp_iostream), NULL, error))
+    {
+        g_object_unref (tmp_iostream);
+        g_file_delete (tmp_file, NULL, NULL);
+        g_object_unref (tmp_file);
+        return FALSE;
+    }
+
+    g_object_unref (tmp_iostream);
+
+    if (!et_save_journal_replace (tmp_file, file, error))
+    {
+        g_object_unref (tmp_file);
+        return FALSE;
+    }
+
+    g_object_unref (tmp_file);
+    return TRUE;
+}
 
 /*
  * Function to detect if id3lib isn't bugged when writting to Unicode
@@ -1541,7 +1708,70 @@ id3tag_check_if_id3lib_is_buggy (GError **error)
     return FALSE;
 }
 
+/*
+ * id3tag_show_buggy_id3lib_dialog:
+ * @user_data: the UTF-8 filename which exposed the bug, freed by the callback
+ *
+ * Warn the user that id3lib corrupted a Unicode tag. Called from an idle, as
+ * tags may be written from a worker thread.
+ *
+ * Returns: %G_SOURCE_REMOVE
+ */
+static gboolean
+id3tag_show_buggy_id3lib_dialog (gpointer user_data)
+{
+    gchar *filename_utf8 = user_data;
+    GtkWidget *msgdialog;
+
+    msgdialog = gtk_message_dialog_new(GTK_WINDOW(MainWindow),
+                                       GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+                                       GTK_MESSAGE_ERROR,
+                                       GTK_BUTTONS_CLOSE,
+                                       "%s",
+                                       _("You have tried to save this tag to Unicode but it was detected that your version of id3lib is buggy"));
+    gtk_message_dialog_format_secondary_text(GTK_MESSAGE_DIALOG(msgdialog),
+                                             _("If you reload this file, some characters in the tag may not be displayed "
+                                             "correctly. Please, apply the patch "
+                                             "src/id3lib/patch_id3lib_3.8.3_UTF16_writing_bug.diff to id3lib, which is "
+                                             "available in the EasyTAG package sources.\nNote that this message will "
+                                             "appear only once.\n\nFile: %s"),
+                                              filename_utf8);
+
+    gtk_window_set_title(GTK_WINDOW(msgdialog),_("Buggy id3lib"));
+    gtk_dialog_run(GTK_DIALOG(msgdialog));
+    gtk_widget_destroy(msgdialog);
+    g_free (filename_utf8);
+
+    return G_SOURCE_REMOVE;
+}
+
+#endif /* ENABLE_ID3LIB */
+
+
+/*
+ * et_id3tag_check_id3lib:
+ *
+ * Check once whether the id3lib of the system has the bug when writing
+ * Unicode tags. The check temporarily changes the settings, so it must run
+ * on the main thread before tags are written from worker threads.
+ */
+void
+et_id3tag_check_id3lib (void)
+{
+#ifdef ENABLE_ID3LIB
+    if (!g_settings_get_boolean (MainSettings, "id3v2-enable-unicode"))
+    {
+        return;
+    }
+
+    if (g_once_init_enter (&id3lib_bug_checked))
+    {
+        g_atomic_int_set (&id3lib_bugged,
+                          id3tag_check_if_id3lib_is_buggy (NULL));
+        g_once_init_leave (&id3lib_bug_checked, 1);
+    }
 #endif /* ENABLE_ID3LIB */
+}
 
 
 /*
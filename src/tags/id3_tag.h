@@ -27,9 +27,10 @@ G_BEGIN_DECLS
 
 #define ID3_INVALID_GENRE 255
 
-gboolean id3tag_read_file_tag (GFile *file, File_Tag *FileTag, GError **error);
+gboolean id3tag_read_file_tag (GFile *file, File_Tag *FileTag, goffset *audio_offset, GError **error);
 gboolean id3tag_write_file_v24tag (const ET_File *ETFile, GError **error);
 gboolean id3tag_write_file_tag (const ET_File *ETFile, GError **error);
+void et_id3tag_check_id3lib (void);
 
 const gchar * Id3tag_Genre_To_String (unsigned char genre_code);
 guchar Id3tag_String_To_Genre (const gchar *genre);
@@ -33,6 +33,7 @@
 #include "misc.h"
 #include "et_core.h"
 #include "charset.h"
+#include "save_journal.h"
 
 #include "win32/win32dep.h"
 
@@ -73,7 +74,10 @@ static struct id3_frame *Id3tag_find_and_create_frame    (struct id3_tag *tag, c
 static int    id3taglib_set_field       (struct id3_frame *frame, const gchar *str, enum id3_field_type type, int num, int clear, int id3v1);
 static int    etag_set_tags             (const gchar *str, const char *frame_name, enum id3_field_type field_type, struct id3_tag *v1tag, struct id3_tag *v2tag, gboolean *strip_tags);
 static gboolean etag_write_tags (const gchar *filename, struct id3_tag const *v1tag,
-                            struct id3_tag const *v2tag, gboolean strip_tags, GError **error);
+                            struct id3_tag *v2tag, gboolean strip_tags, GError **error);
+static id3_byte_t *etag_render_v2_tag (struct id3_tag *v2tag,
+                                       id3_length_t filev2size,
+                                       id3_length_t *v2size);
 
 /*************
  * Functions *
@@ -81,20 +85,26 @@ static gboolean etag_write_tags (const gchar *filename, struct id3_tag const *v1
 
 /*
  * Read id3v1.x / id3v2 tag and load data into the File_Tag structure.
+ * The ID3v2 tag at the start of the file and the ID3v1 tag at its end are
+ * each read and parsed only once. If @audio_offset is not NULL, it is set to
+ * the size of the ID3v2 tag, that is the offset of the first audio frame.
  * Returns TRUE on success, else FALSE.
  * If a tag entry exists (ex: title), we allocate memory, else value stays to NULL
  */
 gboolean
 id3tag_read_file_tag (GFile *gfile,
                       File_Tag *FileTag,
+                      goffset *audio_offset,
                       GError **error)
 {
     GInputStream *istream;
     gsize bytes_read;
     GSeekable *seekable;
-    gchar *filename;
-    struct id3_file *file;
+    id3_byte_t query[ID3_TAG_QUERYSIZE];
+    id3_byte_t v1buf[ID3V1_TAG_SIZE];
     struct id3_tag *tag;
+    struct id3_tag *v1tag = NULL;
+    struct id3_tag *v2tag = NULL;
     struct id3_frame *frame;
     union id3_field *field;
     gchar *string1, *string2;
@@ -106,6 +116,11 @@ id3tag_read_file_tag (GFile *gfile,
     g_return_val_if_fail (gfile != NULL && FileTag != NULL, FALSE);
     g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 
+    if (audio_offset)
+    {
+        *audio_offset = 0;
+    }
+
     istream = G_INPUT_STREAM (g_file_read (gfile, NULL, error));
 
     if (!istream)
@@ -113,97 +128,128 @@ id3tag_read_file_tag (GFile *gfile,
         return FALSE;
     }
 
-    string1 = g_malloc0 (ID3_TAG_QUERYSIZE);
-
     /* Check if the file has an ID3v2 tag or/and an ID3v1 tags.
      * 1) ID3v2 tag. */
-    if (!g_input_stream_read_all (istream, string1, ID3_TAG_QUERYSIZE,
+    if (!g_input_stream_read_all (istream, query, ID3_TAG_QUERYSIZE,
                                   &bytes_read, NULL, error))
     {
         g_object_unref (istream);
-        g_free (string1);
         return FALSE;
     }
     else if (bytes_read != ID3_TAG_QUERYSIZE)
     {
         g_object_unref (istream);
-        g_free (string1);
         g_set_error (error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT, "%s",
                      _("Error reading tags from file"));
         return FALSE;
     }
 
-    if ((tagsize = id3_tag_query((id3_byte_t const *)string1, ID3_TAG_QUERYSIZE)) <= ID3_TAG_QUERYSIZE)
-    {
-        /* ID3v2 tag not found! */
-        update = g_settings_get_boolean (MainSettings, "id3v2-enabled");
-    }else
+    if ((tagsize = id3_tag_query (query, ID3_TAG_QUERYSIZE)) > ID3_TAG_QUERYSIZE
+        && memcmp (query, "ID3", 3) == 0)
     {
+        id3_byte_t *v2buf;
+
+        /* Read the whole tag, to parse it once for both its version and its
+         * frames. */
+        v2buf = g_malloc (tagsize);
+        memcpy (v2buf, query, ID3_TAG_QUERYSIZE);
+
+        if (!g_input_stream_read_all (istream, &v2buf[ID3_TAG_QUERYSIZE],
+                                      tagsize - ID3_TAG_QUERYSIZE,
+                                      &bytes_read, NULL, error))
+        {
+            g_free (v2buf);
+            g_object_unref (istream);
+            return FALSE;
+        }
+        else if (bytes_read != (gsize)(tagsize - ID3_TAG_QUERYSIZE))
+        {
+            g_free (v2buf);
+            g_object_unref (istream);
+            g_set_error (error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT, "%s",
+                         _("Error reading tags from file"));
+            return FALSE;
+        }
+
+        v2tag = id3_tag_parse (v2buf, tagsize);
+        g_free (v2buf);
+
+        /* The audio starts right after the tag. */
+        if (audio_offset)
+        {
+            *audio_offset = tagsize;
+        }
+
         /* ID3v2 tag found */
         if (!g_settings_get_boolean (MainSettings, "id3v2-enabled"))
         {
             /* To delete the tag. */
             update = 1;
-        }else
+        }
+        else if (v2tag
+                 && g_settings_get_boolean (MainSettings, "id3v2-convert-old"))
         {
             /* Determine version if user want to upgrade old tags */
-            if (g_settings_get_boolean (MainSettings, "id3v2-convert-old")
-            && (string1 = g_realloc (string1, tagsize))
-                && g_input_stream_read_all (istream,
-                                            &string1[ID3_TAG_QUERYSIZE],
-                                            tagsize - ID3_TAG_QUERYSIZE,
-                                            &bytes_read, NULL, error)
-                && bytes_read == (gsize)(tagsize - ID3_TAG_QUERYSIZE)
-            && (tag = id3_tag_parse((id3_byte_t const *)string1, tagsize))
-               )
-            {
-                unsigned version = id3_tag_version(tag);
+            unsigned version = id3_tag_version (v2tag);
 #ifdef ENABLE_ID3LIB
-                /* Besides upgrade old tags we will downgrade id3v2.4 to id3v2.3 */
-                if (g_settings_get_boolean (MainSettings, "id3v2-version-4"))
-                {
-                    update = (ID3_TAG_VERSION_MAJOR(version) < 4);
-                }else
-                {
-                    update = ((ID3_TAG_VERSION_MAJOR(version) < 3)
-                            | (ID3_TAG_VERSION_MAJOR(version) == 4));
-                }
-#else
+            /* Besides upgrade old tags we will downgrade id3v2.4 to id3v2.3 */
+            if (g_settings_get_boolean (MainSettings, "id3v2-version-4"))
+            {
                 update = (ID3_TAG_VERSION_MAJOR(version) < 4);
-#endif
-                id3_tag_delete(tag);
+            }else
+            {
+                update = ((ID3_TAG_VERSION_MAJOR(version) < 3)
+                        | (ID3_TAG_VERSION_MAJOR(version) == 4));
             }
+#else
+            update = (ID3_TAG_VERSION_MAJOR(version) < 4);
+#endif
         }
     }
+    else
+    {
+        /* ID3v2 tag not found! */
+        update = g_settings_get_boolean (MainSettings, "id3v2-enabled");
+    }
 
     /* 2) ID3v1 tag. */
     seekable = G_SEEKABLE (istream);
 
     if (!g_seekable_can_seek (seekable))
     {
+        if (v2tag)
+        {
+            id3_tag_delete (v2tag);
+        }
+
         g_object_unref (istream);
-        g_free (string1);
         g_set_error (error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT, "%s",
                      _("Error reading tags from file"));
         return FALSE;
     }
 
     /* Go to the beginning of ID3v1 tag. */
-    if (g_seekable_seek (seekable, -ID3V1_TAG_SIZE, G_SEEK_END, NULL, error)
-    && (string1)
-        && g_input_stream_read_all (istream, string1, 3, &bytes_read, NULL,
+    if (g_seekable_seek (seekable, -ID3V1_TAG_SIZE, G_SEEK_END, NULL,
+                         NULL /* Ignore errors. */)
+        && g_input_stream_read_all (istream, v1buf, ID3V1_TAG_SIZE,
+                                    &bytes_read, NULL,
                                     NULL /* Ignore errors. */)
-        && bytes_read == 3
-    && (string1[0] == 'T')
-    && (string1[1] == 'A')
-    && (string1[2] == 'G')
-       )
+        && bytes_read == ID3V1_TAG_SIZE
+        && memcmp (v1buf, "TAG", 3) == 0)
     {
         /* ID3v1 tag found! */
         if (!g_settings_get_boolean (MainSettings, "id3v1-enabled"))
         {
             update = 1;
         }
+
+        /* As in libid3tag, the frames of the ID3v1 tag are only kept if
+         * there is no ID3v2 tag, or if the ID3v2 tag is an update. */
+        if (v2tag == NULL
+            || (v2tag->extendedflags & ID3_TAG_EXTENDEDFLAG_TAGISANUPDATE))
+        {
+            v1tag = id3_tag_parse (v1buf, ID3V1_TAG_SIZE);
+        }
     }else
     {
         /* ID3v1 tag not found! */
@@ -213,25 +259,29 @@ id3tag_read_file_tag (GFile *gfile,
         }
     }
 
-    g_free (string1);
     g_object_unref (istream);
 
-    filename = g_file_get_path (gfile);
-
-    if ((file = id3_file_open (filename, ID3_FILE_MODE_READONLY)) == NULL)
+    if (v1tag && v2tag)
     {
-        g_free (filename);
-        g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED, "%s",
-                     _("Error reading tags from file"));
-        return FALSE;
+        /* Add the frames of the update to the ID3v1 tag. */
+        for (i = 0; (frame = id3_tag_findframe (v2tag, NULL, i)); i++)
+        {
+            id3_tag_attachframe (v1tag, frame);
+        }
+
+        id3_tag_delete (v2tag);
+        v2tag = NULL;
     }
 
-    g_free (filename);
+    tag = v2tag ? v2tag : v1tag;
 
-    if ( ((tag = id3_file_tag(file)) == NULL)
-    ||   (tag->nframes == 0))
+    if (tag == NULL || tag->nframes == 0)
     {
-        id3_file_close(file);
+        if (tag)
+        {
+            id3_tag_delete (tag);
+        }
+
         g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED, "%s",
                      _("Error reading tags from file"));
         return FALSE;
@@ -576,7 +626,7 @@ id3tag_read_file_tag (GFile *gfile,
         FileTag->saved = FALSE;
 
     /* Free allocated data */
-    id3_file_close(file);
+    id3_tag_delete (tag);
 
     return TRUE;
 }
@@ -990,11 +1040,7 @@ id3tag_write_file_v24tag (const ET_File *ETFile,
 
         id3_file_close(file);
 
-        /* Set padding  XXX */
-        if ((v2tag->paddedsize < 1024)
-        || ((v2tag->paddedsize > 4096) && (tagsize < 1024))
-        )
-            v2tag->paddedsize = 1024;
+        /* The padding is set when writing, from the tag in the file. */
 
         /* Set options */
         id3_tag_options(v2tag, ID3_TAG_OPTION_UNSYNCHRONISATION
@@ -1546,10 +1592,121 @@ etag_set_tags (const gchar *str,
     return 0;
 }
 
+/*
+ * etag_render_v2_tag:
+ * @v2tag: the ID3v2 tag to render
+ * @filev2size: the size of the ID3v2 tag at the beginning of the file, or 0
+ * @v2size: (out): the size of the rendered tag
+ *
+ * Render @v2tag, padded to the size of the tag in the file if it fits in it,
+ * so that it can be written over the old tag without moving the audio data.
+ * If the tag must grow, the padding from the settings is reserved so that the
+ * following edits fit again.
+ *
+ * Returns: the rendered tag, to be freed with g_free(), or %NULL if the tag
+ *          is empty
+ */
+static id3_byte_t *
+etag_render_v2_tag (struct id3_tag *v2tag,
+                    id3_length_t filev2size,
+                    id3_length_t *v2size)
+{
+    id3_length_t needed;
+    id3_byte_t *v2buf;
+
+    /* Size of the tag without any padding. */
+    v2tag->paddedsize = 0;
+    needed = id3_tag_render (v2tag, NULL);
+
+    if (needed <= filev2size)
+    {
+        v2tag->paddedsize = filev2size;
+    }
+    else
+    {
+        v2tag->paddedsize = needed + g_settings_get_uint (MainSettings,
+                                                          "id3v2-padding");
+    }
+
+    *v2size = id3_tag_render (v2tag, NULL);
+
+    if (*v2size <= 10)
+    {
+        *v2size = 0;
+        return NULL;
+    }
+
+    v2buf = g_malloc0 (*v2size);
+
+    if ((*v2size = id3_tag_render (v2tag, v2buf)) == 0)
+    {
+        /* NOTREACHED */
+        g_free (v2buf);
+        return NULL;
+    }
+
+    return v2buf;
+}
+
+/*
+ * etag_region_equals:
+ * @seekable: the stream of the file
+ * @istream: the input stream of the file
+ * @offset: the start of the region of the file
+ * @size: the size of the region of the file
+ * @buf: the data to compare with, or %NULL if @size is 0
+ * @equal: (out): whether the region of the file holds exactly @buf
+ * @error: a #GError to provide information on errors, or %NULL to ignore
+ *
+ * Compare a region of the file with @buf, to avoid writing it again when it
+ * is unchanged.
+ *
+ * Returns: %TRUE if the region was read, %FALSE otherwise
+ */
+static gboolean
+etag_region_equals (GSeekable *seekable,
+                    GInputStream *istream,
+                    goffset offset,
+                    gsize size,
+                    const id3_byte_t *buf,
+                    gboolean *equal,
+                    GError **error)
+{
+    guchar *data;
+    gsize bytes_read;
+
+    *equal = FALSE;
+
+    if (size == 0)
+    {
+        *equal = TRUE;
+        return TRUE;
+    }
+
+    if (!g_seekable_seek (seekable, offset, G_SEEK_SET, NULL, error))
+    {
+        return FALSE;
+    }
+
+    data = g_malloc (size);
+
+    if (!g_input_stream_read_all (istream, data, size, &bytes_read, NULL,
+                                  error))
+    {
+        g_free (data);
+        return FALSE;
+    }
+
+    *equal = (bytes_read == size && memcmp (data, buf, size) == 0);
+    g_free (data);
+
+    return TRUE;
+}
+
 static gboolean
 etag_write_tags (const gchar *filename, 
                  struct id3_tag const *v1tag,
-                 struct id3_tag const *v2tag,
+                 struct id3_tag *v2tag,
                  gboolean strip_tags,
                  GError **error)
 {
@@ -1562,8 +1719,9 @@ etag_write_tags (const gchar *filename,
     GInputStream *istream;
     GOutputStream *ostream;
     long filev2size;
-    gsize ctxsize;
-    gchar *ctx = NULL;
+    goffset tail_offset;
+    goffset file_size;
+    gboolean unchanged;
     gboolean success = TRUE;
     gsize bytes_read;
     gsize bytes_written;
@@ -1589,34 +1747,12 @@ etag_write_tags (const gchar *filename,
                 }
             }
         }
-
-        /* Render v2 tag */
-        if (v2tag)
-        {
-            v2size = id3_tag_render (v2tag, NULL);
-
-            if (v2size > 10)
-            {
-                v2buf = g_malloc0 (v2size);
-
-                if ((v2size = id3_tag_render (v2tag, v2buf)) == 0)
-                {
-                    /* NOTREACHED */
-                    g_free (v2buf);
-                    v2buf = NULL;
-                }
-            }
-        }
     }
     
     if (v1buf == NULL)
     {
         v1size = 0;
     }
-    if (v2buf == NULL)
-    {
-        v2size = 0;
-    }
 
     file = g_file_new_for_path (filename);
     iostream = g_file_open_readwrite (file, NULL, error);
@@ -1719,6 +1855,74 @@ etag_write_tags (const gchar *filename,
         }
     }
 
+    /* The tags at the end of the file start here, up to the end of the
+     * file. */
+    tail_offset = g_seekable_tell (seekable);
+
+    if (!g_seekable_seek (seekable, 0, G_SEEK_END, NULL, error))
+    {
+        goto err;
+    }
+
+    file_size = g_seekable_tell (seekable);
+
+    /* Handle Id3v2 tag */
+    if (!g_seekable_seek (seekable, 0, G_SEEK_SET, NULL, error))
+    {
+        goto err;
+    }
+
+    if (!g_input_stream_read_all (istream, tmp, ID3_TAG_QUERYSIZE, &bytes_read,
+                                  NULL, error))
+    {
+        goto err;
+    }
+
+    filev2size = id3_tag_query ((id3_byte_t const *)tmp, ID3_TAG_QUERYSIZE);
+
+    /* Render the v2 tag, now that the space available for it in the file is
+     * known. */
+    if (!strip_tags && v2tag)
+    {
+        v2buf = etag_render_v2_tag (v2tag, MAX (filev2size, 0), &v2size);
+    }
+
+    /* Writing tags which are byte for byte the same as in the file would
+     * only change its modification time, for example when forcing the save
+     * of unchanged files. */
+    if (v2buf && filev2size == (long)v2size
+        && file_size - tail_offset == (goffset)v1size)
+    {
+        if (!etag_region_equals (seekable, istream, 0, v2size, v2buf,
+                                 &unchanged, error))
+        {
+            goto err;
+        }
+
+        if (unchanged
+            && !etag_region_equals (seekable, istream, tail_offset, v1size,
+                                    v1buf, &unchanged, error))
+        {
+            goto err;
+        }
+
+        if (unchanged)
+        {
+            success = TRUE;
+            goto err;
+        }
+    }
+
+    if (!g_seekable_seek (seekable, tail_offset, G_SEEK_SET, NULL, error))
+    {
+        goto err;
+    }
+
+    if (!et_save_journal_backup (file, tail_offset, -1, error))
+    {
+        goto err;
+    }
+
     ostream = g_io_stream_get_output_stream (G_IO_STREAM (iostream));
 
     /* Write id3v1 tag */
@@ -1745,20 +1949,6 @@ etag_write_tags (const gchar *filename,
         goto err;
     }
 
-    /* Handle Id3v2 tag */
-    if (!g_seekable_seek (seekable, 0, G_SEEK_SET, NULL, error))
-    {
-        goto err;
-    }
-
-    if (!g_input_stream_read_all (istream, tmp, ID3_TAG_QUERYSIZE, &bytes_read,
-                                  NULL, error))
-    {
-        goto err;
-    }
-
-    filev2size = id3_tag_query ((id3_byte_t const *)tmp, ID3_TAG_QUERYSIZE);
-
     /* No ID3v2 tag in the file, and no new tag. */
     if ((filev2size == 0) && (v2size == 0))
     {
@@ -1768,8 +1958,15 @@ etag_write_tags (const gchar *filename,
         goto err;
     }
 
+    /* The new tag fits in the space of the old one (including its padding),
+     * so only the beginning of the file is overwritten. */
     if (filev2size == (long)v2size)
     {
+        if (!et_save_journal_backup (file, 0, v2size, error))
+        {
+            goto err;
+        }
+
         if (!g_seekable_seek (seekable, 0, G_SEEK_SET, NULL, error))
         {
             goto err;
@@ -1783,62 +1980,51 @@ etag_write_tags (const gchar *filename,
     }
     else
     {
-        /* XXX */
-        /* Size of audio data (tags at the end were already removed) */
-        if (!g_seekable_seek (seekable, 0, G_SEEK_END, NULL, error))
-        {
-            goto err;
-        }
+        GFile *tmp_file;
+        GFileIOStream *tmp_iostream;
+        GOutputStream *tmp_ostream;
 
-        ctxsize = g_seekable_tell (seekable) - filev2size;
+        /* The audio data would have to be moved, and backed up first, so
+         * the file is written to a temporary file instead, which replaces it.
+         * The audio data is copied within the kernel where possible (tags at
+         * the end were already written). */
+        tmp_file = et_save_journal_new_temporary (file, &tmp_iostream, error);
 
-        ctx = g_malloc (ctxsize);
-
-        if (!g_seekable_seek (seekable, filev2size, G_SEEK_SET, NULL, error))
+        if (tmp_file == NULL)
         {
             goto err;
         }
 
-        if (!g_input_stream_read_all (istream, ctx, ctxsize, &bytes_read, NULL,
-                                      error))
-        {
-            goto err;
-        }
-        
-        /* Return to the beginning of the file. */
-        if (!g_seekable_seek (seekable, 0, G_SEEK_SET, NULL, error))
-        {
-            goto err;
-        }
+        tmp_ostream = g_io_stream_get_output_stream (G_IO_STREAM (tmp_iostream));
 
-        /* Write the ID3v2 tag. */
-        if (v2buf)
-        {
-            if (!g_output_stream_write_all (ostream, v2buf, v2size,
+        if ((v2buf
+             && !g_output_stream_write_all (tmp_ostream, v2buf, v2size,
                                             &bytes_written, NULL, error))
-            {
-                goto err;
-            }
-        }
-
-        /* Write audio data. */
-        if (!g_output_stream_write_all (ostream, ctx, ctxsize, &bytes_written,
-                                        NULL, error))
+            || !et_save_journal_copy_range (file, filev2size, -1, tmp_file,
+                                            tmp_iostream, error)
+            || !g_io_stream_close (G_IO_STREAM (tmp_iostream), NULL, error))
         {
+            g_object_unref (tmp_iostream);
+            g_file_delete (tmp_file, NULL, NULL);
+            g_object_unref (tmp_file);
             goto err;
         }
 
-        if (!g_seekable_truncate (seekable, g_seekable_tell (seekable), NULL,
-                                  error))
+        g_object_unref (tmp_iostream);
+        g_clear_object (&iostream);
+
+        if (!et_save_journal_replace (tmp_file, file, error))
         {
+            g_object_unref (tmp_file);
             goto err;
         }
+
+        g_object_unref (tmp_file);
     }
 
     success = TRUE;
 
 err:
-    g_free (ctx);
     g_object_unref (file);
     g_clear_object (&iostream);
     g_free (v1buf);
@@ -587,29 +587,20 @@ apetag_free (apetag *mem_cnt)
 }
 
 
-/**
-    \brief read id3v1 and add frames
-
-    read id3v1 and add frames to ape_mem. 
-    Using #apefrm_add_norepleace
-
-    \param mem_cnt     object #apetag
-    \param fp         file pointer
-    \return 0 - OK else check #atl_return
-*/
-int
-readtag_id3v1_fp (apetag *mem_cnt, FILE * fp)
+/* Add the frames of the ID3v1 tag at the end of the window on the file. */
+static int
+readtag_id3v1_tail (apetag *mem_cnt, const struct is_tag_tail *tail)
 {
     struct _id3v1Tag m;
+    const unsigned char *data;
     
-    if (!is_id3v1(fp))
-            return 0;  /* TODO:: 0 or no_id3v1*/
-    
-    fseek(fp, -128, SEEK_END);
-    if (sizeof (struct _id3v1Tag)!=fread(&m, 1, sizeof (struct _id3v1Tag), fp)){
-        PRINT_ERR( "ERROR->libapetag->readtag_id3v1_fp:fread\n");
+    data = is_tag_tail_get (tail, 128, sizeof (struct _id3v1Tag));
+    if (data == NULL) {
+        PRINT_ERR( "ERROR->libapetag->readtag_id3v1_tail:fread\n");
         return ATL_FREAD;
     }
+    /* Copied, as libapetag_maloc_cont_text() changes the text. */
+    memcpy (&m, data, sizeof (struct _id3v1Tag));
 
     libapetag_maloc_cont_text(mem_cnt, 0, 5, "Title", 30, m.title);
     libapetag_maloc_cont_text(mem_cnt, 0, 6, "Artist", 30, m.artist);
@@ -632,6 +623,34 @@ readtag_id3v1_fp (apetag *mem_cnt, FILE * fp)
     return 0;
 }
 
+/**
+    \brief read id3v1 and add frames
+
+    read id3v1 and add frames to ape_mem. 
+    Using #apefrm_add_norepleace
+
+    \param mem_cnt     object #apetag
+    \param fp         file pointer
+    \return 0 - OK else check #atl_return
+*/
+int
+readtag_id3v1_fp (apetag *mem_cnt, FILE * fp)
+{
+    struct is_tag_tail tail;
+    int ret = 0;
+    
+    if (is_tag_tail_open (&tail, fp) != 0) {
+        PRINT_ERR( "ERROR->libapetag->readtag_id3v1_fp:fread\n");
+        return ATL_FREAD;
+    }
+
+    if (is_id3v1_tail (&tail))
+        ret = readtag_id3v1_tail (mem_cnt, &tail);
+
+    is_tag_tail_close (&tail);
+    return ret;
+}
+
 /*
     PL: wczytuje odpowiednie fra(mk)gi do pamieci w razie koniecznosci przyciecia
     PL: dodaje "..." na koniec
@@ -681,88 +700,104 @@ make_id3v1_tag(apetag *mem_cnt, struct _id3v1Tag *m)
     PL: %filename% jest w tej chwili tylko dla id3v2 f..k
     PL: %ape_mem_cnt% moze byc nie zainicjalizowany ale wtedy musi byc = NULL
 */
-/**
-    \brief read file and add frames 
-
-    \param mem_cnt      object #apetag
-    \param filename    
-    \param fp        
-    \param flag        
-    \return 0 - OK else check #atl_return
+/*
+    read the tags from the window on the end of the file, which the APE tag
+    is parsed from in place if it fits, and add frames
+    :NON_USER:!!!
 */
-int
-apetag_read_fp(apetag *mem_cnt, FILE * fp, const char *filename, int flag)
+static int
+apetag_read_tail (apetag *mem_cnt, FILE * fp, const struct is_tag_tail *tail,
+                  const char *filename, int flag)
 {
     int id3v1 = 0;
     int apeTag2 = 0;
-    unsigned char *buff;
+    unsigned char *buff = NULL;
+    const unsigned char *data;
+    const unsigned char *footer;
     struct _apetag_footer ape_footer;
-    size_t savedFilePosition, buffLength;
+    size_t savedFilePosition;
+    unsigned long tagLength;
     
-    unsigned char *end;
+    const unsigned char *end;
     unsigned long tagCount;
-    unsigned char *p;
-    
-    savedFilePosition = ftell(fp);
-    
-    id3v1 = is_id3v1(fp);
+    const unsigned char *p;
     
     if (mem_cnt == NULL) {
         PRINT_ERR( ">apetaglib>READ_FP>FATAL>apetag_init()\n");
-        fseek(fp, savedFilePosition, SEEK_SET);
         return ATL_NOINIT;
     }
     
-    fseek(fp, id3v1 ? -128 - sizeof (ape_footer) : -sizeof (ape_footer), SEEK_END);
-    if (sizeof (ape_footer) != fread(&ape_footer, 1, sizeof (ape_footer), fp)){
+    id3v1 = is_id3v1_tail(tail);
+    
+    footer = is_tag_tail_get(tail, id3v1 ? 128 + sizeof (ape_footer)
+                                         : sizeof (ape_footer),
+                             sizeof (ape_footer));
+    if (footer == NULL) {
         PRINT_ERR( "ERROR->libapetag->apetag_read_fp:fread1\n");
-        fseek(fp, savedFilePosition, SEEK_SET);
         return ATL_FREAD;
     }
+    memcpy(&ape_footer, footer, sizeof (ape_footer));
+    tagLength = ape2long(ape_footer.length);
     
     if (!(flag & DONT_READ_TAG_APE) &&
-        (memcmp(ape_footer.id, "APETAGEX", sizeof (ape_footer.id)) == 0))
+        (memcmp(ape_footer.id, "APETAGEX", sizeof (ape_footer.id)) == 0) &&
+        tagLength >= sizeof (ape_footer))
     {
         PRINT_D9(">apetaglib>READ_FP>>%s: ver %li len %li # %li fl %lx v1=%i v2=%i ape=%i[v%i]\n",
              filename, ape2long(ape_footer.version),
              ape2long(ape_footer.length),
              ape2long(ape_footer.tagCount),
              ape2long(ape_footer.flags), 
-             is_id3v1 (fp), is_id3v2 (fp), is_ape (fp), is_ape_ver (fp));
+             id3v1, is_id3v2 (fp), is_ape_tail (tail), is_ape_ver_tail (tail));
         
         apeTag2 = ape2long(ape_footer.version);
-        buffLength = is_ape(fp) + 128;
-        buff = (unsigned char *) malloc(buffLength);
-        if (buff == NULL) {
-            PRINT_ERR( "ERROR->libapetag->apetag_read_fp:malloc\n");
-            return ATL_MALOC;
-        }
         
-        fseek(fp, id3v1 ? -ape2long(ape_footer.length) -
-              128 : -ape2long(ape_footer.length), SEEK_END);
-        memset(buff, 0, buffLength);
-        if (ape2long(ape_footer.length) != fread(buff, 1, ape2long(ape_footer.length), fp)) {
-            PRINT_ERR( "ERROR->libapetag->apetag_read_fp:fread2\n");
+        /* The items are parsed in place, unless the tag does not fit in the
+         * window, for instance because of large pictures. */
+        data = is_tag_tail_get(tail, id3v1 ? tagLength + 128 : tagLength,
+                               tagLength);
+        if (data == NULL) {
+            savedFilePosition = ftell(fp);
+            buff = (unsigned char *) malloc(tagLength);
+            if (buff == NULL) {
+                PRINT_ERR( "ERROR->libapetag->apetag_read_fp:malloc\n");
+                return ATL_MALOC;
+            }
+            
+            fseek(fp, id3v1 ? -(long) tagLength - 128 : -(long) tagLength,
+                  SEEK_END);
+            if (tagLength != fread(buff, 1, tagLength, fp)) {
+                PRINT_ERR( "ERROR->libapetag->apetag_read_fp:fread2\n");
+                fseek(fp, savedFilePosition, SEEK_SET);
+                free(buff);
+                return ATL_FREAD;
+            }
             fseek(fp, savedFilePosition, SEEK_SET);
-            free(buff);
-            return ATL_FREAD;
+            data = buff;
         }
         
         tagCount = ape2long(ape_footer.tagCount);
         
-        end = buff + ape2long(ape_footer.length) - sizeof (ape_footer);
+        end = data + tagLength - sizeof (ape_footer);
         
-        for (p = buff; p < end && tagCount--;) {
-            /* 8 = sizeof( sizeValue+flags ) */
-            unsigned long flags = ape2long (p + 4);
-            unsigned long sizeValue = ape2long(p);
+        /* 8 = sizeof( sizeValue+flags ), and the items must not run past
+         * the footer, as the data is not followed by padding. */
+        for (p = data; p + 8 < end && tagCount--;) {
+            unsigned long flags = ape2long ((unsigned char *) p + 4);
+            unsigned long sizeValue = ape2long((unsigned char *) p);
             unsigned long sizeName;
-            char *name = (char *)p + 8;
-            char *value;
+            const char *name = (const char *)p + 8;
+            const char *nameEnd;
+            const char *value;
             
-            sizeName = strlen((char *)p + 8);
-            value = (char *)p + sizeName + 8 + 1;
-            if (apeTag2 == 1000 && value[sizeValue - 1] == '\0') {
+            nameEnd = memchr(name, '\0', end - (const unsigned char *) name);
+            if (nameEnd == NULL)
+                break;
+            sizeName = nameEnd - name;
+            value = nameEnd + 1;
+            if (sizeValue > (unsigned long) (end - (const unsigned char *) value))
+                break;
+            if (apeTag2 == 1000 && sizeValue > 0 && value[sizeValue - 1] == '\0') {
                 libapetag_maloc_cont(mem_cnt, flags,
                              sizeName, name,
                              sizeValue - 1, value);
@@ -777,7 +812,7 @@ apetag_read_fp(apetag *mem_cnt, FILE * fp, const char *filename, int flag)
         free(buff);
     } else { /* if no ape tag */
         PRINT_D5(">apetaglib>READ_FP>>%s: v1=%i v2=%i ape=%i[v%i]\n",
-             filename, is_id3v1 (fp), is_id3v2 (fp), is_ape (fp), is_ape_ver (fp));
+             filename, id3v1, is_id3v2 (fp), is_ape_tail (tail), is_ape_ver_tail (tail));
     }
     
 #ifdef ID3V2_READ
@@ -786,13 +821,45 @@ apetag_read_fp(apetag *mem_cnt, FILE * fp, const char *filename, int flag)
     }
 #endif
     if (!(flag & DONT_READ_TAG_ID3V1) && (id3v1)) {
-        readtag_id3v1_fp(mem_cnt, fp);
+        readtag_id3v1_tail(mem_cnt, tail);
     }
     
-    fseek(fp, savedFilePosition, SEEK_SET);
     return 0;
 }
 
+/**
+    \brief read file and add frames 
+
+    The end of the file is mapped once, and the tags are parsed from memory.
+
+    \param mem_cnt      object #apetag
+    \param filename    
+    \param fp        
+    \param flag        
+    \return 0 - OK else check #atl_return
+*/
+int
+apetag_read_fp(apetag *mem_cnt, FILE * fp, const char *filename, int flag)
+{
+    struct is_tag_tail tail;
+    int ret;
+    
+    if (mem_cnt == NULL) {
+        PRINT_ERR( ">apetaglib>READ_FP>FATAL>apetag_init()\n");
+        return ATL_NOINIT;
+    }
+    
+    if (is_tag_tail_open(&tail, fp) != 0) {
+        PRINT_ERR( "ERROR->libapetag->apetag_read_fp:fread1\n");
+        return ATL_FREAD;
+    }
+    
+    ret = apetag_read_tail(mem_cnt, fp, &tail, filename, flag);
+    
+    is_tag_tail_close(&tail);
+    return ret;
+}
+
 /*
     PL: wraper na apetag_read_fp
     PL: otwiera plik wczytuje co trzeba i zamyka 
@@ -884,6 +951,7 @@ int
 apetag_save (const char *filename, apetag *mem_cnt, int flag)
 {
     FILE *fp;
+    struct is_tag_tail tail;
     struct _id3v1Tag id3v1_tag;
     int id3v1;
     int apeTag, saveApe2;
@@ -908,28 +976,41 @@ apetag_save (const char *filename, apetag *mem_cnt, int flag)
         return ATL_FOPEN;
     }
     
+    /* The old tags are all read from the same window, which is released
+     * before the file is written. */
+    if (is_tag_tail_open (&tail, fp) != 0) {
+        PRINT_ERR ("ERROR->apetaglib->apetag_save::fread");
+        fclose (fp);
+        return ATL_FREAD;
+    }
+    
     skipBytes = 0;
-    id3v1 = is_id3v1 (fp);
-    apeTag = is_ape (fp);
+    id3v1 = is_id3v1_tail (&tail);
+    apeTag = is_ape_tail (&tail);
     saveApe2 = !(flag & APE_TAG_V1); // (flag & APE_TAG_V2) ? 1 : (flag & APE_TAG_V1);
     
     if (id3v1) {
-        fseek (fp, -128, SEEK_END);
-        if (fread (&id3v1_tag, 1, sizeof (struct _id3v1Tag), fp)
-            != sizeof (struct _id3v1Tag))
+        const unsigned char *data;
+
+        data = is_tag_tail_get (&tail, 128, sizeof (struct _id3v1Tag));
+        if (data == NULL)
         {
             PRINT_ERR ("ERROR->apetaglib->apetag_save::fread");
+            is_tag_tail_close (&tail);
             fclose (fp);
             return ATL_FREAD;
         }
+        memcpy (&id3v1_tag, data, sizeof (struct _id3v1Tag));
         skipBytes += id3v1;
     }
     skipBytes += apeTag;
 
     if (!(flag & SAVE_NEW_APE_TAG)) {
-        apetag_read_fp (mem_cnt, fp, filename, flag);
+        apetag_read_tail (mem_cnt, fp, &tail, filename, flag);
     }
     
+    is_tag_tail_close (&tail);
+    
     mTag = (mem_cnt->tag);
     qsort( mTag , mem_cnt->countTag , sizeof(struct tag *),
         (int (*)(const void *,const void *))libapetag_qsort);
@@ -66,6 +66,7 @@ info_mpc_read(const char *fn, StreamInfoMpc * Info)
     unsigned int HeaderData[16];
     FILE *tmpFile = NULL;
     long SkipSizeID3;
+    struct is_tag_tail tail;
     
     // load file
     tmpFile = fopen(fn, "rb");
@@ -80,11 +81,17 @@ info_mpc_read(const char *fn, StreamInfoMpc * Info)
         fclose (tmpFile);
         return 1;
     }
-    fseek(tmpFile, 0, SEEK_END);
-    Info->FileSize=ftell(tmpFile);
+    // the tags at the end of the file are looked for in a single window
+    if (is_tag_tail_open(&tail, tmpFile) != 0)
+    {
+        fclose (tmpFile);
+        return 1;
+    }
+    Info->FileSize=tail.fileSize;
     // stream size 
-    Info->ByteLength = Info->FileSize-is_id3v1(tmpFile)-is_ape(tmpFile)-SkipSizeID3;
+    Info->ByteLength = Info->FileSize-is_id3v1_tail(&tail)-is_ape_tail(&tail)-SkipSizeID3;
     
+    is_tag_tail_close(&tail);
     fclose(tmpFile);
     
     if (0 != memcmp(HeaderData, "MP+", 3))
@@ -17,6 +17,8 @@
  * Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
  */
 
+#include "config.h"
+
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -25,10 +27,193 @@
 #include <string.h>
 #include <limits.h>
 #include <assert.h>
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 #include "is_tag.h"
 
-unsigned long
-is_tag_ape2long (unsigned char *p);
+static unsigned long
+is_tag_ape2long (const unsigned char *p);
+
+/**
+    map (or read) the last #IS_TAG_TAIL_SIZE bytes of the file
+
+    \param tail Window to open
+    \param fp File pointer
+    \return 0 - OK, else the end of the file could not be read
+*/
+int
+is_tag_tail_open (struct is_tag_tail *tail, FILE * fp)
+{
+    long savedFilePosition;
+    long start;
+
+    memset (tail, 0, sizeof (*tail));
+
+    savedFilePosition = ftell (fp);
+    if (fseek (fp, 0, SEEK_END) != 0 || (tail->fileSize = ftell (fp)) < 0) {
+        fseek (fp, savedFilePosition, SEEK_SET);
+        return 1;
+    }
+
+    tail->size = tail->fileSize < IS_TAG_TAIL_SIZE ? (size_t) tail->fileSize
+                                                   : IS_TAG_TAIL_SIZE;
+    start = tail->fileSize - tail->size;
+
+    if (tail->size == 0) {
+        fseek (fp, savedFilePosition, SEEK_SET);
+        return 0;
+    }
+
+#ifdef HAVE_MMAP
+    {
+        /* The mapping must start on a page boundary. */
+        long pageSize = sysconf (_SC_PAGESIZE);
+        long offset = pageSize > 0 ? start - start % pageSize : 0;
+        void *map;
+
+        fflush (fp);
+        tail->mapSize = tail->fileSize - offset;
+        map = mmap (NULL, tail->mapSize, PROT_READ, MAP_PRIVATE, fileno (fp),
+                    offset);
+
+        if (map != MAP_FAILED) {
+            tail->map = map;
+            tail->data = (const unsigned char *) map + (start - offset);
+            fseek (fp, savedFilePosition, SEEK_SET);
+            return 0;
+        }
+
+        tail->mapSize = 0;
+    }
+#endif
+
+    tail->buff = (unsigned char *) malloc (tail->size);
+    if (tail->buff == NULL) {
+        fseek (fp, savedFilePosition, SEEK_SET);
+        return 1;
+    }
+
+    if (fseek (fp, start, SEEK_SET) != 0
+        || fread (tail->buff, 1, tail->size, fp) != tail->size) {
+        free (tail->buff);
+        tail->buff = NULL;
+        fseek (fp, savedFilePosition, SEEK_SET);
+        return 1;
+    }
+
+    tail->data = tail->buff;
+    fseek (fp, savedFilePosition, SEEK_SET);
+    return 0;
+}
+
+/**
+    release the window, which must be done before the file is modified
+
+    \param tail Window to close
+*/
+void
+is_tag_tail_close (struct is_tag_tail *tail)
+{
+#ifdef HAVE_MMAP
+    if (tail->map != NULL)
+        munmap (tail->map, tail->mapSize);
+#endif
+    free (tail->buff);
+    memset (tail, 0, sizeof (*tail));
+}
+
+/**
+    return the data at \a offsetFromEnd bytes before the end of the file
+
+    \param tail Window on the end of the file
+    \param offsetFromEnd Offset of the data from the end of the file
+    \param length Length of the data
+    \return Pointer to the data, or NULL if it is not all in the window
+*/
+const unsigned char *
+is_tag_tail_get (const struct is_tag_tail *tail, size_t offsetFromEnd,
+                 size_t length)
+{
+    if (offsetFromEnd > tail->size || length > offsetFromEnd)
+        return NULL;
+
+    return tail->data + tail->size - offsetFromEnd;
+}
+
+/**
+    same as #is_id3v1, from the window on the end of the file
+*/
+int
+is_id3v1_tail (const struct is_tag_tail *tail)
+{
+    int n = 0;
+    const unsigned char *buf;
+
+    for (;;) {
+        buf = is_tag_tail_get (tail, 128 * (n + 1), 3);
+        if (buf == NULL || memcmp (buf, "TAG", 3) != 0)
+            break;
+        /* The "TAG" of the "APETAGEX" of an APE tag is not an ID3v1 tag. */
+        buf = is_tag_tail_get (tail, 128 * (n + 1) + 3, 8);
+        if (buf != NULL && memcmp (buf, "APETAGEX", 8) == 0) /*APE.TAG.EX*/
+            break;
+        n++;
+    }
+
+    return n * 128;
+}
+
+/* Return the APE tag footer, before any ID3v1 tag, or NULL. */
+static const unsigned char *
+is_tag_tail_ape_footer (const struct is_tag_tail *tail)
+{
+    const unsigned char *buf;
+
+    buf = is_tag_tail_get (tail, is_id3v1_tail (tail) ? 32 + 128 : 32, 32);
+    if (buf == NULL || memcmp (buf, "APETAGEX", 8) != 0)
+        return NULL;
+
+    return buf;
+}
+
+#define IS_TAG_FOOTER_NOT       0x40000000
+
+/**
+    same as #is_ape, from the window on the end of the file
+*/
+int
+is_ape_tail (const struct is_tag_tail *tail)
+{
+    const unsigned char *buf = is_tag_tail_ape_footer (tail);
+
+    if (buf == NULL)
+        return 0;
+
+    /* WARNING! macabra code */
+    return (int) (is_tag_ape2long (buf + 8 + 4) +
+        ( 
+            ( (is_tag_ape2long (buf + 8) == 2000) &&
+            !(is_tag_ape2long (buf + 8 + 4 + 8) & IS_TAG_FOOTER_NOT)
+            ) ? 32 : 0 
+        ) /* footer size = 32 */
+        );
+}
+
+/**
+    same as #is_ape_ver, from the window on the end of the file
+*/
+int
+is_ape_ver_tail (const struct is_tag_tail *tail)
+{
+    const unsigned char *buf = is_tag_tail_ape_footer (tail);
+
+    if (buf == NULL)
+        return 0;
+
+    return (int) is_tag_ape2long (buf + 8);
+}
 
 /*
     PL: czy dany plik ma taga odpowiednio id3v1, id3v2 i ape ???
@@ -45,27 +230,15 @@ is_tag_ape2long (unsigned char *p);
 int
 is_id3v1 (FILE * fp)
 {
-    int n=0;
-    char buf[16];
-    size_t savedFilePosition;
-    
-    savedFilePosition = ftell (fp);
-    fseek (fp, 0, SEEK_END);
-    do {
-        n++;
-        memset (buf, 0, sizeof (buf));
-        fseek (fp, ((-128)*n) - 3 , SEEK_END);
-        if (fread (&buf, 1, sizeof (buf), fp) != sizeof (buf))
-        {
-            fseek (fp, savedFilePosition, SEEK_SET);
-            return 0;
-        }
-        if (memcmp (buf, "APETAGEX",8) == 0) /*APE.TAG.EX*/
-        break;
-    } while (memcmp (buf+3, "TAG", 3) == 0);
-    
-    fseek (fp, savedFilePosition, SEEK_SET);
-    return (n-1)*128;
+    struct is_tag_tail tail;
+    int size;
+
+    if (is_tag_tail_open (&tail, fp) != 0)
+        return 0;
+    size = is_id3v1_tail (&tail);
+    is_tag_tail_close (&tail);
+
+    return size;
 }
 
 /** 
@@ -115,28 +288,16 @@ is_id3v2 (FILE * fp)
 int
 is_ape_ver (FILE * fp)
 {
-    char unsigned buf[32];
-    size_t savedFilePosition;
-        
-    savedFilePosition = ftell (fp);
-    memset (buf, 0, sizeof (buf));
-        
-    fseek (fp, (is_id3v1 (fp) ? -32 - 128 : -32), SEEK_END);
-    if (fread (&buf, 1, sizeof (buf), fp) != sizeof (buf))
-    {
-        fseek (fp, savedFilePosition, SEEK_SET);
-        return 0;
-    }
-    if (memcmp (buf, "APETAGEX", 8) != 0) {
-        fseek (fp, savedFilePosition, SEEK_SET);
+    struct is_tag_tail tail;
+    int version;
+
+    if (is_tag_tail_open (&tail, fp) != 0)
         return 0;
-    }
-        
-    fseek (fp, savedFilePosition, SEEK_SET);
-    return (int) is_tag_ape2long (buf + 8);
-}
+    version = is_ape_ver_tail (&tail);
+    is_tag_tail_close (&tail);
 
-#define IS_TAG_FOOTER_NOT       0x40000000
+    return version;
+}
 
 /** 
     return size of ape tag id3v1 is not counting 
@@ -147,37 +308,20 @@ is_ape_ver (FILE * fp)
 int
 is_ape (FILE * fp)
 {
-    char unsigned buf[32];
-    size_t savedFilePosition;
-        
-    savedFilePosition = ftell (fp);
-    memset (buf, 0, sizeof (buf));
-        
-    fseek (fp, (is_id3v1 (fp) ? -32 - 128 : -32), SEEK_END);
-    if (fread (&buf, 1, sizeof (buf), fp) != sizeof (buf))
-    {
-        fseek (fp, savedFilePosition, SEEK_SET);
-        return 0;
-    }
-    if (memcmp (buf, "APETAGEX", 8) != 0) {
-        fseek (fp, savedFilePosition, SEEK_SET);
+    struct is_tag_tail tail;
+    int size;
+
+    if (is_tag_tail_open (&tail, fp) != 0)
         return 0;
-    }
-        
-    fseek (fp, savedFilePosition, SEEK_SET);
-    /* WARNING! macabra code */
-    return (int) (is_tag_ape2long (buf + 8 + 4) +
-        ( 
-            ( (is_tag_ape2long (buf + 8) == 2000) &&
-            !(is_tag_ape2long (buf + 8 + 4 + 8) & IS_TAG_FOOTER_NOT)
-            ) ? 32 : 0 
-        ) /* footer size = 32 */
-        );
+    size = is_ape_tail (&tail);
+    is_tag_tail_close (&tail);
+
+    return size;
 }
 
 
-unsigned long
-is_tag_ape2long (unsigned char *p)
+static unsigned long
+is_tag_ape2long (const unsigned char *p)
 {
 
     return (((unsigned long) p[0] << 0)  |
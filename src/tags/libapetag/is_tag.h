@@ -26,6 +26,41 @@
     All is_* function restore file positon on return
 */
 
+#include <stdio.h>
+#include <stddef.h>
+
+/** size of the window on the end of a file, in which tags are looked for */
+#define IS_TAG_TAIL_SIZE (64 * 1024)
+
+/**
+    \brief window on the end of a file
+
+    The end of the file is mapped (or read) once, so that the ID3v1 and APE
+    tags can be looked for and parsed from memory.
+*/
+struct is_tag_tail
+{
+    const unsigned char *data;  /**< the last \a size bytes of the file */
+    size_t size;                /**< size of the window */
+    long fileSize;              /**< size of the whole file */
+    void *map;                  /**< mapping holding \a data, or NULL */
+    size_t mapSize;             /**< size of \a map */
+    unsigned char *buff;        /**< \a data when it could not be mapped */
+};
+
+int is_tag_tail_open (struct is_tag_tail *tail, FILE * fp);
+
+void is_tag_tail_close (struct is_tag_tail *tail);
+
+const unsigned char *is_tag_tail_get (const struct is_tag_tail *tail,
+                                      size_t offsetFromEnd, size_t length);
+
+int is_id3v1_tail (const struct is_tag_tail *tail);
+
+int is_ape_tail (const struct is_tag_tail *tail);
+
+int is_ape_ver_tail (const struct is_tag_tail *tail);
+
 int is_id3v1 (FILE * fp);
 
 int is_id3v2 (FILE * fp);
@@ -22,35 +22,24 @@
 /* This file is intended to be included directly in mp4_tag.cc */
 
 /*
- * et_mp4_header_read_file_info:
+ * et_mp4_header_read_file_info_from_file:
  *
- * Get header info into the ETFileInfo structure
+ * Get header info into the ETFileInfo structure, from an MP4 file which was
+ * already opened from stream, so that it is not parsed again.
  */
-gboolean
-et_mp4_header_read_file_info (GFile *file,
-                              ET_File_Info *ETFileInfo,
-                              GError **error)
+static gboolean
+et_mp4_header_read_file_info_from_file (TagLib::MP4::File &mp4file,
+                                        GIO_InputStream &stream,
+                                        ET_File_Info *ETFileInfo,
+                                        GError **error)
 {
-    GFileInfo *info;
     const TagLib::MP4::Properties *properties;
-
-    g_return_val_if_fail (file != NULL && ETFileInfo != NULL, FALSE);
+    long int size;
 
     /* Get size of file */
-    info = g_file_query_info (file, G_FILE_ATTRIBUTE_STANDARD_SIZE,
-                              G_FILE_QUERY_INFO_NONE, NULL, error);
-
-    if (!info)
-    {
-        return FALSE;
-    }
-
-    ETFileInfo->size = g_file_info_get_size (info);
-    g_object_unref (info);
-
-    GIO_InputStream stream (file);
+    size = stream.length ();
 
-    if (!stream.isOpen ())
+    if (size < 0)
     {
         const GError *tmp_error = stream.getError ();
 
@@ -59,15 +48,7 @@ et_mp4_header_read_file_info (GFile *file,
         return FALSE;
     }
 
-    TagLib::MP4::File mp4file (&stream);
-
-    if (!mp4file.isOpen ())
-    {
-        g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
-                     _("Error while opening file: %s"),
-                     _("MP4 format invalid"));
-        return FALSE;
-    }
+    ETFileInfo->size = size;
 
     properties = mp4file.audioProperties ();
 
@@ -110,6 +91,43 @@ et_mp4_header_read_file_info (GFile *file,
     return TRUE;
 }
 
+/*
+ * et_mp4_header_read_file_info:
+ *
+ * Get header info into the ETFileInfo structure
+ */
+gboolean
+et_mp4_header_read_file_info (GFile *file,
+                              ET_File_Info *ETFileInfo,
+                              GError **error)
+{
+    g_return_val_if_fail (file != NULL && ETFileInfo != NULL, FALSE);
+
+    GIO_InputStream stream (file);
+
+    if (!stream.isOpen ())
+    {
+        const GError *tmp_error = stream.getError ();
+
+        g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                     _("Error while opening file: %s"), tmp_error->message);
+        return FALSE;
+    }
+
+    TagLib::MP4::File mp4file (&stream);
+
+    if (!mp4file.isOpen ())
+    {
+        g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                     _("Error while opening file: %s"),
+                     _("MP4 format invalid"));
+        return FALSE;
+    }
+
+    return et_mp4_header_read_file_info_from_file (mp4file, stream,
+                                                   ETFileInfo, error);
+}
+
 /*
  * et_mp4_header_display_file_info_to_ui:
  *
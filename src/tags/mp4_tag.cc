@@ -50,11 +50,15 @@
 /*
  * Mp4_Tag_Read_File_Tag:
  *
- * Read tag data into an Mp4 file.
+ * Read tag data into an Mp4 file. If ETFileInfo is not NULL, the header info
+ * is read from the same parsed file. A failure to read the header info does
+ * not fail the tag read, but is reported in info_error instead.
  */
 gboolean
 mp4tag_read_file_tag (GFile *file,
                       File_Tag *FileTag,
+                      ET_File_Info *ETFileInfo,
+                      GError **info_error,
                       GError **error)
 {
     TagLib::MP4::Tag *tag;
@@ -229,6 +233,12 @@ mp4tag_read_file_tag (GFile *file,
         et_file_tag_set_picture (FileTag, NULL);
     }
 
+    if (ETFileInfo)
+    {
+        et_mp4_header_read_file_info_from_file (mp4file, stream, ETFileInfo,
+                                                info_error);
+    }
+
     return TRUE;
 }
 
@@ -481,6 +491,17 @@ mp4tag_write_file_tag (const ET_File *ETFile,
     tag->setProperties (fields);
     success = mp4file.save () ? TRUE : FALSE;
 
+    /* Replace the file by its rewritten copy, if the tag did not fit. */
+    if (success && !stream.commit ())
+    {
+        const GError *tmp_error = stream.getError ();
+
+        g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                     _("Cannot write tag in file ‘%s’: %s"), filename_utf8,
+                     tmp_error->message);
+        success = FALSE;
+    }
+
     return success;
 }
 
@@ -0,0 +1,458 @@
+/* EasyTAG - tag editor for audio files
+ * Copyright (C) 2026  agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "config.h"
+
+#include "mpeg_frame.h"
+
+#include <string.h>
+
+/* Bitrates in kb/s, by MPEG version (1, or 2 and 2.5), layer and index. */
+static const gint mpeg_bitrates[2][3][15] =
+{
+    {
+        { 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416,
+          448 },
+        { 0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384 },
+        { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 }
+    },
+    {
+        { 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256 },
+        { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 },
+        { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 }
+    }
+};
+
+/* Sample rates in Hz of MPEG 1, halved for MPEG 2 and quartered for 2.5. */
+static const gint mpeg_samplerates[3] = { 44100, 48000, 32000 };
+
+/* The offset of the VBRI header, from the start of the frame. */
+#define MPEG_VBRI_OFFSET (ET_MPEG_FRAME_HEADER_SIZE + 32)
+
+static guint32
+read_uint32_be (const guchar *data)
+{
+    return ((guint32)data[0] << 24) | ((guint32)data[1] << 16)
+           | ((guint32)data[2] << 8) | (guint32)data[3];
+}
+
+/*
+ * et_mpeg_frame_parse:
+ * @data: the 4 bytes of a frame header
+ * @frame: the frame to fill
+ *
+ * Decode a frame header. Free format frames, which do not store their bitrate
+ * in the header, are rejected.
+ *
+ * Returns: %TRUE if @data is a valid frame header, %FALSE otherwise
+ */
+gboolean
+et_mpeg_frame_parse (const guchar *data,
+                     EtMpegFrame *frame)
+{
+    guint version_bits;
+    guint layer_bits;
+    guint bitrate_index;
+    guint samplerate_index;
+    guint padding;
+
+    if (data[0] != 0xFF || (data[1] & 0xE0) != 0xE0)
+    {
+        return FALSE;
+    }
+
+    /* 0: MPEG 2.5, 1: reserved, 2: MPEG 2, 3: MPEG 1. */
+    version_bits = (data[1] >> 3) & 0x03;
+    /* 0: reserved, 1: layer III, 2: layer II, 3: layer I. */
+    layer_bits = (data[1] >> 1) & 0x03;
+    bitrate_index = data[2] >> 4;
+    samplerate_index = (data[2] >> 2) & 0x03;
+    padding = (data[2] >> 1) & 0x01;
+
+    if (version_bits == 1 || layer_bits == 0 || bitrate_index == 0
+        || bitrate_index == 0x0F || samplerate_index == 3)
+    {
+        return FALSE;
+    }
+
+    frame->version = version_bits == 3 ? 1 : 2;
+    frame->mpeg25 = version_bits == 0;
+    frame->layer = 4 - layer_bits;
+    frame->bitrate = mpeg_bitrates[frame->version - 1][frame->layer - 1]
+                                  [bitrate_index];
+    frame->samplerate = mpeg_samplerates[samplerate_index]
+                        >> (version_bits == 3 ? 0 : version_bits == 2 ? 1 : 2);
+    frame->mode = data[3] >> 6;
+
+    switch (frame->layer)
+    {
+        case 1:
+            frame->samples = 384;
+            frame->size = (12000 * frame->bitrate / frame->samplerate
+                           + padding) * 4;
+            break;
+        case 2:
+            frame->samples = 1152;
+            frame->size = 144000 * frame->bitrate / frame->samplerate
+                          + padding;
+            break;
+        case 3:
+            frame->samples = frame->version == 1 ? 1152 : 576;
+            frame->size = (frame->samples / 8) * 1000 * frame->bitrate
+                          / frame->samplerate + padding;
+            break;
+        default:
+            g_assert_not_reached ();
+    }
+
+    return TRUE;
+}
+
+/*
+ * et_mpeg_frame_sync:
+ * @data: the start of a stream
+ * @length: the length of @data
+ * @frame: the first frame, if found
+ *
+ * Look for the first frame of the stream. A frame header is only trusted if
+ * it is followed by another frame of the same stream, so that junk before the
+ * stream, or a stray sync word in an unknown tag, is skipped. The last frame
+ * header of @data is trusted if the next one is beyond @length.
+ *
+ * Returns: the offset of the first frame in @data, or -1 if none was found
+ */
+gssize
+et_mpeg_frame_sync (const guchar *data,
+                    gsize length,
+                    EtMpegFrame *frame)
+{
+    gsize i;
+
+    g_return_val_if_fail (data != NULL || length == 0, -1);
+    g_return_val_if_fail (frame != NULL, -1);
+
+    for (i = 0; i + ET_MPEG_FRAME_HEADER_SIZE <= length; i++)
+    {
+        EtMpegFrame next;
+        gsize next_offset;
+
+        if (data[i] != 0xFF || !et_mpeg_frame_parse (&data[i], frame))
+        {
+            continue;
+        }
+
+        next_offset = i + frame->size;
+
+        if (next_offset + ET_MPEG_FRAME_HEADER_SIZE > length)
+        {
+            return i;
+        }
+
+        if (et_mpeg_frame_parse (&data[next_offset], &next)
+            && next.version == frame->version
+            && next.mpeg25 == frame->mpeg25
+            && next.layer == frame->layer
+            && next.samplerate == frame->samplerate)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/*
+ * et_mpeg_frame_parse_vbr_header:
+ * @data: the start of the first frame of a stream
+ * @length: the length of @data, which may extend past the frame
+ * @frame: the header of the frame, from et_mpeg_frame_parse()
+ * @vbr: the VBR header to fill
+ *
+ * Look for a Xing or Info header, followed by an optional LAME extension, or
+ * a VBRI header, in place of the audio of the first frame. @vbr->type is
+ * %ET_MPEG_VBR_NONE if none of them is found.
+ */
+void
+et_mpeg_frame_parse_vbr_header (const guchar *data,
+                                gsize length,
+                                const EtMpegFrame *frame,
+                                EtMpegVbrHeader *vbr)
+{
+    gsize offset;
+
+    g_return_if_fail (data != NULL && frame != NULL && vbr != NULL);
+
+    memset (vbr, 0, sizeof (*vbr));
+
+    /* The headers are only written in layer III streams. */
+    if (frame->layer != 3)
+    {
+        return;
+    }
+
+    length = MIN (length, frame->size);
+
+    /* The Xing header follows the side information, the size of which
+     * depends on the version and on the number of channels. */
+    if (frame->version == 1)
+    {
+        offset = frame->mode == 3 ? 17 : 32;
+    }
+    else
+    {
+        offset = frame->mode == 3 ? 9 : 17;
+    }
+
+    offset += ET_MPEG_FRAME_HEADER_SIZE;
+
+    if (offset + 8 <= length
+        && (memcmp (&data[offset], "Xing", 4) == 0
+            || memcmp (&data[offset], "Info", 4) == 0))
+    {
+        guint32 flags;
+
+        vbr->type = data[offset] == 'X' ? ET_MPEG_VBR_XING : ET_MPEG_VBR_INFO;
+        flags = read_uint32_be (&data[offset + 4]);
+        offset += 8;
+
+        /* Frames, bytes, table of contents and quality, all optional. */
+        if (flags & 0x01)
+        {
+            if (offset + 4 > length)
+            {
+                return;
+            }
+
+            vbr->frames = read_uint32_be (&data[offset]);
+            offset += 4;
+        }
+
+        if (flags & 0x02)
+        {
+            if (offset + 4 > length)
+            {
+                return;
+            }
+
+            vbr->bytes = read_uint32_be (&data[offset]);
+            offset += 4;
+        }
+
+        if (flags & 0x04)
+        {
+            offset += 100;
+        }
+
+        if (flags & 0x08)
+        {
+            offset += 4;
+        }
+
+        /* The LAME extension starts with the name of the encoder, and holds
+         * the encoder delay and padding as two 12-bit values, 21 bytes in. */
+        if (offset + 24 <= length
+            && (memcmp (&data[offset], "LAME", 4) == 0
+                || memcmp (&data[offset], "Lavf", 4) == 0
+                || memcmp (&data[offset], "Lavc", 4) == 0))
+        {
+            const guchar *delays = &data[offset + 21];
+
+            vbr->lame = TRUE;
+            vbr->encoder_delay = (delays[0] << 4) | (delays[1] >> 4);
+            vbr->encoder_padding = ((delays[1] & 0x0F) << 8) | delays[2];
+        }
+    }
+    else if (MPEG_VBRI_OFFSET + 18 <= length
+             && memcmp (&data[MPEG_VBRI_OFFSET], "VBRI", 4) == 0)
+    {
+        /* Version, delay and quality, then the bytes and frames. */
+        vbr->type = ET_MPEG_VBR_VBRI;
+        vbr->bytes = read_uint32_be (&data[MPEG_VBRI_OFFSET + 10]);
+        vbr->frames = read_uint32_be (&data[MPEG_VBRI_OFFSET + 14]);
+    }
+}
+
+/*
+ * et_mpeg_frame_scan_init:
+ * @scan: the scan to initialize
+ *
+ * Prepare a scan, before feeding it the stream from its first frame.
+ */
+void
+et_mpeg_frame_scan_init (EtMpegFrameScan *scan)
+{
+    g_return_if_fail (scan != NULL);
+
+    memset (scan, 0, sizeof (*scan));
+}
+
+/*
+ * Whether @frame belongs to the same stream as @first. The bitrate and the
+ * channel mode may change from frame to frame.
+ */
+static gboolean
+et_mpeg_frame_scan_is_same_stream (const EtMpegFrame *first,
+                                   const EtMpegFrame *frame)
+{
+    return frame->version == first->version
+           && frame->mpeg25 == first->mpeg25
+           && frame->layer == first->layer
+           && frame->samplerate == first->samplerate;
+}
+
+/*
+ * et_mpeg_frame_scan_feed:
+ * @scan: a scan
+ * @data: the next chunk of the stream
+ * @length: the length of @data
+ *
+ * Walk the frames of @data, jumping from one frame header to the next. A
+ * frame header may straddle two chunks. When the stream loses sync, the scan
+ * looks for the next frame header, and counts an error.
+ */
+void
+et_mpeg_frame_scan_feed (EtMpegFrameScan *scan,
+                         const guchar *data,
+                         gsize length)
+{
+    gsize i = 0;
+
+    g_return_if_fail (scan != NULL);
+    g_return_if_fail (data != NULL || length == 0);
+
+    while (i < length)
+    {
+        EtMpegFrame frame;
+
+        if (scan->skip > 0)
+        {
+            gsize n = MIN (scan->skip, length - i);
+
+            scan->skip -= n;
+            i += n;
+            continue;
+        }
+
+        if (scan->header_length == 0 && !scan->in_sync)
+        {
+            const guchar *sync;
+
+            /* Out of sync, so jump to the next possible frame header. */
+            sync = memchr (&data[i], 0xFF, length - i);
+
+            if (sync == NULL)
+            {
+                break;
+            }
+
+            i = sync - data;
+        }
+
+        if (scan->header_length == 0
+            && i + ET_MPEG_FRAME_HEADER_SIZE <= length)
+        {
+            /* The common case, without a copy. */
+            memcpy (scan->header, &data[i], ET_MPEG_FRAME_HEADER_SIZE);
+            scan->header_length = ET_MPEG_FRAME_HEADER_SIZE;
+            i += ET_MPEG_FRAME_HEADER_SIZE;
+        }
+        else
+        {
+            while (scan->header_length < ET_MPEG_FRAME_HEADER_SIZE
+                   && i < length)
+            {
+                scan->header[scan->header_length++] = data[i++];
+            }
+
+            if (scan->header_length < ET_MPEG_FRAME_HEADER_SIZE)
+            {
+                break;
+            }
+        }
+
+        if (et_mpeg_frame_parse (scan->header, &frame)
+            && (scan->frames == 0
+                || et_mpeg_frame_scan_is_same_stream (&scan->first, &frame)))
+        {
+            if (scan->frames == 0)
+            {
+                scan->first = frame;
+            }
+
+            scan->frames++;
+            scan->samples += frame.samples;
+            scan->skip = frame.size - ET_MPEG_FRAME_HEADER_SIZE;
+            scan->header_length = 0;
+            scan->in_sync = TRUE;
+        }
+        else
+        {
+            const guchar *sync;
+
+            if (scan->in_sync)
+            {
+                scan->errors++;
+                scan->in_sync = FALSE;
+            }
+
+            /* Keep the rest of the header, from the next possible sync. */
+            sync = memchr (&scan->header[1], 0xFF,
+                           ET_MPEG_FRAME_HEADER_SIZE - 1);
+
+            if (sync)
+            {
+                scan->header_length = &scan->header[ET_MPEG_FRAME_HEADER_SIZE]
+                                      - sync;
+                memmove (scan->header, sync, scan->header_length);
+            }
+            else
+            {
+                scan->header_length = 0;
+            }
+        }
+    }
+}
+
+/*
+ * et_mpeg_frame_scan_finish:
+ * @scan: a scan
+ *
+ * Account for the end of the stream, after the last chunk was fed to the scan.
+ * A last frame which is cut short is not counted, but counts as an error.
+ */
+void
+et_mpeg_frame_scan_finish (EtMpegFrameScan *scan)
+{
+    g_return_if_fail (scan != NULL);
+
+    if (scan->skip > 0)
+    {
+        /* Do not count the truncated frame. */
+        scan->frames--;
+        scan->samples -= scan->first.samples;
+        scan->errors++;
+    }
+    else if (scan->in_sync && scan->header_length > 0)
+    {
+        scan->errors++;
+    }
+
+    scan->skip = 0;
+    scan->header_length = 0;
+    scan->in_sync = FALSE;
+}
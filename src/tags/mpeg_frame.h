@@ -0,0 +1,129 @@
+/* EasyTAG - tag editor for audio files
+ * Copyright (C) 2026  agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef ET_MPEG_FRAME_H_
+#define ET_MPEG_FRAME_H_
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* The size of an MPEG audio frame header. */
+#define ET_MPEG_FRAME_HEADER_SIZE 4
+
+/*
+ * EtMpegFrame:
+ * @version: the MPEG version, 1 or 2
+ * @mpeg25: %TRUE if the stream is MPEG 2.5 (and @version is 2)
+ * @layer: the layer, from 1 to 3
+ * @bitrate: the bitrate, in kb/s
+ * @samplerate: the sample rate, in Hz
+ * @mode: the channel mode, from 0 (stereo) to 3 (single channel)
+ * @samples: the number of samples in the frame
+ * @size: the size of the frame in bytes, including its header
+ *
+ * The fields of an MPEG audio frame header.
+ */
+typedef struct
+{
+    gint version;
+    gboolean mpeg25;
+    gint layer;
+    gint bitrate;
+    gint samplerate;
+    gint mode;
+    guint samples;
+    gsize size;
+} EtMpegFrame;
+
+/*
+ * EtMpegVbrType:
+ * @ET_MPEG_VBR_NONE: the frame does not hold a VBR header
+ * @ET_MPEG_VBR_XING: a Xing header, for a variable bitrate stream
+ * @ET_MPEG_VBR_INFO: an Info header, which is a Xing header written by LAME
+ *                    for a constant bitrate stream
+ * @ET_MPEG_VBR_VBRI: a VBRI header, written by the Fraunhofer encoder
+ */
+typedef enum
+{
+    ET_MPEG_VBR_NONE,
+    ET_MPEG_VBR_XING,
+    ET_MPEG_VBR_INFO,
+    ET_MPEG_VBR_VBRI
+} EtMpegVbrType;
+
+/*
+ * EtMpegVbrHeader:
+ * @type: the kind of header
+ * @frames: the number of audio frames in the stream, or 0 if unknown
+ * @bytes: the number of bytes of the stream, or 0 if unknown
+ * @lame: %TRUE if a LAME extension followed the Xing or Info header
+ * @encoder_delay: the samples added by the encoder at the start, from LAME
+ * @encoder_padding: the samples added by the encoder at the end, from LAME
+ *
+ * The header which some encoders store in the first frame of a stream, in
+ * place of audio.
+ */
+typedef struct
+{
+    EtMpegVbrType type;
+    guint32 frames;
+    guint32 bytes;
+    gboolean lame;
+    guint encoder_delay;
+    guint encoder_padding;
+} EtMpegVbrHeader;
+
+/*
+ * EtMpegFrameScan:
+ * @frames: the number of frames found
+ * @samples: the number of samples in the frames found
+ * @errors: the number of times that the stream lost sync, as a frame header
+ *          was expected but not found, or as the last frame was truncated
+ *
+ * The state of a walk over all the frames of a stream, fed in chunks of any
+ * size to et_mpeg_frame_scan_feed().
+ */
+typedef struct
+{
+    guint frames;
+    guint64 samples;
+    guint errors;
+
+    /*< private >*/
+    EtMpegFrame first;
+    gsize skip;
+    gboolean in_sync;
+    guchar header[ET_MPEG_FRAME_HEADER_SIZE];
+    gsize header_length;
+} EtMpegFrameScan;
+
+gboolean et_mpeg_frame_parse (const guchar *data, EtMpegFrame *frame);
+gssize et_mpeg_frame_sync (const guchar *data, gsize length,
+                           EtMpegFrame *frame);
+void et_mpeg_frame_parse_vbr_header (const guchar *data, gsize length,
+                                     const EtMpegFrame *frame,
+                                     EtMpegVbrHeader *vbr);
+void et_mpeg_frame_scan_init (EtMpegFrameScan *scan);
+void et_mpeg_frame_scan_feed (EtMpegFrameScan *scan, const guchar *data,
+                              gsize length);
+void et_mpeg_frame_scan_finish (EtMpegFrameScan *scan);
+
+G_END_DECLS
+
+#endif /* ET_MPEG_FRAME_H_ */
@@ -19,17 +19,15 @@
 
 #include "config.h"
 
-#if defined ENABLE_MP3 && defined ENABLE_ID3LIB
+#ifdef ENABLE_MP3
 
 #include <glib/gi18n.h>
-#include <errno.h>
+#include <string.h>
 
 #include "mpeg_header.h"
+#include "mpeg_frame.h"
 #include "misc.h"
 
-#include <id3.h>
-#include "id3lib/id3_bugfix.h"
-
 
 
 /****************
@@ -61,23 +59,33 @@ channel_mode_name (int mode)
     return _(channel_mode[mode]);
 }
 
+/* Enough of the stream to skip the padding or junk after the ID3v2 tag, and to
+ * read the VBR header of the first frame. */
+#define MPEG_HEADER_READ_SIZE 16384
+
 /*
- * Read infos into header of first frame
+ * Read infos into header of first frame. @audio_offset is the size of the
+ * ID3v2 tag at the start of the file, as found when reading the tag, where the
+ * audio begins.
  */
 gboolean
 et_mpeg_header_read_file_info (GFile *file,
+                               goffset audio_offset,
                                ET_File_Info *ETFileInfo,
                                GError **error)
 {
     GFileInfo *info;
-    gchar *filename;
-    /*
-     * With id3lib, the header frame couldn't be read if the file contains an ID3v2 tag with an APIC frame
-     */
-    ID3Tag *id3_tag = NULL;    /* Tag defined by the id3lib */
-    const Mp3_Headerinfo* headerInfo = NULL;
+    GFileInputStream *istream;
+    guchar *buffer;
+    gsize bytes_read;
+    gssize frame_offset;
+    EtMpegFrame frame;
+    EtMpegVbrHeader vbr;
+    goffset audio_size;
+    guchar v1_query[3];
 
     g_return_val_if_fail (file != NULL || ETFileInfo != NULL, FALSE);
+    g_return_val_if_fail (audio_offset >= 0, FALSE);
     g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 
     /* Get size of file */
@@ -92,99 +100,93 @@ et_mpeg_header_read_file_info (GFile *file,
     ETFileInfo->size = g_file_info_get_size (info);
     g_object_unref (info);
 
-    /* Get data from tag */
-    if ((id3_tag = ID3Tag_New()) == NULL)
+    istream = g_file_read (file, NULL, error);
+
+    if (!istream)
     {
-        g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_NOMEM, "%s",
-                     g_strerror (ENOMEM));
-        g_object_unref (info);
         return FALSE;
     }
 
-    /* Link the file to the tag (uses ID3TT_ID3V2 to get header if APIC is present in Tag) */
-    filename = g_file_get_path (file);
-    ID3Tag_LinkWithFlags(id3_tag,filename,ID3TT_ID3V2);
-    g_free (filename);
+    buffer = g_malloc (MPEG_HEADER_READ_SIZE);
 
-    if ( (headerInfo = ID3Tag_GetMp3HeaderInfo(id3_tag)) )
+    if (!g_seekable_seek (G_SEEKABLE (istream), audio_offset, G_SEEK_SET,
+                          NULL, error)
+        || !g_input_stream_read_all (G_INPUT_STREAM (istream), buffer,
+                                     MPEG_HEADER_READ_SIZE, &bytes_read, NULL,
+                                     error))
     {
-        switch (headerInfo->version)
-        {
-            case MPEGVERSION_1:
-                ETFileInfo->version = 1;
-                ETFileInfo->mpeg25 = FALSE;
-                break;
-            case MPEGVERSION_2:
-                ETFileInfo->version = 2;
-                ETFileInfo->mpeg25 = FALSE;
-                break;
-            case MPEGVERSION_2_5:
-                ETFileInfo->version = 2;
-                ETFileInfo->mpeg25 = TRUE;
-                break;
-            case MPEGVERSION_FALSE:
-            case MPEGVERSION_Reserved:
-            default:
-                break;
-        }
+        g_free (buffer);
+        g_object_unref (istream);
+        return FALSE;
+    }
 
-        switch (headerInfo->layer)
-        {
-            case MPEGLAYER_I:
-                ETFileInfo->layer = 1;
-                break;
-            case MPEGLAYER_II:
-                ETFileInfo->layer = 2;
-                break;
-            case MPEGLAYER_III:
-                ETFileInfo->layer = 3;
-                break;
-            case MPEGLAYER_FALSE:
-            case MPEGLAYER_UNDEFINED:
-            default:
-                break;
-        }
+    frame_offset = et_mpeg_frame_sync (buffer, bytes_read, &frame);
 
-        // Samplerate
-        ETFileInfo->samplerate = headerInfo->frequency;
+    if (frame_offset < 0)
+    {
+        /* Not an MPEG stream, but the size is still known. */
+        g_free (buffer);
+        g_object_unref (istream);
+        return TRUE;
+    }
 
-        // Mode -> Seems to be detected but incorrect?!
-        switch (headerInfo->modeext)
+    et_mpeg_frame_parse_vbr_header (&buffer[frame_offset],
+                                    bytes_read - frame_offset, &frame, &vbr);
+    g_free (buffer);
+
+    audio_size = ETFileInfo->size - audio_offset - frame_offset;
+
+    /* Do not count an ID3v1 tag as audio. */
+    if (g_seekable_seek (G_SEEKABLE (istream), -128, G_SEEK_END, NULL, NULL)
+        && g_input_stream_read_all (G_INPUT_STREAM (istream), v1_query,
+                                    sizeof (v1_query), &bytes_read, NULL, NULL)
+        && bytes_read == sizeof (v1_query)
+        && memcmp (v1_query, "TAG", 3) == 0)
+    {
+        audio_size -= 128;
+    }
+
+    g_object_unref (istream);
+
+    audio_size = MAX (audio_size, 0);
+
+    ETFileInfo->version = frame.version;
+    ETFileInfo->mpeg25 = frame.mpeg25;
+    ETFileInfo->layer = frame.layer;
+    ETFileInfo->samplerate = frame.samplerate;
+    ETFileInfo->mode = frame.mode;
+
+    if (vbr.frames > 0)
+    {
+        guint64 samples;
+        guint64 trimmed;
+
+        /* The VBR header does not count itself as an audio frame. */
+        samples = (guint64)vbr.frames * frame.samples;
+        trimmed = vbr.encoder_delay + vbr.encoder_padding;
+
+        if (samples > trimmed)
         {
-            case MP3CHANNELMODE_STEREO:
-                ETFileInfo->mode = 0;
-                break;
-            case MP3CHANNELMODE_JOINT_STEREO:
-                ETFileInfo->mode = 1;
-                break;
-            case MP3CHANNELMODE_DUAL_CHANNEL:
-                ETFileInfo->mode = 2;
-                break;
-            case MP3CHANNELMODE_SINGLE_CHANNEL:
-                ETFileInfo->mode = 3;
-                break;
-            case MP3CHANNELMODE_FALSE:
-            default:
-                break;
+            samples -= trimmed;
         }
 
-        // Bitrate
-        if (headerInfo->vbr_bitrate <= 0)
-        {
-            ETFileInfo->variable_bitrate = FALSE;
-            ETFileInfo->bitrate = headerInfo->bitrate/1000;
-        }else
+        if (vbr.bytes > 0)
         {
-            ETFileInfo->variable_bitrate = TRUE;
-            ETFileInfo->bitrate = headerInfo->vbr_bitrate/1000;
+            audio_size = vbr.bytes;
         }
 
-        // Duration
-        ETFileInfo->duration = headerInfo->time;
+        ETFileInfo->variable_bitrate = vbr.type != ET_MPEG_VBR_INFO;
+        ETFileInfo->duration = samples / frame.samplerate;
+        ETFileInfo->bitrate = samples > 0 ? audio_size * 8 * frame.samplerate
+                                            / samples / 1000
+                                          : frame.bitrate;
+    }
+    else
+    {
+        ETFileInfo->variable_bitrate = FALSE;
+        ETFileInfo->bitrate = frame.bitrate;
+        ETFileInfo->duration = audio_size * 8 / (frame.bitrate * 1000);
     }
-
-    /* Free allocated data */
-    ID3Tag_Delete(id3_tag);
 
     return TRUE;
 }
@@ -283,4 +285,4 @@ et_mpeg_file_header_fields_free (EtFileHeaderFields *fields)
     g_slice_free (EtFileHeaderFields, fields);
 }
 
-#endif /* defined ENABLE_MP3 && defined ENABLE_ID3LIB */
+#endif /* ENABLE_MP3 */
@@ -23,6 +23,7 @@
 
 #include <glib/gi18n.h>
 #include <errno.h>
+#include <string.h>
 #include <vorbis/codec.h>
 #include <vorbis/vorbisfile.h>
 
@@ -184,6 +185,176 @@ et_ogg_tell_func (void *datasource)
     return g_seekable_tell (G_SEEKABLE (state->istream));
 }
 
+/* The largest possible Ogg page: a header with 255 lacing values, each for a
+ * segment of 255 bytes. */
+#define OGG_PAGE_SIZE_MAX (27 + 255 + 255 * 255)
+
+/* Enough for the first page, which only holds the identification header. */
+#define OGG_HEAD_SIZE 4096
+
+/* The size of the Vorbis identification header. */
+#define VORBIS_ID_HEADER_SIZE 30
+
+static guint32
+read_uint32_le (const guchar *data)
+{
+    return ((guint32)data[3] << 24) | ((guint32)data[2] << 16)
+           | ((guint32)data[1] << 8) | (guint32)data[0];
+}
+
+/*
+ * et_ogg_sync_read:
+ * @istream: the stream of the Ogg file
+ * @offset: where to read from
+ * @count: the number of bytes to read
+ * @sync: the sync state to pass the bytes to
+ *
+ * Read a part of the file, to get the Ogg pages from it.
+ *
+ * Returns: %TRUE on success, %FALSE otherwise
+ */
+static gboolean
+et_ogg_sync_read (GInputStream *istream,
+                  goffset offset,
+                  gsize count,
+                  ogg_sync_state *sync)
+{
+    char *buffer;
+    gsize bytes_read;
+
+    if (!g_seekable_seek (G_SEEKABLE (istream), offset, G_SEEK_SET, NULL,
+                          NULL))
+    {
+        return FALSE;
+    }
+
+    buffer = ogg_sync_buffer (sync, count);
+
+    if (!g_input_stream_read_all (istream, buffer, count, &bytes_read, NULL,
+                                  NULL))
+    {
+        return FALSE;
+    }
+
+    ogg_sync_wrote (sync, bytes_read);
+
+    return TRUE;
+}
+
+/*
+ * et_ogg_header_read_pages:
+ * @file: the Ogg file
+ * @ETFileInfo: the file information to fill
+ *
+ * Read the Vorbis identification header from the first page, and the total
+ * number of samples from the granule position of the last page, with a single
+ * bounded read at each end of the file. ov_open_callbacks() instead sets up a
+ * decoder and bisects the file to find the end of each logical stream.
+ *
+ * Returns: %TRUE on success, %FALSE if the file is not a single Vorbis stream
+ * which can be read this way, such as a chained or multiplexed stream
+ */
+static gboolean
+et_ogg_header_read_pages (GFile *file,
+                          ET_File_Info *ETFileInfo)
+{
+    GInputStream *istream;
+    ogg_sync_state sync;
+    ogg_page page;
+    const guchar *id_header;
+    int serialno;
+    ogg_int64_t granulepos = -1;
+    guint32 rate;
+    gint channels;
+    gint32 bitrate_nominal;
+    goffset tail;
+    int res;
+    gboolean success = FALSE;
+
+    istream = G_INPUT_STREAM (g_file_read (file, NULL, NULL));
+
+    if (!istream)
+    {
+        return FALSE;
+    }
+
+    ogg_sync_init (&sync);
+
+    if (!et_ogg_sync_read (istream, 0, OGG_HEAD_SIZE, &sync)
+        || ogg_sync_pageout (&sync, &page) != 1
+        || !ogg_page_bos (&page)
+        || page.body_len < VORBIS_ID_HEADER_SIZE)
+    {
+        goto out;
+    }
+
+    /* Packet type, "vorbis", version, channels, rate and bitrates. */
+    id_header = page.body;
+
+    if (id_header[0] != 1 || memcmp (&id_header[1], "vorbis", 6) != 0
+        || read_uint32_le (&id_header[7]) != 0)
+    {
+        goto out;
+    }
+
+    channels = id_header[11];
+    rate = read_uint32_le (&id_header[12]);
+    bitrate_nominal = (gint32)read_uint32_le (&id_header[20]);
+    serialno = ogg_page_serialno (&page);
+
+    if (channels == 0 || rate == 0)
+    {
+        goto out;
+    }
+
+    /* The last page starts in the last OGG_PAGE_SIZE_MAX bytes. */
+    ogg_sync_reset (&sync);
+    tail = MAX (0, ETFileInfo->size - OGG_PAGE_SIZE_MAX);
+
+    if (!et_ogg_sync_read (istream, tail, ETFileInfo->size - tail, &sync))
+    {
+        goto out;
+    }
+
+    /* Pages are only returned once their checksum was verified, so that
+     * audio data which looks like a page header is skipped. */
+    while ((res = ogg_sync_pageout (&sync, &page)) != 0)
+    {
+        if (res < 0)
+        {
+            continue;
+        }
+
+        if (ogg_page_serialno (&page) != serialno)
+        {
+            goto out;
+        }
+
+        if (ogg_page_granulepos (&page) >= 0)
+        {
+            granulepos = ogg_page_granulepos (&page);
+        }
+    }
+
+    if (granulepos < 0)
+    {
+        goto out;
+    }
+
+    ETFileInfo->version    = 0;
+    ETFileInfo->bitrate    = bitrate_nominal / 1000;
+    ETFileInfo->samplerate = rate;
+    ETFileInfo->mode       = channels;
+    ETFileInfo->duration   = granulepos / rate;
+    success = TRUE;
+
+out:
+    ogg_sync_clear (&sync);
+    g_object_unref (istream);
+
+    return success;
+}
+
 gboolean
 et_ogg_header_read_file_info (GFile *file,
                               ET_File_Info *ETFileInfo,
@@ -216,6 +387,13 @@ et_ogg_header_read_file_info (GFile *file,
     ETFileInfo->size = g_file_info_get_size (info);
     g_object_unref (info);
 
+    /* Most files are a single Vorbis stream, which is much quicker to read
+     * without vorbisfile. */
+    if (et_ogg_header_read_pages (file, ETFileInfo))
+    {
+        return TRUE;
+    }
+
     state.file = file;
     state.error = NULL;
     state.istream = G_INPUT_STREAM (g_file_read (state.file, NULL,
@@ -132,33 +132,21 @@ et_opus_open_file (GFile *gfile, GError **error)
 }
 
 /*
- * et_opus_read_file_info:
- * @file: file to read info from
+ * et_opus_read_file_info_from_file:
+ * @file: an opened Opus file
+ * @gfile: the file which @file was opened from
  * @ETFileInfo: ET_File_Info to put information into
- * @error: a GError or %NULL
  *
- * Read header information of an Opus file.
- *
- * Returns: %TRUE if successful otherwise %FALSE
+ * Read header information from an already opened Opus file.
  */
-gboolean
-et_opus_read_file_info (GFile *gfile, ET_File_Info *ETFileInfo,
-                        GError **error)
+void
+et_opus_read_file_info_from_file (OggOpusFile *file, GFile *gfile,
+                                  ET_File_Info *ETFileInfo)
 {
-    OggOpusFile *file;
     const OpusHead* head;
     GFileInfo *info;
 
-    g_return_val_if_fail (gfile != NULL && ETFileInfo != NULL, FALSE);
-    g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
-
-    file = et_opus_open_file (gfile, error);
-
-    if (!file)
-    {
-        g_assert (error == NULL || *error != NULL);
-        return FALSE;
-    }
+    g_return_if_fail (file != NULL && gfile != NULL && ETFileInfo != NULL);
 
     /* FIXME: Improve error-checking. */
     head = op_head (file, -1);
@@ -179,7 +167,6 @@ et_opus_read_file_info (GFile *gfile, ET_File_Info *ETFileInfo,
     }
 
     ETFileInfo->duration = op_pcm_total (file, -1) / 48000;
-    op_free (file);
 
     info = g_file_query_info (gfile, G_FILE_ATTRIBUTE_STANDARD_SIZE,
                               G_FILE_QUERY_INFO_NONE, NULL, NULL);
@@ -193,6 +180,37 @@ et_opus_read_file_info (GFile *gfile, ET_File_Info *ETFileInfo,
     {
         ETFileInfo->size = 0;
     }
+}
+
+/*
+ * et_opus_read_file_info:
+ * @file: file to read info from
+ * @ETFileInfo: ET_File_Info to put information into
+ * @error: a GError or %NULL
+ *
+ * Read header information of an Opus file.
+ *
+ * Returns: %TRUE if successful otherwise %FALSE
+ */
+gboolean
+et_opus_read_file_info (GFile *gfile, ET_File_Info *ETFileInfo,
+                        GError **error)
+{
+    OggOpusFile *file;
+
+    g_return_val_if_fail (gfile != NULL && ETFileInfo != NULL, FALSE);
+    g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+    file = et_opus_open_file (gfile, error);
+
+    if (!file)
+    {
+        g_assert (error == NULL || *error != NULL);
+        return FALSE;
+    }
+
+    et_opus_read_file_info_from_file (file, gfile, ETFileInfo);
+    op_free (file);
 
     g_assert (error == NULL || *error == NULL);
     return TRUE;
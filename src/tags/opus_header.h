@@ -59,6 +59,7 @@ typedef enum
 } EtOpusError;
 
 gboolean et_opus_read_file_info (GFile *gfile, ET_File_Info *ETFileInfo, GError **error);
+void et_opus_read_file_info_from_file (OggOpusFile *file, GFile *gfile, ET_File_Info *ETFileInfo);
 OggOpusFile * et_opus_open_file (GFile *gfile, GError **error);
 EtFileHeaderFields * et_opus_header_display_file_info_to_ui (const ET_File *ETFile);
 void et_opus_file_header_fields_free (EtFileHeaderFields *fields);
@@ -41,15 +41,19 @@
  * et_opus_tag_read_file_tag:
  * @filename: file from which to read tags
  * @FileTag: File_Tag to read tag into
+ * @ETFileInfo: (allow-none): ET_File_Info to read header information into,
+ *              or %NULL
  * @error: a GError or %NULL
  *
- * Read file tags and store into File_Tag.
+ * Read file tags and store into File_Tag. If @ETFileInfo is not %NULL, the
+ * header information is read from the same opened file, so that the file is
+ * only opened and parsed once.
  *
  * Returns: %TRUE if successful otherwise %FALSE
  */
 gboolean
 et_opus_tag_read_file_tag (GFile *gfile, File_Tag *FileTag,
-                           GError **error)
+                           ET_File_Info *ETFileInfo, GError **error)
 {
     OggOpusFile *file;
     const OpusTags *tags;
@@ -70,6 +74,11 @@ et_opus_tag_read_file_tag (GFile *gfile, File_Tag *FileTag,
     /* The cast is safe according to the opusfile documentation. */
     et_add_file_tags_from_vorbis_comments ((vorbis_comment *)tags, FileTag);
 
+    if (ETFileInfo)
+    {
+        et_opus_read_file_info_from_file (file, gfile, ETFileInfo);
+    }
+
     op_free (file);
 
     g_assert (error == NULL || *error == NULL);
@@ -24,7 +24,7 @@
 
 G_BEGIN_DECLS
 
-gboolean et_opus_tag_read_file_tag (GFile *file, File_Tag *FileTag, GError **error);
+gboolean et_opus_tag_read_file_tag (GFile *file, File_Tag *FileTag, ET_File_Info *ETFileInfo, GError **error);
 
 G_END_DECLS
 
@@ -29,6 +29,7 @@
 
 #include "vcedit.h"
 #include "ogg_header.h"
+#include "save_journal.h"
 
 #define CHUNKSIZE 4096
 
@@ -56,6 +57,11 @@ struct _EtOggState
     gint prevW;
     gint extrapage;
     gint eosin;
+    /* Size and number of the pages holding the header packets at the start
+     * of the file, used to rewrite them in place, or 0 if they are
+     * interleaved with other data. */
+    goffset header_bytes;
+    gint header_pages;
 };
 
 EtOggState *
@@ -160,7 +166,8 @@ _v_writestring (oggpack_buffer *o,
 
 static int
 _commentheader_out (EtOggState *state,
-                    ogg_packet *op)
+                    ogg_packet *op,
+                    gsize padding)
 {
     vorbis_comment *vc = state->vc;
     const gchar *vendor = state->vendor;
@@ -209,6 +216,13 @@ _commentheader_out (EtOggState *state,
 
     oggpack_write (&opb, 1, 1);
 
+    /* Padding after the framing bit is ignored by decoders, and lets the
+     * header keep its size when the comments change. */
+    while (padding--)
+    {
+        oggpack_write (&opb, 0, 8);
+    }
+
     op->packet = _ogg_malloc (oggpack_bytes (&opb));
     memcpy (op->packet, opb.buffer, oggpack_bytes (&opb));
 
@@ -387,8 +401,10 @@ vcedit_open (EtOggState *state,
     char *buffer;
     gssize bytes;
     int i;
+    int result;
     int chunks = 0;
     int headerpackets = 0;
+    gboolean header_contiguous = TRUE;
     oggpack_buffer opb;
     ogg_packet *header;
     ogg_packet  header_main;
@@ -423,8 +439,12 @@ vcedit_open (EtOggState *state,
 
         ogg_sync_wrote(state->oy, bytes);
 
-        if(ogg_sync_pageout(state->oy, &og) == 1)
+        result = ogg_sync_pageout (state->oy, &og);
+
+        if (result == 1)
             break;
+        else if (result < 0)
+            header_contiguous = FALSE; /* Skipped data before the page. */
 
         if(chunks++ >= 10) /* Bail if we don't find data in the first 40 kB */
         {
@@ -439,6 +459,8 @@ vcedit_open (EtOggState *state,
     }
 
     state->serial = ogg_page_serialno(&og);
+    state->header_bytes = og.header_len + og.body_len;
+    state->header_pages = 1;
 
     state->os = g_slice_new (ogg_stream_state);
     ogg_stream_init (state->os, state->serial);
@@ -538,14 +560,26 @@ vcedit_open (EtOggState *state,
     {
         while (i < headerpackets)
         {
-            int result = ogg_sync_pageout (state->oy, &og);
+            result = ogg_sync_pageout (state->oy, &og);
 
             if (result == 0)
             {
                 break; /* Too little data so far */
             }
+            else if (result < 0)
+            {
+                header_contiguous = FALSE;
+            }
             else if (result == 1)
             {
+                if (ogg_page_serialno (&og) != state->serial)
+                {
+                    /* Multiplexed with another logical stream. */
+                    header_contiguous = FALSE;
+                }
+
+                state->header_bytes += og.header_len + og.body_len;
+                state->header_pages++;
                 ogg_stream_pagein (state->os, &og);
 
                 while (i < headerpackets)
@@ -662,6 +696,16 @@ vcedit_open (EtOggState *state,
     /* Copy the vendor tag */
     state->vendor = g_strdup (state->vc->vendor);
 
+    /* The header pages can only be rewritten in place if they contain
+     * nothing but the header packets, which is required by the
+     * specifications, but not checked by libogg. */
+    if (!header_contiguous
+        || state->os->lacing_returned != state->os->lacing_fill)
+    {
+        state->header_bytes = 0;
+        state->header_pages = 0;
+    }
+
     /* Headers are done! */
     g_assert (error == NULL || *error == NULL);
 
@@ -673,16 +717,244 @@ err:
     return FALSE;
 }
 
+/*
+ * _header_packets_in:
+ * @state: the Ogg state
+ * @streamout: the stream to add the header packets to
+ * @padding: the number of bytes of padding to add to the comment header
+ *
+ * Add the header packets, with the current comments, to @streamout.
+ */
+static void
+_header_packets_in (EtOggState *state,
+                    ogg_stream_state *streamout,
+                    gsize padding)
+{
+    ogg_packet header_main;
+    ogg_packet header_comments;
+    ogg_packet header_codebooks;
+
+    header_main.bytes = state->mainlen;
+    header_main.packet = state->mainbuf;
+    header_main.b_o_s = 1;
+    header_main.e_o_s = 0;
+    header_main.granulepos = 0;
+
+    header_codebooks.bytes = state->booklen;
+    header_codebooks.packet = state->bookbuf;
+    header_codebooks.b_o_s = 0;
+    header_codebooks.e_o_s = 0;
+    header_codebooks.granulepos = 0;
+
+    _commentheader_out (state, &header_comments, padding);
+
+    ogg_stream_packetin (streamout, &header_main);
+    ogg_stream_packetin (streamout, &header_comments);
+
+    if (state->oggtype == ET_OGG_KIND_VORBIS)
+    {
+        ogg_stream_packetin (streamout, &header_codebooks);
+    }
+
+    /* The stream keeps its own copy of the packets. */
+    ogg_packet_clear (&header_comments);
+}
+
+/*
+ * _header_pages_out:
+ * @state: the Ogg state
+ * @padding: the number of bytes of padding to add to the comment header
+ * @pages: the array to store the header pages in
+ *
+ * Render the header pages, with the current comments, to @pages.
+ *
+ * Returns: the number of pages
+ */
+static gint
+_header_pages_out (EtOggState *state,
+                   gsize padding,
+                   GByteArray *pages)
+{
+    ogg_stream_state streamout;
+    ogg_page ogout;
+    gint n_pages = 0;
+
+    ogg_stream_init (&streamout, state->serial);
+    _header_packets_in (state, &streamout, padding);
+
+    g_byte_array_set_size (pages, 0);
+
+    while (ogg_stream_flush (&streamout, &ogout))
+    {
+        g_byte_array_append (pages, ogout.header, ogout.header_len);
+        g_byte_array_append (pages, ogout.body, ogout.body_len);
+        n_pages++;
+    }
+
+    ogg_stream_clear (&streamout);
+
+    return n_pages;
+}
+
+/*
+ * _header_pages_equal:
+ * @state: the Ogg state
+ * @pages: the new header pages
+ * @error: a #GError to provide information on errors, or %NULL to ignore
+ *
+ * Compare @pages with the header pages at the start of the input file, so
+ * that unchanged comments are not written again, which would only change the
+ * modification time of the file.
+ *
+ * Returns: %TRUE if the header pages are the same, %FALSE otherwise or on
+ *          error
+ */
+static gboolean
+_header_pages_equal (EtOggState *state,
+                     const GByteArray *pages,
+                     GError **error)
+{
+    guchar *data;
+    gsize bytes_read;
+    gboolean equal;
+
+    g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+    if (!g_seekable_seek (G_SEEKABLE (state->in), 0, G_SEEK_SET, NULL, error))
+    {
+        return FALSE;
+    }
+
+    data = g_malloc (pages->len);
+
+    if (!g_input_stream_read_all (G_INPUT_STREAM (state->in), data,
+                                  pages->len, &bytes_read, NULL, error))
+    {
+        g_free (data);
+        return FALSE;
+    }
+
+    equal = (bytes_read == pages->len
+             && memcmp (data, pages->data, pages->len) == 0);
+    g_free (data);
+
+    return equal;
+}
+
+/*
+ * _write_header_in_place:
+ * @state: the Ogg state
+ * @file: the file to write to
+ * @error: a #GError to provide information on errors, or %NULL to ignore
+ *
+ * Overwrite the header pages at the start of @file, if the new headers can
+ * be padded to exactly the same size and number of pages. The audio pages,
+ * whose sequence numbers follow the header pages, are then left untouched.
+ * If the new header pages are the same as the old ones, nothing is written.
+ *
+ * Returns: %TRUE if the headers were written, %FALSE with @error set if
+ *          writing failed, or %FALSE with @error unset if the headers do not
+ *          fit and the whole stream must be rewritten
+ */
+static gboolean
+_write_header_in_place (EtOggState *state,
+                        GFile *file,
+                        GError **error)
+{
+    GByteArray *pages;
+    GFileIOStream *iostream;
+    GOutputStream *ostream;
+    gssize padding = 0;
+    gboolean fits = FALSE;
+    gint tries;
+    gsize bytes_written;
+    GError *tmp_error = NULL;
+
+    g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+    if (state->header_bytes == 0)
+    {
+        return FALSE;
+    }
+
+    pages = g_byte_array_new ();
+
+    /* Each byte of padding adds at least one byte to the pages, so converge
+     * on the size of the old pages. The segment and page overhead can make
+     * an exact match impossible, in which case the stream is rewritten. */
+    for (tries = 0; tries < 8 && padding >= 0; tries++)
+    {
+        gint n_pages = _header_pages_out (state, padding, pages);
+
+        if ((goffset)pages->len == state->header_bytes
+            && n_pages == state->header_pages)
+        {
+            fits = TRUE;
+            break;
+        }
+
+        padding += state->header_bytes - (goffset)pages->len;
+    }
+
+    if (!fits)
+    {
+        g_byte_array_unref (pages);
+        return FALSE;
+    }
+
+    if (_header_pages_equal (state, pages, &tmp_error))
+    {
+        g_byte_array_unref (pages);
+        return TRUE;
+    }
+    else if (tmp_error)
+    {
+        g_propagate_error (error, tmp_error);
+        g_byte_array_unref (pages);
+        return FALSE;
+    }
+
+    if (!et_save_journal_backup (file, 0, pages->len, error))
+    {
+        g_byte_array_unref (pages);
+        return FALSE;
+    }
+
+    iostream = g_file_open_readwrite (file, NULL, error);
+
+    if (!iostream)
+    {
+        g_byte_array_unref (pages);
+        g_assert (error == NULL || *error != NULL);
+        return FALSE;
+    }
+
+    ostream = g_io_stream_get_output_stream (G_IO_STREAM (iostream));
+
+    if (!g_output_stream_write_all (ostream, pages->data, pages->len,
+                                    &bytes_written, NULL, error)
+        || !g_io_stream_close (G_IO_STREAM (iostream), NULL, error))
+    {
+        g_debug ("Only %" G_GSIZE_FORMAT " bytes out of %u bytes of data "
+                 "were written", bytes_written, pages->len);
+        g_object_unref (iostream);
+        g_byte_array_unref (pages);
+        g_assert (error == NULL || *error != NULL);
+        return FALSE;
+    }
+
+    g_object_unref (iostream);
+    g_byte_array_unref (pages);
+
+    return TRUE;
+}
+
 gboolean
 vcedit_write (EtOggState *state,
               GFile *file,
               GError **error)
 {
     ogg_stream_state streamout;
-    ogg_packet header_main;
-    ogg_packet header_comments;
-    ogg_packet header_codebooks;
-
     ogg_page ogout, ogin;
     ogg_packet op;
     ogg_int64_t granpos = 0;
@@ -690,53 +962,42 @@ vcedit_write (EtOggState *state,
     char *buffer;
     int bytes;
     int needflush = 0, needout = 0;
+    GFile *tmp_file;
+    GFileIOStream *tmp_stream;
     GOutputStream *ostream;
-    gchar *buf;
-    gsize size;
-    GFileInfo *fileinfo;
+    GError *tmp_error = NULL;
 
     g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 
-    fileinfo = g_file_query_info (file, G_FILE_ATTRIBUTE_STANDARD_SIZE,
-                                  G_FILE_QUERY_INFO_NONE, NULL, error);
-    if (!fileinfo)
+    /* Only the header pages need to be written if the new comments fit in
+     * them. */
+    if (_write_header_in_place (state, file, &tmp_error))
+    {
+        return TRUE;
+    }
+    else if (tmp_error)
+    {
+        g_propagate_error (error, tmp_error);
+        return FALSE;
+    }
+
+    /* Otherwise stream the rewritten pages to a temporary file, which then
+     * replaces the original one. */
+    tmp_file = et_save_journal_new_temporary (file, &tmp_stream, error);
+
+    if (!tmp_file)
     {
         g_assert (error == NULL || *error != NULL);
         return FALSE;
     }
 
-    buf = g_malloc (g_file_info_get_size (fileinfo));
-    ostream = g_memory_output_stream_new (buf,
-                                          g_file_info_get_size (fileinfo),
-                                          g_realloc, g_free);
-    g_object_unref (fileinfo);
+    ostream = g_io_stream_get_output_stream (G_IO_STREAM (tmp_stream));
 
     state->eosin = 0;
     state->extrapage = 0;
 
-    header_main.bytes = state->mainlen;
-    header_main.packet = state->mainbuf;
-    header_main.b_o_s = 1;
-    header_main.e_o_s = 0;
-    header_main.granulepos = 0;
-
-    header_codebooks.bytes = state->booklen;
-    header_codebooks.packet = state->bookbuf;
-    header_codebooks.b_o_s = 0;
-    header_codebooks.e_o_s = 0;
-    header_codebooks.granulepos = 0;
-
     ogg_stream_init (&streamout, state->serial);
-
-    _commentheader_out (state, &header_comments);
-
-    ogg_stream_packetin (&streamout, &header_main);
-    ogg_stream_packetin (&streamout, &header_comments);
-
-    if (state->oggtype == ET_OGG_KIND_VORBIS)
-    {
-        ogg_stream_packetin (&streamout, &header_codebooks);
-    }
+    _header_packets_in (state, &streamout, 0);
 
     while ((result = ogg_stream_flush (&streamout, &ogout)))
     {
@@ -998,7 +1259,6 @@ vcedit_write (EtOggState *state,
 
 cleanup:
     ogg_stream_clear (&streamout);
-    ogg_packet_clear (&header_comments);
 
     g_free (state->mainbuf);
     g_free (state->bookbuf);
@@ -1015,36 +1275,39 @@ cleanup:
 
     if (error == NULL || *error != NULL)
     {
-        g_object_unref (ostream);
+        g_io_stream_close (G_IO_STREAM (tmp_stream), NULL, NULL);
+        g_object_unref (tmp_stream);
+        g_file_delete (tmp_file, NULL, NULL);
+        g_object_unref (tmp_file);
         return FALSE;
     }
 
     g_assert (error == NULL || *error == NULL);
 
-    if (!g_output_stream_close (ostream, NULL, error))
+    if (!g_io_stream_close (G_IO_STREAM (tmp_stream), NULL, error))
     {
-        g_object_unref (ostream);
+        g_object_unref (tmp_stream);
+        g_file_delete (tmp_file, NULL, NULL);
+        g_object_unref (tmp_file);
         g_assert (error == NULL || *error != NULL);
         return FALSE;
     }
 
-    g_assert (error == NULL || *error == NULL);
+    g_object_unref (tmp_stream);
 
-    buf = g_memory_output_stream_steal_data (G_MEMORY_OUTPUT_STREAM (ostream));
-    size = g_memory_output_stream_get_data_size (G_MEMORY_OUTPUT_STREAM (ostream));
+    /* The whole input was read, so close it before replacing the file. */
+    g_input_stream_close (G_INPUT_STREAM (state->in), NULL, NULL);
 
-    /* Write the in-memory data back out to the original file. */
-    if (!g_file_replace_contents (file, buf, size, NULL, FALSE,
-                                  G_FILE_CREATE_NONE, NULL, NULL, error))
+    /* Keep the permissions of the original file, and record the temporary
+     * file as ready in the save journal. */
+    if (!et_save_journal_replace (tmp_file, file, error))
     {
-       g_object_unref (ostream);
-       g_free (buf);
-       g_assert (error == NULL || *error != NULL);
-       return FALSE;
+        g_object_unref (tmp_file);
+        g_assert (error == NULL || *error != NULL);
+        return FALSE;
     }
 
-    g_free (buf);
-    g_object_unref (ostream);
+    g_object_unref (tmp_file);
 
     return TRUE;
 }
@@ -21,6 +21,8 @@
 /* For EOF. */
 #include <stdio.h>
 
+#include "save_journal.h"
+
 int32_t
 wavpack_read_bytes (void *id,
                     void *data,
@@ -170,6 +172,13 @@ wavpack_write_bytes (void *id,
 
     state = (EtWavpackWriteState *)id;
 
+    if (!et_save_journal_backup (state->file,
+                                 g_seekable_tell (state->seekable), bcount,
+                                 &state->error))
+    {
+        return 0;
+    }
+
     bytes_written = g_output_stream_write (G_OUTPUT_STREAM (state->ostream),
                                            data, bcount, NULL, &state->error);
 
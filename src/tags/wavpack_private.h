@@ -44,6 +44,8 @@ typedef struct
     /* End fields copied from EtWavpackState. */
     GFileIOStream *iostream;
     GFileOutputStream *ostream;
+    /* To back up the data which is overwritten in the save journal. */
+    GFile *file;
 } EtWavpackWriteState;
 
 int32_t wavpack_read_bytes (void *id, void *data, int32_t bcount);
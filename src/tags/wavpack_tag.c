@@ -34,8 +34,6 @@
 #include "wavpack_private.h"
 #include "wavpack_tag.h"
 
-#define MAXLEN 1024
-
 /*
  * For the APEv2 tags, the following field names are officially supported and
  * recommended by WavPack (although there are no restrictions on what field names
@@ -58,251 +56,453 @@
  */
 
 /*
- * Read tag data from a Wavpack file.
+ * EtWavpackTagFieldType:
+ * @ET_WAVPACK_TAG_FIELD_TEXT: a text field of the File_Tag
+ * @ET_WAVPACK_TAG_FIELD_DISC: the disc number, with an optional disc total
+ * @ET_WAVPACK_TAG_FIELD_TRACK: the track number, with an optional track total
+ *
+ * How the value of an APEv2 item is stored in a File_Tag.
  */
-gboolean
-wavpack_tag_read_file_tag (GFile *file,
-                           File_Tag *FileTag,
-                           GError **error)
+typedef enum
 {
-    WavpackStreamReader reader = { wavpack_read_bytes, wavpack_get_pos,
-                                   wavpack_set_pos_abs, wavpack_set_pos_rel,
-                                   wavpack_push_back_byte, wavpack_get_length,
-                                   wavpack_can_seek, NULL /* No writing. */ };
-    EtWavpackState state;
-    WavpackContext *wpc;
-    gchar message[80];
-    gchar field[MAXLEN] = { 0, };
-    gchar *field2;
-    guint length;
-    const int open_flags = OPEN_TAGS;
+    ET_WAVPACK_TAG_FIELD_TEXT,
+    ET_WAVPACK_TAG_FIELD_DISC,
+    ET_WAVPACK_TAG_FIELD_TRACK
+} EtWavpackTagFieldType;
 
-    g_return_val_if_fail (file != NULL && FileTag != NULL, FALSE);
-    g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+typedef struct
+{
+    const gchar *name;
+    EtWavpackTagFieldType type;
+    /* Offset of the File_Tag field, for text fields. */
+    glong offset;
+} EtWavpackTagField;
+
+/* The APEv2 items which are read into a File_Tag. */
+static const EtWavpackTagField tag_fields[] =
+{
+    { "title", ET_WAVPACK_TAG_FIELD_TEXT, G_STRUCT_OFFSET (File_Tag, title) },
+    { "artist", ET_WAVPACK_TAG_FIELD_TEXT,
+      G_STRUCT_OFFSET (File_Tag, artist) },
+    { "album artist", ET_WAVPACK_TAG_FIELD_TEXT,
+      G_STRUCT_OFFSET (File_Tag, album_artist) },
+    { "album", ET_WAVPACK_TAG_FIELD_TEXT, G_STRUCT_OFFSET (File_Tag, album) },
+    { "part", ET_WAVPACK_TAG_FIELD_DISC, 0 },
+    { "year", ET_WAVPACK_TAG_FIELD_TEXT, G_STRUCT_OFFSET (File_Tag, year) },
+    { "track", ET_WAVPACK_TAG_FIELD_TRACK, 0 },
+    { "genre", ET_WAVPACK_TAG_FIELD_TEXT, G_STRUCT_OFFSET (File_Tag, genre) },
+    { "comment", ET_WAVPACK_TAG_FIELD_TEXT,
+      G_STRUCT_OFFSET (File_Tag, comment) },
+    { "composer", ET_WAVPACK_TAG_FIELD_TEXT,
+      G_STRUCT_OFFSET (File_Tag, composer) },
+    { "original artist", ET_WAVPACK_TAG_FIELD_TEXT,
+      G_STRUCT_OFFSET (File_Tag, orig_artist) },
+    { "copyright", ET_WAVPACK_TAG_FIELD_TEXT,
+      G_STRUCT_OFFSET (File_Tag, copyright) },
+    { "copyright url", ET_WAVPACK_TAG_FIELD_TEXT,
+      G_STRUCT_OFFSET (File_Tag, url) },
+    { "encoded by", ET_WAVPACK_TAG_FIELD_TEXT,
+      G_STRUCT_OFFSET (File_Tag, encoded_by) }
+};
+
+/* Sizes of the APEv2 tag footer and of an ID3v1 tag which may follow it. */
+#define ET_WAVPACK_APE_FOOTER_SIZE 32
+#define ET_WAVPACK_ID3V1_TAG_SIZE 128
+/* Larger APEv2 tags are ignored, as they are by WavPack. */
+#define ET_WAVPACK_APE_TAG_MAX_SIZE (16 * 1024 * 1024)
+/* Bits of the APEv2 item flags which give the type of the value. */
+#define ET_WAVPACK_APE_ITEM_TYPE_MASK 0x6
 
-    state.error = NULL;
-    state.istream = g_file_read (file, NULL, &state.error);
+/*
+ * et_wavpack_tag_field_lookup:
+ * @name: the key of an APEv2 item
+ *
+ * Item keys are case-insensitive.
+ *
+ * Returns: the entry of tag_fields for @name, or %NULL if the item is not
+ *          read into a File_Tag
+ */
+static const EtWavpackTagField *
+et_wavpack_tag_field_lookup (const gchar *name)
+{
+    gsize i;
 
-    if (!state.istream)
+    for (i = 0; i < G_N_ELEMENTS (tag_fields); i++)
     {
-        g_propagate_error (error, state.error);
-        return FALSE;
+        if (g_ascii_strcasecmp (name, tag_fields[i].name) == 0)
+        {
+            return &tag_fields[i];
+        }
     }
 
-    state.seekable = G_SEEKABLE (state.istream);
-
-    /* NULL for the WavPack correction file. */
-    wpc = WavpackOpenFileInputEx (&reader, &state, NULL, message, open_flags,
-                                  0);
+    return NULL;
+}
 
-    if (wpc == NULL)
+/*
+ * et_wavpack_tag_set_field:
+ * @FileTag: the tag to fill
+ * @tag_field: the field which @value is for
+ * @value: (transfer none): the value of the item, which may be modified
+ *
+ * Sets the field of @FileTag given by @tag_field from @value, unless it was
+ * already set by an earlier item.
+ */
+static void
+et_wavpack_tag_set_field (File_Tag *FileTag,
+                          const EtWavpackTagField *tag_field,
+                          gchar *value)
+{
+    switch (tag_field->type)
     {
-        if (state.error)
+        case ET_WAVPACK_TAG_FIELD_TEXT:
         {
-            g_propagate_error (error, state.error);
+            gchar **field = G_STRUCT_MEMBER_P (FileTag, tag_field->offset);
+
+            if (*field == NULL)
+            {
+                *field = Try_To_Validate_Utf8_String (value);
+            }
+            break;
         }
-        else
+        case ET_WAVPACK_TAG_FIELD_DISC:
+        case ET_WAVPACK_TAG_FIELD_TRACK:
         {
-            g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED, "%s",
-                         message);
+            const gboolean disc = tag_field->type
+                                  == ET_WAVPACK_TAG_FIELD_DISC;
+            gchar **number = disc ? &FileTag->disc_number : &FileTag->track;
+            gchar **total = disc ? &FileTag->disc_total
+                                 : &FileTag->track_total;
+            gchar *value2;
+            gchar *tmp;
+
+            /* Need to cut off the total if present */
+            value2 = g_utf8_strchr (value, -1, '/');
+
+            if (value2)
+            {
+                *value2 = 0;
+                value2++;
+
+                if (*total == NULL)
+                {
+                    tmp = Try_To_Validate_Utf8_String (value2);
+                    *total = disc ? et_disc_number_to_string (atoi (tmp))
+                                  : et_track_number_to_string (atoi (tmp));
+                    g_free (tmp);
+                }
+            }
+
+            if (*number == NULL)
+            {
+                tmp = Try_To_Validate_Utf8_String (value);
+                *number = disc ? et_disc_number_to_string (atoi (tmp))
+                               : et_track_number_to_string (atoi (tmp));
+                g_free (tmp);
+            }
+            break;
         }
-
-        g_object_unref (state.istream);
-        return FALSE;
-    }
-
-    /*
-     * Title
-     */
-    length = WavpackGetTagItem(wpc, "title", field, MAXLEN);
-
-    if ( length > 0 && FileTag->title == NULL ) {
-        FileTag->title = Try_To_Validate_Utf8_String(field);
+        default:
+            g_assert_not_reached ();
     }
+}
 
-    memset (field, '\0', MAXLEN);
-
-    /*
-     * Artist
-     */
-    length = WavpackGetTagItem(wpc, "artist", field, MAXLEN);
+/*
+ * et_wavpack_read_at:
+ * @state: the state of the stream to read from
+ * @offset: the offset from the start of the file to read from
+ * @buffer: the buffer to read into
+ * @count: the number of bytes to read
+ * @complete: (out): set to %FALSE if the file ended before @count bytes
+ *
+ * Returns: %TRUE on success, %FALSE with the error of @state set otherwise
+ */
+static gboolean
+et_wavpack_read_at (EtWavpackState *state,
+                    goffset offset,
+                    guchar *buffer,
+                    gsize count,
+                    gboolean *complete)
+{
+    gsize bytes_read;
 
-    if ( length > 0 && FileTag->artist == NULL) {
-        FileTag->artist = Try_To_Validate_Utf8_String(field);
+    if (!g_seekable_seek (state->seekable, offset, G_SEEK_SET, NULL,
+                          &state->error)
+        || !g_input_stream_read_all (G_INPUT_STREAM (state->istream), buffer,
+                                     count, &bytes_read, NULL, &state->error))
+    {
+        return FALSE;
     }
 
-    memset (field, '\0', MAXLEN);
+    *complete = bytes_read == count;
 
-    /* Album artist. */
-    length = WavpackGetTagItem (wpc, "album artist", field, MAXLEN);
+    return TRUE;
+}
 
-    if (length > 0 && FileTag->album_artist == NULL)
+/*
+ * et_wavpack_tag_read_ape_items:
+ * @state: the state of the stream of the WavPack file
+ * @FileTag: the tag to fill
+ * @found: (out): set to %TRUE if the file ends with an APEv2 tag
+ *
+ * WavPack can only return the value of an item by its key, which searches
+ * the items of the tag again, so the APEv2 tag at the end of the file (or
+ * before a trailing ID3v1 tag) is instead read with a single read, and its
+ * items are parsed in a single pass.
+ *
+ * Returns: %TRUE on success, %FALSE with the error of @state set otherwise
+ */
+static gboolean
+et_wavpack_tag_read_ape_items (EtWavpackState *state,
+                               File_Tag *FileTag,
+                               gboolean *found)
+{
+    guchar footer[ET_WAVPACK_APE_FOOTER_SIZE];
+    guchar id3v1[3];
+    goffset size;
+    goffset footer_offset;
+    guint32 tag_size;
+    guint32 n_items;
+    gsize items_size;
+    guchar *items;
+    const guchar *p;
+    const guchar *end;
+    gboolean complete;
+    guint32 i;
+
+    *found = FALSE;
+
+    if (!g_seekable_seek (state->seekable, 0, G_SEEK_END, NULL,
+                          &state->error))
     {
-        FileTag->album_artist = Try_To_Validate_Utf8_String (field);
+        return FALSE;
     }
 
-    memset (field, '\0', MAXLEN);
+    size = g_seekable_tell (state->seekable);
+    footer_offset = size - ET_WAVPACK_APE_FOOTER_SIZE;
 
-    /*
-     * Album
-     */
-    length = WavpackGetTagItem(wpc, "album", field, MAXLEN);
+    if (size >= ET_WAVPACK_ID3V1_TAG_SIZE + ET_WAVPACK_APE_FOOTER_SIZE)
+    {
+        if (!et_wavpack_read_at (state, size - ET_WAVPACK_ID3V1_TAG_SIZE,
+                                 id3v1, sizeof (id3v1), &complete))
+        {
+            return FALSE;
+        }
 
-    if ( length > 0 && FileTag->album == NULL ) {
-        FileTag->album = Try_To_Validate_Utf8_String(field);
+        if (complete && memcmp (id3v1, "TAG", sizeof (id3v1)) == 0)
+        {
+            footer_offset -= ET_WAVPACK_ID3V1_TAG_SIZE;
+        }
     }
 
-    memset (field, '\0', MAXLEN);
-
-    /*
-     * Discnumber + Disctotal.
-     */
-    length = WavpackGetTagItem (wpc, "part", field, MAXLEN);
-    field2 = g_utf8_strchr (field, -1, '/');
-
-    /* Need to cut off the total tracks if present */
-    if (field2)
+    if (footer_offset < 0)
     {
-        *field2 = 0;
-        field2++;
+        return TRUE;
     }
 
-    if (field2 && FileTag->disc_total == NULL)
+    if (!et_wavpack_read_at (state, footer_offset, footer, sizeof (footer),
+                             &complete))
     {
-        gchar *tmp;
-
-        tmp = Try_To_Validate_Utf8_String (field2);
-        FileTag->disc_total = et_disc_number_to_string (atoi (tmp));
-        g_free (tmp);
+        return FALSE;
     }
 
-    if (length > 0 && FileTag->disc_number == NULL)
+    if (!complete || memcmp (footer, "APETAGEX", 8) != 0)
     {
-        gchar *tmp;
-
-        tmp = Try_To_Validate_Utf8_String (field);
-        FileTag->disc_number = et_disc_number_to_string (atoi (tmp));
-        g_free (tmp);
+        return TRUE;
     }
 
-    memset (field, '\0', MAXLEN);
-
-    /*
-     * Year
-     */
-    length = WavpackGetTagItem(wpc, "year", field, MAXLEN);
+    /* The tag size includes the footer, but not the optional header. */
+    tag_size = footer[12] | (footer[13] << 8) | (footer[14] << 16)
+               | ((guint32)footer[15] << 24);
+    n_items = footer[16] | (footer[17] << 8) | (footer[18] << 16)
+              | ((guint32)footer[19] << 24);
 
-    if ( length > 0 && FileTag->year == NULL ) {
-        FileTag->year = Try_To_Validate_Utf8_String(field);
+    if (tag_size < ET_WAVPACK_APE_FOOTER_SIZE
+        || tag_size > ET_WAVPACK_APE_TAG_MAX_SIZE
+        || tag_size - ET_WAVPACK_APE_FOOTER_SIZE > footer_offset)
+    {
+        return TRUE;
     }
 
-    memset (field, '\0', MAXLEN);
-
-    /*
-     * Tracknumber + tracktotal
-     */
-    length = WavpackGetTagItem(wpc, "track", field, MAXLEN);
-    field2 = g_utf8_strchr(field, -1, '/');
+    items_size = tag_size - ET_WAVPACK_APE_FOOTER_SIZE;
+    items = g_malloc (items_size);
 
-    /* Need to cut off the total tracks if present */
-    if (field2) {
-        *field2 = 0;
-        field2++;
+    if (!et_wavpack_read_at (state, footer_offset - items_size, items,
+                             items_size, &complete))
+    {
+        g_free (items);
+        return FALSE;
     }
 
-    if (field2 && FileTag->track_total == NULL)
+    if (!complete)
     {
-        gchar *tmp;
-
-        tmp = Try_To_Validate_Utf8_String (field2);
-        FileTag->track_total = et_track_number_to_string (atoi (tmp));
-        g_free (tmp);
+        g_free (items);
+        return TRUE;
     }
 
-    if (length > 0 && FileTag->track == NULL)
+    *found = TRUE;
+    p = items;
+    end = items + items_size;
+
+    /* Each item is the size of its value and its flags, both 32-bit little
+     * endian, then its key terminated by a nul, and then its value. */
+    for (i = 0; i < n_items && end - p >= 8; i++)
     {
-        gchar *tmp;
+        const EtWavpackTagField *tag_field;
+        const guchar *key;
+        const guchar *key_end;
+        guint32 value_size;
+        guint32 item_flags;
+
+        value_size = p[0] | (p[1] << 8) | (p[2] << 16)
+                     | ((guint32)p[3] << 24);
+        item_flags = p[4] | (p[5] << 8) | (p[6] << 16)
+                     | ((guint32)p[7] << 24);
+        key = p + 8;
+        key_end = memchr (key, '\0', end - key);
+
+        if (key_end == NULL || value_size > (gsize)(end - key_end - 1))
+        {
+            break;
+        }
 
-        tmp = Try_To_Validate_Utf8_String (field);
-        FileTag->track = et_track_number_to_string (atoi (tmp));
-        g_free (tmp);
-    }
+        p = key_end + 1 + value_size;
 
-    memset (field, '\0', MAXLEN);
+        /* Only UTF-8 text items are read, as with WavpackGetTagItem(). */
+        if (value_size == 0
+            || (item_flags & ET_WAVPACK_APE_ITEM_TYPE_MASK) != 0)
+        {
+            continue;
+        }
+
+        tag_field = et_wavpack_tag_field_lookup ((const gchar *)key);
 
-    /*
-     * Genre
-     */
-    length = WavpackGetTagItem(wpc, "genre", field, MAXLEN);
+        if (tag_field != NULL)
+        {
+            gchar *value = g_strndup ((const gchar *)key_end + 1,
+                                      value_size);
 
-    if ( length > 0 && FileTag->genre == NULL ) {
-        FileTag->genre = Try_To_Validate_Utf8_String(field);
+            et_wavpack_tag_set_field (FileTag, tag_field, value);
+            g_free (value);
+        }
     }
 
-    memset (field, '\0', MAXLEN);
+    g_free (items);
 
-    /*
-     * Comment
-     */
-    length = WavpackGetTagItem(wpc, "comment", field, MAXLEN);
+    return TRUE;
+}
 
-    if ( length > 0 && FileTag->comment == NULL ) {
-        FileTag->comment = Try_To_Validate_Utf8_String(field);
-    }
+/*
+ * Read tag data from a Wavpack file.
+ *
+ * The items of an APEv2 tag are parsed in a single pass, so that the cost
+ * is linear in the number of items. Other tags, such as ID3v1, which have a
+ * handful of items at most, are read through WavPack.
+ */
+gboolean
+wavpack_tag_read_file_tag (GFile *file,
+                           File_Tag *FileTag,
+                           GError **error)
+{
+    WavpackStreamReader reader = { wavpack_read_bytes, wavpack_get_pos,
+                                   wavpack_set_pos_abs, wavpack_set_pos_rel,
+                                   wavpack_push_back_byte, wavpack_get_length,
+                                   wavpack_can_seek, NULL /* No writing. */ };
+    EtWavpackState state;
+    WavpackContext *wpc;
+    gchar message[80];
+    gboolean found;
+    gint n_items;
+    gint i;
+    const int open_flags = OPEN_TAGS;
 
-    memset (field, '\0', MAXLEN);
+    g_return_val_if_fail (file != NULL && FileTag != NULL, FALSE);
+    g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 
-    /*
-     * Composer
-     */
-    length = WavpackGetTagItem(wpc, "composer", field, MAXLEN);
+    state.error = NULL;
+    state.istream = g_file_read (file, NULL, &state.error);
 
-    if ( length > 0 && FileTag->composer == NULL ) {
-        FileTag->composer = Try_To_Validate_Utf8_String(field);
+    if (!state.istream)
+    {
+        g_propagate_error (error, state.error);
+        return FALSE;
     }
 
-    memset (field, '\0', MAXLEN);
+    state.seekable = G_SEEKABLE (state.istream);
 
-    /*
-     * Original artist
-     */
-    length = WavpackGetTagItem(wpc, "original artist", field, MAXLEN);
+    if (!et_wavpack_tag_read_ape_items (&state, FileTag, &found))
+    {
+        g_propagate_error (error, state.error);
+        g_object_unref (state.istream);
+        return FALSE;
+    }
 
-    if ( length > 0 && FileTag->orig_artist == NULL ) {
-        FileTag->orig_artist  = Try_To_Validate_Utf8_String(field);
+    if (found)
+    {
+        g_object_unref (state.istream);
+        return TRUE;
     }
 
-    memset (field, '\0', MAXLEN);
+    if (!g_seekable_seek (state.seekable, 0, G_SEEK_SET, NULL, &state.error))
+    {
+        g_propagate_error (error, state.error);
+        g_object_unref (state.istream);
+        return FALSE;
+    }
 
-    /*
-     * Copyright
-     */
-    length = WavpackGetTagItem(wpc, "copyright", field, MAXLEN);
+    /* NULL for the WavPack correction file. */
+    wpc = WavpackOpenFileInputEx (&reader, &state, NULL, message, open_flags,
+                                  0);
 
-    if ( length > 0 && FileTag->copyright == NULL ) {
-        FileTag->copyright = Try_To_Validate_Utf8_String(field);
+    if (wpc == NULL)
+    {
+        if (state.error)
+        {
+            g_propagate_error (error, state.error);
+        }
+        else
+        {
+            g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED, "%s",
+                         message);
+        }
+
+        g_object_unref (state.istream);
+        return FALSE;
     }
 
-    memset (field, '\0', MAXLEN);
+    n_items = WavpackGetNumTagItems (wpc);
 
-    /*
-     * URL
-     */
-    length = WavpackGetTagItem(wpc, "copyright url", field, MAXLEN);
+    for (i = 0; i < n_items; i++)
+    {
+        const EtWavpackTagField *tag_field;
+        gchar *name;
+        gchar *value;
+        gint length;
 
-    if ( length > 0 && FileTag->url == NULL ) {
-        FileTag->url = Try_To_Validate_Utf8_String(field);
-    }
+        length = WavpackGetTagItemIndexed (wpc, i, NULL, 0);
+        name = g_malloc (length + 1);
+        WavpackGetTagItemIndexed (wpc, i, name, length + 1);
+        tag_field = et_wavpack_tag_field_lookup (name);
+
+        if (tag_field == NULL)
+        {
+            g_free (name);
+            continue;
+        }
+
+        length = WavpackGetTagItem (wpc, name, NULL, 0);
 
-    memset (field, '\0', MAXLEN);
+        if (length <= 0)
+        {
+            g_free (name);
+            continue;
+        }
 
-    /*
-     * Encoded by
-     */
-    length = WavpackGetTagItem(wpc, "encoded by", field, MAXLEN);
+        value = g_malloc (length + 1);
+        WavpackGetTagItem (wpc, name, value, length + 1);
+        g_free (name);
 
-    if ( length > 0 && FileTag->encoded_by == NULL ) {
-        FileTag->encoded_by = Try_To_Validate_Utf8_String(field);
+        et_wavpack_tag_set_field (FileTag, tag_field, value);
+        g_free (value);
     }
 
     WavpackCloseFile(wpc);
@@ -364,13 +564,14 @@ wavpack_tag_write_file_tag (const ET_File *ETFile,
     FileTag = (File_Tag *)ETFile->FileTag->data;
 
     file = g_file_new_for_path (filename);
+    state.file = file;
     state.error = NULL;
     state.iostream = g_file_open_readwrite (file, NULL, &state.error);
-    g_object_unref (file);
 
     if (!state.iostream)
     {
         g_propagate_error (error, state.error);
+        g_object_unref (file);
         return FALSE;
     }
 
@@ -395,6 +596,7 @@ wavpack_tag_write_file_tag (const ET_File *ETFile,
         }
 
         g_object_unref (state.iostream);
+        g_object_unref (file);
         return FALSE;
     }
 
@@ -534,6 +736,7 @@ wavpack_tag_write_file_tag (const ET_File *ETFile,
     WavpackCloseFile (wpc);
 
     g_object_unref (state.iostream);
+    g_object_unref (file);
 
     return TRUE;
 
@@ -541,6 +744,7 @@ err:
     g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED, "%s",
                  WavpackGetErrorMessage (wpc));
     WavpackCloseFile (wpc);
+    g_object_unref (file);
     return FALSE;
 }
 
@@ -0,0 +1,135 @@
+/* EasyTAG - tag editor for audio files
+ * Copyright (C) 2026  agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "utf8_validate.h"
+
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+ * Most tag values and filenames are plain ASCII, so the ASCII prefix of a
+ * string is skipped over several bytes at a time, and only the rest is
+ * validated by GLib.
+ *
+ * The string length is not known in advance, so the blocks are loaded from
+ * aligned addresses: an aligned block never crosses a page boundary, so the
+ * bytes after the terminating nul in the same block can be read safely.
+ */
+
+#ifdef __SSE2__
+
+#define ET_UTF8_BLOCK_SIZE 16
+
+#else /* !__SSE2__ */
+
+#define ET_UTF8_BLOCK_SIZE sizeof (gsize)
+/* Bytes of 0x01 and of 0x80, across a word. */
+#define ET_UTF8_LOW_BITS ((gsize)-1 / 0xff)
+#define ET_UTF8_HIGH_BITS (ET_UTF8_LOW_BITS * 0x80)
+
+#endif /* !__SSE2__ */
+
+/*
+ * et_utf8_skip_ascii:
+ * @string: a nul-terminated string
+ *
+ * Find the end of the ASCII prefix of @string.
+ *
+ * Returns: a pointer to the first byte of @string which is not ASCII, or to
+ *          the terminating nul
+ */
+const gchar *
+et_utf8_skip_ascii (const gchar *string)
+{
+    const guchar *p = (const guchar *)string;
+
+    g_return_val_if_fail (string != NULL, NULL);
+
+    while (((guintptr)p % ET_UTF8_BLOCK_SIZE) != 0)
+    {
+        if (*p == '\0' || *p >= 0x80)
+        {
+            return (const gchar *)p;
+        }
+
+        p++;
+    }
+
+    for (;;)
+    {
+#ifdef __SSE2__
+        const __m128i block = _mm_load_si128 ((const __m128i *)p);
+        const gint stop = _mm_movemask_epi8 (block)
+                          | _mm_movemask_epi8 (_mm_cmpeq_epi8 (block,
+                                                               _mm_setzero_si128 ()));
+
+        if (stop != 0)
+        {
+            return (const gchar *)p + g_bit_nth_lsf (stop, -1);
+        }
+#else /* !__SSE2__ */
+        gsize block;
+
+        memcpy (&block, p, sizeof (block));
+
+        /* A byte with its high bit set, or a nul byte. */
+        if ((block & ET_UTF8_HIGH_BITS) != 0
+            || ((block - ET_UTF8_LOW_BITS) & ~block & ET_UTF8_HIGH_BITS) != 0)
+        {
+            while (*p != '\0' && *p < 0x80)
+            {
+                p++;
+            }
+
+            return (const gchar *)p;
+        }
+#endif /* !__SSE2__ */
+
+        p += ET_UTF8_BLOCK_SIZE;
+    }
+}
+
+/*
+ * et_utf8_validate:
+ * @string: a nul-terminated string
+ *
+ * Check if @string is valid UTF-8, with the same result as
+ * g_utf8_validate (@string, -1, NULL), but faster for ASCII text.
+ *
+ * Returns: %TRUE if @string is valid UTF-8, %FALSE otherwise
+ */
+gboolean
+et_utf8_validate (const gchar *string)
+{
+    const gchar *rest;
+
+    g_return_val_if_fail (string != NULL, FALSE);
+
+    rest = et_utf8_skip_ascii (string);
+
+    if (*rest == '\0')
+    {
+        return TRUE;
+    }
+
+    /* The rest starts at a character boundary, after valid ASCII. */
+    return g_utf8_validate (rest, -1, NULL);
+}
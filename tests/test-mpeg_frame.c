@@ -0,0 +1,338 @@
+/* EasyTAG - tag editor for audio files
+ * Copyright (C) 2026  agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "mpeg_frame.h"
+
+#include <string.h>
+
+/* MPEG 1, layer III, 128 kb/s, 44100 Hz, stereo, without padding. */
+static const guchar mpeg1_layer3[] = { 0xFF, 0xFB, 0x90, 0x00 };
+/* The same, as a single channel. */
+static const guchar mpeg1_layer3_mono[] = { 0xFF, 0xFB, 0x90, 0xC0 };
+
+static void
+write_uint32_be (guchar *data, guint32 value)
+{
+    data[0] = value >> 24;
+    data[1] = value >> 16;
+    data[2] = value >> 8;
+    data[3] = value;
+}
+
+static void
+mpeg_frame_parse (void)
+{
+    gsize i;
+
+    static const struct
+    {
+        guchar header[4];
+        gint version;
+        gboolean mpeg25;
+        gint layer;
+        gint bitrate;
+        gint samplerate;
+        gint mode;
+        guint samples;
+        gsize size;
+    } frames[] =
+    {
+        { { 0xFF, 0xFB, 0x90, 0x00 }, 1, FALSE, 3, 128, 44100, 0, 1152, 417 },
+        { { 0xFF, 0xFB, 0x92, 0x40 }, 1, FALSE, 3, 128, 44100, 1, 1152, 418 },
+        { { 0xFF, 0xF3, 0x80, 0xC0 }, 2, FALSE, 3, 64, 22050, 3, 576, 208 },
+        { { 0xFF, 0xE3, 0x18, 0x80 }, 2, TRUE, 3, 8, 8000, 2, 576, 72 },
+        { { 0xFF, 0xFF, 0x14, 0x00 }, 1, FALSE, 1, 32, 48000, 0, 384, 32 },
+        { { 0xFF, 0xFD, 0xA8, 0x00 }, 1, FALSE, 2, 192, 32000, 0, 1152, 864 },
+    };
+
+    static const guchar invalid[][4] =
+    {
+        /* Not a sync word. */
+        { 0xFF, 0x1B, 0x90, 0x00 },
+        { 0xFE, 0xFB, 0x90, 0x00 },
+        /* Reserved version. */
+        { 0xFF, 0xEB, 0x90, 0x00 },
+        /* Reserved layer. */
+        { 0xFF, 0xF9, 0x90, 0x00 },
+        /* Bad bitrate. */
+        { 0xFF, 0xFB, 0xF0, 0x00 },
+        /* Free format. */
+        { 0xFF, 0xFB, 0x00, 0x00 },
+        /* Reserved sample rate. */
+        { 0xFF, 0xFB, 0x9C, 0x00 },
+    };
+
+    for (i = 0; i < G_N_ELEMENTS (frames); i++)
+    {
+        EtMpegFrame frame;
+
+        g_assert (et_mpeg_frame_parse (frames[i].header, &frame));
+        g_assert_cmpint (frame.version, ==, frames[i].version);
+        g_assert_cmpint (frame.mpeg25, ==, frames[i].mpeg25);
+        g_assert_cmpint (frame.layer, ==, frames[i].layer);
+        g_assert_cmpint (frame.bitrate, ==, frames[i].bitrate);
+        g_assert_cmpint (frame.samplerate, ==, frames[i].samplerate);
+        g_assert_cmpint (frame.mode, ==, frames[i].mode);
+        g_assert_cmpuint (frame.samples, ==, frames[i].samples);
+        g_assert_cmpuint (frame.size, ==, frames[i].size);
+    }
+
+    for (i = 0; i < G_N_ELEMENTS (invalid); i++)
+    {
+        EtMpegFrame frame;
+
+        g_assert (!et_mpeg_frame_parse (invalid[i], &frame));
+    }
+}
+
+static void
+mpeg_frame_sync (void)
+{
+    guchar data[2048];
+    EtMpegFrame frame;
+
+    memset (data, 0, sizeof (data));
+
+    /* A stray sync word, not followed by another frame. */
+    memcpy (&data[10], mpeg1_layer3, sizeof (mpeg1_layer3));
+    /* Two frames of 417 bytes. */
+    memcpy (&data[500], mpeg1_layer3, sizeof (mpeg1_layer3));
+    memcpy (&data[917], mpeg1_layer3, sizeof (mpeg1_layer3));
+
+    g_assert_cmpint (et_mpeg_frame_sync (data, sizeof (data), &frame), ==,
+                     500);
+    g_assert_cmpint (frame.bitrate, ==, 128);
+
+    /* A frame which runs past the end of the data is trusted. */
+    g_assert_cmpint (et_mpeg_frame_sync (&data[917], 100, &frame), ==, 0);
+
+    memset (data, 0, sizeof (data));
+    g_assert_cmpint (et_mpeg_frame_sync (data, sizeof (data), &frame), ==,
+                     -1);
+    g_assert_cmpint (et_mpeg_frame_sync (data, 0, &frame), ==, -1);
+}
+
+static void
+mpeg_frame_vbr_xing (void)
+{
+    guchar data[417];
+    EtMpegFrame frame;
+    EtMpegVbrHeader vbr;
+    guchar *xing;
+    guchar *lame;
+
+    memset (data, 0, sizeof (data));
+    memcpy (data, mpeg1_layer3, sizeof (mpeg1_layer3));
+    g_assert (et_mpeg_frame_parse (data, &frame));
+
+    /* After 32 bytes of side information: frames, bytes, table of contents
+     * and quality. */
+    xing = &data[4 + 32];
+    memcpy (xing, "Xing", 4);
+    write_uint32_be (&xing[4], 0x0F);
+    write_uint32_be (&xing[8], 1000);
+    write_uint32_be (&xing[12], 400000);
+
+    /* A delay of 576 samples and a padding of 1000 samples. */
+    lame = &xing[8 + 4 + 4 + 100 + 4];
+    memcpy (lame, "LAME3.99r", 9);
+    lame[21] = 0x24;
+    lame[22] = 0x03;
+    lame[23] = 0xE8;
+
+    et_mpeg_frame_parse_vbr_header (data, sizeof (data), &frame, &vbr);
+    g_assert_cmpint (vbr.type, ==, ET_MPEG_VBR_XING);
+    g_assert_cmpuint (vbr.frames, ==, 1000);
+    g_assert_cmpuint (vbr.bytes, ==, 400000);
+    g_assert (vbr.lame);
+    g_assert_cmpuint (vbr.encoder_delay, ==, 576);
+    g_assert_cmpuint (vbr.encoder_padding, ==, 1000);
+
+    /* The header is not looked for past the end of the data. */
+    et_mpeg_frame_parse_vbr_header (data, 4 + 32 + 10, &frame, &vbr);
+    g_assert_cmpint (vbr.type, ==, ET_MPEG_VBR_XING);
+    g_assert_cmpuint (vbr.frames, ==, 0);
+    g_assert (!vbr.lame);
+}
+
+static void
+mpeg_frame_vbr_info (void)
+{
+    guchar data[417];
+    EtMpegFrame frame;
+    EtMpegVbrHeader vbr;
+    guchar *info;
+
+    memset (data, 0, sizeof (data));
+    memcpy (data, mpeg1_layer3_mono, sizeof (mpeg1_layer3_mono));
+    g_assert (et_mpeg_frame_parse (data, &frame));
+
+    /* After 17 bytes of side information, with only the frames. */
+    info = &data[4 + 17];
+    memcpy (info, "Info", 4);
+    write_uint32_be (&info[4], 0x01);
+    write_uint32_be (&info[8], 2000);
+
+    et_mpeg_frame_parse_vbr_header (data, sizeof (data), &frame, &vbr);
+    g_assert_cmpint (vbr.type, ==, ET_MPEG_VBR_INFO);
+    g_assert_cmpuint (vbr.frames, ==, 2000);
+    g_assert_cmpuint (vbr.bytes, ==, 0);
+    g_assert (!vbr.lame);
+}
+
+static void
+mpeg_frame_vbr_vbri (void)
+{
+    guchar data[417];
+    EtMpegFrame frame;
+    EtMpegVbrHeader vbr;
+    guchar *vbri;
+
+    memset (data, 0, sizeof (data));
+    memcpy (data, mpeg1_layer3, sizeof (mpeg1_layer3));
+    g_assert (et_mpeg_frame_parse (data, &frame));
+
+    et_mpeg_frame_parse_vbr_header (data, sizeof (data), &frame, &vbr);
+    g_assert_cmpint (vbr.type, ==, ET_MPEG_VBR_NONE);
+
+    vbri = &data[4 + 32];
+    memcpy (vbri, "VBRI", 4);
+    write_uint32_be (&vbri[10], 300000);
+    write_uint32_be (&vbri[14], 750);
+
+    et_mpeg_frame_parse_vbr_header (data, sizeof (data), &frame, &vbr);
+    g_assert_cmpint (vbr.type, ==, ET_MPEG_VBR_VBRI);
+    g_assert_cmpuint (vbr.frames, ==, 750);
+    g_assert_cmpuint (vbr.bytes, ==, 300000);
+}
+
+/* Frames of 417 bytes, with some junk after the tenth frame, and a truncated
+ * last frame. */
+static guchar *
+create_stream (gsize n_frames, gsize *length)
+{
+    guchar *data;
+    gsize offset = 0;
+    gsize i;
+
+    data = g_malloc0 (n_frames * 417 + 64);
+
+    for (i = 0; i < n_frames; i++)
+    {
+        memcpy (&data[offset], mpeg1_layer3, sizeof (mpeg1_layer3));
+        offset += 417;
+
+        if (i == 9)
+        {
+            /* Including a sync word which is not a frame header. */
+            memcpy (&data[offset], "junk\xFF\xFF\x00junk", 11);
+            offset += 11;
+        }
+    }
+
+    memcpy (&data[offset], mpeg1_layer3, sizeof (mpeg1_layer3));
+    *length = offset + 100;
+
+    return data;
+}
+
+static void
+mpeg_frame_scan (void)
+{
+    guchar *data;
+    gsize length;
+    gsize i;
+    static const gsize chunk_sizes[] = { 1, 3, 4, 7, 416, 417, 4096, 0 };
+
+    data = create_stream (50, &length);
+
+    for (i = 0; i < G_N_ELEMENTS (chunk_sizes); i++)
+    {
+        EtMpegFrameScan scan;
+        gsize chunk_size;
+        gsize offset;
+
+        chunk_size = chunk_sizes[i] ? chunk_sizes[i] : length;
+        et_mpeg_frame_scan_init (&scan);
+
+        for (offset = 0; offset < length; offset += chunk_size)
+        {
+            et_mpeg_frame_scan_feed (&scan, &data[offset],
+                                     MIN (chunk_size, length - offset));
+        }
+
+        et_mpeg_frame_scan_finish (&scan);
+
+        g_assert_cmpuint (scan.frames, ==, 50);
+        g_assert_cmpuint (scan.samples, ==, 50 * 1152);
+        /* The junk, and the truncated frame. */
+        g_assert_cmpuint (scan.errors, ==, 2);
+    }
+
+    g_free (data);
+}
+
+static void
+mpeg_frame_perf_scan (void)
+{
+    guchar *data;
+    gsize length;
+    gsize i;
+    const gsize PERF_ITERATIONS = 100;
+    gdouble time;
+
+    data = create_stream (10000, &length);
+
+    g_test_timer_start ();
+
+    for (i = 0; i < PERF_ITERATIONS; i++)
+    {
+        EtMpegFrameScan scan;
+
+        et_mpeg_frame_scan_init (&scan);
+        et_mpeg_frame_scan_feed (&scan, data, length);
+        et_mpeg_frame_scan_finish (&scan);
+        g_assert_cmpuint (scan.frames, ==, 10000);
+    }
+
+    time = g_test_timer_elapsed ();
+
+    g_test_minimized_result (time, "%6.1f seconds", time);
+
+    g_free (data);
+}
+
+int
+main (int argc, char** argv)
+{
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func ("/mpeg_frame/parse", mpeg_frame_parse);
+    g_test_add_func ("/mpeg_frame/sync", mpeg_frame_sync);
+    g_test_add_func ("/mpeg_frame/vbr/xing", mpeg_frame_vbr_xing);
+    g_test_add_func ("/mpeg_frame/vbr/info", mpeg_frame_vbr_info);
+    g_test_add_func ("/mpeg_frame/vbr/vbri", mpeg_frame_vbr_vbri);
+    g_test_add_func ("/mpeg_frame/scan", mpeg_frame_scan);
+
+    if (g_test_perf ())
+    {
+        g_test_add_func ("/mpeg_frame/perf/scan", mpeg_frame_perf_scan);
+    }
+
+    return g_test_run ();
+}
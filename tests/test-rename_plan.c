@@ -0,0 +1,327 @@
+/* EasyTAG - tag editor for audio files
+ * Copyright (C) 2026  agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "rename_plan.h"
+
+#include <glib/gstdio.h>
+
+typedef struct
+{
+    const gchar *old_name;
+    const gchar *new_name;
+    gboolean renamed;
+} Rename;
+
+/* Create a temporary directory with a file for each name, holding the name. */
+static gchar *
+create_files (const gchar * const *names)
+{
+    gchar *dir;
+    gsize i;
+
+    dir = g_dir_make_tmp ("easytag-rename-XXXXXX", NULL);
+    g_assert (dir != NULL);
+
+    for (i = 0; names[i] != NULL; i++)
+    {
+        gchar *path;
+
+        path = g_build_filename (dir, names[i], NULL);
+        g_assert (g_file_set_contents (path, names[i], -1, NULL));
+        g_free (path);
+    }
+
+    return dir;
+}
+
+static void
+remove_files (const gchar *dir)
+{
+    GDir *gdir;
+    const gchar *name;
+
+    gdir = g_dir_open (dir, 0, NULL);
+    g_assert (gdir != NULL);
+
+    while ((name = g_dir_read_name (gdir)) != NULL)
+    {
+        gchar *path;
+
+        path = g_build_filename (dir, name, NULL);
+
+        if (g_file_test (path, G_FILE_TEST_IS_DIR))
+        {
+            remove_files (path);
+        }
+        else
+        {
+            g_assert_cmpint (g_unlink (path), ==, 0);
+        }
+
+        g_free (path);
+    }
+
+    g_dir_close (gdir);
+    g_assert_cmpint (g_rmdir (dir), ==, 0);
+}
+
+static void
+check_file (const gchar *dir, const gchar *name, const gchar *contents)
+{
+    gchar *path;
+    gchar *data;
+
+    path = g_build_filename (dir, name, NULL);
+    g_assert (g_file_get_contents (path, &data, NULL, NULL));
+    g_assert_cmpstr (data, ==, contents);
+    g_free (data);
+    g_free (path);
+}
+
+static void
+on_renamed (gpointer data, gboolean renamed, GError *error,
+            gpointer user_data)
+{
+    gboolean *results = user_data;
+
+    g_assert (renamed == (error == NULL));
+    results[GPOINTER_TO_UINT (data)] = renamed;
+    g_clear_error (&error);
+}
+
+static void
+run_plan (const gchar *dir, const Rename *renames, gsize n_renames)
+{
+    EtRenamePlan *plan;
+    gboolean *results;
+    gsize i;
+
+    plan = et_rename_plan_new ();
+    results = g_new0 (gboolean, n_renames);
+
+    for (i = 0; i < n_renames; i++)
+    {
+        gchar *old_path;
+        gchar *new_path;
+
+        old_path = g_build_filename (dir, renames[i].old_name, NULL);
+        new_path = g_build_filename (dir, renames[i].new_name, NULL);
+        et_rename_plan_add (plan, old_path, new_path, GUINT_TO_POINTER (i));
+        g_free (old_path);
+        g_free (new_path);
+    }
+
+    et_rename_plan_run (plan, on_renamed, results);
+    et_rename_plan_free (plan);
+
+    for (i = 0; i < n_renames; i++)
+    {
+        g_assert_cmpint (results[i], ==, renames[i].renamed);
+    }
+
+    g_free (results);
+}
+
+static void
+rename_plan_chain (void)
+{
+    static const gchar * const names[] = { "a", "b", NULL };
+    static const Rename renames[] =
+    {
+        { "a", "b", TRUE },
+        { "b", "c", TRUE },
+    };
+    gchar *dir;
+
+    dir = create_files (names);
+    run_plan (dir, renames, G_N_ELEMENTS (renames));
+
+    check_file (dir, "b", "a");
+    check_file (dir, "c", "b");
+
+    remove_files (dir);
+    g_free (dir);
+}
+
+static void
+rename_plan_swap (void)
+{
+    static const gchar * const names[] = { "a", "b", NULL };
+    static const Rename renames[] =
+    {
+        { "a", "b", TRUE },
+        { "b", "a", TRUE },
+    };
+    gchar *dir;
+
+    dir = create_files (names);
+    run_plan (dir, renames, G_N_ELEMENTS (renames));
+
+    check_file (dir, "a", "b");
+    check_file (dir, "b", "a");
+
+    remove_files (dir);
+    g_free (dir);
+}
+
+static void
+rename_plan_rotation (void)
+{
+    static const gchar * const names[] = { "a", "b", "c", NULL };
+    static const Rename renames[] =
+    {
+        { "a", "b", TRUE },
+        { "b", "c", TRUE },
+        { "c", "a", TRUE },
+    };
+    gchar *dir;
+
+    dir = create_files (names);
+    run_plan (dir, renames, G_N_ELEMENTS (renames));
+
+    check_file (dir, "a", "c");
+    check_file (dir, "b", "a");
+    check_file (dir, "c", "b");
+
+    remove_files (dir);
+    g_free (dir);
+}
+
+static void
+on_aside (gpointer data, const gchar *tmp_path, gpointer user_data)
+{
+    GPtrArray *tmp_paths = user_data;
+
+    /* The path is reserved before the file is moved. */
+    g_assert (g_file_test (tmp_path, G_FILE_TEST_IS_REGULAR));
+    g_ptr_array_add (tmp_paths, g_strdup (tmp_path));
+}
+
+static void
+rename_plan_aside (void)
+{
+    static const gchar * const names[] = { "a", "b", "c", NULL };
+    EtRenamePlan *plan;
+    GPtrArray *tmp_paths;
+    gboolean results[3] = { FALSE, FALSE, FALSE };
+    gchar *dir;
+    gsize i;
+
+    dir = create_files (names);
+    plan = et_rename_plan_new ();
+    tmp_paths = g_ptr_array_new_with_free_func (g_free);
+
+    /* A rotation moves one of its files aside. */
+    for (i = 0; i < 3; i++)
+    {
+        gchar *old_path;
+        gchar *new_path;
+
+        old_path = g_build_filename (dir, names[i], NULL);
+        new_path = g_build_filename (dir, names[(i + 1) % 3], NULL);
+        et_rename_plan_add (plan, old_path, new_path, GUINT_TO_POINTER (i));
+        g_free (old_path);
+        g_free (new_path);
+    }
+
+    et_rename_plan_set_aside_func (plan, on_aside, tmp_paths);
+    et_rename_plan_run (plan, on_renamed, results);
+    et_rename_plan_free (plan);
+
+    g_assert (results[0] && results[1] && results[2]);
+    g_assert_cmpuint (tmp_paths->len, ==, 1);
+    g_assert (g_str_has_prefix (g_ptr_array_index (tmp_paths, 0), dir));
+    g_assert (!g_file_test (g_ptr_array_index (tmp_paths, 0),
+                            G_FILE_TEST_EXISTS));
+
+    check_file (dir, "a", "c");
+    check_file (dir, "b", "a");
+    check_file (dir, "c", "b");
+
+    g_ptr_array_unref (tmp_paths);
+    remove_files (dir);
+    g_free (dir);
+}
+
+static void
+rename_plan_collision (void)
+{
+    static const gchar * const names[] = { "a", "b", "c", "d", "f", "z",
+                                           NULL };
+    static const Rename renames[] =
+    {
+        /* Two files to the same name. */
+        { "a", "e", TRUE },
+        { "b", "e", FALSE },
+        /* Down a chain from a file which cannot be renamed. */
+        { "c", "d", FALSE },
+        { "d", "b", FALSE },
+        /* Over a file which is not renamed. */
+        { "f", "z", FALSE },
+    };
+    gchar *dir;
+
+    dir = create_files (names);
+    run_plan (dir, renames, G_N_ELEMENTS (renames));
+
+    check_file (dir, "b", "b");
+    check_file (dir, "c", "c");
+    check_file (dir, "d", "d");
+    check_file (dir, "e", "a");
+    check_file (dir, "f", "f");
+    check_file (dir, "z", "z");
+
+    remove_files (dir);
+    g_free (dir);
+}
+
+static void
+rename_plan_directory (void)
+{
+    static const gchar * const names[] = { "a", "b", NULL };
+    static const Rename renames[] =
+    {
+        { "a", "x/y/a", TRUE },
+        { "b", "x/y/b", TRUE },
+    };
+    gchar *dir;
+
+    dir = create_files (names);
+    run_plan (dir, renames, G_N_ELEMENTS (renames));
+
+    check_file (dir, "x/y/a", "a");
+    check_file (dir, "x/y/b", "b");
+
+    remove_files (dir);
+    g_free (dir);
+}
+
+int
+main (int argc, char** argv)
+{
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func ("/rename_plan/chain", rename_plan_chain);
+    g_test_add_func ("/rename_plan/swap", rename_plan_swap);
+    g_test_add_func ("/rename_plan/rotation", rename_plan_rotation);
+    g_test_add_func ("/rename_plan/aside", rename_plan_aside);
+    g_test_add_func ("/rename_plan/collision", rename_plan_collision);
+    g_test_add_func ("/rename_plan/directory", rename_plan_directory);
+
+    return g_test_run ();
+}
@@ -0,0 +1,144 @@
+/* EasyTAG - tag editor for audio files
+ * Copyright (C) 2026  agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "utf8_validate.h"
+
+#include <string.h>
+
+/* Longer than two blocks, so that the aligned loop is entered. */
+#define MAX_LENGTH 64
+
+static void
+utf8_validate_ascii (void)
+{
+    gchar buffer[MAX_LENGTH + 32];
+    gsize offset;
+    gsize length;
+
+    /* Every length at every alignment. */
+    for (offset = 0; offset < 16; offset++)
+    {
+        for (length = 0; length <= MAX_LENGTH; length++)
+        {
+            gchar *string = buffer + offset;
+
+            memset (string, 'a', length);
+            string[length] = '\0';
+
+            g_assert (et_utf8_skip_ascii (string) == string + length);
+            g_assert (et_utf8_validate (string));
+        }
+    }
+}
+
+static void
+utf8_validate_utf8 (void)
+{
+    static const gchar * const sequences[] =
+    {
+        "\xc3\xa9", /* Valid, é. */
+        "\xe2\x82\xac", /* Valid, €. */
+        "\xf0\x9d\x84\x9e", /* Valid, outside the BMP. */
+        "\x80", /* Continuation byte without a lead byte. */
+        "\xc3", /* Truncated. */
+        "\xe2\x82", /* Truncated. */
+        "\xc0\x80", /* Overlong. */
+        "\xed\xa0\x80", /* Surrogate. */
+        "\xf4\x90\x80\x80", /* Beyond U+10FFFF. */
+        "\xff" /* Invalid byte. */
+    };
+    gchar buffer[MAX_LENGTH + 32];
+    gsize i;
+    gsize offset;
+    gsize position;
+
+    /* Each sequence at every position of an ASCII string, at every
+     * alignment. */
+    for (i = 0; i < G_N_ELEMENTS (sequences); i++)
+    {
+        const gsize length = strlen (sequences[i]);
+
+        for (offset = 0; offset < 16; offset++)
+        {
+            for (position = 0; position + length <= MAX_LENGTH; position++)
+            {
+                gchar *string = buffer + offset;
+
+                memset (string, 'a', MAX_LENGTH);
+                memcpy (string + position, sequences[i], length);
+                string[MAX_LENGTH] = '\0';
+
+                g_assert (et_utf8_skip_ascii (string) == string + position);
+                g_assert_cmpint (et_utf8_validate (string), ==,
+                                 g_utf8_validate (string, -1, NULL));
+            }
+        }
+    }
+}
+
+static void
+utf8_validate_perf_ascii (void)
+{
+    gchar *strings[100];
+    gsize i;
+    gsize j;
+    const gsize PERF_ITERATIONS = 100000;
+    gdouble time;
+
+    /* Lengths typical of tag values and filenames. */
+    for (i = 0; i < G_N_ELEMENTS (strings); i++)
+    {
+        strings[i] = g_strnfill (8 + i % 64, 'a');
+    }
+
+    g_test_timer_start ();
+
+    for (i = 0; i < PERF_ITERATIONS; i++)
+    {
+        for (j = 0; j < G_N_ELEMENTS (strings); j++)
+        {
+            g_assert (et_utf8_validate (strings[j]));
+        }
+    }
+
+    time = g_test_timer_elapsed ();
+
+    g_test_minimized_result (time, "%6.1f seconds", time);
+
+    for (i = 0; i < G_N_ELEMENTS (strings); i++)
+    {
+        g_free (strings[i]);
+    }
+}
+
+int
+main (int argc, char** argv)
+{
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func ("/utf8_validate/ascii", utf8_validate_ascii);
+    g_test_add_func ("/utf8_validate/utf8", utf8_validate_utf8);
+
+    if (g_test_perf ())
+    {
+        g_test_add_func ("/utf8_validate/perf/ascii",
+                         utf8_validate_perf_ascii);
+    }
+
+    return g_test_run ();
+}